@@ -0,0 +1,50 @@
+// timing and statistics helpers shared by the benchmarks
+#ifndef BENCH_UTILS_H
+#define BENCH_UTILS_H
+
+#include <stdlib.h>
+#include <time.h>
+
+static inline double bench_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int bench_cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static inline void bench_sort(double *samples, int n) {
+  qsort(samples, n, sizeof(double), bench_cmp_double);
+}
+
+// Nearest-rank percentile of sorted samples, p in [0, 100]
+static inline double bench_percentile(const double *sorted, int n, double p) {
+  if (n <= 0)
+    return 0.0;
+  int idx = (int)(p / 100.0 * n + 0.5) - 1;
+  if (idx < 0)
+    idx = 0;
+  if (idx >= n)
+    idx = n - 1;
+  return sorted[idx];
+}
+
+static inline double bench_mean(const double *samples, int n) {
+  double sum = 0.0;
+  for (int i = 0; i < n; i++)
+    sum += samples[i];
+  return n > 0 ? sum / n : 0.0;
+}
+
+// Deterministic values in [-1, 1)
+static inline void bench_fill(float *x, size_t n, unsigned int seed) {
+  for (size_t i = 0; i < n; i++) {
+    seed = seed * 1103515245u + 12345u;
+    x[i] = ((seed >> 8) & 0xFFFF) / 32768.0f - 1.0f;
+  }
+}
+
+#endif
@@ -0,0 +1,770 @@
+#include "../include/checkpoint.h"
+#include "../include/encoder_cache.h"
+#include "../include/numa_placement.h"
+#include "../include/pipeline.h"
+#include "../include/thread_pool.h"
+#include "../include/transformer.h"
+#include "../include/transformer_api.h"
+#include "bench_utils.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+// End-to-end throughput / latency driver for capacity planning. Prints one
+// JSON document on stdout, e.g.
+//   ./e2e_bench --d-model 512 --d-ff 2048 --layers 6 --batch 8
+//               --src-len 16-64 --tgt-len 32 --threads 2
+//
+// Two phases, both per worker thread:
+//   forward: compute_transformer on each request (teacher-forced, all logits)
+//   decode:  requests in batches of --batch cache slots; encoder + cross K/V
+//            once per request, then one compute_decoder_step + logits per
+//            step for every slot still generating.
+// With --pipeline E:D a third phase generates every request greedily to its
+// target length, once serially on one thread and once through a pipeline of
+// E encoder and D decoder workers (pipeline.h).
+// --numa interleave spreads the weights over all NUMA nodes; --numa
+// replicate gives every node its own copy. With replicate or --pin, worker
+// i is bound to node i % nodes (and reads that node's copy); --pin also pins
+// the intra-op pool threads to CPUs.
+// --checkpoint PATH runs on a memory-mapped checkpoint: an existing file
+// brings its own model shape, a missing one is first written with a random
+// model of the requested shape. --resident-layers N streams its layers
+// through an N-layer window (checkpoint.h).
+// --api 1 adds a single-threaded phase through the context API
+// (transformer_api.h) on a random model of the same shape: every request is
+// run as a forward pass, then encoded and decoded step by step, and the heap
+// calls made after session setup are reported.
+// --pos sinusoidal|rotary computes positions instead of reading the learned
+// table, which also lets --src-len / --tgt-len go past --max-seq.
+// Linked with -Wl,--wrap=malloc,... so heap calls made by the model are
+// counted (OpenBLAS internals are not, nor huge_alloc's page mappings).
+
+// ---------------------------------------------------------------------------
+// Allocation counting
+
+static unsigned long long n_allocs, n_frees, alloc_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_posix_memalign(void **ptr, size_t align, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+  __atomic_fetch_add(&n_allocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+  __atomic_fetch_add(&n_allocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&alloc_bytes, nmemb * size, __ATOMIC_RELAXED);
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  __atomic_fetch_add(&n_allocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void **ptr, size_t align, size_t size) {
+  __atomic_fetch_add(&n_allocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+  return __real_posix_memalign(ptr, align, size);
+}
+
+void __wrap_free(void *ptr) {
+  if (ptr)
+    __atomic_fetch_add(&n_frees, 1, __ATOMIC_RELAXED);
+  __real_free(ptr);
+}
+
+static unsigned long long alloc_count(void) {
+  return __atomic_load_n(&n_allocs, __ATOMIC_RELAXED);
+}
+
+// ---------------------------------------------------------------------------
+// Options
+
+typedef struct {
+  int lo, hi; // inclusive; lo == hi for a fixed length
+} LenDist;
+
+typedef struct {
+  TransformerConfig config;
+  int batch;
+  int threads;
+  int requests;
+  unsigned int seed;
+  LenDist src_len;
+  LenDist tgt_len;
+  int pipe_enc, pipe_dec; // --pipeline E:D, 0 when the phase is off
+  int numa;               // NUMA_* placement of the weights
+  int pin;
+  const char *checkpoint; // NULL: weights in memory
+  int resident_layers;
+  int api;
+} BenchOptions;
+
+enum { NUMA_NONE, NUMA_INTERLEAVE, NUMA_REPLICATE };
+static const char *NUMA_MODES[] = {"none", "interleave", "replicate"};
+// Indexed by PositionalMode
+static const char *POS_MODES[] = {"learned", "sinusoidal", "rotary"};
+
+static int parse_dist(const char *s, LenDist *d) {
+  if (sscanf(s, "%d-%d", &d->lo, &d->hi) == 2)
+    return d->lo > 0 && d->hi >= d->lo;
+  if (sscanf(s, "%d", &d->lo) == 1) {
+    d->hi = d->lo;
+    return d->lo > 0;
+  }
+  return 0;
+}
+
+static int sample_len(const LenDist *d, unsigned int *state) {
+  *state = *state * 1103515245u + 12345u;
+  return d->lo + (int)((*state >> 8) % (unsigned)(d->hi - d->lo + 1));
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--layers N] [--d-model N] [--d-ff N] [--heads N]\n"
+          "          [--vocab N] [--max-seq N] [--batch N] [--threads N]\n"
+          "          [--requests N] [--seed N] [--src-len A[-B]]"
+          " [--tgt-len A[-B]]\n"
+          "          [--pipeline E:D] [--numa none|interleave|replicate]"
+          " [--pin 0|1]\n"
+          "          [--checkpoint PATH] [--resident-layers N] [--api 0|1]\n"
+          "          [--pos learned|sinusoidal|rotary]\n"
+          "lengths are fixed (A) or uniform over [A, B]\n",
+          prog);
+}
+
+// ---------------------------------------------------------------------------
+// Workers
+
+typedef struct {
+  const TransformerParams *params;
+  const BenchOptions *opt;
+  int first, count; // request range of this worker
+  int node;         // NUMA node the thread is bound to, -1 for none
+
+  // Results
+  double *forward_us; // count entries
+  double *step_us;    // one per decode step
+  int n_steps;
+  long long forward_tokens;
+  long long decode_tokens;
+} Worker;
+
+// Requests are generated from their index, so every thread count sees the
+// same workload
+static void make_request(const BenchOptions *opt, int r, int *src, int *L_src,
+                         int *tgt, int *L_tgt) {
+  unsigned int state = opt->seed ^ (2654435761u * (unsigned)(r + 1));
+  *L_src = sample_len(&opt->src_len, &state);
+  *L_tgt = sample_len(&opt->tgt_len, &state);
+  for (int i = 0; i < *L_src; i++)
+    src[i] = (int)((state = state * 1103515245u + 12345u) >> 8) %
+             opt->config.vocab_size;
+  for (int i = 0; i < *L_tgt; i++)
+    tgt[i] = (int)((state = state * 1103515245u + 12345u) >> 8) %
+             opt->config.vocab_size;
+}
+
+static void run_forward(Worker *w, int *src, int *tgt, float *logits) {
+  for (int i = 0; i < w->count; i++) {
+    int L_src, L_tgt;
+    make_request(w->opt, w->first + i, src, &L_src, tgt, &L_tgt);
+
+    double t0 = bench_now_us();
+    compute_transformer(src, tgt, w->params, logits, L_src, L_tgt);
+    w->forward_us[i] = bench_now_us() - t0;
+    w->forward_tokens += L_src + L_tgt;
+  }
+}
+
+static void run_decode(Worker *w, int *src, float *logits) {
+  const TransformerConfig *cfg = &w->params->config;
+  const BenchOptions *opt = w->opt;
+  int B = opt->batch;
+  int max_len = opt->tgt_len.hi;
+
+  KVCache cache;
+  init_kv_cache(&cache, cfg->num_layers, cfg->d_model, B, max_len);
+  CrossKV *ckv = (CrossKV *)calloc(B, sizeof(CrossKV));
+  int *tgt_all = (int *)malloc((size_t)B * max_len * sizeof(int));
+  int *tgt_len = (int *)malloc(B * sizeof(int));
+  int *tokens = (int *)malloc(B * sizeof(int));
+  int *slots = (int *)malloc(B * sizeof(int));
+  float *hidden = (float *)malloc((size_t)B * cfg->d_model * sizeof(float));
+  if (!ckv || !tgt_all || !tgt_len || !tokens || !slots || !hidden) {
+    fprintf(stderr, "Alloc failed in e2e_bench\n");
+    exit(1);
+  }
+
+  for (int b0 = 0; b0 < w->count; b0 += B) {
+    int nb = w->count - b0 < B ? w->count - b0 : B;
+
+    // Encoder and cross K/V once per request
+    for (int s = 0; s < nb; s++) {
+      int L_src;
+      make_request(opt, w->first + b0 + s, src, &L_src,
+                   tgt_all + (size_t)s * max_len, &tgt_len[s]);
+      init_cross_kv(&ckv[s], cfg->num_layers, cfg->d_model, L_src);
+      compute_encoder_cached(NULL, src, L_src, w->params, NULL, &ckv[s]);
+      kv_cache_reset_slot(&cache, s, &ckv[s]);
+    }
+
+    // Teacher-forced decode: one row per slot still generating
+    for (int t = 0;; t++) {
+      int n = 0;
+      for (int s = 0; s < nb; s++) {
+        if (t < tgt_len[s]) {
+          tokens[n] = tgt_all[(size_t)s * max_len + t];
+          slots[n++] = s;
+        }
+      }
+      if (n == 0)
+        break;
+
+      double t0 = bench_now_us();
+      compute_decoder_step(tokens, slots, w->params, &cache, hidden, n);
+      compute_logits(hidden, w->params, logits, n);
+      w->step_us[w->n_steps++] = bench_now_us() - t0;
+      w->decode_tokens += n;
+    }
+
+    for (int s = 0; s < nb; s++)
+      free_cross_kv(&ckv[s]);
+  }
+
+  free(ckv);
+  free(tgt_all);
+  free(tgt_len);
+  free(tokens);
+  free(slots);
+  free(hidden);
+  free_kv_cache(&cache);
+}
+
+typedef struct {
+  Worker *w;
+  int phase; // 0 = forward, 1 = decode
+} WorkerArg;
+
+static void *worker_main(void *p) {
+  WorkerArg *a = (WorkerArg *)p;
+  Worker *w = a->w;
+  if (w->node >= 0)
+    pin_thread_to_node(w->node);
+  const TransformerConfig *cfg = &w->params->config;
+  int max_src = w->opt->src_len.hi, max_tgt = w->opt->tgt_len.hi;
+  int max_rows = max_tgt > w->opt->batch ? max_tgt : w->opt->batch;
+
+  int *src = (int *)malloc(max_src * sizeof(int));
+  int *tgt = (int *)malloc(max_tgt * sizeof(int));
+  float *logits =
+      (float *)malloc((size_t)max_rows * cfg->vocab_size * sizeof(float));
+  if (!src || !tgt || !logits) {
+    fprintf(stderr, "Alloc failed in e2e_bench\n");
+    exit(1);
+  }
+
+  if (a->phase == 0)
+    run_forward(w, src, tgt, logits);
+  else
+    run_decode(w, src, logits);
+
+  free(src);
+  free(tgt);
+  free(logits);
+  return NULL;
+}
+
+// Run one phase on every worker; returns wall time in microseconds
+static double run_phase(Worker *workers, int threads, int phase) {
+  pthread_t *tids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+  WorkerArg *args = (WorkerArg *)malloc(threads * sizeof(WorkerArg));
+  if (!tids || !args) {
+    fprintf(stderr, "Alloc failed in e2e_bench\n");
+    exit(1);
+  }
+
+  double t0 = bench_now_us();
+  for (int i = 0; i < threads; i++) {
+    args[i].w = &workers[i];
+    args[i].phase = phase;
+    if (pthread_create(&tids[i], NULL, worker_main, &args[i]) != 0) {
+      fprintf(stderr, "pthread_create failed in e2e_bench\n");
+      exit(1);
+    }
+  }
+  for (int i = 0; i < threads; i++)
+    pthread_join(tids[i], NULL);
+  double wall = bench_now_us() - t0;
+
+  free(tids);
+  free(args);
+  return wall;
+}
+
+// ---------------------------------------------------------------------------
+// Generation: serial vs pipelined
+
+typedef struct {
+  int *src;  // requests x src_len.hi
+  int *out;  // requests x tgt_len.hi
+  PipelineRequest *req;
+  double *submit_us;
+  double *latency_us;
+  long long tokens;
+} GenerateRun;
+
+static void record_done(PipelineRequest *req, void *arg) {
+  GenerateRun *g = (GenerateRun *)arg;
+  int r = (int)(req - g->req);
+  g->latency_us[r] = bench_now_us() - g->submit_us[r];
+}
+
+static void init_generate(GenerateRun *g, const BenchOptions *opt) {
+  int n = opt->requests, max_src = opt->src_len.hi, max_tgt = opt->tgt_len.hi;
+  g->src = (int *)malloc((size_t)n * max_src * sizeof(int));
+  g->out = (int *)malloc((size_t)n * max_tgt * sizeof(int));
+  g->req = (PipelineRequest *)calloc(n, sizeof(PipelineRequest));
+  g->submit_us = (double *)malloc(n * sizeof(double));
+  g->latency_us = (double *)malloc(n * sizeof(double));
+  int *tgt = (int *)malloc(max_tgt * sizeof(int));
+  if (!g->src || !g->out || !g->req || !g->submit_us || !g->latency_us ||
+      !tgt) {
+    fprintf(stderr, "Alloc failed in e2e_bench\n");
+    exit(1);
+  }
+  for (int r = 0; r < n; r++) {
+    PipelineRequest *q = &g->req[r];
+    int L_tgt;
+    make_request(opt, r, g->src + (size_t)r * max_src, &q->L_src, tgt, &L_tgt);
+    q->src_tokens = g->src + (size_t)r * max_src;
+    q->out_tokens = g->out + (size_t)r * max_tgt;
+    // Greedy, and no EOS so every request runs to its target length
+    q->sampling = (SamplingConfig){
+        .temperature = 0.0f, .top_p = 1.0f, .max_len = L_tgt, .eos_id = -1};
+  }
+  free(tgt);
+}
+
+static void free_generate(GenerateRun *g) {
+  free(g->src);
+  free(g->out);
+  free(g->req);
+  free(g->submit_us);
+  free(g->latency_us);
+}
+
+// Both return wall time in microseconds
+static double run_generate_serial(GenerateRun *g, const BenchOptions *opt,
+                                  const TransformerParams *params) {
+  g->tokens = 0;
+  double t0 = bench_now_us();
+  for (int r = 0; r < opt->requests; r++) {
+    PipelineRequest *q = &g->req[r];
+    int n = generate_sampled(q->src_tokens, q->L_src, params, &q->sampling,
+                             q->out_tokens);
+    if (n < 0) {
+      fprintf(stderr, "Alloc failed in e2e_bench\n");
+      exit(1);
+    }
+    g->tokens += n;
+  }
+  return bench_now_us() - t0;
+}
+
+static double run_generate_pipeline(GenerateRun *g, const BenchOptions *opt,
+                                    const TransformerParams *params,
+                                    const ParamsReplicas *replicas) {
+  // Encoder and decoder groups on different nodes when there are two
+  PipelineConfig pc = {.encoder_threads = opt->pipe_enc,
+                       .decoder_threads = opt->pipe_dec,
+                       .queue_capacity = opt->pipe_enc + opt->pipe_dec,
+                       .on_done = record_done,
+                       .on_done_arg = g,
+                       .numa_bind = opt->pin || opt->numa == NUMA_REPLICATE,
+                       .encoder_node = 0,
+                       .decoder_node = numa_node_count() > 1 ? 1 : 0,
+                       .replicas = replicas};
+  Pipeline p;
+  init_pipeline(&p, params, &pc);
+
+  double t0 = bench_now_us();
+  for (int r = 0; r < opt->requests; r++) {
+    g->submit_us[r] = bench_now_us();
+    pipeline_submit(&p, &g->req[r]);
+  }
+  free_pipeline(&p);
+  double wall = bench_now_us() - t0;
+
+  g->tokens = 0;
+  for (int r = 0; r < opt->requests; r++) {
+    if (g->req[r].n_out < 0) {
+      fprintf(stderr, "Alloc failed in e2e_bench\n");
+      exit(1);
+    }
+    g->tokens += g->req[r].n_out;
+  }
+  return wall;
+}
+
+// ---------------------------------------------------------------------------
+// Context API phase
+
+typedef struct {
+  double wall_us;
+  long long tokens;
+  int n_steps;
+  unsigned long long forward_allocs, decode_allocs;
+  TfSessionStats stats;
+} ApiRun;
+
+static void run_api(const BenchOptions *opt, ApiRun *run) {
+  const TransformerConfig *cfg = &opt->config;
+  TfModelConfig mc = {cfg->num_layers, cfg->d_model,    cfg->d_ff,
+                      cfg->num_heads,  cfg->vocab_size, cfg->max_seq_len,
+                      (TfPositional)cfg->pos_mode};
+  TfSessionConfig sc = {opt->src_len.hi, opt->tgt_len.hi};
+  TfModel *model = NULL;
+  TfSession *s = NULL;
+  TfStatus status = tf_model_create_random(&mc, &model);
+  if (status == TF_OK)
+    status = tf_session_create(model, &sc, &s);
+
+  int *src = (int *)malloc(opt->src_len.hi * sizeof(int));
+  int *tgt = (int *)malloc(opt->tgt_len.hi * sizeof(int));
+  float *logits = (float *)malloc((size_t)opt->tgt_len.hi * cfg->vocab_size *
+                                  sizeof(float));
+  if (status != TF_OK || !src || !tgt || !logits) {
+    fprintf(stderr, "API setup failed: %s\n",
+            tf_status_string(status != TF_OK ? status : TF_ERR_NO_MEMORY));
+    exit(1);
+  }
+
+  memset(run, 0, sizeof(*run));
+  double t0 = bench_now_us();
+  unsigned long long a0 = alloc_count();
+  for (int r = 0; r < opt->requests; r++) {
+    int L_src, L_tgt;
+    make_request(opt, r, src, &L_src, tgt, &L_tgt);
+    tf_forward(s, src, L_src, tgt, L_tgt, logits);
+    run->tokens += L_src + L_tgt;
+  }
+  run->forward_allocs = alloc_count() - a0;
+  run->wall_us = bench_now_us() - t0;
+
+  a0 = alloc_count();
+  for (int r = 0; r < opt->requests; r++) {
+    int L_src, L_tgt;
+    make_request(opt, r, src, &L_src, tgt, &L_tgt);
+    tf_encode(s, src, L_src);
+    for (int t = 0; t < L_tgt; t++, run->n_steps++)
+      tf_decode_step(s, tgt[t], logits);
+  }
+  run->decode_allocs = alloc_count() - a0;
+  tf_session_stats(s, &run->stats);
+
+  free(src);
+  free(tgt);
+  free(logits);
+  tf_session_destroy(s);
+  tf_model_destroy(model);
+}
+
+// ---------------------------------------------------------------------------
+// Reporting
+
+static void print_latency(const char *name, double *samples, int n) {
+  bench_sort(samples, n);
+  printf("  \"%s\":{\"count\":%d,\"mean_us\":%.3f,\"p50_us\":%.3f,"
+         "\"p99_us\":%.3f,\"max_us\":%.3f},\n",
+         name, n, bench_mean(samples, n), bench_percentile(samples, n, 50),
+         bench_percentile(samples, n, 99), n > 0 ? samples[n - 1] : 0.0);
+}
+
+int main(int argc, char **argv) {
+  BenchOptions opt = {.config = {.num_layers = 2,
+                                 .d_model = 128,
+                                 .d_ff = 512,
+                                 .num_heads = 8,
+                                 .vocab_size = 1000,
+                                 .max_seq_len = 128},
+                      .batch = 8,
+                      .threads = 1,
+                      .requests = 32,
+                      .seed = 42,
+                      .src_len = {16, 48},
+                      .tgt_len = {16, 48}};
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+    int ok = 1;
+    if (!val) {
+      usage(argv[0]);
+      return 1;
+    }
+    if (strcmp(arg, "--layers") == 0)
+      opt.config.num_layers = atoi(val);
+    else if (strcmp(arg, "--d-model") == 0)
+      opt.config.d_model = atoi(val);
+    else if (strcmp(arg, "--d-ff") == 0)
+      opt.config.d_ff = atoi(val);
+    else if (strcmp(arg, "--heads") == 0)
+      opt.config.num_heads = atoi(val);
+    else if (strcmp(arg, "--vocab") == 0)
+      opt.config.vocab_size = atoi(val);
+    else if (strcmp(arg, "--max-seq") == 0)
+      opt.config.max_seq_len = atoi(val);
+    else if (strcmp(arg, "--batch") == 0)
+      opt.batch = atoi(val);
+    else if (strcmp(arg, "--threads") == 0)
+      opt.threads = atoi(val);
+    else if (strcmp(arg, "--requests") == 0)
+      opt.requests = atoi(val);
+    else if (strcmp(arg, "--seed") == 0)
+      opt.seed = (unsigned int)strtoul(val, NULL, 10);
+    else if (strcmp(arg, "--src-len") == 0)
+      ok = parse_dist(val, &opt.src_len);
+    else if (strcmp(arg, "--tgt-len") == 0)
+      ok = parse_dist(val, &opt.tgt_len);
+    else if (strcmp(arg, "--numa") == 0) {
+      opt.numa = -1;
+      for (int m = 0; m < 3; m++)
+        if (strcmp(val, NUMA_MODES[m]) == 0)
+          opt.numa = m;
+      ok = opt.numa >= 0;
+    } else if (strcmp(arg, "--pos") == 0) {
+      ok = 0;
+      for (int m = 0; m < 3; m++)
+        if (strcmp(val, POS_MODES[m]) == 0) {
+          opt.config.pos_mode = (PositionalMode)m;
+          ok = 1;
+        }
+    } else if (strcmp(arg, "--pin") == 0)
+      opt.pin = atoi(val);
+    else if (strcmp(arg, "--checkpoint") == 0)
+      opt.checkpoint = val;
+    else if (strcmp(arg, "--resident-layers") == 0)
+      opt.resident_layers = atoi(val);
+    else if (strcmp(arg, "--api") == 0)
+      opt.api = atoi(val);
+    else if (strcmp(arg, "--pipeline") == 0)
+      ok = sscanf(val, "%d:%d", &opt.pipe_enc, &opt.pipe_dec) == 2 &&
+           opt.pipe_enc > 0 && opt.pipe_dec > 0;
+    else
+      ok = 0;
+    if (!ok) {
+      usage(argv[0]);
+      return 1;
+    }
+    i++;
+  }
+
+  // An existing checkpoint brings its own shape
+  Checkpoint ck;
+  int have_ckpt = opt.checkpoint &&
+                  open_checkpoint(&ck, opt.checkpoint, opt.resident_layers) == 0;
+  if (have_ckpt)
+    opt.config = ck.params.config;
+
+  const TransformerConfig *cfg = &opt.config;
+  if (opt.batch < 1 || opt.threads < 1 || opt.requests < 1 ||
+      cfg->num_heads < 1 || cfg->d_model % cfg->num_heads != 0) {
+    fprintf(stderr, "Invalid configuration\n");
+    return 1;
+  }
+  int max_positions = transformer_max_positions(*cfg);
+  if (opt.src_len.hi > max_positions || opt.tgt_len.hi > max_positions) {
+    fprintf(stderr, "Lengths must not exceed --max-seq (%d)\n",
+            cfg->max_seq_len);
+    return 1;
+  }
+
+  TransformerParams params;
+  if (opt.checkpoint && !have_ckpt) {
+    init_transformer_params(&params, *cfg);
+    int saved = save_checkpoint(&params, opt.checkpoint) == 0;
+    free_transformer_params(&params);
+    if (!saved ||
+        open_checkpoint(&ck, opt.checkpoint, opt.resident_layers) != 0) {
+      fprintf(stderr, "Cannot write checkpoint %s\n", opt.checkpoint);
+      return 1;
+    }
+    have_ckpt = 1;
+  }
+  if (have_ckpt)
+    params = ck.params; // Tensors and pager stay owned by ck
+  else
+    init_transformer_params(&params, *cfg);
+
+  int nodes = numa_node_count();
+  ParamsReplicas replicas = {0, NULL};
+  if (opt.numa == NUMA_INTERLEAVE && numa_interleave_params(&params) != 0)
+    fprintf(stderr, "warning: could not interleave the weights\n");
+  if (opt.numa == NUMA_REPLICATE) {
+    init_params_replicas(&replicas, &params);
+    thread_pool_set_node_pools(1);
+  }
+  if (opt.pin)
+    thread_pool_set_affinity(1);
+
+  // Split the requests evenly across threads
+  Worker *workers = (Worker *)calloc(opt.threads, sizeof(Worker));
+  if (!workers) {
+    fprintf(stderr, "Alloc failed in e2e_bench\n");
+    return 1;
+  }
+  int per = opt.requests / opt.threads, extra = opt.requests % opt.threads;
+  for (int i = 0, first = 0; i < opt.threads; i++) {
+    Worker *w = &workers[i];
+    w->node = (opt.pin || opt.numa == NUMA_REPLICATE) ? i % nodes : -1;
+    w->params = replicas.replicas && w->node >= 0 ? &replicas.replicas[w->node]
+                                                  : &params;
+    w->opt = &opt;
+    w->first = first;
+    w->count = per + (i < extra);
+    w->forward_us = (double *)malloc((w->count + 1) * sizeof(double));
+    w->step_us =
+        (double *)malloc(((size_t)w->count * opt.tgt_len.hi + 1) *
+                         sizeof(double));
+    if (!w->forward_us || !w->step_us) {
+      fprintf(stderr, "Alloc failed in e2e_bench\n");
+      return 1;
+    }
+    first += w->count;
+  }
+
+  fprintf(stderr, "forward phase...\n");
+  unsigned long long a0 = alloc_count();
+  double forward_wall = run_phase(workers, opt.threads, 0);
+  unsigned long long forward_allocs = alloc_count() - a0;
+
+  fprintf(stderr, "decode phase...\n");
+  a0 = alloc_count();
+  double decode_wall = run_phase(workers, opt.threads, 1);
+  unsigned long long decode_allocs = alloc_count() - a0;
+
+  GenerateRun gen;
+  double serial_wall = 0.0, pipeline_wall = 0.0;
+  long long serial_tokens = 0;
+  if (opt.pipe_enc > 0) {
+    init_generate(&gen, &opt);
+    fprintf(stderr, "generate phase (serial)...\n");
+    serial_wall = run_generate_serial(&gen, &opt, &params);
+    serial_tokens = gen.tokens;
+    fprintf(stderr, "generate phase (pipeline %d:%d)...\n", opt.pipe_enc,
+            opt.pipe_dec);
+    pipeline_wall = run_generate_pipeline(
+        &gen, &opt, &params, replicas.replicas ? &replicas : NULL);
+  }
+
+  ApiRun api;
+  if (opt.api) {
+    fprintf(stderr, "api phase...\n");
+    run_api(&opt, &api);
+  }
+
+  // Merge per-thread samples
+  int n_forward = 0, n_steps = 0;
+  long long forward_tokens = 0, decode_tokens = 0;
+  for (int i = 0; i < opt.threads; i++) {
+    n_forward += workers[i].count;
+    n_steps += workers[i].n_steps;
+    forward_tokens += workers[i].forward_tokens;
+    decode_tokens += workers[i].decode_tokens;
+  }
+  double *forward_us = (double *)malloc((n_forward + 1) * sizeof(double));
+  double *step_us = (double *)malloc((n_steps + 1) * sizeof(double));
+  if (!forward_us || !step_us) {
+    fprintf(stderr, "Alloc failed in e2e_bench\n");
+    return 1;
+  }
+  for (int i = 0, f = 0, s = 0; i < opt.threads; i++) {
+    memcpy(forward_us + f, workers[i].forward_us,
+           workers[i].count * sizeof(double));
+    memcpy(step_us + s, workers[i].step_us,
+           workers[i].n_steps * sizeof(double));
+    f += workers[i].count;
+    s += workers[i].n_steps;
+  }
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+
+  printf("{\n");
+  printf("  \"config\":{\"num_layers\":%d,\"d_model\":%d,\"d_ff\":%d,"
+         "\"num_heads\":%d,\"vocab_size\":%d,\"max_seq_len\":%d,"
+         "\"pos\":\"%s\"},\n",
+         cfg->num_layers, cfg->d_model, cfg->d_ff, cfg->num_heads,
+         cfg->vocab_size, cfg->max_seq_len, POS_MODES[cfg->pos_mode]);
+  printf("  \"workload\":{\"requests\":%d,\"batch\":%d,\"threads\":%d,"
+         "\"src_len\":[%d,%d],\"tgt_len\":[%d,%d],\"seed\":%u},\n",
+         opt.requests, opt.batch, opt.threads, opt.src_len.lo, opt.src_len.hi,
+         opt.tgt_len.lo, opt.tgt_len.hi, opt.seed);
+  printf("  \"placement\":{\"numa_nodes\":%d,\"numa\":\"%s\",\"pin\":%d},\n",
+         nodes, NUMA_MODES[opt.numa], opt.pin);
+  if (have_ckpt)
+    printf("  \"checkpoint\":{\"resident_layers\":%d,\"prefetches\":%llu,"
+           "\"releases\":%llu},\n",
+           ck.paged ? ck.pager.max_resident : 0, ck.pager.prefetches,
+           ck.pager.releases);
+  printf("  \"forward_tokens_per_sec\":%.1f,\n",
+         forward_tokens / (forward_wall / 1e6));
+  printf("  \"decode_tokens_per_sec\":%.1f,\n",
+         decode_tokens / (decode_wall / 1e6));
+  print_latency("forward_latency", forward_us, n_forward);
+  print_latency("decode_step_latency", step_us, n_steps);
+  if (opt.pipe_enc > 0) {
+    printf("  \"pipeline\":{\"encoder_threads\":%d,\"decoder_threads\":%d},\n",
+           opt.pipe_enc, opt.pipe_dec);
+    printf("  \"generate_serial_tokens_per_sec\":%.1f,\n",
+           serial_tokens / (serial_wall / 1e6));
+    printf("  \"generate_pipeline_tokens_per_sec\":%.1f,\n",
+           gen.tokens / (pipeline_wall / 1e6));
+    print_latency("pipeline_request_latency", gen.latency_us, opt.requests);
+    free_generate(&gen);
+  }
+  if (opt.api)
+    printf("  \"api\":{\"forward_tokens_per_sec\":%.1f,"
+           "\"allocs_per_forward\":%.1f,\"allocs_per_decode_step\":%.1f,"
+           "\"workspace_bytes\":%zu,\"overflows\":%llu},\n",
+           api.tokens / (api.wall_us / 1e6),
+           (double)api.forward_allocs / opt.requests,
+           api.n_steps ? (double)api.decode_allocs / api.n_steps : 0.0,
+           api.stats.workspace_bytes, api.stats.overflows);
+  printf("  \"allocs_per_forward\":%.1f,\n",
+         n_forward ? (double)forward_allocs / n_forward : 0.0);
+  printf("  \"allocs_per_decode_step\":%.1f,\n",
+         n_steps ? (double)decode_allocs / n_steps : 0.0);
+  printf("  \"total_allocs\":%llu,\n  \"total_frees\":%llu,\n"
+         "  \"total_alloc_bytes\":%llu,\n",
+         alloc_count(), n_frees, alloc_bytes);
+  printf("  \"peak_rss_kb\":%ld\n}\n", ru.ru_maxrss);
+
+  for (int i = 0; i < opt.threads; i++) {
+    free(workers[i].forward_us);
+    free(workers[i].step_us);
+  }
+  free(workers);
+  free(forward_us);
+  free(step_us);
+  if (replicas.replicas)
+    free_params_replicas(&replicas);
+  if (have_ckpt)
+    close_checkpoint(&ck);
+  else
+    free_transformer_params(&params);
+  return 0;
+}
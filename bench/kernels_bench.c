@@ -0,0 +1,595 @@
+#include "../include/attention.h"
+#include "../include/attention_kernels.h"
+#include "../include/feedforward.h"
+#include "../include/huge_alloc.h"
+#include "../include/kernels.h"
+#include "../include/layernorm.h"
+#include "../include/math_utils.h"
+#include "../include/tensor.h"
+#include "bench_utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Kernel microbenchmarks. Prints one JSON document on stdout:
+//   ./kernels_bench [--quick] [--kernel NAME] [--backend NAME|all]
+// --backend picks the kernel table used by the layer-level benchmarks and by
+// the "gemm", "gemm_nt", "softmax" and "gelu" cases; "all" repeats the sweep for every
+// backend available on this host plus calibrated "auto".
+// Throughput figures use the median time and analytic FLOP / byte counts
+// (bytes = minimum traffic: every operand read once, every result written
+// once).
+
+#define MAX_SAMPLES 1000
+#define MIN_SAMPLES 10
+#define MIN_TIME_US 200000.0
+
+typedef struct {
+  const char *kernel;
+  const char *backend; // fixed implementation; NULL = the selected table
+  char shape[96];
+  double flops;
+  double bytes;
+  void (*run)(void *ctx);
+  void (*reset)(void *ctx); // untimed, before every run (may be NULL)
+  void *ctx;
+} BenchCase;
+
+static int first_result = 1;
+static const char *backend_name = "auto";
+
+static void run_case(const BenchCase *bc) {
+  static double samples[MAX_SAMPLES];
+  const char *backend = bc->backend ? bc->backend : backend_name;
+
+  // Warm-up: fault in buffers and caches
+  if (bc->reset)
+    bc->reset(bc->ctx);
+  bc->run(bc->ctx);
+
+  int n = 0;
+  double elapsed = 0.0;
+  while (n < MAX_SAMPLES && (n < MIN_SAMPLES || elapsed < MIN_TIME_US)) {
+    if (bc->reset)
+      bc->reset(bc->ctx);
+    double t0 = bench_now_us();
+    bc->run(bc->ctx);
+    samples[n] = bench_now_us() - t0;
+    elapsed += samples[n];
+    n++;
+  }
+
+  bench_sort(samples, n);
+  double p50 = bench_percentile(samples, n, 50);
+  double secs = p50 / 1e6;
+
+  printf("%s    {\"kernel\":\"%s\",\"backend\":\"%s\",\"shape\":{%s},"
+         "\"samples\":%d,"
+         "\"min_us\":%.3f,\"mean_us\":%.3f,\"p50_us\":%.3f,\"p90_us\":%.3f,"
+         "\"p99_us\":%.3f,\"flops\":%.0f,\"bytes\":%.0f,\"gflops\":%.3f,"
+         "\"gbps\":%.3f}",
+         first_result ? "" : ",\n", bc->kernel, backend, bc->shape, n,
+         samples[0],
+         bench_mean(samples, n), p50, bench_percentile(samples, n, 90),
+         bench_percentile(samples, n, 99), bc->flops, bc->bytes,
+         secs > 0 ? bc->flops / secs / 1e9 : 0.0,
+         secs > 0 ? bc->bytes / secs / 1e9 : 0.0);
+  fflush(stdout);
+  first_result = 0;
+  fprintf(stderr, "%-28s %-9s %-40s p50 %10.2f us\n", bc->kernel, backend,
+          bc->shape, p50);
+}
+
+static float *alloc_random(size_t n, unsigned int seed) {
+  float *x = (float *)malloc((n ? n : 1) * sizeof(float));
+  if (!x) {
+    fprintf(stderr, "Alloc failed in kernels_bench\n");
+    exit(1);
+  }
+  bench_fill(x, n, seed);
+  return x;
+}
+
+// ---------------------------------------------------------------------------
+// matmul_blocked: C (M x N) = A (M x K) * B (K x N)
+
+typedef struct {
+  int M, N, K;
+  float *A, *B, *C;
+} MatmulCtx;
+
+static void run_matmul(void *p) {
+  MatmulCtx *c = (MatmulCtx *)p;
+  matmul_blocked(c->A, c->B, c->C, c->M, c->N, c->K);
+}
+
+static void run_gemm(void *p) {
+  MatmulCtx *c = (MatmulCtx *)p;
+  kernels()->gemm(c->A, c->K, c->B, c->N, c->C, c->N, c->M, c->N, c->K);
+}
+
+// B stored as (N x K)
+static void run_gemm_nt(void *p) {
+  MatmulCtx *c = (MatmulCtx *)p;
+  kernels()->gemm_nt(c->A, c->K, c->B, c->K, c->C, c->N, c->M, c->N, c->K);
+}
+
+// Weight-sized GEMM with every operand allocated under one huge-page mode:
+// the B panel (K x N) spans many megabytes, so with 4KB pages the walk over
+// it misses the TLB on nearly every new page
+static void bench_gemm_pages(int M, int N, int K) {
+  static const HugePageMode modes[] = {HUGE_PAGES_OFF, HUGE_PAGES_THP};
+  static const char *mode_names[] = {"off", "thp"};
+  HugePageMode saved = huge_pages_mode();
+  for (int m = 0; m < 2; m++) {
+    huge_pages_set_mode(modes[m]);
+    size_t sizes[3] = {(size_t)M * K, (size_t)K * N, (size_t)M * N};
+    float *buf[3];
+    for (int i = 0; i < 3; i++) {
+      buf[i] = (float *)huge_alloc(sizes[i] * sizeof(float));
+      if (!buf[i]) {
+        fprintf(stderr, "Alloc failed in kernels_bench\n");
+        exit(1);
+      }
+      bench_fill(buf[i], sizes[i], i + 1);
+    }
+    MatmulCtx c = {M, N, K, buf[0], buf[1], buf[2]};
+    BenchCase bc = {.kernel = "gemm_pages",
+                    .flops = 2.0 * M * N * K,
+                    .bytes = 4.0 * (sizes[0] + sizes[1] + sizes[2]),
+                    .run = run_gemm,
+                    .ctx = &c};
+    snprintf(bc.shape, sizeof(bc.shape),
+             "\"M\":%d,\"N\":%d,\"K\":%d,\"hugepages\":\"%s\"", M, N, K,
+             mode_names[m]);
+    run_case(&bc);
+    for (int i = 0; i < 3; i++)
+      huge_free(buf[i]);
+  }
+  huge_pages_set_mode(saved);
+}
+
+// Attention scores Q x K^T through the selected table: (L x d_k) x (L x d_k)^T
+static void bench_gemm_nt(int L, int d_k) {
+  MatmulCtx c = {L, L, d_k, alloc_random((size_t)L * d_k, 1),
+                 alloc_random((size_t)L * d_k, 2), alloc_random((size_t)L * L, 3)};
+  BenchCase bc = {.kernel = "gemm_nt",
+                  .flops = 2.0 * L * L * d_k,
+                  .bytes = 4.0 * (2.0 * L * d_k + (double)L * L),
+                  .run = run_gemm_nt,
+                  .ctx = &c};
+  snprintf(bc.shape, sizeof(bc.shape), "\"M\":%d,\"N\":%d,\"K\":%d", L, L,
+           d_k);
+  run_case(&bc);
+  free(c.A);
+  free(c.B);
+  free(c.C);
+}
+
+// dispatch: 0 for matmul_blocked, 1 for the selected kernel table
+static void bench_matmul(int M, int N, int K, int dispatch) {
+  MatmulCtx c = {M, N, K, alloc_random((size_t)M * K, 1),
+                 alloc_random((size_t)K * N, 2), alloc_random((size_t)M * N, 3)};
+  BenchCase bc = {.kernel = dispatch ? "gemm" : "matmul_blocked",
+                  .backend = dispatch ? NULL : "blocked",
+                  .flops = 2.0 * M * N * K,
+                  .bytes = 4.0 * ((double)M * K + (double)K * N + (double)M * N),
+                  .run = dispatch ? run_gemm : run_matmul,
+                  .ctx = &c};
+  snprintf(bc.shape, sizeof(bc.shape), "\"M\":%d,\"N\":%d,\"K\":%d", M, N, K);
+  run_case(&bc);
+  free(c.A);
+  free(c.B);
+  free(c.C);
+}
+
+// ---------------------------------------------------------------------------
+// softmax_rows over a (rows x cols) score matrix
+
+typedef struct {
+  int rows, cols;
+  float *in, *out;
+} SoftmaxCtx;
+
+static void run_softmax(void *p) {
+  SoftmaxCtx *c = (SoftmaxCtx *)p;
+  softmax_rows(c->in, c->out, c->rows, c->cols);
+}
+
+static void run_softmax_table(void *p) {
+  SoftmaxCtx *c = (SoftmaxCtx *)p;
+  kernels()->softmax(c->in, c->out, c->rows, c->cols);
+}
+
+static void bench_softmax(int rows, int cols, int dispatch) {
+  size_t n = (size_t)rows * cols;
+  SoftmaxCtx c = {rows, cols, alloc_random(n, 4), alloc_random(n, 5)};
+  // max, subtract, exp, accumulate, divide
+  BenchCase bc = {.kernel = dispatch ? "softmax" : "softmax_rows",
+                  .backend = dispatch ? NULL : "reference",
+                  .flops = 5.0 * n,
+                  .bytes = 8.0 * n,
+                  .run = dispatch ? run_softmax_table : run_softmax,
+                  .ctx = &c};
+  snprintf(bc.shape, sizeof(bc.shape), "\"rows\":%d,\"cols\":%d", rows, cols);
+  run_case(&bc);
+  free(c.in);
+  free(c.out);
+}
+
+// ---------------------------------------------------------------------------
+// compute_layernorm over L rows of d_model
+
+typedef struct {
+  int L, d_model;
+  float *in, *out;
+  LayerNormParams params;
+} LayerNormCtx;
+
+static void run_layernorm(void *p) {
+  LayerNormCtx *c = (LayerNormCtx *)p;
+  compute_layernorm(c->in, &c->params, c->out, c->L, c->d_model);
+}
+
+static void bench_layernorm(int L, int d_model) {
+  size_t n = (size_t)L * d_model;
+  LayerNormCtx c = {L, d_model, alloc_random(n, 6), alloc_random(n, 7),
+                    {alloc_random(d_model, 8), alloc_random(d_model, 9)}};
+  // mean, variance, normalize, scale and shift
+  BenchCase bc = {.kernel = "compute_layernorm",
+                  .flops = 8.0 * n,
+                  .bytes = 4.0 * (2.0 * n + 2.0 * d_model),
+                  .run = run_layernorm,
+                  .ctx = &c};
+  snprintf(bc.shape, sizeof(bc.shape), "\"L\":%d,\"d_model\":%d", L, d_model);
+  run_case(&bc);
+  free(c.in);
+  free(c.out);
+  free(c.params.gamma);
+  free(c.params.beta);
+}
+
+// ---------------------------------------------------------------------------
+// apply_gelu, in place, so the input is restored before every run
+
+typedef struct {
+  int rows, cols;
+  float *src, *x;
+} GeluCtx;
+
+static void reset_gelu(void *p) {
+  GeluCtx *c = (GeluCtx *)p;
+  memcpy(c->x, c->src, (size_t)c->rows * c->cols * sizeof(float));
+}
+
+static void run_gelu(void *p) {
+  GeluCtx *c = (GeluCtx *)p;
+  apply_gelu(c->x, c->rows, c->cols);
+}
+
+static void run_gelu_table(void *p) {
+  GeluCtx *c = (GeluCtx *)p;
+  kernels()->gelu(c->x, c->rows * c->cols);
+}
+
+static void bench_gelu(int rows, int cols, int dispatch) {
+  size_t n = (size_t)rows * cols;
+  GeluCtx c = {rows, cols, alloc_random(n, 10), alloc_random(n, 11)};
+  // tanh approximation, counting tanh as one op
+  BenchCase bc = {.kernel = dispatch ? "gelu" : "apply_gelu",
+                  .backend = dispatch ? NULL : "reference",
+                  .flops = 9.0 * n,
+                  .bytes = 8.0 * n,
+                  .run = dispatch ? run_gelu_table : run_gelu,
+                  .reset = reset_gelu,
+                  .ctx = &c};
+  snprintf(bc.shape, sizeof(bc.shape), "\"rows\":%d,\"cols\":%d", rows, cols);
+  run_case(&bc);
+  free(c.src);
+  free(c.x);
+}
+
+// ---------------------------------------------------------------------------
+// compute_attention_gemm: one causal self-attention head
+
+typedef struct {
+  int L, d_model, d_k;
+  float *X, *W_qkv, *Q, *K, *V, *scores, *weights, *out;
+} AttnCtx;
+
+static void run_attention(void *p) {
+  AttnCtx *c = (AttnCtx *)p;
+  compute_attention_gemm(c->X, c->W_qkv, c->Q, c->K, c->V, c->scores,
+                         c->weights, c->out, c->L, c->d_model, c->d_k,
+                         NULL);
+}
+
+static void bench_attention(int L, int d_model, int d_k) {
+  size_t Ld = (size_t)L * d_k, LL = (size_t)L * L;
+  AttnCtx c = {L,
+               d_model,
+               d_k,
+               alloc_random((size_t)L * d_model, 12),
+               alloc_random((size_t)d_model * 3 * d_k, 13),
+               alloc_random(Ld, 0),
+               alloc_random(Ld, 0),
+               alloc_random(Ld, 0),
+               alloc_random(LL, 0),
+               alloc_random(LL, 0),
+               alloc_random(Ld, 0)};
+  double l = L;
+  BenchCase bc = {
+      .kernel = "compute_attention_gemm",
+      // QKV projection, Q K^T, softmax, weights V
+      .flops = 2.0 * l * d_model * 3 * d_k + 4.0 * l * l * d_k + 5.0 * l * l,
+      .bytes = 4.0 * (l * d_model + (double)d_model * 3 * d_k + 4.0 * Ld +
+                      2.0 * LL),
+      .run = run_attention,
+      .ctx = &c};
+  snprintf(bc.shape, sizeof(bc.shape), "\"L\":%d,\"d_model\":%d,\"d_k\":%d", L,
+           d_model, d_k);
+  run_case(&bc);
+  free(c.X);
+  free(c.W_qkv);
+  free(c.Q);
+  free(c.K);
+  free(c.V);
+  free(c.scores);
+  free(c.weights);
+  free(c.out);
+}
+
+// ---------------------------------------------------------------------------
+// attention_kernel: one decode query row against n_keys cached keys / values
+// of one head, rows strided by d_model as in the KV cache
+
+typedef struct {
+  int n_keys, d_model, d_k;
+  AttentionKernel attend;
+  float *q, *K, *V, *w, *out;
+} DecodeAttnCtx;
+
+static void run_decode_attention(void *p) {
+  DecodeAttnCtx *c = (DecodeAttnCtx *)p;
+  c->attend(c->q, c->d_k, c->K, c->V, c->d_model, c->w, c->n_keys, c->out,
+            c->d_k, 1, c->n_keys, 0, c->d_k);
+}
+
+static void bench_decode_attention(int n_keys, int d_model, int d_k) {
+  size_t kv = (size_t)n_keys * d_model;
+  DecodeAttnCtx c = {n_keys,
+                     d_model,
+                     d_k,
+                     attention_kernel(d_k),
+                     alloc_random(d_k, 23),
+                     alloc_random(kv, 24),
+                     alloc_random(kv, 25),
+                     alloc_random(n_keys, 0),
+                     alloc_random(d_k, 0)};
+  double n = n_keys, dk = d_k;
+  // q·k and weighted sum of v per key, plus scale and softmax
+  BenchCase bc = {.kernel = "attention_kernel",
+                  .backend = attention_kernel_specialized(d_k) ? "fixed_dk"
+                                                               : "generic",
+                  .flops = 4.0 * n * dk + 6.0 * n,
+                  .bytes = 4.0 * (2.0 * n * dk + 2.0 * dk + n),
+                  .run = run_decode_attention,
+                  .ctx = &c};
+  snprintf(bc.shape, sizeof(bc.shape), "\"n_keys\":%d,\"d_k\":%d", n_keys,
+           d_k);
+  run_case(&bc);
+  free(c.q);
+  free(c.K);
+  free(c.V);
+  free(c.w);
+  free(c.out);
+}
+
+// ---------------------------------------------------------------------------
+// compute_cross_attention: all heads plus the output projection
+
+typedef struct {
+  int L_dec, L_enc, d_model, num_heads;
+  float *X_q, *X_kv, *out;
+  AttentionParams params;
+} CrossCtx;
+
+static void run_cross(void *p) {
+  CrossCtx *c = (CrossCtx *)p;
+  compute_cross_attention(c->X_q, c->X_kv, &c->params, c->out, c->L_dec,
+                          c->L_enc, c->d_model, c->num_heads);
+}
+
+static void bench_cross(int L_dec, int L_enc, int d_model, int num_heads) {
+  size_t d = d_model;
+  CrossCtx c = {L_dec,
+                L_enc,
+                d_model,
+                num_heads,
+                alloc_random((size_t)L_dec * d, 14),
+                alloc_random((size_t)L_enc * d, 15),
+                alloc_random((size_t)L_dec * d, 0),
+                {alloc_random(d * 3 * d, 16), alloc_random(d * d, 17)}};
+  double ld = L_dec, le = L_enc, dm = d_model;
+  BenchCase bc = {
+      .kernel = "compute_cross_attention",
+      // Q and output projections on the decoder rows, K/V on the encoder
+      // rows, then scores, softmax and weighted sum for every head
+      .flops = 4.0 * ld * dm * dm + 4.0 * le * dm * dm + 4.0 * ld * le * dm +
+               5.0 * ld * le * num_heads,
+      .bytes = 4.0 * (2.0 * ld * dm + le * dm + 4.0 * dm * dm),
+      .run = run_cross,
+      .ctx = &c};
+  snprintf(bc.shape, sizeof(bc.shape),
+           "\"L_dec\":%d,\"L_enc\":%d,\"d_model\":%d,\"num_heads\":%d", L_dec,
+           L_enc, d_model, num_heads);
+  run_case(&bc);
+  free(c.X_q);
+  free(c.X_kv);
+  free(c.out);
+  free(c.params.W_qkv);
+  free(c.params.W_o);
+}
+
+// ---------------------------------------------------------------------------
+// compute_feedforward_network: GEMM + bias, GELU, GEMM + bias
+
+typedef struct {
+  int L, d_model, d_ff;
+  float *in, *out;
+  FeedForwardParams params;
+} FfnCtx;
+
+static void run_ffn(void *p) {
+  FfnCtx *c = (FfnCtx *)p;
+  compute_feedforward_network(c->in, &c->params, c->out, c->L, c->d_model,
+                              c->d_ff);
+}
+
+static void bench_ffn(int L, int d_model, int d_ff) {
+  size_t d = d_model, f = d_ff;
+  FfnCtx c = {L,
+              d_model,
+              d_ff,
+              alloc_random((size_t)L * d, 18),
+              alloc_random((size_t)L * d, 0),
+              {alloc_random(d * f, 19), alloc_random(f, 20),
+               alloc_random(f * d, 21), alloc_random(d, 22)}};
+  double l = L;
+  BenchCase bc = {
+      .kernel = "compute_feedforward_network",
+      .flops = 4.0 * l * d * f + 9.0 * l * f + l * (d + f),
+      .bytes = 4.0 * (2.0 * l * d + 2.0 * d * f + d + f + 2.0 * l * f),
+      .run = run_ffn,
+      .ctx = &c};
+  snprintf(bc.shape, sizeof(bc.shape), "\"L\":%d,\"d_model\":%d,\"d_ff\":%d", L,
+           d_model, d_ff);
+  run_case(&bc);
+  free(c.in);
+  free(c.out);
+  free(c.params.W1);
+  free(c.params.B1);
+  free(c.params.W2);
+  free(c.params.B2);
+}
+
+// ---------------------------------------------------------------------------
+
+static int selected(const char *filter, const char *kernel) {
+  return !filter || strcmp(filter, kernel) == 0;
+}
+
+// fixed: also run the implementations that bypass the kernel table
+static void run_sweep(int quick, const char *filter, int fixed) {
+  // Sweeps: decode-like single rows up to prefill-sized blocks
+  static const int seq_lens[] = {1, 16, 64, 256};
+  static const int d_models[] = {64, 256, 512};
+  static const int mm_sizes[] = {32, 64, 128, 256, 512};
+  int n_seq = quick ? 2 : 4;
+  int n_dm = quick ? 2 : 3;
+  int n_mm = quick ? 3 : 5;
+
+  for (int dispatch = !fixed; dispatch <= 1; dispatch++) {
+    if (!selected(filter, dispatch ? "gemm" : "matmul_blocked"))
+      continue;
+    for (int i = 0; i < n_mm; i++)
+      bench_matmul(mm_sizes[i], mm_sizes[i], mm_sizes[i], dispatch);
+    // Skinny shapes seen in decoding: one row against a weight matrix
+    for (int j = 0; j < n_dm; j++)
+      bench_matmul(1, 4 * d_models[j], d_models[j], dispatch);
+  }
+
+  // 16MB weight matrix against decode- and prefill-sized row blocks
+  if (selected(filter, "gemm_pages")) {
+    bench_gemm_pages(1, 4096, 1024);
+    if (!quick)
+      bench_gemm_pages(32, 4096, 1024);
+  }
+
+  if (selected(filter, "gemm_nt")) {
+    for (int i = 0; i < n_seq; i++)
+      for (int j = 0; j < n_dm; j++)
+        bench_gemm_nt(seq_lens[i], d_models[j] / 8);
+  }
+
+  // Specialized head sizes next to one served by the generic kernel
+  static const int head_dims[] = {32, 48, 64, 128};
+  if (fixed && selected(filter, "attention_kernel")) {
+    for (int i = 0; i < n_seq; i++)
+      for (int j = 0; j < 4; j++)
+        bench_decode_attention(4 * seq_lens[i], 512, head_dims[j]);
+  }
+
+  for (int i = 0; i < n_seq; i++) {
+    for (int j = 0; j < n_dm; j++) {
+      int L = seq_lens[i], d = d_models[j];
+      if (fixed && selected(filter, "softmax_rows"))
+        bench_softmax(L, d, 0);
+      if (selected(filter, "softmax"))
+        bench_softmax(L, d, 1);
+      if (selected(filter, "compute_layernorm"))
+        bench_layernorm(L, d);
+      if (fixed && selected(filter, "apply_gelu"))
+        bench_gelu(L, 4 * d, 0);
+      if (selected(filter, "gelu"))
+        bench_gelu(L, 4 * d, 1);
+      if (selected(filter, "compute_attention_gemm"))
+        bench_attention(L, d, d / 8);
+      if (selected(filter, "compute_cross_attention"))
+        bench_cross(L, 64, d, 8);
+      if (selected(filter, "compute_feedforward_network"))
+        bench_ffn(L, d, 4 * d);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int quick = 0;
+  const char *filter = NULL;
+  const char *backend = NULL; // default: TRANSFORMER_KERNELS or auto
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0)
+      quick = 1;
+    else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc)
+      filter = argv[++i];
+    else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc)
+      backend = argv[++i];
+    else {
+      fprintf(stderr,
+              "usage: %s [--quick] [--kernel NAME] [--backend NAME|all]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  int all = backend && strcmp(backend, "all") == 0;
+  if (backend && !all && kernels_select_by_name(backend) != 0) {
+    fprintf(stderr, "Unknown or unavailable kernel backend: %s\n", backend);
+    return 1;
+  }
+  // Automatic selection is only meaningful once calibrated
+  kernels_calibrate(0);
+
+  printf("{\"benchmarks\":[\n");
+
+  if (all) {
+    int fixed = 1;
+    for (int b = 0; b < KERNEL_NUM_BACKENDS; b++) {
+      if (kernels_select((KernelBackend)b) != 0)
+        continue;
+      backend_name = kernel_backend_name((KernelBackend)b);
+      run_sweep(quick, filter, fixed);
+      fixed = 0;
+    }
+    kernels_select_auto();
+    backend_name = KERNEL_AUTO_NAME;
+    run_sweep(quick, filter, 0);
+  } else {
+    backend_name = kernels()->name;
+    run_sweep(quick, filter, 1);
+  }
+
+  printf("\n]}\n");
+  return 0;
+}
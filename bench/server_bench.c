@@ -0,0 +1,276 @@
+#include "../include/server.h"
+#include "../include/transformer.h"
+#include "bench_utils.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Load generator for the Unix socket server. Prints one JSON document on
+// stdout, e.g.
+//   ./server_bench --clients 8 --requests 256 --src-len 16-64 --max-len 32
+//
+// Each client thread holds one connection and sends its share of the
+// requests one after another, timing the first streamed token (TTFT) and
+// the final DONE frame. With --socket PATH it drives a running
+// transformer_server; without it, a server for a random model of the given
+// shape is started in this process on a temporary socket. EOS is disabled so
+// every request generates exactly --max-len tokens.
+
+typedef struct {
+  TransformerConfig config;
+  const char *socket; // NULL: in-process server
+  int batch;
+  int clients;
+  int requests;
+  int src_lo, src_hi;
+  int max_len;
+  float temperature;
+  unsigned int seed;
+} BenchOptions;
+
+typedef struct {
+  const BenchOptions *opt;
+  const char *path;
+  int first, count; // request range of this client
+
+  // Results
+  double *ttft_us;
+  double *latency_us;
+  long long tokens;
+  int failed;
+} Client;
+
+static void *client_main(void *p) {
+  Client *c = (Client *)p;
+  const BenchOptions *opt = c->opt;
+  int fd = server_connect(c->path);
+  int *src = (int *)malloc(opt->src_hi * sizeof(int));
+  if (fd < 0 || !src) {
+    c->failed = c->count;
+    free(src);
+    return NULL;
+  }
+
+  for (int i = 0; i < c->count; i++) {
+    int r = c->first + i;
+    unsigned int state = opt->seed ^ (2654435761u * (unsigned)(r + 1));
+    state = state * 1103515245u + 12345u;
+    int L_src = opt->src_lo +
+                (int)((state >> 8) % (unsigned)(opt->src_hi - opt->src_lo + 1));
+    for (int j = 0; j < L_src; j++)
+      src[j] = (int)((state = state * 1103515245u + 12345u) >> 8) %
+               opt->config.vocab_size;
+
+    ServerRequestHeader h = {.magic = SERVER_REQUEST_MAGIC,
+                             .request_id = (uint32_t)r,
+                             .L_src = (uint32_t)L_src,
+                             .max_len = (uint32_t)opt->max_len,
+                             .bos_id = 0,
+                             .eos_id = -1,
+                             .temperature = opt->temperature,
+                             .top_p = 1.0f,
+                             .seed = (uint64_t)r + 1};
+    double t0 = bench_now_us();
+    c->ttft_us[i] = c->latency_us[i] = 0.0;
+    if (server_send_request(fd, &h, src) != 0) {
+      c->failed++;
+      continue;
+    }
+    for (;;) {
+      ServerResponse resp;
+      if (server_read_response(fd, &resp) != 0) {
+        c->failed++;
+        break;
+      }
+      if (resp.type == SERVER_MSG_TOKEN) {
+        if (c->ttft_us[i] == 0.0)
+          c->ttft_us[i] = bench_now_us() - t0;
+        c->tokens++;
+        continue;
+      }
+      if (resp.type == SERVER_MSG_ERROR)
+        c->failed++;
+      c->latency_us[i] = bench_now_us() - t0;
+      break;
+    }
+  }
+
+  close(fd);
+  free(src);
+  return NULL;
+}
+
+static void print_latency(const char *name, double *samples, int n) {
+  bench_sort(samples, n);
+  printf("  \"%s\":{\"count\":%d,\"mean_us\":%.3f,\"p50_us\":%.3f,"
+         "\"p99_us\":%.3f,\"max_us\":%.3f},\n",
+         name, n, bench_mean(samples, n), bench_percentile(samples, n, 50),
+         bench_percentile(samples, n, 99), n > 0 ? samples[n - 1] : 0.0);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--socket PATH] [--clients N] [--requests N]\n"
+          "          [--src-len A[-B]] [--max-len N] [--temperature F]"
+          " [--seed N]\n"
+          "          in-process server: [--batch N] [--layers N]"
+          " [--d-model N]\n"
+          "          [--d-ff N] [--heads N] [--vocab N] [--max-seq N]\n",
+          prog);
+}
+
+int main(int argc, char **argv) {
+  BenchOptions opt = {.config = {.num_layers = 2,
+                                 .d_model = 128,
+                                 .d_ff = 512,
+                                 .num_heads = 8,
+                                 .vocab_size = 1000,
+                                 .max_seq_len = 128},
+                      .batch = 8,
+                      .clients = 4,
+                      .requests = 64,
+                      .src_lo = 16,
+                      .src_hi = 48,
+                      .max_len = 32,
+                      .seed = 42};
+
+  for (int i = 1; i < argc; i += 2) {
+    const char *arg = argv[i];
+    const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+    int ok = 1;
+    if (!val) {
+      usage(argv[0]);
+      return 1;
+    }
+    if (strcmp(arg, "--socket") == 0)
+      opt.socket = val;
+    else if (strcmp(arg, "--clients") == 0)
+      opt.clients = atoi(val);
+    else if (strcmp(arg, "--requests") == 0)
+      opt.requests = atoi(val);
+    else if (strcmp(arg, "--src-len") == 0) {
+      int n = sscanf(val, "%d-%d", &opt.src_lo, &opt.src_hi);
+      if (n == 1)
+        opt.src_hi = opt.src_lo;
+      ok = n >= 1 && opt.src_lo > 0 && opt.src_hi >= opt.src_lo;
+    } else if (strcmp(arg, "--max-len") == 0)
+      opt.max_len = atoi(val);
+    else if (strcmp(arg, "--temperature") == 0)
+      opt.temperature = (float)atof(val);
+    else if (strcmp(arg, "--seed") == 0)
+      opt.seed = (unsigned int)strtoul(val, NULL, 10);
+    else if (strcmp(arg, "--batch") == 0)
+      opt.batch = atoi(val);
+    else if (strcmp(arg, "--layers") == 0)
+      opt.config.num_layers = atoi(val);
+    else if (strcmp(arg, "--d-model") == 0)
+      opt.config.d_model = atoi(val);
+    else if (strcmp(arg, "--d-ff") == 0)
+      opt.config.d_ff = atoi(val);
+    else if (strcmp(arg, "--heads") == 0)
+      opt.config.num_heads = atoi(val);
+    else if (strcmp(arg, "--vocab") == 0)
+      opt.config.vocab_size = atoi(val);
+    else if (strcmp(arg, "--max-seq") == 0)
+      opt.config.max_seq_len = atoi(val);
+    else
+      ok = 0;
+    if (!ok) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (opt.clients < 1 || opt.requests < 1 || opt.max_len < 1 ||
+      opt.config.num_heads < 1 ||
+      opt.config.d_model % opt.config.num_heads != 0) {
+    fprintf(stderr, "Invalid configuration\n");
+    return 1;
+  }
+
+  // Without --socket, serve a random model from this process
+  TransformerParams params;
+  Server server;
+  char path[64];
+  if (!opt.socket) {
+    snprintf(path, sizeof(path), "/tmp/server_bench_%d.sock", (int)getpid());
+    init_transformer_params(&params, opt.config);
+    ServerConfig sc = {.max_batch = opt.batch, .queue_capacity = 256};
+    if (server_start(&server, &params, &sc, path) != 0) {
+      perror(path);
+      return 1;
+    }
+  }
+
+  Client *clients = (Client *)calloc(opt.clients, sizeof(Client));
+  pthread_t *tids = (pthread_t *)malloc(opt.clients * sizeof(pthread_t));
+  double *ttft = (double *)malloc(opt.requests * sizeof(double));
+  double *latency = (double *)malloc(opt.requests * sizeof(double));
+  if (!clients || !tids || !ttft || !latency) {
+    fprintf(stderr, "Alloc failed in server_bench\n");
+    return 1;
+  }
+  int per = opt.requests / opt.clients, extra = opt.requests % opt.clients;
+  for (int i = 0, first = 0; i < opt.clients; i++) {
+    Client *c = &clients[i];
+    c->opt = &opt;
+    c->path = opt.socket ? opt.socket : path;
+    c->first = first;
+    c->count = per + (i < extra);
+    c->ttft_us = ttft + first;
+    c->latency_us = latency + first;
+    first += c->count;
+  }
+
+  double t0 = bench_now_us();
+  for (int i = 0; i < opt.clients; i++) {
+    if (pthread_create(&tids[i], NULL, client_main, &clients[i]) != 0) {
+      fprintf(stderr, "pthread_create failed in server_bench\n");
+      return 1;
+    }
+  }
+  for (int i = 0; i < opt.clients; i++)
+    pthread_join(tids[i], NULL);
+  double wall = bench_now_us() - t0;
+
+  long long tokens = 0;
+  int failed = 0;
+  for (int i = 0; i < opt.clients; i++) {
+    tokens += clients[i].tokens;
+    failed += clients[i].failed;
+  }
+  if (!opt.socket)
+    server_stop(&server);
+
+  printf("{\n");
+  printf("  \"workload\":{\"clients\":%d,\"requests\":%d,\"src_len\":[%d,%d],"
+         "\"max_len\":%d,\"temperature\":%.2f},\n",
+         opt.clients, opt.requests, opt.src_lo, opt.src_hi, opt.max_len,
+         opt.temperature);
+  if (!opt.socket)
+    printf("  \"server\":{\"max_batch\":%d,\"mean_batch\":%.2f},\n",
+           opt.batch,
+           server.steps ? (double)server.step_rows / server.steps : 0.0);
+  printf("  \"failed_requests\":%d,\n", failed);
+  printf("  \"requests_per_sec\":%.1f,\n", opt.requests / (wall / 1e6));
+  printf("  \"tokens_per_sec\":%.1f,\n", tokens / (wall / 1e6));
+  print_latency("ttft", ttft, opt.requests);
+  // Last entry, without the trailing comma
+  bench_sort(latency, opt.requests);
+  printf("  \"request_latency\":{\"count\":%d,\"mean_us\":%.3f,"
+         "\"p50_us\":%.3f,\"p99_us\":%.3f,\"max_us\":%.3f}\n}\n",
+         opt.requests, bench_mean(latency, opt.requests),
+         bench_percentile(latency, opt.requests, 50),
+         bench_percentile(latency, opt.requests, 99),
+         latency[opt.requests - 1]);
+
+  free(clients);
+  free(tids);
+  free(ttft);
+  free(latency);
+  if (!opt.socket)
+    free_transformer_params(&params);
+  return 0;
+}
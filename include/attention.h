@@ -5,13 +5,20 @@
 typedef struct {
   float *W_qkv;
   float *W_o;
+  int rotary; // Rotate Q / K by position (self-attention of POS_ROTARY)
 } AttentionParams;
 
 void apply_mask(float *scores, const float *mask, int rows, int cols);
 
+/**
+ * @brief Causal single-head attention over rows 0..L-1.
+ * @param rope sinusoidal_table of positions 0..L-1 (L x d_k) to rotate Q and
+ * K with (positional.h), or NULL
+ */
 void compute_attention_gemm(const float *X, const float *W_qkv, float *Q,
                             float *K, float *V, float *scores, float *weights,
-                            float *out, int L, int d_model, int d_k);
+                            float *out, int L, int d_model, int d_k,
+                            const float *rope);
 
 void compute_multihead_attention(const float *X, const AttentionParams *params,
                                  float *out, int L, int d_model, int num_heads);
@@ -0,0 +1,31 @@
+// fused score / softmax / output kernels specialized per head dimension
+#ifndef ATTENTION_KERNELS_H
+#define ATTENTION_KERNELS_H
+
+/**
+ * @brief Scaled dot-product attention of `rows` query rows against `n_keys`
+ * key / value rows: out = softmax(Q K^T / sqrt(d_k)) V, one row at a time.
+ * @param Q query rows (rows x d_k, row stride ldq)
+ * @param K, V key / value rows (n_keys x d_k, row stride ldkv)
+ * @param W softmax weights (rows x n_keys, row stride ldw); masked keys are 0
+ * @param out output rows (rows x d_k, row stride ldo)
+ * @param causal when set, query row i only sees keys 0 .. n_keys - rows + i
+ * (the queries are the last `rows` positions of the sequence)
+ * @param d_k head dimension; ignored by the specialized kernels
+ */
+typedef void (*AttentionKernel)(const float *Q, int ldq, const float *K,
+                                const float *V, int ldkv, float *W, int ldw,
+                                float *out, int ldo, int rows, int n_keys,
+                                int causal, int d_k);
+
+/**
+ * @brief Kernel for a head dimension: a fixed-d_k specialization for
+ * d_k = 32, 64 or 128 (AVX2/FMA builds of them when the CPU supports it),
+ * otherwise the generic kernel.
+ */
+AttentionKernel attention_kernel(int d_k);
+
+// 1 if attention_kernel(d_k) is a fixed-d_k specialization
+int attention_kernel_specialized(int d_k);
+
+#endif
@@ -0,0 +1,46 @@
+// beam search generation
+#ifndef BEAM_SEARCH_H
+#define BEAM_SEARCH_H
+
+#include "encoder_cache.h"
+#include "prefix_cache.h"
+#include "shortlist.h"
+#include "transformer.h"
+
+typedef struct {
+  int beam_width;
+  int max_len;          // Maximum generated tokens (BOS excluded)
+  float length_penalty; // alpha in ((5 + len) / 6)^alpha, 0 disables
+  int bos_id;
+  int eos_id;
+
+  // Optional candidate vocabulary (must contain eos_id, as build_shortlist_ids
+  // ensures), NULL for full vocab
+  const VocabShortlist *shortlist;
+  // Optional cache of encoder outputs / cross K/V, NULL to always recompute
+  EncoderCache *encoder_cache;
+
+  // Optional forced decoder prefix fed after BOS (language tags, prompts)
+  const int *prefix;
+  int prefix_len;
+  // Optional cache of prefix decoder state, shared across requests
+  PrefixCache *prefix_cache;
+} BeamSearchConfig;
+
+/**
+ * @brief Beam search over the decoder using the incremental KV cache.
+ * All live beams advance in one batched decoder step; surviving beams keep
+ * their cache slot and forked beams copy their parent's cached state. The
+ * encoder output and cross-attention keys/values are shared by every beam.
+ * @param out_tokens Best hypothesis without BOS/prefix/EOS (at least
+ * cfg->max_len)
+ * @param out_score Length-normalised log probability of that hypothesis
+ * @return Number of tokens written to out_tokens; 0 without touching
+ * out_score when max_len is 0 or BOS and the prefix already fill the model's
+ * positions; -1 when memory runs out
+ */
+int beam_search(const int *src_tokens, int L_src,
+                const TransformerParams *params, const BeamSearchConfig *cfg,
+                int *out_tokens, float *out_score);
+
+#endif
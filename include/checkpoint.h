@@ -0,0 +1,85 @@
+// on-disk checkpoints, memory-mapped, optionally paged in layer by layer
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "transformer.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * @brief Write params to path: a small versioned header, then the tensors in
+ * the packed layout of pack_transformer_params. Tensors are streamed one by
+ * one, so no second copy of the model is held in memory.
+ * @return 0 on success, -1 on I/O error (errno set)
+ */
+int save_checkpoint(const TransformerParams *params, const char *path);
+
+/**
+ * @brief Keeps a window of decoder / encoder layers of a mapped checkpoint
+ * resident. Entering layer i asks a background thread to read layer i+1
+ * (madvise WILLNEED, then one touch per page) while i computes, and drops the
+ * least recently used layers beyond the window from memory. Layers run
+ * encoder 0 .. N-1, then decoder 0 .. N-1; the decoder stack is followed by
+ * decoder 0 again since decode steps repeat it. Embeddings and the output
+ * projection stay resident.
+ */
+typedef struct LayerPager {
+  char *base; // Mapping of the whole file
+  size_t bytes;
+  int fd;
+  int num_units;   // 2 * num_layers: encoder layers, then decoder layers
+  size_t *start;   // Per unit: byte range in the file
+  size_t *end;
+  int max_resident; // Units kept in memory, the running one included
+
+  unsigned long long *last_used; // Per unit, 0: not resident
+  unsigned long long tick;
+  int prefetch_unit; // Waiting for the background thread, -1 for none
+  int stop;
+
+  // Counters
+  unsigned long long prefetches;
+  unsigned long long releases;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+} LayerPager;
+
+/**
+ * @brief A model read from a checkpoint through mmap: pages are loaded on
+ * first use and, being clean file pages, the kernel can drop them again, so
+ * the model does not have to fit in RAM.
+ *
+ * params points into the mapping and is usable with every forward /
+ * generation function; release it with close_checkpoint, never
+ * free_transformer_params. With paging on, params.pager points into this
+ * struct, so it must not be moved or copied while open.
+ */
+typedef struct {
+  TransformerParams params;
+  void *base; // Mapping of the whole file
+  size_t bytes;
+  int fd;
+  int paged; // pager is running
+  LayerPager pager;
+} Checkpoint;
+
+/**
+ * @param resident_layers Layers to keep in memory at once when streaming
+ * (at least 2: the running one and the one being read); 0 maps the file
+ * without paging and lets the kernel keep what it can
+ * @return 0 on success, -1 if the file is missing, truncated or not a
+ * checkpoint of this format (errno set)
+ */
+int open_checkpoint(Checkpoint *ck, const char *path, int resident_layers);
+void close_checkpoint(Checkpoint *ck);
+
+// Which layer loop is calling layer_pager_enter
+typedef enum { PAGER_ENCODER, PAGER_DECODER } PagerStack;
+
+// Called by the forward passes before they run a layer
+void layer_pager_enter(LayerPager *pager, PagerStack stack, int layer);
+
+#endif
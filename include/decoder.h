@@ -4,6 +4,7 @@
 
 #include "attention.h"
 #include "feedforward.h"
+#include "kv_cache.h"
 #include "layernorm.h"
 
 typedef struct {
@@ -25,4 +26,25 @@ void compute_decoder_layer(const float *dec_input, const float *enc_output,
                            int L_dec, int L_enc, int d_model, int d_ff,
                            int num_heads);
 
+/**
+ * @brief Project the encoder output into this layer's cross-attention keys and
+ * values (L_enc x d_model each). Done once per source sentence.
+ */
+void compute_decoder_cross_kv(const float *enc_output,
+                              const DecoderLayerParams *params, float *K,
+                              float *V, int L_enc, int d_model, int num_heads);
+
+/**
+ * @brief Incremental decoder layer over n new rows.
+ * Row b is the token at position positions[b] of cache slot slots[b]; its
+ * self-attention keys/values are appended to the cache and it attends to
+ * every cached position <= positions[b] of that slot. Several rows may belong
+ * to the same slot as long as their positions are consecutive.
+ */
+void compute_decoder_layer_step(const float *dec_input,
+                                const DecoderLayerParams *params,
+                                KVCache *cache, int layer, const int *slots,
+                                const int *positions, float *dec_output, int n,
+                                int d_model, int d_ff, int num_heads);
+
 #endif
@@ -0,0 +1,74 @@
+// LRU cache of encoder outputs keyed by source tokens
+#ifndef ENCODER_CACHE_H
+#define ENCODER_CACHE_H
+
+#include "kv_cache.h"
+#include "transformer.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+typedef struct EncoderCacheEntry {
+  const TransformerParams *params; // Model that produced the output
+  unsigned long long hash;
+  int *tokens;
+  int L_src;
+  float *enc_output; // L_src x d_model
+  CrossKV cross;     // Only filled when the cache stores cross K/V
+  size_t bytes;
+
+  struct EncoderCacheEntry *prev, *next; // LRU list, head is most recent
+  struct EncoderCacheEntry *chain;       // Hash bucket chain
+} EncoderCacheEntry;
+
+typedef struct {
+  int num_layers;
+  int d_model;
+  int store_cross_kv; // Also keep each layer's projected cross-attention K/V
+
+  size_t max_bytes;
+  size_t bytes;
+  int count;
+
+  int num_buckets;
+  EncoderCacheEntry **buckets;
+  EncoderCacheEntry *head, *tail;
+
+  // Counters
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long evictions;
+
+  pthread_mutex_t mutex; // Guards the entries, LRU list and counters
+} EncoderCache;
+
+unsigned long long hash_tokens(const int *tokens, int L);
+
+// 0, or -1 when out of memory
+int init_encoder_cache(EncoderCache *cache, const TransformerConfig *config,
+                       size_t max_bytes, int store_cross_kv);
+void free_encoder_cache(EncoderCache *cache);
+
+/**
+ * @brief Encoder output (and/or cross K/V) for a source sentence, served from
+ * the cache when the same model saw the same tokens before. A hit skips the
+ * encoder entirely, and also the cross K/V projection when those are stored.
+ * Misses are inserted, evicting least recently used entries to stay under
+ * max_bytes; a miss that cannot be copied for lack of memory is just not
+ * cached.
+ *
+ * Entries are keyed by params as well as the tokens, so several models (a
+ * draft and its target) can share one cache; a model whose d_model or layer
+ * count differs from the cache's bypasses it. Every call takes the cache's
+ * mutex, so threads can share it too; the encoder runs outside the lock.
+ * @param cache May be NULL, in which case everything is computed
+ * @param enc_output Optional (L_src x d_model) copy of the encoder output
+ * @param ckv Optional cross K/V, initialised with init_cross_kv for L_src
+ * @return 0, or -1 when enc_output is NULL and its temporary cannot be
+ * allocated (nothing is computed)
+ */
+int compute_encoder_cached(EncoderCache *cache, const int *src_tokens,
+                           int L_src, const TransformerParams *params,
+                           float *enc_output, CrossKV *ckv);
+
+#endif
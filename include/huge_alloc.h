@@ -0,0 +1,55 @@
+// huge-page backed, cache-line aligned allocation for weights and workspaces
+#ifndef HUGE_ALLOC_H
+#define HUGE_ALLOC_H
+
+#include <stddef.h>
+
+#define HUGE_ALLOC_ALIGN 64
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+typedef enum {
+  HUGE_PAGES_OFF,    // Aligned heap memory only
+  HUGE_PAGES_THP,    // 2MB-aligned mappings advised with MADV_HUGEPAGE
+  HUGE_PAGES_HUGETLB // MAP_HUGETLB from the reserved pool, THP when it is empty
+} HugePageMode;
+
+/**
+ * @brief How blocks of at least HUGE_PAGE_SIZE are backed. Defaults to
+ * HUGE_PAGES_THP; the TRANSFORMER_HUGEPAGES environment variable
+ * (off / thp / hugetlb) overrides it on first use. Only affects later
+ * allocations.
+ */
+HugePageMode huge_pages_mode(void);
+void huge_pages_set_mode(HugePageMode mode);
+
+/**
+ * @brief HUGE_ALLOC_ALIGN-aligned block. Blocks of HUGE_PAGE_SIZE and up get
+ * their own mapping starting on a huge-page boundary, so the TLB covers them
+ * with 2MB entries; smaller ones come from the heap. Falls back to normal
+ * pages whenever the kernel refuses huge pages.
+ * @return NULL when out of memory
+ */
+void *huge_alloc(size_t bytes);
+// Zero-filled huge_alloc
+void *huge_calloc(size_t count, size_t size);
+// Accepts NULL and plain malloc'ed pointers too
+void huge_free(void *p);
+
+/**
+ * @brief Give the whole pages inside [p, p + bytes) back to the kernel
+ * (MADV_DONTNEED) without freeing the block: it stays valid, reads back as
+ * zeros and is faulted in again on the next write. For idle buffers whose
+ * contents are no longer needed; works on any heap or huge_alloc block.
+ */
+void huge_release(void *p, size_t bytes);
+
+// Live bytes in huge-page mappings. Whether the kernel actually backed the
+// THP ones with 2MB pages shows in /proc/self/smaps (AnonHugePages).
+typedef struct {
+  size_t thp_bytes;
+  size_t hugetlb_bytes;
+} HugeAllocStats;
+
+void huge_alloc_stats(HugeAllocStats *stats);
+
+#endif
@@ -0,0 +1,115 @@
+// runtime-selectable compute kernels (GEMM, softmax, norm, activation)
+#ifndef KERNELS_H
+#define KERNELS_H
+
+typedef enum {
+  KERNEL_REFERENCE, // plain loops, the correctness oracle
+  KERNEL_BLOCKED,   // cache-blocked GEMM
+  KERNEL_SIMD,      // AVX2/FMA, x86-64 hosts that support it
+  KERNEL_BLAS,      // OpenBLAS builds only; one OpenBLAS thread per pool task
+  KERNEL_NUM_BACKENDS
+} KernelBackend;
+
+// Name accepted by kernels_select_by_name besides the backend names
+#define KERNEL_AUTO_NAME "auto"
+
+typedef struct {
+  const char *name;
+
+  // C (M x N) = A (M x K) * B (K x N); row-major with row strides
+  void (*gemm)(const float *A, int lda, const float *B, int ldb, float *C,
+               int ldc, int M, int N, int K);
+  // C (M x N) = A (M x K) * B^T, with B stored as (N x K)
+  void (*gemm_nt)(const float *A, int lda, const float *B, int ldb, float *C,
+                  int ldc, int M, int N, int K);
+  // Row-wise softmax; out may alias in
+  void (*softmax)(const float *in, float *out, int rows, int cols);
+  // Row-wise layer normalization with per-column gamma / beta
+  void (*layernorm)(const float *in, const float *gamma, const float *beta,
+                    float *out, int rows, int cols);
+  // In-place GELU (tanh approximation) over n values
+  void (*gelu)(float *x, int n);
+} KernelTable;
+
+/**
+ * @brief Table of one backend.
+ * @return NULL when the backend is not compiled in or the CPU lacks support
+ */
+const KernelTable *kernel_backend_table(KernelBackend backend);
+const char *kernel_backend_name(KernelBackend backend);
+
+/**
+ * @brief Kernels used by the model. Defaults to automatic selection (the
+ * per-shape-class winners of kernels_calibrate, or the fastest backend
+ * expected on this host before calibration). The TRANSFORMER_KERNELS
+ * environment variable ("reference", "blocked", "simd", "blas" or "auto")
+ * overrides the default on first use. Selection, calibration and tile
+ * updates may run while other threads use the kernels.
+ */
+const KernelTable *kernels(void);
+
+// Route every kernel through one backend; -1 if it is unavailable
+int kernels_select(KernelBackend backend);
+// Backend name or "auto"; -1 if unknown or unavailable
+int kernels_select_by_name(const char *name);
+// Back to automatic per-shape selection
+void kernels_select_auto(void);
+
+/**
+ * @brief Time every available backend on representative shapes and keep the
+ * fastest one per GEMM shape class and per row-wise op for automatic
+ * selection. Takes a fraction of a second; call once at startup.
+ * @param verbose Print the winners to stderr
+ * @return 0, or -1 when out of memory (the choices are left unchanged)
+ */
+int kernels_calibrate(int verbose);
+
+/**
+ * @brief Cache tiles of the blocked and SIMD GEMMs: MC rows of A, NC columns
+ * of B and KC along the shared dimension per block; 0 leaves a dimension
+ * untiled. Tiles are kept per backend and per GEMM shape class.
+ */
+typedef struct {
+  int mc, nc, kc;
+} GemmTiles;
+
+typedef struct {
+  int M, N, K;
+} GemmShape;
+
+// Suggested tile cache file for applications. Nothing is read implicitly:
+// kernels() loads tiles on first use only from the file named by the
+// TRANSFORMER_TILE_CACHE environment variable, otherwise call
+// kernels_load_tiles
+#define KERNEL_TILE_CACHE_DEFAULT "transformer_tiles.cache"
+
+// Tiles the backend uses for an (M x N x K) product
+GemmTiles kernels_gemm_tiles(KernelBackend backend, int M, int N, int K);
+// Override the tiles of the shape class that (M x N x K) belongs to
+void kernels_set_gemm_tiles(KernelBackend backend, int M, int N, int K,
+                            GemmTiles tiles);
+
+/**
+ * @brief Benchmark candidate MC / NC / KC tiles for the blocked and SIMD
+ * GEMMs on the given shapes (the ones the model actually runs) and keep the
+ * fastest per shape class. Seconds to a minute depending on the shapes;
+ * persist the result with kernels_save_tiles.
+ * @param verbose Print the winners to stderr
+ * @return 0, or -1 when out of memory (the tiles are left unchanged)
+ */
+int kernels_autotune(const GemmShape *shapes, int n_shapes, int verbose);
+
+/**
+ * @brief Write the tuned tiles, tagged with the host CPU model.
+ * @return 0 on success, -1 if the file cannot be written
+ */
+int kernels_save_tiles(const char *path);
+
+/**
+ * @brief Load tiles written by kernels_save_tiles.
+ * @return 0 on success, -1 if the file is missing, malformed or was tuned on
+ * a different CPU model (the current tiles are then left unchanged)
+ */
+int kernels_load_tiles(const char *path);
+
+#endif
@@ -0,0 +1,70 @@
+// key/value caches for incremental decoding
+#ifndef KV_CACHE_H
+#define KV_CACHE_H
+
+typedef struct {
+  int num_layers;
+  int d_model;
+  int L_src;
+
+  // Cross-attention keys/values projected from the encoder output, one
+  // (L_src x d_model) matrix per decoder layer. Head h occupies columns
+  // [h * d_k, (h + 1) * d_k).
+  float **K;
+  float **V;
+} CrossKV;
+
+typedef struct {
+  int num_layers;
+  int d_model;
+  int num_slots;
+  int max_len;
+
+  // Self-attention keys/values, one (num_slots x max_len x d_model) block per
+  // decoder layer. Same head layout as CrossKV.
+  float **K;
+  float **V;
+
+  int *len;              // Positions already cached, per slot
+  const CrossKV **cross; // Encoder context each slot attends to
+
+  // Staging area for kv_cache_reorder (one layer worth of K or V)
+  float *scratch;
+  int *scratch_len;
+  const CrossKV **scratch_cross;
+} KVCache;
+
+// Legacy setup helpers: print and exit when memory runs out. Library code
+// uses create_cross_kv / create_kv_cache instead.
+void init_cross_kv(CrossKV *ckv, int num_layers, int d_model, int L_src);
+void free_cross_kv(CrossKV *ckv);
+
+void init_kv_cache(KVCache *cache, int num_layers, int d_model, int num_slots,
+                   int max_len);
+void free_kv_cache(KVCache *cache);
+
+// Like init_cross_kv / init_kv_cache, but return -1 (nothing left allocated)
+// instead of exiting when memory runs out
+int create_cross_kv(CrossKV *ckv, int num_layers, int d_model, int L_src);
+int create_kv_cache(KVCache *cache, int num_layers, int d_model, int num_slots,
+                    int max_len);
+
+// Empty a slot and attach it to an encoder context
+void kv_cache_reset_slot(KVCache *cache, int slot, const CrossKV *cross);
+
+// Empty every slot and return the cached keys/values to the kernel
+// (huge_release); the buffers stay allocated and are refilled on reuse
+void kv_cache_release(KVCache *cache);
+void cross_kv_release(CrossKV *ckv);
+
+// Roll a slot back to its first len positions (no-op if already shorter)
+void kv_cache_truncate(KVCache *cache, int slot, int len);
+
+/**
+ * @brief Rebuild slots 0..n-1 from the given parents: slot i takes over the
+ * cached state of slot parents[i]. Slots whose parent is themselves are left
+ * untouched, so surviving beams cost nothing.
+ */
+void kv_cache_reorder(KVCache *cache, const int *parents, int n);
+
+#endif
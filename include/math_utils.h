@@ -16,4 +16,12 @@ void compute_mean_variance(const float *M, int size, float *mean_out,
 
 void apply_gelu(float *M, int rows, int cols);
 
+void log_softmax_rows(const float *scores, float *out, int rows, int cols);
+
+// Bounded min-heap keeping the k largest values pushed so far.
+// vals[0] is always the smallest kept value.
+void topk_push(float *vals, int *ids, int *count, int k, float val, int id);
+// Sort a heap filled by topk_push into descending order (in place).
+void topk_sort(float *vals, int *ids, int count);
+
 #endif
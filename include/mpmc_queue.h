@@ -0,0 +1,47 @@
+// bounded lock-free multi-producer / multi-consumer queue of pointers
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stddef.h>
+
+#define MPMC_CACHE_LINE 64
+
+typedef struct {
+  size_t seq; // Ticket of the push (or pop) allowed to use this cell next
+  void *item;
+} MpmcCell;
+
+/**
+ * @brief Vyukov-style ring: every cell carries a sequence number, so a push
+ * or pop claims a position with one compare-and-swap and never takes a lock.
+ * The two cursors sit on separate cache lines so producers and consumers do
+ * not false-share.
+ */
+typedef struct {
+  MpmcCell *cells;
+  size_t mask; // capacity - 1, capacity a power of two
+
+  char pad0[MPMC_CACHE_LINE];
+  size_t head; // Next push position
+  char pad1[MPMC_CACHE_LINE];
+  size_t tail; // Next pop position
+  char pad2[MPMC_CACHE_LINE];
+} MpmcQueue;
+
+// Capacity is rounded up to a power of two (at least 2)
+void init_mpmc_queue(MpmcQueue *q, size_t capacity);
+void free_mpmc_queue(MpmcQueue *q);
+
+// Non-blocking; 0 on success, -1 when the queue is full / empty
+int mpmc_try_push(MpmcQueue *q, void *item);
+int mpmc_try_pop(MpmcQueue *q, void **item);
+
+// Block (spin, then yield, then sleep) until there is room / an item
+void mpmc_push(MpmcQueue *q, void *item);
+void *mpmc_pop(MpmcQueue *q);
+
+// One step of that wait, for callers polling some other condition; start
+// *attempt at 0
+void mpmc_backoff(int *attempt);
+
+#endif
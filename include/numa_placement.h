@@ -0,0 +1,62 @@
+// NUMA topology, thread pinning and weight placement
+#ifndef NUMA_PLACEMENT_H
+#define NUMA_PLACEMENT_H
+
+#include "transformer.h"
+
+#include <stddef.h>
+
+// Nodes handled (one 64-bit node mask)
+#define NUMA_MAX_NODES 64
+
+/**
+ * @brief Nodes on this host, from /sys/devices/system/node. 1 when the
+ * kernel exposes no NUMA information; node ids are 0 .. count - 1 (a missing
+ * id simply has no CPUs).
+ */
+int numa_node_count(void);
+
+// CPU ids of a node, up to max_cpus of them; returns how many were written
+int numa_node_cpus(int node, int *cpus, int max_cpus);
+
+// Node the calling thread is running on (0 if unknown)
+int numa_current_node(void);
+
+// Pin the calling thread to one CPU / to every CPU of a node; 0 or -1
+int pin_thread_to_cpu(int cpu);
+int pin_thread_to_node(int node);
+
+/**
+ * @brief Online CPUs ordered node by node (all of node 0, then node 1, ...),
+ * the order in which pinned pool threads are placed so that neighbouring
+ * workers share a socket.
+ * @return Number of CPUs written (at most max_cpus)
+ */
+int numa_cpu_order(int *cpus, int max_cpus);
+
+/**
+ * @brief Move existing weight pages: spread them round-robin over every node
+ * (interleave) or onto one node (bind). Only whole pages inside each tensor
+ * move; tensors smaller than a page stay where they are.
+ * @return 0 on success, -1 if the kernel refused (no NUMA support, sandbox)
+ */
+int numa_interleave_params(TransformerParams *params);
+int numa_bind_params(TransformerParams *params, int node);
+
+/**
+ * @brief One read-only copy of the weights per node, each allocated on its
+ * node, so threads bound to a node only read local memory. Costs one model's
+ * memory per node.
+ */
+typedef struct {
+  int num_nodes;
+  TransformerParams *replicas; // Per node
+} ParamsReplicas;
+
+void init_params_replicas(ParamsReplicas *r, const TransformerParams *params);
+void free_params_replicas(ParamsReplicas *r);
+
+// The calling thread's local replica
+const TransformerParams *params_replica_local(const ParamsReplicas *r);
+
+#endif
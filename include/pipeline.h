@@ -0,0 +1,77 @@
+// encoder / decoder pipelining across requests
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "kv_cache.h"
+#include "mpmc_queue.h"
+#include "numa_placement.h"
+#include "sampling.h"
+#include "transformer.h"
+
+#include <pthread.h>
+
+typedef struct PipelineRequest {
+  // Set by the caller
+  const int *src_tokens;
+  int L_src;
+  SamplingConfig sampling;
+  int *out_tokens; // At least sampling.max_len entries
+  void *user;      // Passed through untouched
+
+  // Set by the pipeline
+  int n_out; // Tokens written to out_tokens; -1 when memory ran out
+  int done;  // Nonzero once n_out / out_tokens are final (see pipeline_wait)
+  CrossKV ckv;
+} PipelineRequest;
+
+// Runs on a decoder worker once a request is finished, just before its done
+// flag is raised
+typedef void (*PipelineCallback)(PipelineRequest *req, void *arg);
+
+typedef struct {
+  int encoder_threads;
+  int decoder_threads;
+  int queue_capacity; // Per stage; pipeline_submit blocks while it is full
+  PipelineCallback on_done; // Optional
+  void *on_done_arg;
+
+  // NUMA placement (numa_placement.h): with numa_bind set, each group is
+  // pinned to the CPUs of its node. With replicas given, workers read the
+  // weights of the node they run on instead of init_pipeline's params, and
+  // the thread pool is split per node for the pipeline's lifetime
+  // (thread_pool_set_node_pools) so that their loops stay local too.
+  int numa_bind;
+  int encoder_node, decoder_node;
+  const ParamsReplicas *replicas; // Optional
+} PipelineConfig;
+
+/**
+ * @brief Two worker groups joined by bounded lock-free queues: encoder
+ * workers turn submitted requests into cross K/V, decoder workers run the
+ * autoregressive loop on them. While request n decodes, the encoder of
+ * request n+1 (and of everything queued behind it) already runs on another
+ * core. Output matches generate_sampled for the same request.
+ *
+ * Caches in a request's SamplingConfig are not thread-safe: encoder_cache
+ * needs encoder_threads == 1 and prefix_cache needs decoder_threads == 1.
+ */
+typedef struct {
+  const TransformerParams *params;
+  PipelineConfig config;
+
+  MpmcQueue submitted; // Waiting for an encoder worker
+  MpmcQueue encoded;   // Cross K/V ready, waiting for a decoder worker
+  pthread_t *threads;  // Encoder workers first
+} Pipeline;
+
+void init_pipeline(Pipeline *p, const TransformerParams *params,
+                   const PipelineConfig *config);
+// Finishes every submitted request, then stops the workers
+void free_pipeline(Pipeline *p);
+
+// Queue a request; it must stay valid until done
+void pipeline_submit(Pipeline *p, PipelineRequest *req);
+// Block until the request is done
+void pipeline_wait(PipelineRequest *req);
+
+#endif
@@ -0,0 +1,28 @@
+// positional encodings computed from the position instead of a table
+#ifndef POSITIONAL_H
+#define POSITIONAL_H
+
+// Wavelength scale of the sinusoidal encoding (Vaswani et al.)
+#define POSITIONAL_BASE 10000.0
+
+/**
+ * @brief Sinusoidal encoding of each row's position: column 2j holds
+ * sin(pos * POSITIONAL_BASE^(-2j / dim)), column 2j + 1 the cosine of the
+ * same angle. Consecutive positions are stepped with the angle-addition
+ * identities (in double, across all frequencies at once) instead of calling
+ * sin / cos per element.
+ * @param positions Position of each row, or NULL for 0..n-1
+ * @param out Result (n x dim)
+ */
+void sinusoidal_table(const int *positions, int n, int dim, float *out);
+
+/**
+ * @brief Rotary embedding: rotate every pair (2j, 2j + 1) of each row by the
+ * angle whose (sin, cos) sit at the same columns of table, as written by
+ * sinusoidal_table for dim = d_k. An odd last column is left as is.
+ * @param x n rows of d_k values, row_stride floats apart, rotated in place
+ */
+void apply_rotary(float *x, int row_stride, const float *table, int n,
+                  int d_k);
+
+#endif
@@ -0,0 +1,85 @@
+// shared decoder-prefix cache
+#ifndef PREFIX_CACHE_H
+#define PREFIX_CACHE_H
+
+#include "kv_cache.h"
+#include "transformer.h"
+
+#include <stddef.h>
+
+typedef struct PrefixNode {
+  int token;
+  float *kv;     // Per layer: K row then V row (num_layers x 2 x d_model)
+  float *hidden; // Final decoder output at this position (d_model)
+  unsigned long long last_used;
+
+  // Roots only: source sentence whose encoder context the subtree shares
+  unsigned long long key; // hash_tokens(src, L_src)
+  int *src;
+  int L_src;
+
+  struct PrefixNode *parent;   // NULL for roots
+  struct PrefixNode *children; // First child
+  struct PrefixNode *sibling;  // Next child of the same parent / next root
+  struct PrefixNode *prev, *next; // Leaves only: LRU list, head is most recent
+} PrefixNode;
+
+typedef struct {
+  int num_layers;
+  int d_model;
+
+  size_t max_bytes;
+  size_t bytes;
+  int num_nodes;
+
+  PrefixNode *roots; // One trie per encoder context
+  PrefixNode *head, *tail; // Leaves, least recently used at the tail
+  unsigned long long tick;
+
+  // Counters
+  unsigned long long lookups;
+  unsigned long long hit_tokens;  // Positions restored from the cache
+  unsigned long long miss_tokens; // Positions that had to be computed
+  unsigned long long evictions;
+} PrefixCache;
+
+void init_prefix_cache(PrefixCache *cache, const TransformerConfig *config,
+                       size_t max_bytes);
+void free_prefix_cache(PrefixCache *cache);
+
+/**
+ * @brief Copy the longest cached prefix of tokens into an empty cache slot.
+ * Decoder self-attention state depends on the encoder output through every
+ * cross-attention layer, so prefixes are only shared between identical
+ * source sentences.
+ * @param src Source tokens the slot's cross-attention K/V were computed from
+ * @param hidden Decoder output of the last restored position (may be NULL)
+ * @return Number of positions restored
+ */
+int prefix_cache_restore(PrefixCache *cache, const int *src, int L_src,
+                         const int *tokens, int n, KVCache *kv, int slot,
+                         float *hidden);
+
+/**
+ * @brief Record positions [start, n) of a slot's cached tokens.
+ * Positions before start must already be in the trie. Best effort: when
+ * memory runs out, only the positions recorded so far are kept.
+ * @param hidden Decoder outputs of positions start..n-1
+ */
+void prefix_cache_insert(PrefixCache *cache, const int *src, int L_src,
+                         const int *tokens, int start, int n,
+                         const KVCache *kv, int slot, const float *hidden);
+
+/**
+ * @brief Feed a forced decoder prefix into an empty slot, reusing whatever is
+ * cached and computing only the divergent suffix in one decoder pass.
+ * @param cache May be NULL to compute everything
+ * @param hidden_last Decoder output of the last prefix token (d_model)
+ * @return Number of positions served from the cache, or -1 when out of memory
+ * (the slot then holds only the restored positions)
+ */
+int decoder_prefill(const TransformerParams *params, PrefixCache *cache,
+                    const int *src, int L_src, KVCache *kv, int slot,
+                    const int *tokens, int n, float *hidden_last);
+
+#endif
@@ -0,0 +1,90 @@
+// per-op timing, tracing and summaries
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+
+typedef enum {
+  OP_EMBEDDING,
+  OP_QKV_PROJECTION,
+  OP_ATTN_SCORES,
+  OP_ATTN_SOFTMAX,
+  OP_ATTN_OUTPUT,
+  OP_ATTN_CACHED, // scores + softmax + output fused over the KV cache
+  OP_ATTN_OUT_PROJECTION,
+  OP_FFN_GEMM1,
+  OP_FFN_GELU,
+  OP_FFN_GEMM2,
+  OP_LAYERNORM,
+  OP_OUTPUT_PROJECTION,
+  OP_COUNT
+} ProfOp;
+
+typedef enum { PROF_MODEL, PROF_ENCODER, PROF_DECODER } ProfStack;
+
+// Events kept per run; later ones are counted as dropped
+#define PROF_MAX_EVENTS (1 << 20)
+
+typedef struct {
+  unsigned char op;
+  unsigned char stack;
+  short layer;
+  int tid;
+  long long start_ns;
+  long long dur_ns;
+  // Analytic work of the call: floating point ops and the minimum bytes
+  // moved (every operand read once, every result written once)
+  double flops;
+  double bytes;
+} ProfEvent;
+
+long long prof_now_ns(void);
+void prof_set_layer(ProfStack stack, int layer);
+void prof_record(ProfOp op, long long start_ns, double flops, double bytes);
+const char *prof_op_name(ProfOp op);
+
+// Drop every recorded event
+void prof_reset(void);
+int prof_num_events(void);
+
+/**
+ * @brief Write the recorded events as Chrome / Perfetto trace JSON
+ * (chrome://tracing, ui.perfetto.dev). One complete event per op call,
+ * tagged with its encoder/decoder layer.
+ * @return 0 on success, -1 if the file could not be written
+ */
+int prof_write_chrome_trace(const char *path);
+
+/**
+ * @brief Per-op call counts, total/mean time and share of the profiled time,
+ * with achieved GFLOP/s, GB/s and arithmetic intensity (FLOP per byte).
+ * Compare the intensity with the host's peak FLOP/s over peak bandwidth to
+ * tell compute-bound ops from bandwidth-bound ones.
+ */
+void prof_print_summary(FILE *out);
+
+// The same figures aggregated per encoder/decoder layer
+void prof_print_layer_summary(FILE *out);
+
+// Cost of C (M x N) = A (M x K) * B (K x N) in fp32
+#define PROF_GEMM_FLOPS(M, N, K) (2.0 * (M) * (N) * (K))
+#define PROF_GEMM_BYTES(M, N, K)                                               \
+  (4.0 * ((double)(M) * (K) + (double)(K) * (N) + (double)(M) * (N)))
+
+// Instrumentation is compiled out unless built with -DENABLE_PROFILING
+// (see `make profile`).
+// The cost expressions of PROF_END_COST are not evaluated in that case.
+#ifdef ENABLE_PROFILING
+#define PROF_BEGIN(op) long long prof_t0_##op = prof_now_ns()
+#define PROF_END(op) prof_record(op, prof_t0_##op, 0.0, 0.0)
+#define PROF_END_COST(op, flops, bytes)                                        \
+  prof_record(op, prof_t0_##op, flops, bytes)
+#define PROF_LAYER(stack, layer) prof_set_layer(stack, layer)
+#else
+#define PROF_BEGIN(op)
+#define PROF_END(op)
+#define PROF_END_COST(op, flops, bytes) ((void)sizeof((flops) + (bytes)))
+#define PROF_LAYER(stack, layer)
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+// token sampling fused with the output projection
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include "encoder_cache.h"
+#include "prefix_cache.h"
+#include "shortlist.h"
+#include "transformer.h"
+
+// Upper bound on candidates kept when top_k is 0 (top-p / plain sampling)
+#define SAMPLING_MAX_CANDIDATES 256
+// Vocabulary columns projected per tile of the fused GEMV
+#define SAMPLING_TILE 256
+
+// Receives each generated token as soon as it is sampled; a nonzero return
+// stops the generation after that token
+typedef int (*TokenCallback)(int token, void *arg);
+
+typedef struct {
+  float temperature; // <= 0 selects greedy decoding
+  int top_k;         // 0 disables top-k filtering
+  float top_p;       // >= 1 disables nucleus filtering
+  unsigned long long seed;
+
+  int max_len; // Maximum generated tokens (BOS excluded)
+  int bos_id;
+  int eos_id;
+
+  // Optional candidate vocabulary (must contain eos_id, as build_shortlist_ids
+  // ensures), NULL for full vocab
+  const VocabShortlist *shortlist;
+  // Optional cache of encoder outputs / cross K/V, NULL to always recompute
+  EncoderCache *encoder_cache;
+
+  // Optional forced decoder prefix fed after BOS (language tags, prompts)
+  const int *prefix;
+  int prefix_len;
+  // Optional cache of prefix decoder state, shared across requests
+  PrefixCache *prefix_cache;
+
+  // Optional streaming of the output, NULL to only fill out_tokens
+  TokenCallback on_token;
+  void *on_token_arg;
+} SamplingConfig;
+
+// xorshift64* generator, returns a float in [0, 1)
+float sampling_rand(unsigned long long *state);
+
+/**
+ * @brief Pick the next token from one decoder output row.
+ * Logits are produced tile by tile from output_projection (d_model x
+ * vocab_size) and folded straight into a running log-sum-exp and a bounded
+ * top-k heap, so the full vocabulary row is never materialised. When top_k is
+ * 0 only the SAMPLING_MAX_CANDIDATES most likely tokens can be drawn.
+ */
+int sample_from_hidden(const float *hidden, const float *output_projection,
+                       int d_model, int vocab_size, const SamplingConfig *cfg,
+                       unsigned long long *rng_state);
+
+/**
+ * @brief Autoregressive generation with the incremental KV cache. With
+ * cfg->on_token set, tokens are streamed as they are produced and the
+ * callback can cancel; the KV cache is freed before returning either way.
+ * @param out_tokens Generated tokens without BOS/prefix/EOS (at least
+ * cfg->max_len)
+ * @return Number of tokens written to out_tokens; 0 when max_len is 0 or BOS
+ * and the prefix already fill the model's positions; -1 when memory runs out
+ */
+int generate_sampled(const int *src_tokens, int L_src,
+                     const TransformerParams *params, const SamplingConfig *cfg,
+                     int *out_tokens);
+
+/**
+ * @brief Decoder half of generate_sampled, for callers that ran the encoder
+ * themselves (see pipeline.h). cfg->encoder_cache is not used.
+ * @param ckv Cross-attention K/V of the source sentence
+ * @param src_tokens Source the cross K/V belong to, keying the prefix cache
+ */
+int generate_from_cross(const CrossKV *ckv, const int *src_tokens, int L_src,
+                        const TransformerParams *params,
+                        const SamplingConfig *cfg, int *out_tokens);
+
+#endif
@@ -0,0 +1,124 @@
+// local inference server: binary protocol over a Unix domain socket
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "kv_cache.h"
+#include "mpmc_queue.h"
+#include "transformer.h"
+#include "workspace.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/un.h>
+
+/**
+ * Wire format, host byte order (both ends share the machine). A client sends
+ * any number of requests on one connection without waiting for the previous
+ * ones; every response frame carries the request_id it belongs to, so
+ * tokens of concurrent requests may interleave.
+ *
+ *   request:  ServerRequestHeader, then L_src int32 source tokens
+ *   response: ServerResponse frames: one SERVER_MSG_TOKEN per generated
+ *             token as soon as it is sampled, then SERVER_MSG_DONE (value:
+ *             tokens generated) or SERVER_MSG_ERROR (value: a TfStatus)
+ */
+#define SERVER_REQUEST_MAGIC 0x51524654u  // "TFRQ"
+#define SERVER_RESPONSE_MAGIC 0x53524654u // "TFRS"
+
+typedef struct {
+  uint32_t magic;
+  uint32_t request_id; // Chosen by the client, echoed in every response
+  uint32_t L_src;
+  uint32_t max_len; // Maximum generated tokens (BOS excluded)
+  int32_t bos_id;
+  int32_t eos_id;    // -1: stop on max_len only
+  float temperature; // <= 0: greedy
+  uint32_t top_k;
+  float top_p;
+  uint32_t reserved;
+  uint64_t seed;
+} ServerRequestHeader;
+
+typedef enum {
+  SERVER_MSG_TOKEN = 1,
+  SERVER_MSG_DONE = 2,
+  SERVER_MSG_ERROR = 3,
+} ServerMessage;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t type; // ServerMessage
+  uint32_t request_id;
+  int32_t value; // Token id, token count or status
+} ServerResponse;
+
+typedef struct {
+  int max_batch;      // Requests decoded together, one KV cache slot each
+  int queue_capacity; // Admitted but not yet scheduled; readers block beyond
+} ServerConfig;
+
+/**
+ * @brief One reader thread per connection parses requests into a bounded
+ * queue. A single scheduler thread owns the model: it moves queued requests
+ * into free cache slots (encoder + cross K/V), then runs one batched
+ * compute_decoder_step over every active slot, samples each row and streams
+ * the tokens out. Finished slots are refilled between steps, so short and
+ * long requests share batches (continuous batching). Each request yields the
+ * same tokens as generate_sampled with the same settings.
+ *
+ * A client that disconnects has its pending requests dropped at the next
+ * step. The scheduler's scratch comes from a workspace sized at start for a
+ * full batch of max_seq_len requests; should the heap still refuse an
+ * overflow, the affected requests end with SERVER_MSG_ERROR
+ * (TF_ERR_NO_MEMORY) and the server keeps going.
+ */
+typedef struct Server {
+  const TransformerParams *params;
+  ServerConfig config;
+  int listen_fd;
+  struct sockaddr_un addr; // Removed again by server_stop
+
+  MpmcQueue queue; // ServerRequest *, NULL stops the scheduler
+  pthread_t accept_thread, scheduler_thread;
+
+  // Scheduler state: one entry per cache slot
+  KVCache cache;                 // max_batch slots of max_seq_len
+  CrossKV *ckv;                  // Sized for max_seq_len
+  struct ServerRequest **active; // NULL when the slot is free
+  int *step_tokens, *step_slots; // Rows of the current step
+  float *hidden;                 // max_batch x d_model
+  float *enc_output;             // max_seq_len x d_model
+  Workspace ws;                  // Bound by the scheduler thread
+
+  // Open connections, so stopping can unblock their readers
+  struct ServerConn *conns;
+  int n_readers;
+  int stopping;
+  pthread_mutex_t mutex;
+  pthread_cond_t readers_done;
+
+  // Counters (scheduler thread)
+  unsigned long long requests, tokens;
+  unsigned long long steps, step_rows; // step_rows / steps: mean batch
+} Server;
+
+/**
+ * @brief Listen on path (an existing socket file is replaced) and start
+ * serving params, which must outlive the server.
+ * @return 0, or -1 if the socket cannot be bound, memory runs out or a
+ * thread cannot be started (errno set)
+ */
+int server_start(Server *s, const TransformerParams *params,
+                 const ServerConfig *config, const char *path);
+// Close every connection, drop queued and running requests, release
+// everything
+void server_stop(Server *s);
+
+// Client side. server_connect returns a socket (-1 on error); the others 0,
+// or -1 on error or a closed connection.
+int server_connect(const char *path);
+int server_send_request(int fd, const ServerRequestHeader *header,
+                        const int *src_tokens);
+int server_read_response(int fd, ServerResponse *response);
+
+#endif
@@ -0,0 +1,49 @@
+// model weights published once per host in POSIX shared memory
+#ifndef SHARED_PARAMS_H
+#define SHARED_PARAMS_H
+
+#include "transformer.h"
+
+#include <stddef.h>
+
+/**
+ * @brief A model whose tensors live in a named shared memory segment
+ * (shm_open) in the packed layout of pack_transformer_params. One process
+ * publishes, any number of worker processes attach; every attachment maps
+ * the same physical pages, so host memory grows with the number of models,
+ * not of workers. Attached mappings are read-only: a stray write faults
+ * instead of corrupting the other workers' weights.
+ *
+ * params is usable with every forward / generation function but must not
+ * be passed to free_transformer_params; release it with
+ * shared_params_detach.
+ */
+typedef struct {
+  TransformerParams params; // Tensors point into the mapping
+  void *base;               // Mapping (segment header first)
+  size_t bytes;
+} SharedParams;
+
+/**
+ * @brief Create segment `name` ("/model-a": a leading slash, no other) and
+ * copy src into it, then attach to it like a worker. Fails if the name is
+ * taken; remove stale segments with shared_params_unlink.
+ * @return 0 on success, -1 on error (errno from the failing call)
+ */
+int shared_params_publish(SharedParams *sp, const char *name,
+                          const TransformerParams *src);
+
+/**
+ * @brief Map a published segment read-only.
+ * @return 0 on success, -1 if it does not exist, is still being written or
+ * was written by an incompatible build
+ */
+int shared_params_attach(SharedParams *sp, const char *name);
+
+// Unmap; the segment itself stays until unlinked and every process detached
+void shared_params_detach(SharedParams *sp);
+
+// Remove the name; attached processes keep their mapping
+int shared_params_unlink(const char *name);
+
+#endif
@@ -0,0 +1,41 @@
+// vocabulary shortlist for the output projection
+#ifndef SHORTLIST_H
+#define SHORTLIST_H
+
+#include "transformer.h"
+
+typedef struct {
+  int d_model;
+  int size;
+  int *ids; // Vocabulary id of each shortlist column, ascending
+  float *W; // Gathered output_projection columns (d_model x size)
+} VocabShortlist;
+
+/**
+ * @brief Candidate vocabulary for one request: the source tokens plus a
+ * frequent-word list, deduplicated and sorted. BOS, EOS and the forced
+ * decoder prefix are always included, so decoding can still stop and the
+ * prompt stays representable. Ids outside [0, vocab_size) are skipped.
+ * @param eos_id -1 when decoding stops on length only
+ * @param out_ids At least L_src + n_frequent + prefix_len + 2 entries
+ * @return Number of ids written, or -1 when out of memory
+ */
+int build_shortlist_ids(const int *src_tokens, int L_src, const int *frequent,
+                        int n_frequent, int bos_id, int eos_id,
+                        const int *prefix, int prefix_len, int vocab_size,
+                        int *out_ids);
+
+// Gather the output_projection columns of ids once per request; 0, or -1
+// when out of memory or an id is outside the vocabulary
+int init_vocab_shortlist(VocabShortlist *sl, const TransformerParams *params,
+                         const int *ids, int size);
+void free_vocab_shortlist(VocabShortlist *sl);
+
+/**
+ * @brief Logits over the shortlist only: (L x d_model) * (d_model x size).
+ * Column j of out_logits is vocabulary token sl->ids[j].
+ */
+void compute_shortlist_logits(const float *hidden, const VocabShortlist *sl,
+                              float *out_logits, int L);
+
+#endif
@@ -0,0 +1,38 @@
+// speculative decoding with a draft model
+#ifndef SPECULATIVE_H
+#define SPECULATIVE_H
+
+#include "transformer.h"
+
+typedef struct {
+  int num_draft; // Tokens proposed by the draft model per round
+  int max_len;   // Maximum generated tokens (BOS excluded)
+  int bos_id;
+  int eos_id;
+} SpeculativeConfig;
+
+typedef struct {
+  int rounds;   // Target model passes
+  int proposed; // Draft tokens offered for verification
+  int accepted; // Draft tokens kept
+} SpeculativeStats;
+
+/**
+ * @brief Greedy generation where a small draft model proposes num_draft
+ * tokens that the target model verifies in one multi-token decoder pass.
+ * The longest prefix matching the target's own greedy choices is committed,
+ * followed by the target's token at the first mismatch, and both KV caches
+ * are rolled back past the rejected positions. Output is identical to greedy
+ * decoding with the target alone. Both models must share the vocabulary.
+ * @param out_tokens Generated tokens without BOS/EOS (at least cfg->max_len)
+ * @param stats Optional acceptance counters
+ * @return Number of tokens written to out_tokens, or -1 when memory runs out
+ * or the two vocabularies differ
+ */
+int speculative_generate(const int *src_tokens, int L_src,
+                         const TransformerParams *target,
+                         const TransformerParams *draft,
+                         const SpeculativeConfig *cfg, int *out_tokens,
+                         SpeculativeStats *stats);
+
+#endif
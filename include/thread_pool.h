@@ -0,0 +1,56 @@
+// work-stealing thread pool for intra-op parallelism
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Upper bound on pool threads (the calling thread included)
+#define THREAD_POOL_MAX_THREADS 256
+
+/**
+ * @brief Body of a parallel loop: iterations [begin, end) on pool thread
+ * `worker`, in [0, thread_pool_size()). A worker runs one chunk at a time,
+ * so worker-indexed scratch needs no locking.
+ */
+typedef void (*ParallelForFn)(void *ctx, int begin, int end, int worker);
+
+/**
+ * @brief Threads sharing a parallel_for, the caller included, and the bound
+ * on the worker index of any loop. Defaults to the online CPUs; the
+ * TRANSFORMER_THREADS environment variable overrides it on first use.
+ */
+int thread_pool_size(void);
+
+// Resize the pool, every node's with node pools (n <= 0: back to the
+// default). Not while a loop runs.
+void thread_pool_set_threads(int n);
+
+/**
+ * @brief Pin pool worker i to the i-th CPU of numa_cpu_order (node by node),
+ * so workers stop migrating and a pool smaller than the host stays on one
+ * socket. The calling thread is left as it is. Off by default;
+ * TRANSFORMER_PIN_THREADS=1 turns it on at first use. Not while a loop runs.
+ */
+void thread_pool_set_affinity(int pin);
+
+/**
+ * @brief Split the pool into one per NUMA node, the same threads in total,
+ * each kept on its node's CPUs. A loop runs on the pool of the node its
+ * calling thread is on, so a thread bound to a node and reading that node's
+ * weight replica (numa_placement.h) has its loops read local memory too, and
+ * groups on different nodes no longer wait for one shared pool. A no-op on a
+ * single node. Off by default; not while a loop runs.
+ */
+void thread_pool_set_node_pools(int on);
+
+/**
+ * @brief Run fn over [0, n) on the shared pool and return once every
+ * iteration is done. Each thread starts on a contiguous share and takes
+ * grain-sized chunks from its front; threads that run dry steal the back
+ * half of another thread's remainder, so uneven iterations (causal rows,
+ * ragged batches) still balance. Runs inline on the calling thread when n
+ * fits one grain, the pool has one thread, the call is nested in another
+ * loop, or another thread already owns the pool.
+ * @param grain Minimum iterations per chunk (at least 1)
+ */
+void parallel_for(int n, int grain, ParallelForFn fn, void *ctx);
+
+#endif
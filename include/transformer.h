@@ -3,6 +3,19 @@
 
 #include "decoder.h"
 #include "encoder.h"
+#include "kernels.h"
+#include "kv_cache.h"
+
+#include <stddef.h>
+
+struct LayerPager; // checkpoint.h
+
+// How token positions enter the model
+typedef enum {
+  POS_LEARNED = 0, // pos_encoding table added to the embeddings
+  POS_SINUSOIDAL,  // Sinusoidal encoding computed in the embedding gather
+  POS_ROTARY,      // Q / K of self-attention rotated by position (RoPE)
+} PositionalMode;
 
 typedef struct {
   int num_layers;
@@ -10,7 +23,8 @@ typedef struct {
   int d_ff;
   int num_heads;
   int vocab_size;
-  int max_seq_len;
+  int max_seq_len; // Length cap of POS_LEARNED; default capacity otherwise
+  PositionalMode pos_mode;
 } TransformerConfig;
 
 typedef struct {
@@ -18,7 +32,7 @@ typedef struct {
 
   // 1. Embeddings
   float *token_embedding; // Shape: vocab_size x d_model
-  float *pos_encoding;    // Shape: max_seq_len x d_model
+  float *pos_encoding;    // Shape: max_seq_len x d_model; POS_LEARNED only
 
   // 2. Encoder: Array of N layers
   EncoderLayerParams *encoder_layers;
@@ -28,6 +42,10 @@ typedef struct {
 
   // 4. Final Output Projection
   float *output_projection; // Shape: d_model x vocab_size
+
+  // Streams layer weights in and out of memory when the tensors live in a
+  // mapped checkpoint (checkpoint.h); NULL when they are all resident
+  struct LayerPager *pager;
 } TransformerParams;
 
 /**
@@ -35,14 +53,117 @@ typedef struct {
  * @param src_input Tokens for the source sentence (Encoder input)
  * @param tgt_input Tokens for the target sentence (Decoder input)
  * @param out_logits Final probability distribution over vocab
+ * @return 0, or -1 when the pass gave up (see compute_transformer_positions)
+ */
+int compute_transformer(const int *src_tokens, const int *tgt_tokens,
+                        const TransformerParams *params, float *out_logits,
+                        int L_src, int L_tgt);
+
+/**
+ * @brief Forward pass that only projects the requested target positions.
+ * @param positions Target rows to score (each in [0, L_tgt)), NULL for the
+ * first n_positions rows
+ * @param n_positions Entries in positions, at most L_tgt
+ * @param out_logits Logits in the order of positions (n_positions x vocab)
+ * @return 0; -1 without computing anything when a position or n_positions
+ * is out of range, or when the pass gave up (scratch_fail)
+ */
+int compute_transformer_positions(const int *src_tokens,
+                                  const int *tgt_tokens,
+                                  const TransformerParams *params,
+                                  const int *positions, int n_positions,
+                                  float *out_logits, int L_src, int L_tgt);
+
+/**
+ * @brief Run the encoder stack only.
+ * @param enc_output Final encoder context (L_src x d_model)
+ */
+void compute_encoder(const int *src_tokens, const TransformerParams *params,
+                     float *enc_output, int L_src);
+
+/**
+ * @brief Project decoder hidden states to vocabulary logits.
+ * @param hidden Decoder output (L x d_model)
+ * @param out_logits Result (L x vocab_size)
+ */
+void compute_logits(const float *hidden, const TransformerParams *params,
+                    float *out_logits, int L);
+
+/**
+ * @brief Fill every decoder layer's cross-attention keys/values for a source.
+ * @param ckv Initialised with init_cross_kv for enc_output's length
+ */
+void compute_cross_kv(const TransformerParams *params, const float *enc_output,
+                      CrossKV *ckv);
+
+/**
+ * @brief Incremental decoder pass over n new tokens, batched across slots.
+ * Token b is appended to cache slot slots[b]; a slot may receive several
+ * consecutive tokens in one call. Cache lengths are advanced on return.
+ * @param hidden Final decoder output for each new token (n x d_model)
  */
-void compute_transformer(const int *src_tokens, const int *tgt_tokens,
-                         const TransformerParams *params, float *out_logits,
-                         int L_src, int L_tgt);
+void compute_decoder_step(const int *tokens, const int *slots,
+                          const TransformerParams *params, KVCache *cache,
+                          float *hidden, int n);
+
+// Longest sequence the model can encode positions for: max_seq_len with a
+// learned table, unbounded (INT_MAX) when positions are computed
+int transformer_max_positions(TransformerConfig config);
+
+// Upper bound on the shapes written by transformer_gemm_shapes
+#define TRANSFORMER_MAX_GEMM_SHAPES 16
+
+/**
+ * @brief GEMM shapes of a forward pass over L rows and of a one-token decode
+ * step, the workload kernels_autotune should tune for.
+ * @param shapes Room for TRANSFORMER_MAX_GEMM_SHAPES entries
+ * @return Number of shapes written
+ */
+int transformer_gemm_shapes(TransformerConfig config, int L, GemmShape *shapes);
 
 // Lifecycle functions
 void init_transformer_params(TransformerParams *params,
                              TransformerConfig config);
 void free_transformer_params(TransformerParams *params);
+// Same weights as init_transformer_params, but returns -1 (nothing left
+// allocated) instead of exiting when memory runs out
+int create_transformer_params(TransformerParams *params,
+                              TransformerConfig config);
+
+// Called with the address of every weight pointer and its element count
+typedef void (*ParamTensorFn)(float **tensor, size_t count, void *ctx);
+
+/**
+ * @brief Visit every weight tensor of the model (embeddings, all layers,
+ * output projection), e.g. to move, copy or share them.
+ */
+void transformer_params_foreach(TransformerParams *params, ParamTensorFn fn,
+                                void *ctx);
+
+// Deep copy into fresh allocations; release with free_transformer_params
+void copy_transformer_params(TransformerParams *dst,
+                             const TransformerParams *src);
+
+// Alignment of each tensor inside a packed parameter block
+#define TRANSFORMER_PACK_ALIGN 64
+
+/**
+ * @brief Packed layout: every tensor back to back in foreach order, each
+ * starting on a TRANSFORMER_PACK_ALIGN boundary. One contiguous block that
+ * can live in a file or a shared mapping.
+ * @return Bytes of the packed block for this config
+ */
+size_t transformer_params_packed_bytes(TransformerConfig config);
+void pack_transformer_params(const TransformerParams *src, void *dst);
+
+/**
+ * @brief Point params at a packed block without copying it. Only the layer
+ * arrays are allocated; release them with free_transformer_params_view (not
+ * free_transformer_params), the block stays owned by the caller.
+ * @return 0, or -1 when the layer arrays cannot be allocated
+ */
+int view_transformer_params(TransformerParams *params,
+                            TransformerConfig config, void *packed);
+void free_transformer_params_view(TransformerParams *params);
 
 #endif
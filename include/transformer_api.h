@@ -0,0 +1,168 @@
+// embeddable C API: model and session handles, status codes, no allocation
+// after setup
+#ifndef TRANSFORMER_API_H
+#define TRANSFORMER_API_H
+
+#include <stddef.h>
+
+/**
+ * Every call returns a status instead of exiting, and validates its
+ * arguments (lengths, token ids, session state) before touching the model.
+ *
+ * Memory is only allocated by tf_model_* and tf_session_create. A session
+ * owns its KV cache, cross-attention K/V, output rows and a workspace sized
+ * for its maximum shapes, so tf_forward / tf_encode / tf_decode_step /
+ * tf_generate / tf_generate_stream never reach the heap afterwards (should a
+ * pass still not fit in the workspace, the call returns TF_ERR_NO_MEMORY and
+ * the session must be encoded again). Sessions
+ * are not thread-safe (tf_session_cancel aside); give each serving thread its
+ * own. Any number of sessions can share one model.
+ */
+
+typedef enum {
+  TF_OK = 0,
+  TF_ERR_INVALID_ARG, // NULL pointer, token id or length out of range
+  TF_ERR_NO_MEMORY,   // Setup, or a workspace overflow, could not allocate
+  TF_ERR_IO,          // Checkpoint or shared segment missing or unreadable
+  TF_ERR_CAPACITY,    // Request longer than the session was created for
+  TF_ERR_STATE,       // e.g. tf_decode_step before tf_encode
+  TF_ERR_CANCELLED,   // Stopped by a token callback or tf_session_cancel
+} TfStatus;
+
+// Static description of a status ("ok", "invalid argument", ...)
+const char *tf_status_string(TfStatus status);
+
+typedef struct TfModel TfModel;
+typedef struct TfSession TfSession;
+
+// How token positions are encoded
+typedef enum {
+  TF_POS_LEARNED = 0, // Learned table: sequences capped at max_seq_len
+  TF_POS_SINUSOIDAL,  // Computed sinusoidal encoding, no length cap
+  TF_POS_ROTARY,      // Rotary Q / K in self-attention, no length cap
+} TfPositional;
+
+typedef struct {
+  int num_layers;
+  int d_model;
+  int d_ff;
+  int num_heads;
+  int vocab_size;
+  int max_seq_len; // Default session length; the cap for TF_POS_LEARNED
+  TfPositional positional;
+} TfModelConfig;
+
+// Model with random weights (as init_transformer_params, seeded by rand())
+TfStatus tf_model_create_random(const TfModelConfig *config, TfModel **model);
+
+/**
+ * @brief Model mapped from a save_checkpoint file (checkpoint.h).
+ * @param resident_layers 0 to map everything, else layers kept in memory
+ * while streaming (at least 2)
+ */
+TfStatus tf_model_open(const char *path, int resident_layers,
+                       TfModel **model);
+
+// Model attached read-only from a segment published with
+// shared_params_publish (shared_params.h)
+TfStatus tf_model_attach_shared(const char *name, TfModel **model);
+
+// Destroy every session of the model first
+void tf_model_destroy(TfModel *model);
+
+TfStatus tf_model_config(const TfModel *model, TfModelConfig *config);
+
+typedef struct {
+  int max_src_len; // Longest source; 0 for the model's max_seq_len
+  int max_tgt_len; // Longest target / generation; 0 for max_seq_len
+  // Both may exceed max_seq_len unless positions come from a learned table
+} TfSessionConfig;
+
+/**
+ * @brief Allocate everything a session needs. The workspace is sized by one
+ * dry run at the maximum shapes, which also warms up the thread pool and
+ * kernel tables so the first real call does not pay for them.
+ */
+TfStatus tf_session_create(const TfModel *model, const TfSessionConfig *config,
+                           TfSession **session);
+void tf_session_destroy(TfSession *session);
+
+/**
+ * @brief Full forward pass, as compute_transformer.
+ * @param logits Result (L_tgt x vocab_size)
+ */
+TfStatus tf_forward(TfSession *session, const int *src, int L_src,
+                    const int *tgt, int L_tgt, float *logits);
+
+// Run the encoder on a source and start an empty target
+TfStatus tf_encode(TfSession *session, const int *src, int L_src);
+
+/**
+ * @brief Append one target token to the encoded source.
+ * @param logits Next-token logits (vocab_size), or NULL to skip the output
+ * projection
+ */
+TfStatus tf_decode_step(TfSession *session, int token, float *logits);
+
+typedef struct {
+  float temperature; // <= 0 selects greedy decoding
+  int top_k;         // 0 disables top-k filtering
+  float top_p;       // >= 1 disables nucleus filtering
+  unsigned long long seed;
+
+  int max_len; // Maximum generated tokens (BOS excluded)
+  int bos_id;
+  int eos_id; // -1: stop on max_len only
+} TfSamplingParams;
+
+/**
+ * @brief Encode src and sample until EOS, max_len tokens or the session's
+ * max_tgt_len. Same tokens as generate_sampled for the same settings.
+ * @param out Generated tokens without BOS / EOS (room for max_len)
+ * @param n_out Tokens written
+ */
+TfStatus tf_generate(TfSession *session, const int *src, int L_src,
+                     const TfSamplingParams *sampling, int *out, int *n_out);
+
+/**
+ * @brief Receives each token of tf_generate_stream as soon as it is sampled,
+ * before the next decode step starts. Return nonzero to cancel.
+ */
+typedef int (*TfTokenCallback)(int token, void *user);
+
+/**
+ * @brief tf_generate, delivering tokens through on_token instead of an
+ * array, for first-token latency. Cancelling (from the callback or with
+ * tf_session_cancel) returns TF_ERR_CANCELLED right after the current step
+ * and releases the session's caches as tf_session_release does.
+ * @param n_out Tokens delivered, cancelled or not; may be NULL
+ */
+TfStatus tf_generate_stream(TfSession *session, const int *src, int L_src,
+                            const TfSamplingParams *sampling,
+                            TfTokenCallback on_token, void *user, int *n_out);
+
+/**
+ * @brief Stop the generation running on the session at its next token. The
+ * one call that is safe from another thread; a call made while no
+ * generation runs is ignored.
+ */
+void tf_session_cancel(TfSession *session);
+
+/**
+ * @brief Forget the encoded source and hand the memory of the KV cache,
+ * cross K/V and workspace back to the kernel. Nothing is freed: the session
+ * stays usable and its next call faults the pages back in without
+ * allocating.
+ */
+TfStatus tf_session_release(TfSession *session);
+
+typedef struct {
+  size_t workspace_bytes;       // Arena reserved at creation
+  size_t workspace_peak;        // Most of it used so far
+  unsigned long long overflows; // Scratch requests that did not fit (their
+                                // calls returned TF_ERR_NO_MEMORY)
+} TfSessionStats;
+
+TfStatus tf_session_stats(const TfSession *session, TfSessionStats *stats);
+
+#endif
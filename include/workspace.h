@@ -0,0 +1,70 @@
+// preallocated scratch memory for the forward passes
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <stddef.h>
+
+typedef struct {
+  size_t offset; // From the workspace base
+  int freed;
+  void *heap; // Measuring workspaces: the heap buffer standing in for it
+} WorkspaceBlock;
+
+/**
+ * @brief Stack arena for the temporary buffers of one forward pass.
+ * Buffers are carved off the top and handed back when they and everything
+ * above them were freed, so out-of-order frees within a layer still unwind.
+ * A request that does not fit is refused (NULL) and counted in overflows;
+ * a bound arena never falls back to the heap.
+ *
+ * With capacity 0 the workspace only measures: every request goes to the
+ * heap while virtual blocks are pushed and unwound exactly as in an arena,
+ * so peak / peak_blocks are the high-water marks an arena would reach.
+ */
+typedef struct {
+  char *base;
+  size_t capacity;
+  size_t top;
+  WorkspaceBlock *blocks; // Live blocks, oldest first
+  int n_blocks, max_blocks;
+
+  // Stats
+  size_t peak;        // Highest top seen
+  int peak_blocks;    // Most blocks live at once
+  unsigned long long overflows; // Requests that did not fit
+  unsigned long long failed;    // scratch_fail calls while bound
+} Workspace;
+
+/**
+ * @brief Arena of the given size with room for max_blocks live buffers;
+ * both 0 for a measuring workspace.
+ * @return 0, or -1 when out of memory
+ */
+int init_workspace(Workspace *ws, size_t capacity, int max_blocks);
+void free_workspace(Workspace *ws);
+
+/**
+ * @brief Route scratch_alloc / scratch_free of the calling thread to ws (NULL
+ * for the heap) until the next bind.
+ * @return The previously bound workspace, to restore afterwards
+ */
+Workspace *workspace_bind(Workspace *ws);
+
+// HUGE_ALLOC_ALIGN-aligned temporary buffer: from the bound workspace, else
+// huge_alloc. NULL when the arena is full or the heap is exhausted.
+void *scratch_alloc(size_t bytes);
+void *scratch_calloc(size_t count, size_t size);
+// Release in any order; also accepts heap pointers and NULL
+void scratch_free(void *p);
+
+/**
+ * @brief Report a forward pass that cannot go on (scratch request refused,
+ * state out of range). With a workspace bound this only counts the
+ * failure in its failed field: the caller frees what it holds and returns,
+ * and the owner of the workspace turns the count into an error status.
+ * Without one it prints what and exits, as the legacy entry points always
+ * did.
+ */
+void scratch_fail(const char *what);
+
+#endif
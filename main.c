@@ -1,8 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "include/beam_search.h"
+#include "include/profiler.h"
+#include "include/sampling.h"
 #include "include/transformer.h"
 
-int main(void) {
+int main(int argc, char **argv) {
+  int autotune = argc > 1 && strcmp(argv[1], "--autotune") == 0;
   printf("Transformer Model Demo\n");
 
   // 1. Model Configuration
@@ -21,6 +26,24 @@ int main(void) {
   printf("Model initialized with %d layers and d_model=%d\n", config.num_layers,
          config.d_model);
 
+  // Optional: tune GEMM tiles for this model on this host; later runs load
+  // them from the tile cache
+  const char *cache = getenv("TRANSFORMER_TILE_CACHE");
+  if (!cache)
+    cache = KERNEL_TILE_CACHE_DEFAULT;
+  if (autotune) {
+    GemmShape shapes[TRANSFORMER_MAX_GEMM_SHAPES];
+    int n_shapes = transformer_gemm_shapes(config, config.max_seq_len, shapes);
+    if (kernels_autotune(shapes, n_shapes, 1) != 0) {
+      fprintf(stderr, "Out of memory while autotuning\n");
+      return 1;
+    }
+    if (kernels_save_tiles(cache) == 0)
+      printf("GEMM tiles written to %s\n", cache);
+  } else if (kernels_load_tiles(cache) == 0) {
+    printf("GEMM tiles loaded from %s\n", cache);
+  }
+
   // 3. Prepare Dummy Input
   int L_src = 10;
   int L_tgt = 8;
@@ -35,10 +58,63 @@ int main(void) {
 
   // 5. Forward Pass
   printf("Running forward pass for %d source and %d target tokens...\n", L_src, L_tgt);
-  compute_transformer(src_tokens, tgt_tokens, &params, out_logits, L_src, L_tgt);
+  if (compute_transformer(src_tokens, tgt_tokens, &params, out_logits, L_src,
+                          L_tgt) != 0) {
+    fprintf(stderr, "Forward pass failed\n");
+    return 1;
+  }
   printf("Forward pass completed successfully.\n");
 
-  // 6. Cleanup
+  // 6. Beam Search Generation
+  BeamSearchConfig beam_cfg = {
+      .beam_width = 4,
+      .max_len = 16,
+      .length_penalty = 0.6f,
+      .bos_id = 0,
+      .eos_id = 1
+  };
+  int *generated = malloc(beam_cfg.max_len * sizeof(int));
+  float score;
+  int n_generated =
+      beam_search(src_tokens, L_src, &params, &beam_cfg, generated, &score);
+  if (n_generated < 0) {
+    fprintf(stderr, "Out of memory in beam search\n");
+    return 1;
+  }
+  printf("Beam search (width=%d) produced %d tokens, score=%.4f:", beam_cfg.beam_width,
+         n_generated, score);
+  for (int i = 0; i < n_generated; i++) printf(" %d", generated[i]);
+  printf("\n");
+
+  // 7. Sampled Generation (top-k / top-p)
+  SamplingConfig sample_cfg = {
+      .temperature = 0.8f,
+      .top_k = 40,
+      .top_p = 0.9f,
+      .seed = 1234,
+      .max_len = 16,
+      .bos_id = 0,
+      .eos_id = 1
+  };
+  n_generated = generate_sampled(src_tokens, L_src, &params, &sample_cfg, generated);
+  if (n_generated < 0) {
+    fprintf(stderr, "Out of memory in sampling\n");
+    return 1;
+  }
+  printf("Sampling (top_k=%d, top_p=%.2f) produced %d tokens:", sample_cfg.top_k,
+         sample_cfg.top_p, n_generated);
+  for (int i = 0; i < n_generated; i++) printf(" %d", generated[i]);
+  printf("\n");
+
+#ifdef ENABLE_PROFILING
+  prof_print_summary(stdout);
+  prof_print_layer_summary(stdout);
+  if (prof_write_chrome_trace("profile.json") == 0)
+    printf("Trace written to profile.json\n");
+#endif
+
+  // 8. Cleanup
+  free(generated);
   free(src_tokens);
   free(tgt_tokens);
   free(out_logits);
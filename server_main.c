@@ -0,0 +1,114 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/checkpoint.h"
+#include "include/server.h"
+#include "include/transformer.h"
+
+// Serve a model on a Unix socket until SIGINT / SIGTERM, e.g.
+//   ./transformer_server --socket /tmp/transformer.sock --checkpoint model.bin
+// Without --checkpoint a random model of the given shape is served. The
+// protocol is described in include/server.h; bench/server_bench.c is a
+// matching load generator.
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--socket PATH] [--batch N] [--queue N]\n"
+          "          [--checkpoint PATH] [--resident-layers N]\n"
+          "          [--layers N] [--d-model N] [--d-ff N] [--heads N]"
+          " [--vocab N] [--max-seq N]\n",
+          prog);
+}
+
+int main(int argc, char **argv) {
+  const char *socket_path = "/tmp/transformer.sock";
+  const char *checkpoint = NULL;
+  int resident_layers = 0;
+  ServerConfig server_cfg = {.max_batch = 8, .queue_capacity = 256};
+  TransformerConfig config = {.num_layers = 2,
+                              .d_model = 128,
+                              .d_ff = 512,
+                              .num_heads = 8,
+                              .vocab_size = 1000,
+                              .max_seq_len = 128};
+
+  for (int i = 1; i < argc; i += 2) {
+    const char *arg = argv[i], *val = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!val) {
+      usage(argv[0]);
+      return 1;
+    }
+    if (strcmp(arg, "--socket") == 0)
+      socket_path = val;
+    else if (strcmp(arg, "--batch") == 0)
+      server_cfg.max_batch = atoi(val);
+    else if (strcmp(arg, "--queue") == 0)
+      server_cfg.queue_capacity = atoi(val);
+    else if (strcmp(arg, "--checkpoint") == 0)
+      checkpoint = val;
+    else if (strcmp(arg, "--resident-layers") == 0)
+      resident_layers = atoi(val);
+    else if (strcmp(arg, "--layers") == 0)
+      config.num_layers = atoi(val);
+    else if (strcmp(arg, "--d-model") == 0)
+      config.d_model = atoi(val);
+    else if (strcmp(arg, "--d-ff") == 0)
+      config.d_ff = atoi(val);
+    else if (strcmp(arg, "--heads") == 0)
+      config.num_heads = atoi(val);
+    else if (strcmp(arg, "--vocab") == 0)
+      config.vocab_size = atoi(val);
+    else if (strcmp(arg, "--max-seq") == 0)
+      config.max_seq_len = atoi(val);
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // Load the model once
+  Checkpoint ck;
+  TransformerParams params;
+  if (checkpoint) {
+    if (open_checkpoint(&ck, checkpoint, resident_layers) != 0) {
+      perror(checkpoint);
+      return 1;
+    }
+    params = ck.params; // Tensors and pager stay owned by ck
+  } else {
+    if (config.num_heads < 1 || config.d_model % config.num_heads != 0) {
+      fprintf(stderr, "Invalid model shape\n");
+      return 1;
+    }
+    init_transformer_params(&params, config);
+  }
+
+  // Handle the stop signals here; server threads inherit the blocked mask
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+  Server server;
+  if (server_start(&server, &params, &server_cfg, socket_path) != 0) {
+    perror(socket_path);
+    return 1;
+  }
+  fprintf(stderr, "Serving %d-layer model (d_model=%d) on %s\n",
+          params.config.num_layers, params.config.d_model, socket_path);
+
+  int sig;
+  sigwait(&stop_signals, &sig);
+  server_stop(&server);
+  fprintf(stderr, "%llu requests, %llu tokens, mean batch %.2f\n",
+          server.requests, server.tokens,
+          server.steps ? (double)server.step_rows / server.steps : 0.0);
+
+  if (checkpoint)
+    close_checkpoint(&ck);
+  else
+    free_transformer_params(&params);
+  return 0;
+}
@@ -1,10 +1,12 @@
 #include "../include/attention.h"
+#include "../include/kernels.h"
 #include "../include/math_utils.h"
+#include "../include/positional.h"
+#include "../include/profiler.h"
 #include "../include/tensor.h"
+#include "../include/thread_pool.h"
+#include "../include/workspace.h"
 
-#ifdef USE_OPENBLAS
-#include <cblas.h>
-#endif
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,220 +19,265 @@ void apply_mask(float *scores, const float *mask, int rows, int cols) {
       scores[i] = -INFINITY;
 }
 
-void compute_attention_gemm(const float *X, const float *W_qkv, float *Q,
-                            float *K, float *V, float *scores, float *weights,
-                            float *out, int L, int d_model, int d_k) {
+// Causal attention of one head. QKV (L x 3d_k) receives the head's Q | K | V
+// columns, scores are softmaxed into weights (which may alias them) and the
+// head's output lands in out, ldo floats between rows. Allocates nothing, so
+// pool workers can run it on their own slice of the caller's scratch.
+static void attention_head(const float *X, const float *W_qkv, int ldw,
+                           float *QKV, float *scores, float *weights,
+                           const float *mask, float *out, int ldo, int L,
+                           int d_model, int d_k, const float *rope) {
+  const KernelTable *kt = kernels();
+  int stride = 3 * d_k;
 
   //--1-- Compute QKV
-  // = X × W_qkv   (L x d_model) * (d_model x 3d_model)
-  float *QKV = calloc(L * 3 * d_k, sizeof(float));
-  matmul_blocked(X, W_qkv, QKV, L, 3 * d_k, d_model);
-
-  //--2-- Split QKV into Q, K, V (L x d_k)
-  int stride = 3 * d_k;
-  for (int i = 0; i < L; i++) {
-    memcpy(Q + i * d_k, QKV + i * stride + 0 * d_k, sizeof(float) * d_k);
-    memcpy(K + i * d_k, QKV + i * stride + 1 * d_k, sizeof(float) * d_k);
-    memcpy(V + i * d_k, QKV + i * stride + 2 * d_k, sizeof(float) * d_k);
+  // = X × W_qkv   (L x d_model) * (d_model x 3d_k)
+  PROF_BEGIN(OP_QKV_PROJECTION);
+  kt->gemm(X, d_model, W_qkv, ldw, QKV, stride, L, stride, d_model);
+  if (rope) {
+    apply_rotary(QKV, stride, rope, L, d_k);
+    apply_rotary(QKV + d_k, stride, rope, L, d_k);
   }
+  PROF_END_COST(OP_QKV_PROJECTION, PROF_GEMM_FLOPS(L, 3 * d_k, d_model),
+                PROF_GEMM_BYTES(L, 3 * d_k, d_model));
 
-  //--3-- Compute scores
+  //--2-- Compute scores
   // = Q × K^T : (L × d_k) * (d_k × L) = (L × L)
-  //
-  //
-  //
-  //
-  // why no transpose in the useopenblas
-  //
-  //
-#ifdef USE_OPENBLAS
-  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, L, L, d_k, 1.0f, Q, d_k,
-              K, d_k, 0.0f, scores, L);
-#else
-  float *K_T = calloc(L * d_k, sizeof(float));
-  transpose_matrix(K, K_T, L, d_k);
-  matmul_blocked(Q, K_T, scores, L, L, d_k);
-  free(K_T);
-
-#endif
-  //--4-- Scale scores
+  // gemm_nt takes K as stored (L × d_k), no explicit transpose
+  PROF_BEGIN(OP_ATTN_SCORES);
+  kt->gemm_nt(QKV, stride, QKV + d_k, stride, scores, L, L, L, d_k);
+
+  //--3-- Scale scores
   scale_scores(scores, L * L, d_k);
+  PROF_END_COST(OP_ATTN_SCORES, PROF_GEMM_FLOPS(L, L, d_k) + (double)L * L,
+                PROF_GEMM_BYTES(L, L, d_k));
 
-  // --5-- Mask application
-  float *mask = calloc(L * L, sizeof(float));
-  mattri_low(mask, L);
+  // --4-- Mask application and softmax
+  PROF_BEGIN(OP_ATTN_SOFTMAX);
   apply_mask(scores, mask, L, L);
-  free(mask);
-
-  //--6-- Compute the softmax
-  softmax_rows(scores, weights, L, L);
+  kt->softmax(scores, weights, L, L);
+  // mask, then max / exp / sum / divide per score
+  PROF_END_COST(OP_ATTN_SOFTMAX, 6.0 * L * L, 4.0 * 3 * L * L);
 
-  // --7-- Compute out
+  // --5-- Compute out
   // = weights × V  (L × L) * (L × d_k) = (L × d_k)
-#ifdef USE_OPENBLAS
-  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, L, d_k, L, 1.0f,
-              weights, L, V, d_k, 0.0f, out, d_k);
-#else
-  matmul_blocked(weights, V, out, L, L, d_k);
-#endif
-
-  free(QKV);
+  PROF_BEGIN(OP_ATTN_OUTPUT);
+  kt->gemm(weights, L, QKV + 2 * d_k, stride, out, ldo, L, d_k, L);
+  PROF_END_COST(OP_ATTN_OUTPUT, PROF_GEMM_FLOPS(L, d_k, L),
+                PROF_GEMM_BYTES(L, d_k, L));
 }
 
-void compute_multihead_attention(const float *X, const AttentionParams *params,
-                                 float *out, int L, int d_model,
-                                 int num_heads) {
+void compute_attention_gemm(const float *X, const float *W_qkv, float *Q,
+                            float *K, float *V, float *scores, float *weights,
+                            float *out, int L, int d_model, int d_k,
+                            const float *rope) {
+  float *QKV = scratch_alloc((size_t)L * 3 * d_k * sizeof(float));
+  float *mask = scratch_calloc(L * L, sizeof(float));
+  if (!QKV || !mask) {
+    scratch_fail("Alloc failed in attention");
+    scratch_free(QKV);
+    scratch_free(mask);
+    return;
+  }
+  mattri_low(mask, L);
 
-  // -- 1 -- Calculate dimensions
-  int d_k = d_model / num_heads;
+  attention_head(X, W_qkv, 3 * d_k, QKV, scores, weights, mask, out, d_k, L,
+                 d_model, d_k, rope);
 
-  // -- 2 -- Allocate buffer for all heads' outputs (will be concatenated)
-  float *all_heads = calloc(L * d_model, sizeof(float));
-
-  // Loop over each head
-  for (int h = 0; h < num_heads; h++) {
-    float *W_head = calloc(d_model * 3 * d_k, sizeof(float));
-
-    // Copy the (3*d_k) columns for this head
-    for (int i = 0; i < d_model; i++) {
-      memcpy(W_head + i * (3 * d_k),
-             params->W_qkv + i * (3 * d_model) + h * (3 * d_k),
-             (3 * d_k) * sizeof(float));
-    }
-
-    float *head_tmp = calloc(L * d_k, sizeof(float));
-    float *Q = calloc(L * d_k, sizeof(float));
-    float *K = calloc(L * d_k, sizeof(float));
-    float *V = calloc(L * d_k, sizeof(float));
-    float *scores = calloc(L * L, sizeof(float));
-    float *weights = calloc(L * L, sizeof(float));
-
-    // -- 3 -- Compute single-head attention
-    compute_attention_gemm(X, W_head, Q, K, V, scores, weights, head_tmp, L,
-                           d_model, d_k);
-
-    // -- 4 -- Interleave head output into all_heads
-    for (int i = 0; i < L; i++) {
-      memcpy(all_heads + i * d_model + h * d_k, head_tmp + i * d_k,
-             d_k * sizeof(float));
-    }
-
-    free(W_head);
-    free(Q);
-    free(K);
-    free(V);
-    free(scores);
-    free(weights);
-    free(head_tmp);
+  // Split QKV into Q, K, V (L x d_k) for the caller
+  int stride = 3 * d_k;
+  for (int i = 0; i < L; i++) {
+    memcpy(Q + i * d_k, QKV + i * stride + 0 * d_k, sizeof(float) * d_k);
+    memcpy(K + i * d_k, QKV + i * stride + 1 * d_k, sizeof(float) * d_k);
+    memcpy(V + i * d_k, QKV + i * stride + 2 * d_k, sizeof(float) * d_k);
   }
 
-  // -- 5 -- Apply the final output projection
-  // = all_heads × W_o (L x d_model) * (d_model x d_model) = (L x d_model)
-#ifdef USE_OPENBLAS
-  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, L, d_model, d_model,
-              1.0f, all_heads, d_model, params->W_o, d_model, 0.0f, out,
-              d_model);
-#else
-  matmul_blocked(all_heads, params->W_o, out, L, d_model, d_model);
-#endif
-
-  free(all_heads);
+  scratch_free(mask);
+  scratch_free(QKV);
 }
 
-static void matmul_safe(const float *A, const float *B, float *C, int M, int N,
-                        int K) {
-#ifdef USE_OPENBLAS
-  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, M, N, K, 1.0f, A, K, B,
-              N, 0.0f, C, N);
-#else
-  for (int i = 0; i < M; i++) {
-    for (int j = 0; j < N; j++) {
-      float sum = 0.0f;
-      for (int k = 0; k < K; k++) {
-        sum += A[i * K + k] * B[k * N + j];
-      }
-      C[i * N + j] = sum;
-    }
+// Floats of per-worker scratch, rounded to a cache line so that neighbouring
+// workers do not share one
+static size_t worker_floats(size_t n) { return (n + 15) & ~(size_t)15; }
+
+// Self-attention heads as pool tasks, each worker on its own scratch slice
+typedef struct {
+  const float *X, *W_qkv, *mask, *rope;
+  float *all_heads; // L x d_model, head h at columns h * d_k
+  float *work;      // per_worker floats per pool thread: QKV, then scores
+  size_t per_worker;
+  int L, d_model, d_k;
+} SelfAttentionHeads;
+
+static void self_attention_heads_run(void *ctx, int begin, int end,
+                                     int worker) {
+  const SelfAttentionHeads *a = (const SelfAttentionHeads *)ctx;
+  float *QKV = a->work + (size_t)worker * a->per_worker;
+  float *scores = QKV + (size_t)a->L * 3 * a->d_k;
+  for (int h = begin; h < end; h++) {
+    // Head h's (3*d_k) columns, read in place from W_qkv
+    attention_head(a->X, a->W_qkv + h * (3 * a->d_k), 3 * a->d_model, QKV,
+                   scores, scores, a->mask, a->all_heads + h * a->d_k,
+                   a->d_model, a->L, a->d_model, a->d_k, a->rope);
   }
-#endif
 }
 
-void compute_cross_attention(const float *X_q, const float *X_kv,
-                             const AttentionParams *params, float *out,
-                             int L_dec, int L_enc, int d_model, int num_heads) {
+void compute_multihead_attention(const float *X, const AttentionParams *params,
+                                 float *out, int L, int d_model,
+                                 int num_heads) {
 
+  // -- 1 -- Calculate dimensions
   int d_k = d_model / num_heads;
-  float *all_heads = (float *)calloc(L_dec * d_model, sizeof(float));
-  if (!all_heads)
+  size_t per_worker = worker_floats((size_t)L * 3 * d_k + (size_t)L * L);
+
+  // -- 2 -- Allocate buffer for all heads' outputs (will be concatenated),
+  // the shared causal mask and each pool thread's scratch
+  float *all_heads = scratch_calloc(L * d_model, sizeof(float));
+  float *mask = scratch_calloc(L * L, sizeof(float));
+  float *work = scratch_alloc(thread_pool_size() * per_worker * sizeof(float));
+
+  // Rotation angles are the same for every head
+  float *rope = NULL;
+  if (params->rotary)
+    rope = scratch_alloc((size_t)L * d_k * sizeof(float));
+
+  if (!all_heads || !mask || !work || (params->rotary && !rope)) {
+    scratch_fail("Alloc failed in multi-head attention");
+    scratch_free(all_heads);
+    scratch_free(mask);
+    scratch_free(work);
+    scratch_free(rope);
     return;
+  }
+  mattri_low(mask, L);
+  if (rope)
+    sinusoidal_table(NULL, L, d_k, rope);
+
+  // -- 3 -- Heads are independent: one pool task each. Their GEMMs run
+  // inline on the task's thread (the BLAS backend keeps OpenBLAS to one).
+  SelfAttentionHeads a = {.X = X,
+                          .W_qkv = params->W_qkv,
+                          .mask = mask,
+                          .rope = rope,
+                          .all_heads = all_heads,
+                          .work = work,
+                          .per_worker = per_worker,
+                          .L = L,
+                          .d_model = d_model,
+                          .d_k = d_k};
+  parallel_for(num_heads, 1, self_attention_heads_run, &a);
+
+  // -- 4 -- Apply the final output projection
+  // = all_heads × W_o (L x d_model) * (d_model x d_model) = (L x d_model)
+  PROF_BEGIN(OP_ATTN_OUT_PROJECTION);
+  kernels()->gemm(all_heads, d_model, params->W_o, d_model, out, d_model, L,
+                  d_model, d_model);
+  PROF_END_COST(OP_ATTN_OUT_PROJECTION, PROF_GEMM_FLOPS(L, d_model, d_model),
+                PROF_GEMM_BYTES(L, d_model, d_model));
+
+  scratch_free(all_heads);
+  scratch_free(mask);
+  scratch_free(work);
+  scratch_free(rope);
+}
 
-  for (int h = 0; h < num_heads; h++) {
+// Cross-attention heads as pool tasks, each worker on its own scratch slice
+typedef struct {
+  const float *X_q, *X_kv, *W_qkv;
+  float *all_heads; // L_dec x d_model, head h at columns h * d_k
+  float *work;      // per_worker floats per pool thread: Q, K, V, scores
+  size_t per_worker;
+  int L_dec, L_enc, d_model, d_k;
+} CrossAttentionHeads;
+
+static void cross_attention_heads_run(void *ctx, int begin, int end,
+                                      int worker) {
+  const CrossAttentionHeads *a = (const CrossAttentionHeads *)ctx;
+  const KernelTable *kt = kernels();
+  int L_dec = a->L_dec, L_enc = a->L_enc, d_model = a->d_model, d_k = a->d_k;
+  float *Q = a->work + (size_t)worker * a->per_worker;
+  float *K = Q + (size_t)L_dec * d_k;
+  float *V = K + (size_t)L_enc * d_k;
+  float *scores = V + (size_t)L_enc * d_k;
+
+  for (int h = begin; h < end; h++) {
     // Weight Slicing: Interleaved layout [H0_Q, H0_K, H0_V, H1_Q, ...]
-    // W_Q, W_K, W_V are each (d_model x d_k)
-    float *W_Q = (float *)malloc(d_model * d_k * sizeof(float));
-    float *W_K = (float *)malloc(d_model * d_k * sizeof(float));
-    float *W_V = (float *)malloc(d_model * d_k * sizeof(float));
-
-    for (int i = 0; i < d_model; i++) {
-      memcpy(W_Q + i * d_k, params->W_qkv + i * (3 * d_model) + h * (3 * d_k),
-             d_k * sizeof(float));
-      memcpy(W_K + i * d_k,
-             params->W_qkv + i * (3 * d_model) + h * (3 * d_k) + d_k,
-             d_k * sizeof(float));
-      memcpy(W_V + i * d_k,
-             params->W_qkv + i * (3 * d_model) + h * (3 * d_k) + 2 * d_k,
-             d_k * sizeof(float));
-    }
+    // W_Q, W_K, W_V are each (d_model x d_k), read in place from W_qkv
+    const float *W_Q = a->W_qkv + h * (3 * d_k);
+    const float *W_K = W_Q + d_k;
+    const float *W_V = W_Q + 2 * d_k;
 
     // 1. Q, K, V Projection
-    float *Q = (float *)calloc(L_dec * d_k, sizeof(float));
-    float *K = (float *)calloc(L_enc * d_k, sizeof(float));
-    float *V = (float *)calloc(L_enc * d_k, sizeof(float));
-
-    matmul_safe(X_q, W_Q, Q, L_dec, d_k, d_model);
-    matmul_safe(X_kv, W_K, K, L_enc, d_k, d_model);
-    matmul_safe(X_kv, W_V, V, L_enc, d_k, d_model);
+    PROF_BEGIN(OP_QKV_PROJECTION);
+    kt->gemm(a->X_q, d_model, W_Q, 3 * d_model, Q, d_k, L_dec, d_k, d_model);
+    kt->gemm(a->X_kv, d_model, W_K, 3 * d_model, K, d_k, L_enc, d_k, d_model);
+    kt->gemm(a->X_kv, d_model, W_V, 3 * d_model, V, d_k, L_enc, d_k, d_model);
+    PROF_END_COST(OP_QKV_PROJECTION,
+                  PROF_GEMM_FLOPS(L_dec, d_k, d_model) +
+                      2 * PROF_GEMM_FLOPS(L_enc, d_k, d_model),
+                  PROF_GEMM_BYTES(L_dec, d_k, d_model) +
+                      2 * PROF_GEMM_BYTES(L_enc, d_k, d_model));
 
     // 2. Scores = Q * K^T
-    float *scores = (float *)calloc(L_dec * L_enc, sizeof(float));
-
-#ifdef USE_OPENBLAS
-    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, L_dec, L_enc, d_k,
-                1.0f, Q, d_k, K, d_k, 0.0f, scores, L_enc);
-#else
-    float *K_T = (float *)calloc(d_k * L_enc, sizeof(float));
-    transpose_matrix(K, K_T, L_enc, d_k);
-    matmul_safe(Q, K_T, scores, L_dec, L_enc, d_k);
-    free(K_T);
-#endif
+    PROF_BEGIN(OP_ATTN_SCORES);
+    kt->gemm_nt(Q, d_k, K, d_k, scores, L_enc, L_dec, L_enc, d_k);
 
     // 3. Scale and Softmax
     scale_scores(scores, L_dec * L_enc, d_k);
-    softmax_rows(scores, scores, L_dec, L_enc);
-
-    // 4. Weighted Sum: Out = Weights * V
-    float *head_tmp = (float *)calloc(L_dec * d_k, sizeof(float));
-    matmul_safe(scores, V, head_tmp, L_dec, d_k, L_enc);
-
-    // Interleave head output into all_heads
-    for (int i = 0; i < L_dec; i++) {
-      memcpy(all_heads + i * d_model + h * d_k, head_tmp + i * d_k,
-             d_k * sizeof(float));
-    }
-
-    // Cleanup per head
-    free(W_Q);
-    free(W_K);
-    free(W_V);
-    free(Q);
-    free(K);
-    free(V);
-    free(scores);
-    free(head_tmp);
+    PROF_END_COST(OP_ATTN_SCORES,
+                  PROF_GEMM_FLOPS(L_dec, L_enc, d_k) + (double)L_dec * L_enc,
+                  PROF_GEMM_BYTES(L_dec, L_enc, d_k));
+    PROF_BEGIN(OP_ATTN_SOFTMAX);
+    kt->softmax(scores, scores, L_dec, L_enc);
+    PROF_END_COST(OP_ATTN_SOFTMAX, 5.0 * L_dec * L_enc, 8.0 * L_dec * L_enc);
+
+    // 4. Weighted Sum: Out = Weights * V, straight into the head's columns
+    PROF_BEGIN(OP_ATTN_OUTPUT);
+    kt->gemm(scores, L_enc, V, d_k, a->all_heads + h * d_k, d_model, L_dec,
+             d_k, L_enc);
+    PROF_END_COST(OP_ATTN_OUTPUT, PROF_GEMM_FLOPS(L_dec, d_k, L_enc),
+                  PROF_GEMM_BYTES(L_dec, d_k, L_enc));
   }
+}
 
-  // 5. Final Projection (W_o)
-  matmul_safe(all_heads, params->W_o, out, L_dec, d_model, d_model);
+void compute_cross_attention(const float *X_q, const float *X_kv,
+                             const AttentionParams *params, float *out,
+                             int L_dec, int L_enc, int d_model, int num_heads) {
 
-  free(all_heads);
+  int d_k = d_model / num_heads;
+  size_t per_worker = worker_floats((size_t)L_dec * d_k +
+                                    (size_t)2 * L_enc * d_k +
+                                    (size_t)L_dec * L_enc);
+  float *all_heads = (float *)scratch_calloc(L_dec * d_model, sizeof(float));
+  float *work = (float *)scratch_alloc(thread_pool_size() * per_worker *
+                                       sizeof(float));
+  if (!all_heads || !work) {
+    scratch_fail("Alloc failed in cross attention");
+    scratch_free(all_heads);
+    scratch_free(work);
+    return;
+  }
+
+  CrossAttentionHeads a = {.X_q = X_q,
+                           .X_kv = X_kv,
+                           .W_qkv = params->W_qkv,
+                           .all_heads = all_heads,
+                           .work = work,
+                           .per_worker = per_worker,
+                           .L_dec = L_dec,
+                           .L_enc = L_enc,
+                           .d_model = d_model,
+                           .d_k = d_k};
+  parallel_for(num_heads, 1, cross_attention_heads_run, &a);
+
+  // 5. Final Projection (W_o)
+  PROF_BEGIN(OP_ATTN_OUT_PROJECTION);
+  kernels()->gemm(all_heads, d_model, params->W_o, d_model, out, d_model,
+                  L_dec, d_model, d_model);
+  PROF_END_COST(OP_ATTN_OUT_PROJECTION,
+                PROF_GEMM_FLOPS(L_dec, d_model, d_model),
+                PROF_GEMM_BYTES(L_dec, d_model, d_model));
+
+  scratch_free(all_heads);
+  scratch_free(work);
 }
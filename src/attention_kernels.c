@@ -0,0 +1,128 @@
+#include "../include/attention_kernels.h"
+#include "../include/kernels.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#define ATTN_HAVE_SIMD 1
+#define SIMD_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+// 8-float GNU vector: one AVX register, or a pair of SSE registers on
+// targets without AVX
+typedef float attn_v8 __attribute__((vector_size(32)));
+
+#define ATTN_LOAD(v, p) memcpy(&(v), (p), sizeof(attn_v8))
+
+// One kernel body for every head dimension. With D_K a constant, every
+// d-loop has a fixed trip count the compiler fully unrolls, so the four
+// dot-product accumulators and the output row stay in registers; with
+// D_K = d_k_arg the same code is the generic fallback.
+#define DEFINE_ATTENTION_KERNEL(NAME, ATTRS, D_K)                              \
+  ATTRS static void NAME(const float *restrict Q, int ldq,                     \
+                         const float *restrict K, const float *restrict V,     \
+                         int ldkv, float *restrict W, int ldw,                 \
+                         float *restrict out, int ldo, int rows, int n_keys,   \
+                         int causal, int d_k_arg) {                            \
+    const int d_k = (D_K);                                                     \
+    const float scale = 1.0f / sqrtf((float)d_k);                              \
+    (void)d_k_arg;                                                             \
+    for (int i = 0; i < rows; i++) {                                           \
+      const float *q = Q + (size_t)i * ldq;                                    \
+      float *w = W + (size_t)i * ldw;                                          \
+      float *o = out + (size_t)i * ldo;                                        \
+      int n = causal ? n_keys - rows + i + 1 : n_keys;                         \
+                                                                               \
+      /* scores: four independent accumulators hide the FMA latency */        \
+      for (int j = 0; j < n; j++) {                                            \
+        const float *k_j = K + (size_t)j * ldkv;                               \
+        attn_v8 acc0 = {0}, acc1 = {0}, acc2 = {0}, acc3 = {0};                \
+        attn_v8 x0, x1, x2, x3, y0, y1, y2, y3;                                \
+        int d = 0;                                                             \
+        _Pragma("GCC unroll 4") for (; d + 32 <= d_k; d += 32) {               \
+          ATTN_LOAD(x0, q + d);                                                \
+          ATTN_LOAD(x1, q + d + 8);                                            \
+          ATTN_LOAD(x2, q + d + 16);                                           \
+          ATTN_LOAD(x3, q + d + 24);                                           \
+          ATTN_LOAD(y0, k_j + d);                                              \
+          ATTN_LOAD(y1, k_j + d + 8);                                          \
+          ATTN_LOAD(y2, k_j + d + 16);                                         \
+          ATTN_LOAD(y3, k_j + d + 24);                                         \
+          acc0 += x0 * y0;                                                     \
+          acc1 += x1 * y1;                                                     \
+          acc2 += x2 * y2;                                                     \
+          acc3 += x3 * y3;                                                     \
+        }                                                                      \
+        for (; d + 8 <= d_k; d += 8) {                                         \
+          ATTN_LOAD(x0, q + d);                                                \
+          ATTN_LOAD(y0, k_j + d);                                              \
+          acc0 += x0 * y0;                                                     \
+        }                                                                      \
+        acc0 = (acc0 + acc1) + (acc2 + acc3);                                  \
+        float dot = ((acc0[0] + acc0[4]) + (acc0[1] + acc0[5])) +              \
+                    ((acc0[2] + acc0[6]) + (acc0[3] + acc0[7]));               \
+        for (; d < d_k; d++)                                                   \
+          dot += q[d] * k_j[d];                                                \
+        w[j] = dot * scale;                                                    \
+      }                                                                        \
+      kernels()->softmax(w, w, 1, n);                                          \
+      for (int j = n; j < n_keys; j++)                                         \
+        w[j] = 0.0f;                                                           \
+                                                                               \
+      /* output: weighted sum of the value rows */                            \
+      for (int d = 0; d < d_k; d++)                                            \
+        o[d] = 0.0f;                                                           \
+      for (int j = 0; j < n; j++) {                                            \
+        const float *v_j = V + (size_t)j * ldkv;                               \
+        float w_j = w[j];                                                      \
+        _Pragma("GCC unroll 16") for (int d = 0; d < d_k; d++)                 \
+          o[d] += w_j * v_j[d];                                                \
+      }                                                                        \
+    }                                                                          \
+  }
+
+DEFINE_ATTENTION_KERNEL(attention_generic, , d_k_arg)
+DEFINE_ATTENTION_KERNEL(attention_dk32, , 32)
+DEFINE_ATTENTION_KERNEL(attention_dk64, , 64)
+DEFINE_ATTENTION_KERNEL(attention_dk128, , 128)
+
+#ifdef ATTN_HAVE_SIMD
+DEFINE_ATTENTION_KERNEL(attention_dk32_simd, SIMD_TARGET, 32)
+DEFINE_ATTENTION_KERNEL(attention_dk64_simd, SIMD_TARGET, 64)
+DEFINE_ATTENTION_KERNEL(attention_dk128_simd, SIMD_TARGET, 128)
+
+static int simd_supported(void) {
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#endif
+
+AttentionKernel attention_kernel(int d_k) {
+#ifdef ATTN_HAVE_SIMD
+  if (simd_supported()) {
+    switch (d_k) {
+    case 32:
+      return attention_dk32_simd;
+    case 64:
+      return attention_dk64_simd;
+    case 128:
+      return attention_dk128_simd;
+    }
+  }
+#endif
+  switch (d_k) {
+  case 32:
+    return attention_dk32;
+  case 64:
+    return attention_dk64;
+  case 128:
+    return attention_dk128;
+  default:
+    return attention_generic;
+  }
+}
+
+int attention_kernel_specialized(int d_k) {
+  return d_k == 32 || d_k == 64 || d_k == 128;
+}
@@ -0,0 +1,238 @@
+#include "../include/beam_search.h"
+#include "../include/kv_cache.h"
+#include "../include/math_utils.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Completed hypotheses, keeping only the best `capacity` by normalised score
+typedef struct {
+  int *tokens; // capacity x max_len
+  int *len;
+  float *score;
+  int count;
+  int capacity;
+  int max_len;
+} FinishedSet;
+
+static float length_penalty(int len, float alpha) {
+  if (alpha == 0.0f)
+    return 1.0f;
+  return powf((5.0f + len) / 6.0f, alpha);
+}
+
+static int worst_finished(const FinishedSet *fin) {
+  int worst = 0;
+  for (int i = 1; i < fin->count; i++) {
+    if (fin->score[i] < fin->score[worst])
+      worst = i;
+  }
+  return worst;
+}
+
+static void add_finished(FinishedSet *fin, const int *tokens, int len,
+                         float score) {
+  int idx;
+  if (fin->count < fin->capacity) {
+    idx = fin->count++;
+  } else {
+    idx = worst_finished(fin);
+    if (score <= fin->score[idx])
+      return;
+  }
+  memcpy(fin->tokens + idx * fin->max_len, tokens, len * sizeof(int));
+  fin->len[idx] = len;
+  fin->score[idx] = score;
+}
+
+int beam_search(const int *src_tokens, int L_src,
+                const TransformerParams *params, const BeamSearchConfig *cfg,
+                int *out_tokens, float *out_score) {
+
+  int d_model = params->config.d_model;
+  int vocab_size = params->config.vocab_size;
+  int num_layers = params->config.num_layers;
+  int beam_width = cfg->beam_width;
+  int n_cand = 2 * beam_width; // enough to survive beam_width EOS hits
+
+  // Logit columns: the whole vocabulary or the request's shortlist
+  const VocabShortlist *sl = cfg->shortlist;
+  int n_cols = sl ? sl->size : vocab_size;
+
+  // The prompt (BOS + forced prefix) fills the first n_prompt positions and
+  // generated token s is fed at position n_prompt + s
+  int n_prompt = 1 + cfg->prefix_len;
+  int max_len = cfg->max_len;
+  int max_positions = transformer_max_positions(params->config);
+  if (max_len <= 0 || n_prompt > max_positions)
+    return 0; // Nothing asked for, or no position left for the first token
+  if (max_len > max_positions - (n_prompt - 1))
+    max_len = max_positions - (n_prompt - 1);
+
+  // --- 1. Encoder and cross-attention state, shared by every beam ---
+  CrossKV ckv;
+  if (create_cross_kv(&ckv, num_layers, d_model, L_src) != 0)
+    return -1;
+  KVCache cache;
+  if (create_kv_cache(&cache, num_layers, d_model, beam_width,
+                      n_prompt - 1 + max_len) != 0) {
+    free_cross_kv(&ckv);
+    return -1;
+  }
+
+  // --- 2. Beam bookkeeping ---
+  int *hist = (int *)malloc((size_t)beam_width * max_len * sizeof(int));
+  int *next_hist = (int *)malloc((size_t)beam_width * max_len * sizeof(int));
+  float *beam_scores = (float *)malloc(beam_width * sizeof(float));
+  float *next_scores = (float *)malloc(beam_width * sizeof(float));
+  int *tokens = (int *)malloc((beam_width > n_prompt ? beam_width : n_prompt) *
+                             sizeof(int));
+  int *slots = (int *)malloc(beam_width * sizeof(int));
+  int *parents = (int *)malloc(beam_width * sizeof(int));
+  float *hidden = (float *)malloc((size_t)beam_width * d_model * sizeof(float));
+  float *logits =
+      (float *)malloc((size_t)beam_width * n_cols * sizeof(float));
+  float *cand_vals = (float *)malloc(n_cand * sizeof(float));
+  int *cand_ids = (int *)malloc(n_cand * sizeof(int));
+
+  FinishedSet fin = {0};
+  fin.capacity = beam_width;
+  fin.max_len = max_len;
+  fin.tokens = (int *)malloc((size_t)beam_width * max_len * sizeof(int));
+  fin.len = (int *)malloc(beam_width * sizeof(int));
+  fin.score = (float *)malloc(beam_width * sizeof(float));
+
+  // Out of memory anywhere up to the prompt: nothing is decoded, -1
+  int ok = hist && next_hist && beam_scores && next_scores && tokens &&
+           slots && parents && hidden && logits && cand_vals && cand_ids &&
+           fin.tokens && fin.len && fin.score &&
+           compute_encoder_cached(cfg->encoder_cache, src_tokens, L_src,
+                                  params, NULL, &ckv) == 0;
+  kv_cache_reset_slot(&cache, 0, &ckv);
+
+  int n_beams = 1;
+  if (ok) {
+    for (int b = 0; b < beam_width; b++)
+      slots[b] = b;
+    beam_scores[0] = 0.0f;
+
+    // --- 3. Prompt, reusing shared prefixes when a prefix cache is given ---
+    tokens[0] = cfg->bos_id;
+    if (cfg->prefix_len > 0)
+      memcpy(tokens + 1, cfg->prefix, cfg->prefix_len * sizeof(int));
+    ok = decoder_prefill(params, cfg->prefix_cache, src_tokens, L_src, &cache,
+                         0, tokens, n_prompt, hidden) >= 0;
+  }
+
+  // --- 4. Decode ---
+  for (int s = 0; ok && s < max_len; s++) {
+    if (s > 0) {
+      for (int b = 0; b < n_beams; b++)
+        tokens[b] = hist[b * max_len + s - 1];
+
+      // One batched decoder call for every live beam
+      compute_decoder_step(tokens, slots, params, &cache, hidden, n_beams);
+    }
+    if (sl)
+      compute_shortlist_logits(hidden, sl, logits, n_beams);
+    else
+      compute_logits(hidden, params, logits, n_beams);
+    log_softmax_rows(logits, logits, n_beams, n_cols);
+
+    // Partial selection of the best continuations across all beams
+    int count = 0;
+    for (int b = 0; b < n_beams; b++) {
+      const float *row = logits + (size_t)b * n_cols;
+      for (int v = 0; v < n_cols; v++) {
+        topk_push(cand_vals, cand_ids, &count, n_cand, beam_scores[b] + row[v],
+                  b * n_cols + v);
+      }
+    }
+    topk_sort(cand_vals, cand_ids, count);
+
+    int next_beams = 0;
+    for (int c = 0; c < count && next_beams < beam_width; c++) {
+      int parent = cand_ids[c] / n_cols;
+      int col = cand_ids[c] % n_cols;
+      int token = sl ? sl->ids[col] : col;
+      const int *parent_hist = hist + parent * max_len;
+
+      if (token == cfg->eos_id) {
+        // Only EOS ranked within the beam counts as a finished hypothesis
+        if (c < beam_width)
+          add_finished(&fin, parent_hist, s,
+                       cand_vals[c] / length_penalty(s + 1, cfg->length_penalty));
+        continue;
+      }
+
+      int *child_hist = next_hist + next_beams * max_len;
+      memcpy(child_hist, parent_hist, s * sizeof(int));
+      child_hist[s] = token;
+      next_scores[next_beams] = cand_vals[c];
+      parents[next_beams] = parent;
+      next_beams++;
+    }
+
+    if (next_beams == 0)
+      break;
+
+    if (s == max_len - 1) {
+      // Out of length: surviving beams end here without EOS
+      for (int b = 0; b < next_beams; b++)
+        add_finished(&fin, next_hist + b * max_len, s + 1,
+                     next_scores[b] / length_penalty(s + 1, cfg->length_penalty));
+      break;
+    }
+
+    // Children take over their parent's cached keys/values
+    kv_cache_reorder(&cache, parents, next_beams);
+
+    int *tmp_hist = hist;
+    hist = next_hist;
+    next_hist = tmp_hist;
+    float *tmp_scores = beam_scores;
+    beam_scores = next_scores;
+    next_scores = tmp_scores;
+    n_beams = next_beams;
+
+    // Stop once no live beam can beat the worst finished hypothesis
+    if (fin.count == beam_width &&
+        beam_scores[0] / length_penalty(s + 1, cfg->length_penalty) <=
+            fin.score[worst_finished(&fin)])
+      break;
+  }
+
+  // --- 5. Best hypothesis ---
+  int best = 0;
+  for (int i = 1; i < fin.count; i++) {
+    if (fin.score[i] > fin.score[best])
+      best = i;
+  }
+  int out_len = ok ? 0 : -1;
+  if (fin.count > 0) {
+    out_len = fin.len[best];
+    memcpy(out_tokens, fin.tokens + best * max_len, out_len * sizeof(int));
+    if (out_score)
+      *out_score = fin.score[best];
+  }
+
+  free(hist);
+  free(next_hist);
+  free(beam_scores);
+  free(next_scores);
+  free(tokens);
+  free(slots);
+  free(parents);
+  free(hidden);
+  free(logits);
+  free(cand_vals);
+  free(cand_ids);
+  free(fin.tokens);
+  free(fin.len);
+  free(fin.score);
+  free_kv_cache(&cache);
+  free_cross_kv(&ckv);
+
+  return out_len;
+}
@@ -0,0 +1,328 @@
+// madvise and MADV_* are not part of POSIX
+#define _GNU_SOURCE
+#include "../include/checkpoint.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC 0x313054504B434654ULL // "TFCKPT01" little-endian
+// 2 added TransformerConfig.pos_mode; version 1 files still open
+#define CHECKPOINT_VERSION 2
+// Tensors start here; a multiple of every common page size
+#define CHECKPOINT_DATA_OFFSET 65536
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t reserved;
+  TransformerConfig config;
+  uint64_t data_offset;
+  uint64_t data_bytes;
+} CheckpointHeader;
+
+// Version 1 predates pos_mode: always a learned position table
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t reserved;
+  struct {
+    int num_layers, d_model, d_ff, num_heads, vocab_size, max_seq_len;
+  } config;
+  uint64_t data_offset;
+  uint64_t data_bytes;
+} CheckpointHeaderV1;
+
+// Header of a mapped file in the current layout; -1 if unknown
+static int read_header(const void *base, CheckpointHeader *h) {
+  memcpy(h, base, sizeof(*h));
+  if (h->magic != CHECKPOINT_MAGIC)
+    return -1;
+  if (h->version == 1) {
+    const CheckpointHeaderV1 *v1 = (const CheckpointHeaderV1 *)base;
+    h->config = (TransformerConfig){
+        v1->config.num_layers, v1->config.d_model,    v1->config.d_ff,
+        v1->config.num_heads,  v1->config.vocab_size, v1->config.max_seq_len,
+        POS_LEARNED};
+    h->data_offset = v1->data_offset;
+    h->data_bytes = v1->data_bytes;
+    return 0;
+  }
+  return h->version == CHECKPOINT_VERSION ? 0 : -1;
+}
+
+// ---------------------------------------------------------------------------
+// Saving
+
+typedef struct {
+  FILE *f;
+  int failed;
+} WriteCtx;
+
+static void write_tensor(float **tensor, size_t count, void *ctx) {
+  static const char zeros[TRANSFORMER_PACK_ALIGN];
+  WriteCtx *c = (WriteCtx *)ctx;
+  size_t bytes = count * sizeof(float);
+  size_t pad = (TRANSFORMER_PACK_ALIGN - bytes % TRANSFORMER_PACK_ALIGN) %
+               TRANSFORMER_PACK_ALIGN;
+  if (c->failed || fwrite(*tensor, 1, bytes, c->f) != bytes ||
+      fwrite(zeros, 1, pad, c->f) != pad)
+    c->failed = 1;
+}
+
+int save_checkpoint(const TransformerParams *params, const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return -1;
+
+  CheckpointHeader h = {.magic = CHECKPOINT_MAGIC,
+                        .version = CHECKPOINT_VERSION,
+                        .config = params->config,
+                        .data_offset = CHECKPOINT_DATA_OFFSET,
+                        .data_bytes =
+                            transformer_params_packed_bytes(params->config)};
+  WriteCtx c = {f, 0};
+  if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+      fseek(f, CHECKPOINT_DATA_OFFSET, SEEK_SET) != 0)
+    c.failed = 1;
+  // write_tensor only reads the tensors
+  transformer_params_foreach((TransformerParams *)params, write_tensor, &c);
+
+  int err = c.failed ? (errno ? errno : EIO) : 0;
+  if (fclose(f) != 0 && !err)
+    err = errno;
+  if (err) {
+    remove(path);
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Layer paging
+
+static size_t page_size(void) { return (size_t)sysconf(_SC_PAGESIZE); }
+
+// Ask for [start, end) and fault it in, so the layer is read while the one
+// before it computes
+static void read_range(LayerPager *p, size_t start, size_t end) {
+  size_t page = page_size();
+  size_t lo = start / page * page;
+  madvise(p->base + lo, end - lo, MADV_WILLNEED);
+  volatile char sink = 0;
+  for (size_t off = lo; off < end; off += page)
+    sink += p->base[off];
+  (void)sink;
+}
+
+// Drop the pages wholly inside [start, end): unmapped here and evicted from
+// the page cache. Clean file pages, so this never writes anything back.
+static void release_range(LayerPager *p, size_t start, size_t end) {
+  size_t page = page_size();
+  size_t lo = (start + page - 1) / page * page;
+  size_t hi = end / page * page;
+  if (hi <= lo)
+    return;
+  madvise(p->base + lo, hi - lo, MADV_DONTNEED);
+  posix_fadvise(p->fd, (off_t)lo, (off_t)(hi - lo), POSIX_FADV_DONTNEED);
+}
+
+static void *prefetch_main(void *arg) {
+  LayerPager *p = (LayerPager *)arg;
+  pthread_mutex_lock(&p->mutex);
+  for (;;) {
+    while (!p->stop && p->prefetch_unit < 0)
+      pthread_cond_wait(&p->wake, &p->mutex);
+    if (p->stop)
+      break;
+    int u = p->prefetch_unit;
+    p->prefetch_unit = -1;
+    pthread_mutex_unlock(&p->mutex);
+    read_range(p, p->start[u], p->end[u]);
+    pthread_mutex_lock(&p->mutex);
+  }
+  pthread_mutex_unlock(&p->mutex);
+  return NULL;
+}
+
+void layer_pager_enter(LayerPager *p, PagerStack stack, int layer) {
+  int half = p->num_units / 2;
+  int u = (stack == PAGER_ENCODER ? 0 : half) + layer;
+  // After the last decoder layer the decoder stack runs again (decode steps)
+  int next = u + 1 < p->num_units ? u + 1 : half;
+
+  pthread_mutex_lock(&p->mutex);
+  p->last_used[u] = ++p->tick;
+  if (!p->last_used[next]) {
+    p->last_used[next] = ++p->tick;
+    p->prefetch_unit = next;
+    p->prefetches++;
+    pthread_cond_signal(&p->wake);
+  }
+
+  // Evict least recently used layers beyond the window
+  int resident = 0;
+  for (int i = 0; i < p->num_units; i++)
+    resident += p->last_used[i] != 0;
+  while (resident > p->max_resident) {
+    int victim = -1;
+    for (int i = 0; i < p->num_units; i++) {
+      if (i == u || i == next || !p->last_used[i])
+        continue;
+      if (victim < 0 || p->last_used[i] < p->last_used[victim])
+        victim = i;
+    }
+    if (victim < 0)
+      break;
+    p->last_used[victim] = 0;
+    p->releases++;
+    resident--;
+    release_range(p, p->start[victim], p->end[victim]);
+  }
+  pthread_mutex_unlock(&p->mutex);
+}
+
+static size_t offset_of(const Checkpoint *ck, const float *tensor) {
+  return (size_t)((const char *)tensor - (const char *)ck->base);
+}
+
+static int init_layer_pager(Checkpoint *ck, int resident_layers) {
+  LayerPager *p = &ck->pager;
+  const TransformerParams *params = &ck->params;
+  int N = params->config.num_layers;
+
+  memset(p, 0, sizeof(*p));
+  p->base = (char *)ck->base;
+  p->bytes = ck->bytes;
+  p->fd = ck->fd;
+  p->num_units = 2 * N;
+  p->max_resident = resident_layers < 2 ? 2 : resident_layers;
+  p->prefetch_unit = -1;
+  p->start = (size_t *)malloc(p->num_units * sizeof(size_t));
+  p->end = (size_t *)malloc(p->num_units * sizeof(size_t));
+  p->last_used = (unsigned long long *)calloc(p->num_units,
+                                              sizeof(unsigned long long));
+  if (!p->start || !p->end || !p->last_used) {
+    free(p->start);
+    free(p->end);
+    free(p->last_used);
+    return -1;
+  }
+
+  // Packed layout: each layer runs from its first tensor to the next one's
+  for (int i = 0; i < N; i++) {
+    p->start[i] = offset_of(ck, params->encoder_layers[i].attn_params.W_qkv);
+    p->start[N + i] =
+        offset_of(ck, params->decoder_layers[i].self_attn_params.W_qkv);
+  }
+  for (int u = 0; u + 1 < p->num_units; u++)
+    p->end[u] = p->start[u + 1];
+  p->end[p->num_units - 1] = offset_of(ck, params->output_projection);
+
+  pthread_mutex_init(&p->mutex, NULL);
+  pthread_cond_init(&p->wake, NULL);
+  if (pthread_create(&p->thread, NULL, prefetch_main, p) != 0) {
+    pthread_mutex_destroy(&p->mutex);
+    pthread_cond_destroy(&p->wake);
+    free(p->start);
+    free(p->end);
+    free(p->last_used);
+    return -1;
+  }
+  return 0;
+}
+
+static void free_layer_pager(LayerPager *p) {
+  pthread_mutex_lock(&p->mutex);
+  p->stop = 1;
+  pthread_cond_signal(&p->wake);
+  pthread_mutex_unlock(&p->mutex);
+  pthread_join(p->thread, NULL);
+  pthread_mutex_destroy(&p->mutex);
+  pthread_cond_destroy(&p->wake);
+  free(p->start);
+  free(p->end);
+  free(p->last_used);
+}
+
+// ---------------------------------------------------------------------------
+// Opening
+
+int open_checkpoint(Checkpoint *ck, const char *path, int resident_layers) {
+  memset(ck, 0, sizeof(*ck));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CheckpointHeader)) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+  size_t bytes = (size_t)st.st_size;
+  void *base = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+
+  CheckpointHeader header;
+  const CheckpointHeader *h = &header;
+  if (read_header(base, &header) != 0 ||
+      h->data_offset + h->data_bytes > bytes ||
+      transformer_params_packed_bytes(h->config) != h->data_bytes) {
+    munmap(base, bytes);
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+
+  ck->base = base;
+  ck->bytes = bytes;
+  ck->fd = fd;
+  int paged = resident_layers > 0 && h->config.num_layers > 0;
+  int failed = view_transformer_params(&ck->params, h->config,
+                                       (char *)base + h->data_offset) != 0;
+  if (!failed && paged && init_layer_pager(ck, resident_layers) != 0) {
+    free_transformer_params_view(&ck->params);
+    failed = 1;
+  }
+  if (failed) {
+    munmap(base, bytes);
+    close(fd);
+    ck->base = NULL;
+    errno = ENOMEM;
+    return -1;
+  }
+
+  if (paged) {
+    ck->paged = 1;
+    ck->params.pager = &ck->pager;
+    // Embeddings and the output projection are used on every step
+    LayerPager *p = &ck->pager;
+    read_range(p, h->data_offset, p->start[0]);
+    read_range(p, p->end[p->num_units - 1], bytes);
+  }
+  return 0;
+}
+
+void close_checkpoint(Checkpoint *ck) {
+  if (!ck->base)
+    return;
+  if (ck->paged)
+    free_layer_pager(&ck->pager);
+  free_transformer_params_view(&ck->params);
+  munmap(ck->base, ck->bytes);
+  close(ck->fd);
+  ck->base = NULL;
+  ck->paged = 0;
+}
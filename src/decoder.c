@@ -1,11 +1,18 @@
 #include "../include/decoder.h"
 #include "../include/attention.h"
+#include "../include/attention_kernels.h"
 #include "../include/feedforward.h"
+#include "../include/workspace.h"
 #include "../include/layernorm.h"
+#include "../include/math_utils.h"
+#include "../include/positional.h"
+#include "../include/profiler.h"
 #include "../include/tensor.h"
+#include "../include/thread_pool.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 void compute_decoder_layer(const float *dec_input, const float *enc_output,
                           const DecoderLayerParams *params, float *dec_output,
@@ -13,15 +20,20 @@ void compute_decoder_layer(const float *dec_input, const float *enc_output,
                           int num_heads) {
 
   // helper buffer
-  float *A1 = (float *)calloc(L_dec * d_model, sizeof(float)); // self attn out
-  float *Y1 = (float *)calloc(L_dec * d_model, sizeof(float)); // post ln1
-  float *A2 = (float *)calloc(L_dec * d_model, sizeof(float)); // cross attn out
-  float *Y2 = (float *)calloc(L_dec * d_model, sizeof(float)); // post ln2
-  float *FF = (float *)calloc(L_dec * d_model, sizeof(float)); // ffn output
+  float *A1 = (float *)scratch_calloc(L_dec * d_model, sizeof(float)); // self attn out
+  float *Y1 = (float *)scratch_calloc(L_dec * d_model, sizeof(float)); // post ln1
+  float *A2 = (float *)scratch_calloc(L_dec * d_model, sizeof(float)); // cross attn out
+  float *Y2 = (float *)scratch_calloc(L_dec * d_model, sizeof(float)); // post ln2
+  float *FF = (float *)scratch_calloc(L_dec * d_model, sizeof(float)); // ffn output
 
   if (!A1 || !Y1 || !A2 || !Y2 || !FF) {
-    fprintf(stderr, "Alloc failed in decoder\n");
-    exit(1);
+    scratch_fail("Alloc failed in decoder");
+    scratch_free(A1);
+    scratch_free(Y1);
+    scratch_free(A2);
+    scratch_free(Y2);
+    scratch_free(FF);
+    return;
   }
 
   // Mask Self_attention
@@ -48,9 +60,238 @@ void compute_decoder_layer(const float *dec_input, const float *enc_output,
   compute_layernorm(FF, &params->ln3_params, dec_output, L_dec, d_model);
 
   // cleanup
-  free(A1);
-  free(Y1);
-  free(A2);
-  free(Y2);
-  free(FF);
+  scratch_free(A1);
+  scratch_free(Y1);
+  scratch_free(A2);
+  scratch_free(Y2);
+  scratch_free(FF);
+}
+
+void compute_decoder_cross_kv(const float *enc_output,
+                              const DecoderLayerParams *params, float *K,
+                              float *V, int L_enc, int d_model, int num_heads) {
+  int d_k = d_model / num_heads;
+  const float *W_qkv = params->cross_attn_params.W_qkv;
+
+  // Interleaved layout [H0_Q, H0_K, H0_V, H1_Q, ...]: project straight into
+  // the head's columns of K and V without slicing the weights
+  PROF_BEGIN(OP_QKV_PROJECTION);
+  for (int h = 0; h < num_heads; h++) {
+    matmul_strided(enc_output, d_model, W_qkv + h * (3 * d_k) + d_k,
+                   3 * d_model, K + h * d_k, d_model, L_enc, d_k, d_model);
+    matmul_strided(enc_output, d_model, W_qkv + h * (3 * d_k) + 2 * d_k,
+                   3 * d_model, V + h * d_k, d_model, L_enc, d_k, d_model);
+  }
+  PROF_END_COST(OP_QKV_PROJECTION, PROF_GEMM_FLOPS(L_enc, 2 * d_model, d_model),
+                PROF_GEMM_BYTES(L_enc, 2 * d_model, d_model));
+}
+
+// Multiply-adds of attention per parallel_for chunk in a decode step
+#define STEP_ATTENTION_GRAIN_WORK (1 << 14)
+
+// One decode step's attention, a task per (row, head): rows of a ragged
+// batch attend over different numbers of keys, which the pool balances
+typedef struct {
+  AttentionKernel attend;
+  const KVCache *cache;
+  int layer;
+  const int *slots, *positions;
+  int cross; // Attend over the slot's encoder K/V instead of its cache
+  const float *Q;
+  int q_stride, q_head; // Floats between rows / heads of Q
+  float *out;    // n x d_model
+  float *scores; // max_keys per pool thread
+  int max_keys;
+  int num_heads, d_k, d_model;
+} StepAttention;
+
+static void step_attention_run(void *ctx, int begin, int end, int worker) {
+  const StepAttention *a = (const StepAttention *)ctx;
+  size_t slot_size = (size_t)a->cache->max_len * a->d_model;
+  float *scores = a->scores + (size_t)worker * a->max_keys;
+  for (int i = begin; i < end; i++) {
+    int b = i / a->num_heads, h = i % a->num_heads;
+    const float *K, *V;
+    int n_keys;
+    if (a->cross) {
+      const CrossKV *ckv = a->cache->cross[a->slots[b]];
+      K = ckv->K[a->layer];
+      V = ckv->V[a->layer];
+      n_keys = ckv->L_src;
+    } else {
+      K = a->cache->K[a->layer] + a->slots[b] * slot_size;
+      V = a->cache->V[a->layer] + a->slots[b] * slot_size;
+      n_keys = a->positions[b] + 1;
+    }
+    a->attend(a->Q + (size_t)b * a->q_stride + h * a->q_head, a->d_k,
+              K + h * a->d_k, V + h * a->d_k, a->d_model, scores, a->max_keys,
+              a->out + (size_t)b * a->d_model + h * a->d_k, a->d_k, 1, n_keys,
+              0, a->d_k);
+  }
+}
+
+static void step_attention(StepAttention *a, int n, double total_keys) {
+  // Grain from the average keys per row
+  double per_task = total_keys / n * a->d_k;
+  int grain = per_task >= STEP_ATTENTION_GRAIN_WORK
+                  ? 1
+                  : (int)(STEP_ATTENTION_GRAIN_WORK / (per_task + 1.0));
+  parallel_for(n * a->num_heads, grain, step_attention_run, a);
+}
+
+void compute_decoder_layer_step(const float *dec_input,
+                                const DecoderLayerParams *params,
+                                KVCache *cache, int layer, const int *slots,
+                                const int *positions, float *dec_output, int n,
+                                int d_model, int d_ff, int num_heads) {
+  int d_k = d_model / num_heads;
+  AttentionKernel attend = attention_kernel(d_k);
+  size_t slot_size = (size_t)cache->max_len * d_model;
+
+  int max_keys = cache->max_len;
+  for (int b = 0; b < n; b++) {
+    const CrossKV *ckv = cache->cross[slots[b]];
+    if (ckv->L_src > max_keys)
+      max_keys = ckv->L_src;
+  }
+
+  float *QKV = (float *)scratch_alloc((size_t)n * 3 * d_model * sizeof(float));
+  float *attn = (float *)scratch_alloc((size_t)n * d_model * sizeof(float));
+  float *A = (float *)scratch_alloc((size_t)n * d_model * sizeof(float));
+  float *Y1 = (float *)scratch_alloc((size_t)n * d_model * sizeof(float));
+  float *Y2 = (float *)scratch_alloc((size_t)n * d_model * sizeof(float));
+  float *scores = (float *)scratch_alloc((size_t)thread_pool_size() * max_keys *
+                                      sizeof(float));
+  int rotary = params->self_attn_params.rotary;
+  float *rope = rotary ? (float *)scratch_alloc((size_t)n * d_k * sizeof(float))
+                       : NULL;
+
+  if (!QKV || !attn || !A || !Y1 || !Y2 || !scores || (rotary && !rope)) {
+    scratch_fail("Alloc failed in decoder step");
+    scratch_free(QKV);
+    scratch_free(attn);
+    scratch_free(A);
+    scratch_free(Y1);
+    scratch_free(Y2);
+    scratch_free(scores);
+    scratch_free(rope);
+    return;
+  }
+
+  // --- Masked self-attention against the cache ---
+  // All heads' Q, K, V for every new row in a single GEMM
+  PROF_BEGIN(OP_QKV_PROJECTION);
+  matmul_strided(dec_input, d_model, params->self_attn_params.W_qkv,
+                 3 * d_model, QKV, 3 * d_model, n, 3 * d_model, d_model);
+
+  // Keys are cached already rotated to their position
+  if (rotary) {
+    sinusoidal_table(positions, n, d_k, rope);
+    for (int h = 0; h < num_heads; h++) {
+      apply_rotary(QKV + h * (3 * d_k), 3 * d_model, rope, n, d_k);
+      apply_rotary(QKV + h * (3 * d_k) + d_k, 3 * d_model, rope, n, d_k);
+    }
+  }
+
+  // Append the new keys/values first so rows of the same slot see each other
+  float *K_cache = cache->K[layer];
+  float *V_cache = cache->V[layer];
+  for (int b = 0; b < n; b++) {
+    size_t offset = slots[b] * slot_size + (size_t)positions[b] * d_model;
+    const float *row = QKV + (size_t)b * 3 * d_model;
+    for (int h = 0; h < num_heads; h++) {
+      memcpy(K_cache + offset + h * d_k, row + h * (3 * d_k) + d_k,
+             d_k * sizeof(float));
+      memcpy(V_cache + offset + h * d_k, row + h * (3 * d_k) + 2 * d_k,
+             d_k * sizeof(float));
+    }
+  }
+  PROF_END_COST(OP_QKV_PROJECTION, PROF_GEMM_FLOPS(n, 3 * d_model, d_model),
+                PROF_GEMM_BYTES(n, 3 * d_model, d_model) +
+                    4.0 * 2 * n * d_model);
+
+  // Keys attended over by all rows, for the grain and the cost accounting
+  double n_keys = 0;
+  for (int b = 0; b < n; b++)
+    n_keys += positions[b] + 1;
+  // Q sits in the interleaved QKV rows: heads 3 d_k apart
+  StepAttention sa = {.attend = attend,
+                      .cache = cache,
+                      .layer = layer,
+                      .slots = slots,
+                      .positions = positions,
+                      .Q = QKV,
+                      .q_stride = 3 * d_model,
+                      .q_head = 3 * d_k,
+                      .out = attn,
+                      .scores = scores,
+                      .max_keys = max_keys,
+                      .num_heads = num_heads,
+                      .d_k = d_k,
+                      .d_model = d_model};
+  PROF_BEGIN(OP_ATTN_CACHED);
+  step_attention(&sa, n, n_keys);
+  // per key and head: q·k, scale, softmax, weighted sum of v
+  PROF_END_COST(OP_ATTN_CACHED, n_keys * (4.0 * d_model + 6.0 * num_heads),
+                4.0 * (2.0 * n_keys * d_model + 2.0 * n * d_model));
+
+  PROF_BEGIN(OP_ATTN_OUT_PROJECTION);
+  matmul_strided(attn, d_model, params->self_attn_params.W_o, d_model, A,
+                 d_model, n, d_model, d_model);
+  PROF_END_COST(OP_ATTN_OUT_PROJECTION, PROF_GEMM_FLOPS(n, d_model, d_model),
+                PROF_GEMM_BYTES(n, d_model, d_model));
+
+  // add & norm
+  matsum(dec_input, A, A, n * d_model);
+  compute_layernorm(A, &params->ln1_params, Y1, n, d_model);
+
+  // --- Cross attention against the precomputed encoder keys/values ---
+  // (own scope so its profiling timers do not clash with the ones above)
+  {
+    const float *W_cross = params->cross_attn_params.W_qkv;
+    PROF_BEGIN(OP_QKV_PROJECTION);
+    for (int h = 0; h < num_heads; h++) {
+      // Q columns only, written into the head's slot of a (n x d_model) buffer
+      matmul_strided(Y1, d_model, W_cross + h * (3 * d_k), 3 * d_model,
+                     QKV + h * d_k, d_model, n, d_k, d_model);
+    }
+    PROF_END_COST(OP_QKV_PROJECTION, PROF_GEMM_FLOPS(n, d_model, d_model),
+                  PROF_GEMM_BYTES(n, d_model, d_model));
+
+    double n_src = 0;
+    for (int b = 0; b < n; b++)
+      n_src += cache->cross[slots[b]]->L_src;
+    // Q rows are now (n x d_model), heads d_k apart
+    sa.cross = 1;
+    sa.q_stride = d_model;
+    sa.q_head = d_k;
+    PROF_BEGIN(OP_ATTN_CACHED);
+    step_attention(&sa, n, n_src);
+    PROF_END_COST(OP_ATTN_CACHED, n_src * (4.0 * d_model + 6.0 * num_heads),
+                  4.0 * (2.0 * n_src * d_model + 2.0 * n * d_model));
+
+    PROF_BEGIN(OP_ATTN_OUT_PROJECTION);
+    matmul_strided(attn, d_model, params->cross_attn_params.W_o, d_model, A,
+                   d_model, n, d_model, d_model);
+    PROF_END_COST(OP_ATTN_OUT_PROJECTION, PROF_GEMM_FLOPS(n, d_model, d_model),
+                  PROF_GEMM_BYTES(n, d_model, d_model));
+  }
+
+  // add & norm
+  matsum(Y1, A, A, n * d_model);
+  compute_layernorm(A, &params->ln2_params, Y2, n, d_model);
+
+  // --- Feed-Forward ---
+  compute_feedforward_network(Y2, &params->ffn_params, A, n, d_model, d_ff);
+  // add & norm
+  matsum(Y2, A, A, n * d_model);
+  compute_layernorm(A, &params->ln3_params, dec_output, n, d_model);
+
+  scratch_free(QKV);
+  scratch_free(attn);
+  scratch_free(A);
+  scratch_free(Y1);
+  scratch_free(Y2);
+  scratch_free(scores);
+  scratch_free(rope);
 }
@@ -2,6 +2,7 @@
 
 #include "../include/attention.h"
 #include "../include/feedforward.h"
+#include "../include/workspace.h"
 #include "../include/init.h"
 #include "../include/layernorm.h"
 #include "../include/tensor.h"
@@ -14,14 +15,18 @@ void compute_encoder_layer(const float *X, const EncoderLayerParams *params,
                            int num_heads) {
 
   // --- 1. Allocate intermediate buffers ---
-  float *H1 = (float *)calloc(L * d_model, sizeof(float));
-  float *H1_res = (float *)calloc(L * d_model, sizeof(float));
-  float *H2 = (float *)calloc(L * d_model, sizeof(float));
-  float *H2_res = (float *)calloc(L * d_model, sizeof(float));
+  float *H1 = (float *)scratch_calloc(L * d_model, sizeof(float));
+  float *H1_res = (float *)scratch_calloc(L * d_model, sizeof(float));
+  float *H2 = (float *)scratch_calloc(L * d_model, sizeof(float));
+  float *H2_res = (float *)scratch_calloc(L * d_model, sizeof(float));
 
   if (!H1 || !H1_res || !H2 || !H2_res) {
-    fprintf(stderr, "Memory allocation failed in encoder layer.\n");
-    exit(1);
+    scratch_fail("Memory allocation failed in encoder layer.");
+    scratch_free(H1);
+    scratch_free(H1_res);
+    scratch_free(H2);
+    scratch_free(H2_res);
+    return;
   }
 
   // --- 2 Multi-head attention ---
@@ -41,8 +46,8 @@ void compute_encoder_layer(const float *X, const EncoderLayerParams *params,
   compute_layernorm(H2_res, &params->ln2_params, out, L, d_model);
 
   // --- 6. Free temporary buffers ---
-  free(H1);
-  free(H1_res);
-  free(H2);
-  free(H2_res);
+  scratch_free(H1);
+  scratch_free(H1_res);
+  scratch_free(H2);
+  scratch_free(H2_res);
 }
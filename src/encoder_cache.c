@@ -0,0 +1,245 @@
+#include "../include/encoder_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ENCODER_CACHE_BUCKETS 1024
+
+unsigned long long hash_tokens(const int *tokens, int L) {
+  // FNV-1a over the raw token ids, seeded with the length
+  unsigned long long h = 0xcbf29ce484222325ULL ^ (unsigned long long)L;
+  const unsigned char *bytes = (const unsigned char *)tokens;
+  for (size_t i = 0; i < (size_t)L * sizeof(int); i++) {
+    h ^= bytes[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+int init_encoder_cache(EncoderCache *cache, const TransformerConfig *config,
+                       size_t max_bytes, int store_cross_kv) {
+  memset(cache, 0, sizeof(*cache));
+  cache->num_layers = config->num_layers;
+  cache->d_model = config->d_model;
+  cache->store_cross_kv = store_cross_kv;
+  cache->max_bytes = max_bytes;
+  cache->num_buckets = ENCODER_CACHE_BUCKETS;
+  cache->buckets = (EncoderCacheEntry **)calloc(cache->num_buckets,
+                                                sizeof(EncoderCacheEntry *));
+  if (!cache->buckets)
+    return -1;
+  pthread_mutex_init(&cache->mutex, NULL);
+  return 0;
+}
+
+static void free_entry(EncoderCacheEntry *e) {
+  free(e->tokens);
+  free(e->enc_output);
+  free_cross_kv(&e->cross);
+  free(e);
+}
+
+void free_encoder_cache(EncoderCache *cache) {
+  if (!cache || !cache->buckets)
+    return;
+  EncoderCacheEntry *e = cache->head;
+  while (e) {
+    EncoderCacheEntry *next = e->next;
+    free_entry(e);
+    e = next;
+  }
+  free(cache->buckets);
+  pthread_mutex_destroy(&cache->mutex);
+  cache->buckets = NULL;
+  cache->head = cache->tail = NULL;
+  cache->bytes = 0;
+  cache->count = 0;
+}
+
+static void lru_unlink(EncoderCache *cache, EncoderCacheEntry *e) {
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    cache->head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    cache->tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void lru_push_front(EncoderCache *cache, EncoderCacheEntry *e) {
+  e->prev = NULL;
+  e->next = cache->head;
+  if (cache->head)
+    cache->head->prev = e;
+  cache->head = e;
+  if (!cache->tail)
+    cache->tail = e;
+}
+
+static EncoderCacheEntry *lookup(EncoderCache *cache,
+                                 const TransformerParams *params,
+                                 unsigned long long hash, const int *tokens,
+                                 int L) {
+  EncoderCacheEntry *e = cache->buckets[hash % cache->num_buckets];
+  for (; e; e = e->chain) {
+    if (e->params == params && e->hash == hash && e->L_src == L &&
+        memcmp(e->tokens, tokens, L * sizeof(int)) == 0)
+      return e;
+  }
+  return NULL;
+}
+
+static void evict_lru(EncoderCache *cache) {
+  EncoderCacheEntry *victim = cache->tail;
+  EncoderCacheEntry **link = &cache->buckets[victim->hash % cache->num_buckets];
+  while (*link != victim)
+    link = &(*link)->chain;
+  *link = victim->chain;
+
+  lru_unlink(cache, victim);
+  cache->bytes -= victim->bytes;
+  cache->count--;
+  cache->evictions++;
+  free_entry(victim);
+}
+
+// Best effort: when memory runs out the entry is simply not cached. The copy
+// is made before taking the lock; an entry another thread inserted meanwhile
+// wins.
+static void insert(EncoderCache *cache, const TransformerParams *params,
+                   unsigned long long hash, const int *tokens, int L,
+                   const float *enc_output, const CrossKV *ckv) {
+  size_t row_bytes = (size_t)L * cache->d_model * sizeof(float);
+  size_t bytes = sizeof(EncoderCacheEntry) + L * sizeof(int) + row_bytes;
+  if (cache->store_cross_kv)
+    bytes += 2 * cache->num_layers * row_bytes;
+  if (bytes > cache->max_bytes)
+    return;
+
+  EncoderCacheEntry *e =
+      (EncoderCacheEntry *)calloc(1, sizeof(EncoderCacheEntry));
+  if (!e)
+    return;
+  e->params = params;
+  e->hash = hash;
+  e->L_src = L;
+  e->bytes = bytes;
+  e->tokens = (int *)malloc(L * sizeof(int));
+  e->enc_output = (float *)malloc(row_bytes);
+  if (!e->tokens || !e->enc_output ||
+      (cache->store_cross_kv &&
+       create_cross_kv(&e->cross, cache->num_layers, cache->d_model, L) != 0)) {
+    free_entry(e);
+    return;
+  }
+  memcpy(e->tokens, tokens, L * sizeof(int));
+  memcpy(e->enc_output, enc_output, row_bytes);
+
+  if (cache->store_cross_kv) {
+    for (int l = 0; l < cache->num_layers; l++) {
+      memcpy(e->cross.K[l], ckv->K[l], row_bytes);
+      memcpy(e->cross.V[l], ckv->V[l], row_bytes);
+    }
+  }
+
+  pthread_mutex_lock(&cache->mutex);
+  if (lookup(cache, params, hash, tokens, L)) {
+    pthread_mutex_unlock(&cache->mutex);
+    free_entry(e);
+    return;
+  }
+  while (cache->bytes + bytes > cache->max_bytes)
+    evict_lru(cache);
+
+  size_t b = hash % cache->num_buckets;
+  e->chain = cache->buckets[b];
+  cache->buckets[b] = e;
+  lru_push_front(cache, e);
+  cache->bytes += bytes;
+  cache->count++;
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+int compute_encoder_cached(EncoderCache *cache, const int *src_tokens,
+                           int L_src, const TransformerParams *params,
+                           float *enc_output, CrossKV *ckv) {
+  size_t row_bytes = (size_t)L_src * params->config.d_model * sizeof(float);
+  unsigned long long hash = 0;
+
+  float *enc = enc_output;
+
+  // Entries are sized for the cache's layout; other models bypass it
+  if (cache && (params->config.d_model != cache->d_model ||
+                params->config.num_layers != cache->num_layers))
+    cache = NULL;
+
+  // --- 1. Hit: copy out, skipping the encoder ---
+  if (cache) {
+    hash = hash_tokens(src_tokens, L_src);
+    pthread_mutex_lock(&cache->mutex);
+    EncoderCacheEntry *e = lookup(cache, params, hash, src_tokens, L_src);
+    if (e) {
+      cache->hits++;
+      lru_unlink(cache, e);
+      lru_push_front(cache, e);
+
+      // Copied under the lock, since another thread may evict the entry
+      // right after; the cross K/V projection, if needed, runs outside it
+      int project = ckv && !cache->store_cross_kv;
+      if (!enc && project)
+        enc = (float *)malloc(row_bytes);
+      if (enc)
+        memcpy(enc, e->enc_output, row_bytes);
+      if (ckv && cache->store_cross_kv) {
+        for (int l = 0; l < cache->num_layers; l++) {
+          memcpy(ckv->K[l], e->cross.K[l], row_bytes);
+          memcpy(ckv->V[l], e->cross.V[l], row_bytes);
+        }
+      }
+      pthread_mutex_unlock(&cache->mutex);
+
+      if (project && !enc)
+        return -1;
+      if (project)
+        compute_cross_kv(params, enc, ckv);
+      if (enc != enc_output)
+        free(enc);
+      return 0;
+    }
+    cache->misses++;
+    pthread_mutex_unlock(&cache->mutex);
+  }
+
+  // --- 2. Miss: run the encoder ---
+  if (!enc) {
+    enc = (float *)malloc(row_bytes);
+    if (!enc)
+      return -1;
+  }
+  compute_encoder(src_tokens, params, enc, L_src);
+
+  // Cross K/V are needed for insertion even if the caller did not ask; the
+  // entry is only left out of the cache if they cannot be allocated
+  CrossKV tmp_ckv;
+  CrossKV *cross = ckv;
+  if (!cross && cache && cache->store_cross_kv) {
+    if (create_cross_kv(&tmp_ckv, params->config.num_layers,
+                        params->config.d_model, L_src) == 0)
+      cross = &tmp_ckv;
+    else
+      cache = NULL;
+  }
+  if (cross)
+    compute_cross_kv(params, enc, cross);
+
+  if (cache)
+    insert(cache, params, hash, src_tokens, L_src, enc, cross);
+
+  if (cross && cross != ckv)
+    free_cross_kv(&tmp_ckv);
+  if (enc != enc_output)
+    free(enc);
+  return 0;
+}
@@ -1,47 +1,48 @@
 #include "../include/feedforward.h"
+#include "../include/workspace.h"
+#include "../include/kernels.h"
 #include "../include/math_utils.h"
+#include "../include/profiler.h"
 #include "../include/tensor.h"
 #include "../include/utils.h"
 
 #include <stdlib.h>
 #include <string.h>
 
-#ifdef USE_OPENBLAS
-#include <cblas.h>
-#endif
-
 void compute_feedforward_network(const float *input,
                                  const FeedForwardParams *params, float *output,
                                  int L, int d_model, int d_ff) {
 
   //--1-- Linear Layer 1: H1 = X * W1 + B1
-  float *H1_pre_act = calloc((size_t)L * d_ff, sizeof(float));
-  if (!H1_pre_act)
+  float *H1_pre_act = (float *)scratch_calloc((size_t)L * d_ff, sizeof(float));
+  if (!H1_pre_act) {
+    scratch_fail("Alloc failed in feed-forward network");
     return;
+  }
 
-#ifdef USE_OPENBLAS
-  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, L, d_ff, d_model, 1.0f,
-              input, d_model, params->W1, d_ff, 0.0f, H1_pre_act, d_ff);
-
-#else
-  matmul_blocked(input, params->W1, H1_pre_act, L, d_ff, d_model);
-
-#endif
+  const KernelTable *kt = kernels();
+  PROF_BEGIN(OP_FFN_GEMM1);
+  kt->gemm(input, d_model, params->W1, d_ff, H1_pre_act, d_ff, L, d_ff,
+           d_model);
   matrix_add_vector_bias(H1_pre_act, params->B1, L, d_ff);
+  PROF_END_COST(OP_FFN_GEMM1,
+                PROF_GEMM_FLOPS(L, d_ff, d_model) + (double)L * d_ff,
+                PROF_GEMM_BYTES(L, d_ff, d_model) + 4.0 * d_ff);
 
   //--2-- Activation: H1 = GeLu(H1_pre_act)
-  apply_gelu(H1_pre_act, L, d_ff);
+  PROF_BEGIN(OP_FFN_GELU);
+  kt->gelu(H1_pre_act, L * d_ff);
+  // tanh approximation, counting tanh as one op
+  PROF_END_COST(OP_FFN_GELU, 9.0 * L * d_ff, 8.0 * L * d_ff);
 
   //--3-- Linear Layer 2: Output = H1 * W2 + B2
-#ifdef USE_OPENBLAS
-  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, L, d_model, d_ff, 1.0f,
-              H1_pre_act, d_ff, params->W2, d_model, 0.0f, output, d_model);
-
-#else
-  matmul_blocked(H1_pre_act, params->W2, output, L, d_model, d_ff);
-
-#endif
+  PROF_BEGIN(OP_FFN_GEMM2);
+  kt->gemm(H1_pre_act, d_ff, params->W2, d_model, output, d_model, L, d_model,
+           d_ff);
   matrix_add_vector_bias(output, params->B2, L, d_model);
+  PROF_END_COST(OP_FFN_GEMM2,
+                PROF_GEMM_FLOPS(L, d_model, d_ff) + (double)L * d_model,
+                PROF_GEMM_BYTES(L, d_model, d_ff) + 4.0 * d_model);
 
-  free(H1_pre_act);
+  scratch_free(H1_pre_act);
 }
@@ -0,0 +1,182 @@
+// MAP_ANONYMOUS, MAP_HUGETLB and MADV_HUGEPAGE are Linux extensions
+#define _GNU_SOURCE
+#include "../include/huge_alloc.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Mapped blocks, so huge_free can tell them from heap pointers
+typedef struct {
+  void *p;
+  size_t bytes; // Mapping length
+  int hugetlb;
+} HugeBlock;
+
+static struct {
+  int mode; // -1: not read from the environment yet
+  HugeBlock *blocks;
+  int n_blocks, cap_blocks;
+  HugeAllocStats stats;
+  pthread_mutex_t mutex;
+} state = {.mode = -1, .mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static int env_mode(void) {
+  const char *env = getenv("TRANSFORMER_HUGEPAGES");
+  if (!env || strcmp(env, "thp") == 0)
+    return HUGE_PAGES_THP;
+  if (strcmp(env, "off") == 0 || strcmp(env, "0") == 0)
+    return HUGE_PAGES_OFF;
+  if (strcmp(env, "hugetlb") == 0)
+    return HUGE_PAGES_HUGETLB;
+  fprintf(stderr, "warning: unknown TRANSFORMER_HUGEPAGES=%s, using thp\n",
+          env);
+  return HUGE_PAGES_THP;
+}
+
+HugePageMode huge_pages_mode(void) {
+  pthread_mutex_lock(&state.mutex);
+  if (state.mode < 0)
+    state.mode = env_mode();
+  int mode = state.mode;
+  pthread_mutex_unlock(&state.mutex);
+  return (HugePageMode)mode;
+}
+
+void huge_pages_set_mode(HugePageMode mode) {
+  pthread_mutex_lock(&state.mutex);
+  state.mode = mode;
+  pthread_mutex_unlock(&state.mutex);
+}
+
+static size_t round_up(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+static void *map_hugetlb(size_t bytes) {
+  void *p = mmap(NULL, round_up(bytes, HUGE_PAGE_SIZE), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+// Over-map by one huge page, trim to a 2MB-aligned start, then advise. The
+// tail past the last whole huge page stays in normal pages.
+static void *map_thp(size_t bytes) {
+  size_t len = round_up(bytes, (size_t)sysconf(_SC_PAGESIZE));
+  char *raw = mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED)
+    return NULL;
+  char *p = (char *)round_up((uintptr_t)raw, HUGE_PAGE_SIZE);
+  if (p > raw)
+    munmap(raw, p - raw);
+  size_t tail = (raw + len + HUGE_PAGE_SIZE) - (p + len);
+  if (tail)
+    munmap(p + len, tail);
+  // Refused when THP is disabled: the mapping simply keeps 4KB pages
+  madvise(p, len, MADV_HUGEPAGE);
+  return p;
+}
+
+static int record_block(void *p, size_t bytes, int hugetlb) {
+  pthread_mutex_lock(&state.mutex);
+  if (state.n_blocks == state.cap_blocks) {
+    int cap = state.cap_blocks ? 2 * state.cap_blocks : 64;
+    HugeBlock *b =
+        (HugeBlock *)realloc(state.blocks, cap * sizeof(HugeBlock));
+    if (!b) {
+      pthread_mutex_unlock(&state.mutex);
+      return -1;
+    }
+    state.blocks = b;
+    state.cap_blocks = cap;
+  }
+  state.blocks[state.n_blocks++] = (HugeBlock){p, bytes, hugetlb};
+  if (hugetlb)
+    state.stats.hugetlb_bytes += bytes;
+  else
+    state.stats.thp_bytes += bytes;
+  pthread_mutex_unlock(&state.mutex);
+  return 0;
+}
+
+// *mapped tells whether the block is a fresh (zeroed) mapping
+static void *alloc_block(size_t bytes, int *mapped) {
+  HugePageMode mode = huge_pages_mode();
+  *mapped = 0;
+  if (mode == HUGE_PAGES_OFF || bytes < HUGE_PAGE_SIZE) {
+    void *p = NULL;
+    if (posix_memalign(&p, HUGE_ALLOC_ALIGN,
+                       round_up(bytes ? bytes : 1, HUGE_ALLOC_ALIGN)) != 0)
+      return NULL;
+    return p;
+  }
+
+  void *p = mode == HUGE_PAGES_HUGETLB ? map_hugetlb(bytes) : NULL;
+  int hugetlb = p != NULL;
+  size_t len = hugetlb ? round_up(bytes, HUGE_PAGE_SIZE)
+                       : round_up(bytes, (size_t)sysconf(_SC_PAGESIZE));
+  if (!p)
+    p = map_thp(bytes);
+  if (!p)
+    return NULL;
+  if (record_block(p, len, hugetlb) != 0) {
+    munmap(p, len);
+    return NULL;
+  }
+  *mapped = 1;
+  return p;
+}
+
+void *huge_alloc(size_t bytes) {
+  int mapped;
+  return alloc_block(bytes, &mapped);
+}
+
+void *huge_calloc(size_t count, size_t size) {
+  if (size && count > SIZE_MAX / size)
+    return NULL;
+  int mapped;
+  void *p = alloc_block(count * size, &mapped);
+  // Fresh anonymous mappings are already zero
+  if (p && !mapped)
+    memset(p, 0, count * size);
+  return p;
+}
+
+void huge_free(void *p) {
+  if (!p)
+    return;
+  pthread_mutex_lock(&state.mutex);
+  for (int i = state.n_blocks - 1; i >= 0; i--) {
+    if (state.blocks[i].p != p)
+      continue;
+    HugeBlock b = state.blocks[i];
+    state.blocks[i] = state.blocks[--state.n_blocks];
+    if (b.hugetlb)
+      state.stats.hugetlb_bytes -= b.bytes;
+    else
+      state.stats.thp_bytes -= b.bytes;
+    pthread_mutex_unlock(&state.mutex);
+    munmap(b.p, b.bytes);
+    return;
+  }
+  pthread_mutex_unlock(&state.mutex);
+  free(p);
+}
+
+void huge_release(void *p, size_t bytes) {
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = ((uintptr_t)p + page - 1) & ~(page - 1);
+  uintptr_t end = ((uintptr_t)p + bytes) & ~(page - 1);
+  if (p && end > start)
+    madvise((void *)start, end - start, MADV_DONTNEED);
+}
+
+void huge_alloc_stats(HugeAllocStats *stats) {
+  pthread_mutex_lock(&state.mutex);
+  *stats = state.stats;
+  pthread_mutex_unlock(&state.mutex);
+}
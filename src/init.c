@@ -1,4 +1,5 @@
 #include "../include/init.h"
+#include "../include/huge_alloc.h"
 #include "../include/transformer.h"
 
 #include <math.h>
@@ -11,6 +12,45 @@ void fill_random(float *M, int N) {
     M[i] = (float)rand() / RAND_MAX;
 }
 
+// Initial values, shared by the init_* functions and
+// create_transformer_params so both consume rand() in the same order
+static void fill_attention_params(AttentionParams *params, int d_model,
+                                  int random_init) {
+  size_t qkv_size = (size_t)d_model * 3 * d_model;
+  size_t wo_size = (size_t)d_model * d_model;
+  for (size_t i = 0; i < qkv_size; i++) {
+    params->W_qkv[i] =
+        random_init ? ((float)rand() / RAND_MAX - 0.5f) * 0.1f : 0.0f;
+  }
+
+  for (size_t i = 0; i < wo_size; i++) {
+    params->W_o[i] =
+        random_init ? ((float)rand() / RAND_MAX - 0.5f) * 0.1f : 0.0f;
+  }
+}
+
+static void fill_layernorm_params(LayerNormParams *params, int d_model) {
+  // gamma (scale) 1.0, beta (bias) 0.0 — standard defaults
+  for (int i = 0; i < d_model; i++) {
+    params->gamma[i] = 1.0f;
+    params->beta[i] = 0.0f;
+  }
+}
+
+static void fill_feedforward_params(FeedForwardParams *params, int d_model,
+                                    int d_ff) {
+  float limit = sqrtf(6.0f / (d_model + d_ff));
+
+  // Xavier G(lorot Initialization
+  for (int i = 0; i < d_model * d_ff; i++)
+    params->W1[i] = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * limit;
+
+  for (int i = 0; i < d_ff * d_model; i++)
+    params->W2[i] = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * limit;
+  memset(params->B1, 0, d_ff * sizeof(float));
+  memset(params->B2, 0, d_model * sizeof(float));
+}
+
 // AttentionParams
 void init_attention_params(AttentionParams *params, int d_model, int num_heads,
                            int random_init) {
@@ -26,8 +66,8 @@ void init_attention_params(AttentionParams *params, int d_model, int num_heads,
   size_t qkv_size = (size_t)d_model * 3 * d_k * num_heads;
   size_t wo_size = (size_t)d_model * d_model;
 
-  params->W_qkv = malloc(sizeof(float) * qkv_size);
-  params->W_o = malloc(sizeof(float) * wo_size);
+  params->W_qkv = (float *)huge_alloc(sizeof(float) * qkv_size);
+  params->W_o = (float *)huge_alloc(sizeof(float) * wo_size);
 
   if (!params->W_qkv || !params->W_o) {
     fprintf(stderr, "Error: failed to allocate W_qkv or W_o\n");
@@ -35,23 +75,14 @@ void init_attention_params(AttentionParams *params, int d_model, int num_heads,
     exit(1);
   }
 
-  // Initialize parameters
-  for (size_t i = 0; i < qkv_size; i++) {
-    params->W_qkv[i] =
-        random_init ? ((float)rand() / RAND_MAX - 0.5f) * 0.1f : 0.0f;
-  }
-
-  for (size_t i = 0; i < wo_size; i++) {
-    params->W_o[i] =
-        random_init ? ((float)rand() / RAND_MAX - 0.5f) * 0.1f : 0.0f;
-  }
+  fill_attention_params(params, d_model, random_init);
 }
 
 void free_attention_params(AttentionParams *params) {
   if (!params)
     return;
-  free(params->W_qkv);
-  free(params->W_o);
+  huge_free(params->W_qkv);
+  huge_free(params->W_o);
   params->W_qkv = NULL;
   params->W_o = NULL;
 }
@@ -63,8 +94,8 @@ void init_layernorm_params(LayerNormParams *params, int d_model) {
     exit(1);
   }
 
-  params->gamma = (float *)calloc(d_model, sizeof(float));
-  params->beta = (float *)calloc(d_model, sizeof(float));
+  params->gamma = (float *)huge_calloc(d_model, sizeof(float));
+  params->beta = (float *)huge_calloc(d_model, sizeof(float));
 
   if (!params->gamma || !params->beta) {
     fprintf(stderr, "Memory allocation failed for LayerNormParams.\n");
@@ -72,18 +103,14 @@ void init_layernorm_params(LayerNormParams *params, int d_model) {
     exit(1);
   }
 
-  // Initialize gamma (scale) to 1.0, beta (bias) to 0.0 — standard defaults
-  for (int i = 0; i < d_model; i++) {
-    params->gamma[i] = 1.0f;
-    params->beta[i] = 0.0f;
-  }
+  fill_layernorm_params(params, d_model);
 }
 
 void free_layernorm_params(LayerNormParams *params) {
   if (!params)
     return;
-  free(params->gamma);
-  free(params->beta);
+  huge_free(params->gamma);
+  huge_free(params->beta);
   params->gamma = NULL;
   params->beta = NULL;
 }
@@ -95,10 +122,10 @@ void init_feedforward_params(FeedForwardParams *params, int d_model, int d_ff) {
     exit(1);
   }
 
-  params->W1 = (float *)malloc(d_model * d_ff * sizeof(float));
-  params->B1 = (float *)calloc(d_ff, sizeof(float));
-  params->W2 = (float *)malloc(d_ff * d_model * sizeof(float));
-  params->B2 = (float *)calloc(d_model, sizeof(float));
+  params->W1 = (float *)huge_alloc((size_t)d_model * d_ff * sizeof(float));
+  params->B1 = (float *)huge_calloc(d_ff, sizeof(float));
+  params->W2 = (float *)huge_alloc((size_t)d_ff * d_model * sizeof(float));
+  params->B2 = (float *)huge_calloc(d_model, sizeof(float));
 
   if (!params->W1 || !params->W2 || !params->B1 || !params->B2) {
     fprintf(stderr, "Memory allocation failed for FeedForwardParams");
@@ -106,23 +133,16 @@ void init_feedforward_params(FeedForwardParams *params, int d_model, int d_ff) {
     exit(1);
   }
 
-  float limit = sqrtf(6.0f / (d_model + d_ff));
-
-  // Xavier G(lorot Initialization
-  for (int i = 0; i < d_model * d_ff; i++)
-    params->W1[i] = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * limit;
-
-  for (int i = 0; i < d_ff * d_model; i++)
-    params->W2[i] = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * limit;
+  fill_feedforward_params(params, d_model, d_ff);
 }
 
 void free_feedforward_params(FeedForwardParams *params) {
   if (!params)
     return;
-  free(params->W1);
-  free(params->B1);
-  free(params->W2);
-  free(params->B2);
+  huge_free(params->W1);
+  huge_free(params->B1);
+  huge_free(params->W2);
+  huge_free(params->B2);
   params->W1 = params->W2 = params->B1 = params->B2 = NULL;
 }
 
@@ -179,53 +199,260 @@ void free_decoder_layer_params(DecoderLayerParams *params) {
   free_layernorm_params(&(params->ln3_params));
 }
 
-void init_transformer_params(TransformerParams *params,
-                             TransformerConfig config) {
+static void alloc_tensor(float **tensor, size_t count, void *ctx) {
+  *tensor = (float *)huge_alloc(count * sizeof(float));
+  if (!*tensor)
+    *(int *)ctx = 1;
+}
+
+// Self-attention of a POS_ROTARY model rotates Q / K; cross-attention never
+static void set_rotary(TransformerParams *params) {
+  int rotary = params->config.pos_mode == POS_ROTARY;
+  for (int i = 0; i < params->config.num_layers; i++) {
+    params->encoder_layers[i].attn_params.rotary = rotary;
+    params->decoder_layers[i].self_attn_params.rotary = rotary;
+  }
+}
+
+int create_transformer_params(TransformerParams *params,
+                              TransformerConfig config) {
+  memset(params, 0, sizeof(*params));
   params->config = config;
+  params->encoder_layers = (EncoderLayerParams *)calloc(
+      config.num_layers, sizeof(EncoderLayerParams));
+  params->decoder_layers = (DecoderLayerParams *)calloc(
+      config.num_layers, sizeof(DecoderLayerParams));
+  if (config.num_layers > 0 &&
+      (!params->encoder_layers || !params->decoder_layers)) {
+    free_transformer_params(params);
+    return -1;
+  }
+  set_rotary(params);
+
+  // Weights live in huge pages (huge_alloc.h): GEMMs stream through them
+  int failed = 0;
+  transformer_params_foreach(params, alloc_tensor, &failed);
+  if (failed) {
+    free_transformer_params(params);
+    return -1;
+  }
 
   // 1. Embeddings
-  params->token_embedding =
-      (float *)malloc(config.vocab_size * config.d_model * sizeof(float));
-  params->pos_encoding =
-      (float *)malloc(config.max_seq_len * config.d_model * sizeof(float));
-
   fill_random(params->token_embedding, config.vocab_size * config.d_model);
-  fill_random(params->pos_encoding, config.max_seq_len * config.d_model);
+  if (config.pos_mode == POS_LEARNED)
+    fill_random(params->pos_encoding, config.max_seq_len * config.d_model);
 
   // 2. Encoder Layers
-  params->encoder_layers = (EncoderLayerParams *)malloc(
-      config.num_layers * sizeof(EncoderLayerParams));
   for (int i = 0; i < config.num_layers; i++) {
-    init_encoder_params(&params->encoder_layers[i], config.d_model, config.d_ff,
-                        config.num_heads, 1);
+    EncoderLayerParams *e = &params->encoder_layers[i];
+    fill_attention_params(&e->attn_params, config.d_model, 1);
+    fill_layernorm_params(&e->ln1_params, config.d_model);
+    fill_feedforward_params(&e->ffn_params, config.d_model, config.d_ff);
+    fill_layernorm_params(&e->ln2_params, config.d_model);
   }
 
   // 3. Decoder Layers
-  params->decoder_layers = (DecoderLayerParams *)malloc(
-      config.num_layers * sizeof(DecoderLayerParams));
   for (int i = 0; i < config.num_layers; i++) {
-    init_decoder_layer_params(&params->decoder_layers[i], config.d_model,
-                               config.d_ff, config.num_heads, 1);
+    DecoderLayerParams *d = &params->decoder_layers[i];
+    fill_attention_params(&d->self_attn_params, config.d_model, 1);
+    fill_layernorm_params(&d->ln1_params, config.d_model);
+    fill_attention_params(&d->cross_attn_params, config.d_model, 1);
+    fill_layernorm_params(&d->ln2_params, config.d_model);
+    fill_feedforward_params(&d->ffn_params, config.d_model, config.d_ff);
+    fill_layernorm_params(&d->ln3_params, config.d_model);
   }
 
   // 4. Output Projection
-  params->output_projection =
-      (float *)malloc(config.d_model * config.vocab_size * sizeof(float));
   fill_random(params->output_projection, config.d_model * config.vocab_size);
+  return 0;
+}
+
+void init_transformer_params(TransformerParams *params,
+                             TransformerConfig config) {
+  if (create_transformer_params(params, config) != 0) {
+    fprintf(stderr, "Memory allocation failed for TransformerParams\n");
+    exit(1);
+  }
 }
 
 void free_transformer_params(TransformerParams *params) {
   if (!params)
     return;
 
-  free(params->token_embedding);
-  free(params->pos_encoding);
+  huge_free(params->token_embedding);
+  huge_free(params->pos_encoding);
 
-  for (int i = 0; i < params->config.num_layers; i++) {
+  for (int i = 0; params->encoder_layers && i < params->config.num_layers; i++)
     free_encoder_params(&params->encoder_layers[i]);
+  for (int i = 0; params->decoder_layers && i < params->config.num_layers; i++)
     free_decoder_layer_params(&params->decoder_layers[i]);
+  free(params->encoder_layers);
+  free(params->decoder_layers);
+  huge_free(params->output_projection);
+}
+
+static void attention_foreach(AttentionParams *p, int d_model, ParamTensorFn fn,
+                              void *ctx) {
+  fn(&p->W_qkv, (size_t)d_model * 3 * d_model, ctx);
+  fn(&p->W_o, (size_t)d_model * d_model, ctx);
+}
+
+static void layernorm_foreach(LayerNormParams *p, int d_model,
+                              ParamTensorFn fn, void *ctx) {
+  fn(&p->gamma, d_model, ctx);
+  fn(&p->beta, d_model, ctx);
+}
+
+static void feedforward_foreach(FeedForwardParams *p, int d_model, int d_ff,
+                                ParamTensorFn fn, void *ctx) {
+  fn(&p->W1, (size_t)d_model * d_ff, ctx);
+  fn(&p->B1, d_ff, ctx);
+  fn(&p->W2, (size_t)d_ff * d_model, ctx);
+  fn(&p->B2, d_model, ctx);
+}
+
+void transformer_params_foreach(TransformerParams *params, ParamTensorFn fn,
+                                void *ctx) {
+  TransformerConfig c = params->config;
+
+  fn(&params->token_embedding, (size_t)c.vocab_size * c.d_model, ctx);
+  if (c.pos_mode == POS_LEARNED)
+    fn(&params->pos_encoding, (size_t)c.max_seq_len * c.d_model, ctx);
+
+  for (int i = 0; i < c.num_layers; i++) {
+    EncoderLayerParams *e = &params->encoder_layers[i];
+    attention_foreach(&e->attn_params, c.d_model, fn, ctx);
+    layernorm_foreach(&e->ln1_params, c.d_model, fn, ctx);
+    feedforward_foreach(&e->ffn_params, c.d_model, c.d_ff, fn, ctx);
+    layernorm_foreach(&e->ln2_params, c.d_model, fn, ctx);
   }
+  for (int i = 0; i < c.num_layers; i++) {
+    DecoderLayerParams *d = &params->decoder_layers[i];
+    attention_foreach(&d->self_attn_params, c.d_model, fn, ctx);
+    layernorm_foreach(&d->ln1_params, c.d_model, fn, ctx);
+    attention_foreach(&d->cross_attn_params, c.d_model, fn, ctx);
+    layernorm_foreach(&d->ln2_params, c.d_model, fn, ctx);
+    feedforward_foreach(&d->ffn_params, c.d_model, c.d_ff, fn, ctx);
+    layernorm_foreach(&d->ln3_params, c.d_model, fn, ctx);
+  }
+
+  fn(&params->output_projection, (size_t)c.d_model * c.vocab_size, ctx);
+}
+
+// Replace a pointer still aimed at the source tensor with a private copy
+static void copy_tensor(float **tensor, size_t count, void *ctx) {
+  (void)ctx;
+  float *copy = (float *)huge_alloc(count * sizeof(float));
+  if (!copy) {
+    fprintf(stderr, "Alloc failed in copy_transformer_params\n");
+    exit(1);
+  }
+  memcpy(copy, *tensor, count * sizeof(float));
+  *tensor = copy;
+}
+
+void copy_transformer_params(TransformerParams *dst,
+                             const TransformerParams *src) {
+  int L = src->config.num_layers;
+  *dst = *src;
+  dst->pager = NULL; // The copy is fully resident
+  dst->encoder_layers =
+      (EncoderLayerParams *)malloc(L * sizeof(EncoderLayerParams));
+  dst->decoder_layers =
+      (DecoderLayerParams *)malloc(L * sizeof(DecoderLayerParams));
+  if (!dst->encoder_layers || !dst->decoder_layers) {
+    fprintf(stderr, "Alloc failed in copy_transformer_params\n");
+    exit(1);
+  }
+  memcpy(dst->encoder_layers, src->encoder_layers,
+         L * sizeof(EncoderLayerParams));
+  memcpy(dst->decoder_layers, src->decoder_layers,
+         L * sizeof(DecoderLayerParams));
+  transformer_params_foreach(dst, copy_tensor, NULL);
+}
+
+static size_t packed_tensor_bytes(size_t count) {
+  size_t bytes = count * sizeof(float);
+  return (bytes + TRANSFORMER_PACK_ALIGN - 1) / TRANSFORMER_PACK_ALIGN *
+         TRANSFORMER_PACK_ALIGN;
+}
+
+typedef struct {
+  char *base; // NULL when only measuring
+  size_t offset;
+} PackCtx;
+
+static void measure_tensor(float **tensor, size_t count, void *ctx) {
+  (void)tensor;
+  ((PackCtx *)ctx)->offset += packed_tensor_bytes(count);
+}
+
+static void pack_tensor(float **tensor, size_t count, void *ctx) {
+  PackCtx *c = (PackCtx *)ctx;
+  memcpy(c->base + c->offset, *tensor, count * sizeof(float));
+  c->offset += packed_tensor_bytes(count);
+}
+
+static void view_tensor(float **tensor, size_t count, void *ctx) {
+  PackCtx *c = (PackCtx *)ctx;
+  *tensor = (float *)(c->base + c->offset);
+  c->offset += packed_tensor_bytes(count);
+}
+
+// Layer arrays of a view; their tensor pointers are filled in by foreach
+static int alloc_layer_arrays(TransformerParams *params,
+                              TransformerConfig config) {
+  memset(params, 0, sizeof(*params));
+  params->config = config;
+  params->encoder_layers = (EncoderLayerParams *)calloc(
+      config.num_layers, sizeof(EncoderLayerParams));
+  params->decoder_layers = (DecoderLayerParams *)calloc(
+      config.num_layers, sizeof(DecoderLayerParams));
+  if (config.num_layers > 0 &&
+      (!params->encoder_layers || !params->decoder_layers)) {
+    free_transformer_params_view(params);
+    return -1;
+  }
+  set_rotary(params);
+  return 0;
+}
+
+size_t transformer_params_packed_bytes(TransformerConfig config) {
+  // Measure a model without layers and one with a single layer on the
+  // stack; every further layer adds the same amount
+  EncoderLayerParams enc;
+  DecoderLayerParams dec;
+  size_t bytes[2];
+  for (int n = 0; n < 2; n++) {
+    TransformerParams shape = {.config = config};
+    shape.config.num_layers = n;
+    shape.encoder_layers = &enc;
+    shape.decoder_layers = &dec;
+    PackCtx c = {NULL, 0};
+    transformer_params_foreach(&shape, measure_tensor, &c);
+    bytes[n] = c.offset;
+  }
+  return bytes[0] + (size_t)config.num_layers * (bytes[1] - bytes[0]);
+}
+
+void pack_transformer_params(const TransformerParams *src, void *dst) {
+  PackCtx c = {(char *)dst, 0};
+  // pack_tensor only reads the tensors
+  transformer_params_foreach((TransformerParams *)src, pack_tensor, &c);
+}
+
+int view_transformer_params(TransformerParams *params,
+                            TransformerConfig config, void *packed) {
+  if (alloc_layer_arrays(params, config) != 0)
+    return -1;
+  PackCtx c = {(char *)packed, 0};
+  transformer_params_foreach(params, view_tensor, &c);
+  return 0;
+}
+
+void free_transformer_params_view(TransformerParams *params) {
   free(params->encoder_layers);
   free(params->decoder_layers);
-  free(params->output_projection);
+  params->encoder_layers = NULL;
+  params->decoder_layers = NULL;
 }
@@ -0,0 +1,1525 @@
+#include "../include/kernels.h"
+#include "../include/math_utils.h"
+#include "../include/thread_pool.h"
+
+#ifdef USE_OPENBLAS
+#include <cblas.h>
+#endif
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define KERNELS_HAVE_SIMD 1
+#define SIMD_TARGET __attribute__((target("avx2,fma")))
+#endif
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static GemmTiles gemm_tiles_for(KernelBackend backend, int M, int N, int K);
+
+// Serial GEMM over one block of C with the given tiles; the table entries
+// look the tiles up once and spread blocks over the thread pool
+typedef void (*GemmTiledFn)(const float *A, int lda, const float *B, int ldb,
+                            float *C, int ldc, int M, int N, int K,
+                            GemmTiles t);
+static void parallel_gemm(KernelBackend backend, GemmTiledFn fn, int nt,
+                          const float *A, int lda, const float *B, int ldb,
+                          float *C, int ldc, int M, int N, int K);
+
+// Tile extent along a dimension of size n; 0 means untiled
+static int tile_extent(int tile, int n) { return tile > 0 && tile < n ? tile : n; }
+
+// ---------------------------------------------------------------------------
+// Reference: straightforward loops
+
+static void gemm_reference(const float *A, int lda, const float *B, int ldb,
+                           float *C, int ldc, int M, int N, int K) {
+  for (int i = 0; i < M; i++) {
+    float *C_i = C + (size_t)i * ldc;
+    memset(C_i, 0, N * sizeof(float));
+    for (int k = 0; k < K; k++) {
+      float a_ik = A[(size_t)i * lda + k];
+      const float *B_k = B + (size_t)k * ldb;
+      for (int j = 0; j < N; j++)
+        C_i[j] += a_ik * B_k[j];
+    }
+  }
+}
+
+static void gemm_nt_reference(const float *A, int lda, const float *B, int ldb,
+                              float *C, int ldc, int M, int N, int K) {
+  for (int i = 0; i < M; i++) {
+    for (int j = 0; j < N; j++) {
+      float sum = 0.0f;
+      for (int k = 0; k < K; k++)
+        sum += A[(size_t)i * lda + k] * B[(size_t)j * ldb + k];
+      C[(size_t)i * ldc + j] = sum;
+    }
+  }
+}
+
+static void layernorm_reference(const float *in, const float *gamma,
+                                const float *beta, float *out, int rows,
+                                int cols) {
+  for (int i = 0; i < rows; i++) {
+    const float *X_i = in + (size_t)i * cols;
+    float *Y_i = out + (size_t)i * cols;
+    float mean, var;
+    compute_mean_variance(X_i, cols, &mean, &var);
+    for (int j = 0; j < cols; j++) {
+      float x_hat = (X_i[j] - mean) / sqrtf(var);
+      Y_i[j] = gamma[j] * x_hat + beta[j];
+    }
+  }
+}
+
+static void gelu_reference(float *x, int n) { apply_gelu(x, 1, n); }
+
+// ---------------------------------------------------------------------------
+// Blocked: MC x NC tiles of C over KC-deep slices so A, B and C blocks stay in
+// cache; tile sizes come from the autotuner (64 each until tuned)
+
+static void gemm_blocked_tiled(const float *A, int lda, const float *B,
+                               int ldb, float *C, int ldc, int M, int N, int K,
+                               GemmTiles t) {
+  int mc = tile_extent(t.mc, M), nc = tile_extent(t.nc, N),
+      kc = tile_extent(t.kc, K);
+
+  for (int i = 0; i < M; i++)
+    memset(C + (size_t)i * ldc, 0, N * sizeof(float));
+
+  for (int ii = 0; ii < M; ii += mc) {
+    for (int jj = 0; jj < N; jj += nc) {
+      for (int kk = 0; kk < K; kk += kc) {
+
+        int i_max = (ii + mc > M) ? M : ii + mc;
+        int j_max = (jj + nc > N) ? N : jj + nc;
+        int k_max = (kk + kc > K) ? K : kk + kc;
+
+        for (int i = ii; i < i_max; i++) {
+          float *C_i = C + (size_t)i * ldc;
+          for (int k = kk; k < k_max; k++) {
+            float a_ik = A[(size_t)i * lda + k];
+            const float *B_k = B + (size_t)k * ldb;
+            for (int j = jj; j < j_max; j++)
+              C_i[j] += a_ik * B_k[j];
+          }
+        }
+      }
+    }
+  }
+}
+
+// Dot-product form over contiguous rows of A and B, no transposed copy. An
+// MC x NC block of C reuses NC rows of B from cache; K is not split (the NT
+// products here are Q x K^T with K = d_k).
+static void gemm_nt_blocked_tiled(const float *A, int lda, const float *B,
+                                  int ldb, float *C, int ldc, int M, int N,
+                                  int K, GemmTiles t) {
+  int mc = tile_extent(t.mc, M), nc = tile_extent(t.nc, N);
+
+  for (int ii = 0; ii < M; ii += mc) {
+    for (int jj = 0; jj < N; jj += nc) {
+      int i_max = (ii + mc > M) ? M : ii + mc;
+      int j_max = (jj + nc > N) ? N : jj + nc;
+      for (int i = ii; i < i_max; i++) {
+        const float *A_i = A + (size_t)i * lda;
+        for (int j = jj; j < j_max; j++) {
+          const float *B_j = B + (size_t)j * ldb;
+          float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+          int k = 0;
+          for (; k + 4 <= K; k += 4) {
+            s0 += A_i[k] * B_j[k];
+            s1 += A_i[k + 1] * B_j[k + 1];
+            s2 += A_i[k + 2] * B_j[k + 2];
+            s3 += A_i[k + 3] * B_j[k + 3];
+          }
+          for (; k < K; k++)
+            s0 += A_i[k] * B_j[k];
+          C[(size_t)i * ldc + j] = (s0 + s1) + (s2 + s3);
+        }
+      }
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// SIMD: AVX2 + FMA, compiled for x86-64 and enabled when the CPU has them
+
+#ifdef KERNELS_HAVE_SIMD
+
+// Four rows of C, 16 then 8 columns per register block. With accumulate set
+// the product is added to C (later KC slices), otherwise it overwrites C.
+SIMD_TARGET static void gemm_simd_4rows(const float *A, int lda,
+                                        const float *B, int ldb, float *C,
+                                        int ldc, int N, int K, int accumulate) {
+  const float *A0 = A, *A1 = A + lda, *A2 = A + 2 * (size_t)lda,
+              *A3 = A + 3 * (size_t)lda;
+  float *C0 = C, *C1 = C + ldc, *C2 = C + 2 * (size_t)ldc,
+        *C3 = C + 3 * (size_t)ldc;
+  int j = 0;
+  for (; j + 16 <= N; j += 16) {
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    if (accumulate) {
+      c00 = _mm256_loadu_ps(C0 + j);
+      c01 = _mm256_loadu_ps(C0 + j + 8);
+      c10 = _mm256_loadu_ps(C1 + j);
+      c11 = _mm256_loadu_ps(C1 + j + 8);
+      c20 = _mm256_loadu_ps(C2 + j);
+      c21 = _mm256_loadu_ps(C2 + j + 8);
+      c30 = _mm256_loadu_ps(C3 + j);
+      c31 = _mm256_loadu_ps(C3 + j + 8);
+    }
+    for (int k = 0; k < K; k++) {
+      const float *B_k = B + (size_t)k * ldb + j;
+      __m256 b0 = _mm256_loadu_ps(B_k);
+      __m256 b1 = _mm256_loadu_ps(B_k + 8);
+      __m256 a = _mm256_broadcast_ss(A0 + k);
+      c00 = _mm256_fmadd_ps(a, b0, c00);
+      c01 = _mm256_fmadd_ps(a, b1, c01);
+      a = _mm256_broadcast_ss(A1 + k);
+      c10 = _mm256_fmadd_ps(a, b0, c10);
+      c11 = _mm256_fmadd_ps(a, b1, c11);
+      a = _mm256_broadcast_ss(A2 + k);
+      c20 = _mm256_fmadd_ps(a, b0, c20);
+      c21 = _mm256_fmadd_ps(a, b1, c21);
+      a = _mm256_broadcast_ss(A3 + k);
+      c30 = _mm256_fmadd_ps(a, b0, c30);
+      c31 = _mm256_fmadd_ps(a, b1, c31);
+    }
+    _mm256_storeu_ps(C0 + j, c00);
+    _mm256_storeu_ps(C0 + j + 8, c01);
+    _mm256_storeu_ps(C1 + j, c10);
+    _mm256_storeu_ps(C1 + j + 8, c11);
+    _mm256_storeu_ps(C2 + j, c20);
+    _mm256_storeu_ps(C2 + j + 8, c21);
+    _mm256_storeu_ps(C3 + j, c30);
+    _mm256_storeu_ps(C3 + j + 8, c31);
+  }
+  for (; j + 8 <= N; j += 8) {
+    __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps();
+    __m256 c2 = _mm256_setzero_ps(), c3 = _mm256_setzero_ps();
+    if (accumulate) {
+      c0 = _mm256_loadu_ps(C0 + j);
+      c1 = _mm256_loadu_ps(C1 + j);
+      c2 = _mm256_loadu_ps(C2 + j);
+      c3 = _mm256_loadu_ps(C3 + j);
+    }
+    for (int k = 0; k < K; k++) {
+      __m256 b = _mm256_loadu_ps(B + (size_t)k * ldb + j);
+      c0 = _mm256_fmadd_ps(_mm256_broadcast_ss(A0 + k), b, c0);
+      c1 = _mm256_fmadd_ps(_mm256_broadcast_ss(A1 + k), b, c1);
+      c2 = _mm256_fmadd_ps(_mm256_broadcast_ss(A2 + k), b, c2);
+      c3 = _mm256_fmadd_ps(_mm256_broadcast_ss(A3 + k), b, c3);
+    }
+    _mm256_storeu_ps(C0 + j, c0);
+    _mm256_storeu_ps(C1 + j, c1);
+    _mm256_storeu_ps(C2 + j, c2);
+    _mm256_storeu_ps(C3 + j, c3);
+  }
+  for (; j < N; j++) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    if (accumulate) {
+      s0 = C0[j];
+      s1 = C1[j];
+      s2 = C2[j];
+      s3 = C3[j];
+    }
+    for (int k = 0; k < K; k++) {
+      float b = B[(size_t)k * ldb + j];
+      s0 += A0[k] * b;
+      s1 += A1[k] * b;
+      s2 += A2[k] * b;
+      s3 += A3[k] * b;
+    }
+    C0[j] = s0;
+    C1[j] = s1;
+    C2[j] = s2;
+    C3[j] = s3;
+  }
+}
+
+// One row of C: streams B once, four registers wide
+SIMD_TARGET static void gemm_simd_row(const float *A, const float *B, int ldb,
+                                      float *C, int N, int K, int accumulate) {
+  int j = 0;
+  for (; j + 32 <= N; j += 32) {
+    __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps();
+    __m256 c2 = _mm256_setzero_ps(), c3 = _mm256_setzero_ps();
+    if (accumulate) {
+      c0 = _mm256_loadu_ps(C + j);
+      c1 = _mm256_loadu_ps(C + j + 8);
+      c2 = _mm256_loadu_ps(C + j + 16);
+      c3 = _mm256_loadu_ps(C + j + 24);
+    }
+    for (int k = 0; k < K; k++) {
+      const float *B_k = B + (size_t)k * ldb + j;
+      __m256 a = _mm256_broadcast_ss(A + k);
+      c0 = _mm256_fmadd_ps(a, _mm256_loadu_ps(B_k), c0);
+      c1 = _mm256_fmadd_ps(a, _mm256_loadu_ps(B_k + 8), c1);
+      c2 = _mm256_fmadd_ps(a, _mm256_loadu_ps(B_k + 16), c2);
+      c3 = _mm256_fmadd_ps(a, _mm256_loadu_ps(B_k + 24), c3);
+    }
+    _mm256_storeu_ps(C + j, c0);
+    _mm256_storeu_ps(C + j + 8, c1);
+    _mm256_storeu_ps(C + j + 16, c2);
+    _mm256_storeu_ps(C + j + 24, c3);
+  }
+  for (; j + 8 <= N; j += 8) {
+    __m256 c = accumulate ? _mm256_loadu_ps(C + j) : _mm256_setzero_ps();
+    for (int k = 0; k < K; k++)
+      c = _mm256_fmadd_ps(_mm256_broadcast_ss(A + k),
+                          _mm256_loadu_ps(B + (size_t)k * ldb + j), c);
+    _mm256_storeu_ps(C + j, c);
+  }
+  for (; j < N; j++) {
+    float s = accumulate ? C[j] : 0.0f;
+    for (int k = 0; k < K; k++)
+      s += A[k] * B[(size_t)k * ldb + j];
+    C[j] = s;
+  }
+}
+
+// NC-wide column panels of B, KC-deep slices, MC-row blocks of A; untiled
+// until tuned
+SIMD_TARGET static void gemm_simd_tiled(const float *A, int lda,
+                                        const float *B, int ldb, float *C,
+                                        int ldc, int M, int N, int K,
+                                        GemmTiles t) {
+  int mc = tile_extent(t.mc, M), nc = tile_extent(t.nc, N),
+      kc = tile_extent(t.kc, K);
+
+  if (K == 0) {
+    for (int i = 0; i < M; i++)
+      memset(C + (size_t)i * ldc, 0, N * sizeof(float));
+    return;
+  }
+
+  for (int jj = 0; jj < N; jj += nc) {
+    int nb = (jj + nc > N) ? N - jj : nc;
+    for (int kk = 0; kk < K; kk += kc) {
+      int kb = (kk + kc > K) ? K - kk : kc;
+      const float *B_blk = B + (size_t)kk * ldb + jj;
+      for (int ii = 0; ii < M; ii += mc) {
+        int i_max = (ii + mc > M) ? M : ii + mc;
+        int i = ii;
+        for (; i + 4 <= i_max; i += 4)
+          gemm_simd_4rows(A + (size_t)i * lda + kk, lda, B_blk, ldb,
+                          C + (size_t)i * ldc + jj, ldc, nb, kb, kk > 0);
+        for (; i < i_max; i++)
+          gemm_simd_row(A + (size_t)i * lda + kk, B_blk, ldb,
+                        C + (size_t)i * ldc + jj, nb, kb, kk > 0);
+      }
+    }
+  }
+}
+
+// Horizontal sums of four vectors: {sum a, sum b, sum c, sum d}
+SIMD_TARGET static inline __m128 hsum4x256(__m256 a, __m256 b, __m256 c,
+                                           __m256 d) {
+  __m256 t = _mm256_hadd_ps(_mm256_hadd_ps(a, b), _mm256_hadd_ps(c, d));
+  return _mm_add_ps(_mm256_castps256_ps128(t), _mm256_extractf128_ps(t, 1));
+}
+
+// rows A rows (1 or 2) against four rows of B: eight dot products over K
+SIMD_TARGET static void gemm_nt_simd_block(const float *A, int lda,
+                                           const float *B, int ldb, float *C,
+                                           int ldc, int rows, int K) {
+  const float *B0 = B, *B1 = B + ldb, *B2 = B + 2 * (size_t)ldb,
+              *B3 = B + 3 * (size_t)ldb;
+  for (int r = 0; r + 2 <= rows; r += 2) {
+    const float *A0 = A + (size_t)r * lda, *A1 = A0 + lda;
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c02 = _mm256_setzero_ps(), c03 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c12 = _mm256_setzero_ps(), c13 = _mm256_setzero_ps();
+    int k = 0;
+    for (; k + 8 <= K; k += 8) {
+      __m256 b0 = _mm256_loadu_ps(B0 + k), b1 = _mm256_loadu_ps(B1 + k);
+      __m256 b2 = _mm256_loadu_ps(B2 + k), b3 = _mm256_loadu_ps(B3 + k);
+      __m256 a = _mm256_loadu_ps(A0 + k);
+      c00 = _mm256_fmadd_ps(a, b0, c00);
+      c01 = _mm256_fmadd_ps(a, b1, c01);
+      c02 = _mm256_fmadd_ps(a, b2, c02);
+      c03 = _mm256_fmadd_ps(a, b3, c03);
+      a = _mm256_loadu_ps(A1 + k);
+      c10 = _mm256_fmadd_ps(a, b0, c10);
+      c11 = _mm256_fmadd_ps(a, b1, c11);
+      c12 = _mm256_fmadd_ps(a, b2, c12);
+      c13 = _mm256_fmadd_ps(a, b3, c13);
+    }
+    float s0[4], s1[4];
+    _mm_storeu_ps(s0, hsum4x256(c00, c01, c02, c03));
+    _mm_storeu_ps(s1, hsum4x256(c10, c11, c12, c13));
+    for (; k < K; k++) {
+      s0[0] += A0[k] * B0[k];
+      s0[1] += A0[k] * B1[k];
+      s0[2] += A0[k] * B2[k];
+      s0[3] += A0[k] * B3[k];
+      s1[0] += A1[k] * B0[k];
+      s1[1] += A1[k] * B1[k];
+      s1[2] += A1[k] * B2[k];
+      s1[3] += A1[k] * B3[k];
+    }
+    memcpy(C + (size_t)r * ldc, s0, sizeof(s0));
+    memcpy(C + (size_t)(r + 1) * ldc, s1, sizeof(s1));
+  }
+  if (rows & 1) {
+    const float *A0 = A + (size_t)(rows - 1) * lda;
+    __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps();
+    __m256 c2 = _mm256_setzero_ps(), c3 = _mm256_setzero_ps();
+    int k = 0;
+    for (; k + 8 <= K; k += 8) {
+      __m256 a = _mm256_loadu_ps(A0 + k);
+      c0 = _mm256_fmadd_ps(a, _mm256_loadu_ps(B0 + k), c0);
+      c1 = _mm256_fmadd_ps(a, _mm256_loadu_ps(B1 + k), c1);
+      c2 = _mm256_fmadd_ps(a, _mm256_loadu_ps(B2 + k), c2);
+      c3 = _mm256_fmadd_ps(a, _mm256_loadu_ps(B3 + k), c3);
+    }
+    float s[4];
+    _mm_storeu_ps(s, hsum4x256(c0, c1, c2, c3));
+    for (; k < K; k++) {
+      s[0] += A0[k] * B0[k];
+      s[1] += A0[k] * B1[k];
+      s[2] += A0[k] * B2[k];
+      s[3] += A0[k] * B3[k];
+    }
+    memcpy(C + (size_t)(rows - 1) * ldc, s, sizeof(s));
+  }
+}
+
+// One dot product, for the columns left over after the 4-wide blocks
+SIMD_TARGET static float dot_simd(const float *a, const float *b, int K) {
+  __m256 acc = _mm256_setzero_ps();
+  int k = 0;
+  for (; k + 8 <= K; k += 8)
+    acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k), acc);
+  __m128 s4 = _mm_add_ps(_mm256_castps256_ps128(acc),
+                         _mm256_extractf128_ps(acc, 1));
+  s4 = _mm_add_ps(s4, _mm_movehl_ps(s4, s4));
+  float s = _mm_cvtss_f32(_mm_add_ss(s4, _mm_movehdup_ps(s4)));
+  for (; k < K; k++)
+    s += a[k] * b[k];
+  return s;
+}
+
+// In-register transpose of an 8 x 8 tile: r[j][k] -> r[k][j]
+SIMD_TARGET static inline void transpose8x8(__m256 r[8]) {
+  __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+  __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+  __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]);
+  __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]), t7 = _mm256_unpackhi_ps(r[6], r[7]);
+  __m256 u0 = _mm256_shuffle_ps(t0, t2, 0x44), u1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+  __m256 u2 = _mm256_shuffle_ps(t1, t3, 0x44), u3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+  __m256 u4 = _mm256_shuffle_ps(t4, t6, 0x44), u5 = _mm256_shuffle_ps(t4, t6, 0xEE);
+  __m256 u6 = _mm256_shuffle_ps(t5, t7, 0x44), u7 = _mm256_shuffle_ps(t5, t7, 0xEE);
+  r[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+  r[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+  r[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+  r[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+  r[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+  r[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+  r[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+  r[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+
+// Pack 16 rows of B (columns j..j+15 of B^T) over k in [k0, k0 + kb) into a
+// (kb x 16) panel, 8 x 8 tiles at a time through registers
+#define NT_PANEL_COLS 16
+#define NT_PANEL_DEPTH 256
+
+SIMD_TARGET static void pack_nt_panel(const float *B, int ldb, int k0, int kb,
+                                      float *panel) {
+  for (int half = 0; half < 2; half++) {
+    const float *B_h = B + (size_t)(8 * half) * ldb + k0;
+    int k = 0;
+    for (; k + 8 <= kb; k += 8) {
+      __m256 r[8];
+      for (int j = 0; j < 8; j++)
+        r[j] = _mm256_loadu_ps(B_h + (size_t)j * ldb + k);
+      transpose8x8(r);
+      for (int kk = 0; kk < 8; kk++)
+        _mm256_storeu_ps(panel + (size_t)(k + kk) * NT_PANEL_COLS + 8 * half,
+                         r[kk]);
+    }
+    for (; k < kb; k++)
+      for (int j = 0; j < 8; j++)
+        panel[(size_t)k * NT_PANEL_COLS + 8 * half + j] =
+            B_h[(size_t)j * ldb + k];
+  }
+}
+
+// Native A x B^T: rows of A and B are both contiguous along K, so B never
+// needs a transposed copy in memory. Decode-sized products (few rows of A)
+// are plain dot products; larger ones pack 16 rows of B at a time into a
+// small L1-resident panel (at most NT_PANEL_DEPTH deep) and reuse the NN
+// micro-kernels on it, as BLAS does for the transposed case.
+SIMD_TARGET static void gemm_nt_simd_tiled(const float *A, int lda,
+                                           const float *B, int ldb, float *C,
+                                           int ldc, int M, int N, int K,
+                                           GemmTiles t) {
+  int mc = tile_extent(t.mc, M), nc = tile_extent(t.nc, N);
+  float panel[NT_PANEL_DEPTH * NT_PANEL_COLS];
+
+  for (int jj = 0; jj < N; jj += nc) {
+    int j_max = (jj + nc > N) ? N : jj + nc;
+    for (int ii = 0; ii < M; ii += mc) {
+      int i_max = (ii + mc > M) ? M : ii + mc;
+      int j = jj;
+      if (i_max - ii >= 8 && K > 0) {
+        for (; j + NT_PANEL_COLS <= j_max; j += NT_PANEL_COLS) {
+          for (int kk = 0; kk < K; kk += NT_PANEL_DEPTH) {
+            int kb = (kk + NT_PANEL_DEPTH > K) ? K - kk : NT_PANEL_DEPTH;
+            pack_nt_panel(B + (size_t)j * ldb, ldb, kk, kb, panel);
+            int i = ii;
+            for (; i + 4 <= i_max; i += 4)
+              gemm_simd_4rows(A + (size_t)i * lda + kk, lda, panel,
+                              NT_PANEL_COLS, C + (size_t)i * ldc + j, ldc,
+                              NT_PANEL_COLS, kb, kk > 0);
+            for (; i < i_max; i++)
+              gemm_simd_row(A + (size_t)i * lda + kk, panel, NT_PANEL_COLS,
+                            C + (size_t)i * ldc + j, NT_PANEL_COLS, kb,
+                            kk > 0);
+          }
+        }
+      }
+      for (; j + 4 <= j_max; j += 4) {
+        for (int i = ii; i < i_max; i += 2) {
+          int rows = (i + 2 <= i_max) ? 2 : 1;
+          gemm_nt_simd_block(A + (size_t)i * lda, lda, B + (size_t)j * ldb,
+                             ldb, C + (size_t)i * ldc + j, ldc, rows, K);
+        }
+      }
+      for (; j < j_max; j++)
+        for (int i = ii; i < i_max; i++)
+          C[(size_t)i * ldc + j] =
+              dot_simd(A + (size_t)i * lda, B + (size_t)j * ldb, K);
+    }
+  }
+}
+
+SIMD_TARGET static inline float hsum256(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+SIMD_TARGET static inline float hmax256(__m256 v) {
+  __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+  m = _mm_max_ss(m, _mm_movehdup_ps(m));
+  return _mm_cvtss_f32(m);
+}
+
+// expf to ~1 ulp (Cephes polynomial); exactly 0 below the normal float range
+SIMD_TARGET static inline __m256 exp256(__m256 x) {
+  __m256 underflow = _mm256_cmp_ps(x, _mm256_set1_ps(-87.33654f), _CMP_LT_OQ);
+  x = _mm256_min_ps(x, _mm256_set1_ps(88.0f));
+  x = _mm256_max_ps(x, _mm256_set1_ps(-87.33654f));
+
+  __m256 fx = _mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504088896341f),
+                              _mm256_set1_ps(0.5f));
+  fx = _mm256_floor_ps(fx);
+  x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(0.693359375f), x);
+  x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(-2.12194440e-4f), x);
+
+  __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+  y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), x);
+  y = _mm256_add_ps(y, _mm256_set1_ps(1.0f));
+
+  __m256i e = _mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(127));
+  y = _mm256_mul_ps(y, _mm256_castsi256_ps(_mm256_slli_epi32(e, 23)));
+  return _mm256_andnot_ps(underflow, y);
+}
+
+SIMD_TARGET static void softmax_simd(const float *in, float *out, int rows,
+                                     int cols) {
+  for (int i = 0; i < rows; i++) {
+    const float *x = in + (size_t)i * cols;
+    float *y = out + (size_t)i * cols;
+
+    int j = 0;
+    __m256 vmax = _mm256_set1_ps(-INFINITY);
+    for (; j + 8 <= cols; j += 8)
+      vmax = _mm256_max_ps(vmax, _mm256_loadu_ps(x + j));
+    float max_val = hmax256(vmax);
+    for (; j < cols; j++)
+      if (x[j] > max_val)
+        max_val = x[j];
+
+    // Fully masked row: keep the reference behaviour
+    if (max_val == -INFINITY) {
+      softmax_rows(x, y, 1, cols);
+      continue;
+    }
+
+    __m256 vm = _mm256_set1_ps(max_val);
+    __m256 vsum = _mm256_setzero_ps();
+    for (j = 0; j + 8 <= cols; j += 8) {
+      __m256 e = exp256(_mm256_sub_ps(_mm256_loadu_ps(x + j), vm));
+      _mm256_storeu_ps(y + j, e);
+      vsum = _mm256_add_ps(vsum, e);
+    }
+    float sum = hsum256(vsum);
+    for (; j < cols; j++) {
+      y[j] = expf(x[j] - max_val);
+      sum += y[j];
+    }
+
+    float inv = 1.0f / (sum + EPSILON);
+    __m256 vinv = _mm256_set1_ps(inv);
+    for (j = 0; j + 8 <= cols; j += 8)
+      _mm256_storeu_ps(y + j, _mm256_mul_ps(_mm256_loadu_ps(y + j), vinv));
+    for (; j < cols; j++)
+      y[j] *= inv;
+  }
+}
+
+SIMD_TARGET static void layernorm_simd(const float *in, const float *gamma,
+                                       const float *beta, float *out, int rows,
+                                       int cols) {
+  for (int i = 0; i < rows; i++) {
+    const float *x = in + (size_t)i * cols;
+    float *y = out + (size_t)i * cols;
+
+    int j = 0;
+    __m256 vs = _mm256_setzero_ps();
+    for (; j + 8 <= cols; j += 8)
+      vs = _mm256_add_ps(vs, _mm256_loadu_ps(x + j));
+    float sum = hsum256(vs);
+    for (; j < cols; j++)
+      sum += x[j];
+    float mean = sum / (float)cols;
+
+    __m256 vm = _mm256_set1_ps(mean);
+    __m256 vq = _mm256_setzero_ps();
+    for (j = 0; j + 8 <= cols; j += 8) {
+      __m256 d = _mm256_sub_ps(_mm256_loadu_ps(x + j), vm);
+      vq = _mm256_fmadd_ps(d, d, vq);
+    }
+    float sq = hsum256(vq);
+    for (; j < cols; j++)
+      sq += (x[j] - mean) * (x[j] - mean);
+    float var = sq / (float)cols;
+    if (var == 0)
+      var += EPSILON;
+
+    float inv = 1.0f / sqrtf(var);
+    __m256 vinv = _mm256_set1_ps(inv);
+    for (j = 0; j + 8 <= cols; j += 8) {
+      __m256 x_hat =
+          _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + j), vm), vinv);
+      _mm256_storeu_ps(y + j, _mm256_fmadd_ps(_mm256_loadu_ps(gamma + j),
+                                              x_hat,
+                                              _mm256_loadu_ps(beta + j)));
+    }
+    for (; j < cols; j++)
+      y[j] = gamma[j] * ((x[j] - mean) * inv) + beta[j];
+  }
+}
+
+// 0.5 * x * (1 + tanh(u)) == x / (1 + exp(-2u))
+SIMD_TARGET static void gelu_simd(float *x, int n) {
+  const __m256 a = _mm256_set1_ps(GELU_A);
+  const __m256 m2s = _mm256_set1_ps(-2.0f * SQRT_2_OVER_PI);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    __m256 v3 = _mm256_mul_ps(_mm256_mul_ps(v, v), v);
+    __m256 u = _mm256_mul_ps(m2s, _mm256_fmadd_ps(a, v3, v));
+    __m256 den = _mm256_add_ps(one, exp256(u));
+    _mm256_storeu_ps(x + i, _mm256_div_ps(v, den));
+  }
+  if (i < n)
+    apply_gelu(x + i, 1, n - i);
+}
+
+static int simd_supported(void) {
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// BLAS: OpenBLAS GEMM / GEMV, plain loops for the row-wise ops
+
+#ifdef USE_OPENBLAS
+// One OpenBLAS call per block of C; the thread pool spreads the blocks like
+// it does for the blocked and SIMD backends
+static void gemm_blas_tiled(const float *A, int lda, const float *B, int ldb,
+                            float *C, int ldc, int M, int N, int K,
+                            GemmTiles t) {
+  (void)t;
+  if (M == 1) {
+    // Decode steps: a single row against a weight matrix
+    cblas_sgemv(CblasRowMajor, CblasTrans, K, N, 1.0f, B, ldb, A, 1, 0.0f, C,
+                1);
+    return;
+  }
+  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, M, N, K, 1.0f, A, lda,
+              B, ldb, 0.0f, C, ldc);
+}
+
+static void gemm_nt_blas_tiled(const float *A, int lda, const float *B,
+                               int ldb, float *C, int ldc, int M, int N, int K,
+                               GemmTiles t) {
+  (void)t;
+  if (M == 1) {
+    cblas_sgemv(CblasRowMajor, CblasNoTrans, N, K, 1.0f, B, ldb, A, 1, 0.0f, C,
+                1);
+    return;
+  }
+  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, M, N, K, 1.0f, A, lda,
+              B, ldb, 0.0f, C, ldc);
+}
+
+// OpenBLAS would otherwise start its own threads inside every pool task
+// (attention heads, GEMM blocks): pool size times OpenBLAS threads in all
+static pthread_once_t blas_once = PTHREAD_ONCE_INIT;
+
+static void blas_single_threaded(void) { openblas_set_num_threads(1); }
+
+static void gemm_blas(const float *A, int lda, const float *B, int ldb,
+                      float *C, int ldc, int M, int N, int K) {
+  pthread_once(&blas_once, blas_single_threaded);
+  parallel_gemm(KERNEL_BLAS, gemm_blas_tiled, 0, A, lda, B, ldb, C, ldc, M, N,
+                K);
+}
+
+static void gemm_nt_blas(const float *A, int lda, const float *B, int ldb,
+                         float *C, int ldc, int M, int N, int K) {
+  pthread_once(&blas_once, blas_single_threaded);
+  parallel_gemm(KERNEL_BLAS, gemm_nt_blas_tiled, 1, A, lda, B, ldb, C, ldc, M,
+                N, K);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Threading: GEMMs are cut into a grid of C blocks and row-wise ops into row
+// ranges, spread over the shared work-stealing pool (thread_pool.h). The
+// reference backend stays single-threaded; OpenBLAS runs one thread per
+// block.
+
+// Multiply-adds below which a GEMM stays on the calling thread
+#define PARALLEL_GEMM_MIN_WORK (1 << 17)
+// Elements per chunk of a row-wise op
+#define PARALLEL_ROWWISE_GRAIN (1 << 14)
+
+typedef struct {
+  GemmTiledFn fn;
+  int nt;
+  const float *A, *B;
+  float *C;
+  int lda, ldb, ldc;
+  int M, N, K;
+  GemmTiles tiles;
+  int rb, cb;       // Block of C: rows (multiple of 8) x columns (of 16)
+  int n_col_blocks; // Blocks per block row
+} GemmJob;
+
+static void gemm_job_run(void *ctx, int begin, int end, int worker) {
+  const GemmJob *g = (const GemmJob *)ctx;
+  (void)worker;
+  for (int blk = begin; blk < end; blk++) {
+    int i0 = (blk / g->n_col_blocks) * g->rb;
+    int j0 = (blk % g->n_col_blocks) * g->cb;
+    int mb = g->M - i0 < g->rb ? g->M - i0 : g->rb;
+    int nb = g->N - j0 < g->cb ? g->N - j0 : g->cb;
+    // Columns of C are rows of B in the NT case
+    const float *B = g->nt ? g->B + (size_t)j0 * g->ldb : g->B + j0;
+    g->fn(g->A + (size_t)i0 * g->lda, g->lda, B, g->ldb,
+          g->C + (size_t)i0 * g->ldc + j0, g->ldc, mb, nb, g->K, g->tiles);
+  }
+}
+
+static int round_up(int x, int m) { return (x + m - 1) / m * m; }
+
+// Halve the block along its longer side (rows weighted 8x, since a row of A
+// is reused across all of B) until every thread has a few blocks to balance
+// with, or blocks get too small to be worth a task. Row blocks stay multiples
+// of 8 and column blocks of 16 so the SIMD micro-kernels keep their widths.
+static void parallel_gemm(KernelBackend backend, GemmTiledFn fn, int nt,
+                          const float *A, int lda, const float *B, int ldb,
+                          float *C, int ldc, int M, int N, int K) {
+  GemmTiles t = gemm_tiles_for(backend, M, N, K);
+  int threads = thread_pool_size();
+  if (threads == 1 || (double)M * N * K < 2.0 * PARALLEL_GEMM_MIN_WORK) {
+    fn(A, lda, B, ldb, C, ldc, M, N, K, t);
+    return;
+  }
+
+  int rb = M, cb = N;
+  for (;;) {
+    int blocks = ((M + rb - 1) / rb) * ((N + cb - 1) / cb);
+    if (blocks >= 4 * threads ||
+        (double)rb * cb * K < 2.0 * PARALLEL_GEMM_MIN_WORK)
+      break;
+    if (rb >= 16 && 8 * rb >= cb)
+      rb = round_up(rb / 2, 8);
+    else if (cb >= 32)
+      cb = round_up(cb / 2, 16);
+    else if (rb >= 16)
+      rb = round_up(rb / 2, 8);
+    else
+      break;
+  }
+
+  int n_col_blocks = (N + cb - 1) / cb;
+  GemmJob g = {fn, nt, A, B, C, lda, ldb, ldc, M, N, K, t, rb, cb,
+               n_col_blocks};
+  parallel_for(((M + rb - 1) / rb) * n_col_blocks, 1, gemm_job_run, &g);
+}
+
+static void gemm_blocked(const float *A, int lda, const float *B, int ldb,
+                         float *C, int ldc, int M, int N, int K) {
+  parallel_gemm(KERNEL_BLOCKED, gemm_blocked_tiled, 0, A, lda, B, ldb, C, ldc,
+                M, N, K);
+}
+
+static void gemm_nt_blocked(const float *A, int lda, const float *B, int ldb,
+                            float *C, int ldc, int M, int N, int K) {
+  parallel_gemm(KERNEL_BLOCKED, gemm_nt_blocked_tiled, 1, A, lda, B, ldb, C,
+                ldc, M, N, K);
+}
+
+#ifdef KERNELS_HAVE_SIMD
+static void gemm_simd(const float *A, int lda, const float *B, int ldb,
+                      float *C, int ldc, int M, int N, int K) {
+  parallel_gemm(KERNEL_SIMD, gemm_simd_tiled, 0, A, lda, B, ldb, C, ldc, M, N,
+                K);
+}
+
+static void gemm_nt_simd(const float *A, int lda, const float *B, int ldb,
+                         float *C, int ldc, int M, int N, int K) {
+  parallel_gemm(KERNEL_SIMD, gemm_nt_simd_tiled, 1, A, lda, B, ldb, C, ldc, M,
+                N, K);
+}
+#endif
+
+typedef struct {
+  void (*softmax)(const float *in, float *out, int rows, int cols);
+  void (*layernorm)(const float *in, const float *gamma, const float *beta,
+                    float *out, int rows, int cols);
+  void (*gelu)(float *x, int n);
+  const float *in, *gamma, *beta;
+  float *out;
+  int cols;
+} RowwiseJob;
+
+static void softmax_job_run(void *ctx, int begin, int end, int worker) {
+  const RowwiseJob *j = (const RowwiseJob *)ctx;
+  (void)worker;
+  j->softmax(j->in + (size_t)begin * j->cols, j->out + (size_t)begin * j->cols,
+             end - begin, j->cols);
+}
+
+static void layernorm_job_run(void *ctx, int begin, int end, int worker) {
+  const RowwiseJob *j = (const RowwiseJob *)ctx;
+  (void)worker;
+  j->layernorm(j->in + (size_t)begin * j->cols, j->gamma, j->beta,
+               j->out + (size_t)begin * j->cols, end - begin, j->cols);
+}
+
+static void gelu_job_run(void *ctx, int begin, int end, int worker) {
+  const RowwiseJob *j = (const RowwiseJob *)ctx;
+  (void)worker;
+  j->gelu(j->out + begin, end - begin);
+}
+
+static int row_grain(int cols) {
+  return cols > 0 && cols < PARALLEL_ROWWISE_GRAIN
+             ? PARALLEL_ROWWISE_GRAIN / cols
+             : 1;
+}
+
+static void parallel_softmax(const RowwiseJob *j, int rows) {
+  parallel_for(rows, row_grain(j->cols), softmax_job_run, (void *)j);
+}
+
+static void parallel_layernorm(const RowwiseJob *j, int rows) {
+  parallel_for(rows, row_grain(j->cols), layernorm_job_run, (void *)j);
+}
+
+static void parallel_gelu(const RowwiseJob *j, int n) {
+  parallel_for(n, PARALLEL_ROWWISE_GRAIN, gelu_job_run, (void *)j);
+}
+
+// Plain loops, threaded (blocked and BLAS backends)
+static void softmax_threaded(const float *in, float *out, int rows, int cols) {
+  RowwiseJob j = {.softmax = softmax_rows, .in = in, .out = out, .cols = cols};
+  parallel_softmax(&j, rows);
+}
+
+static void layernorm_threaded(const float *in, const float *gamma,
+                               const float *beta, float *out, int rows,
+                               int cols) {
+  RowwiseJob j = {.layernorm = layernorm_reference,
+                  .in = in,
+                  .gamma = gamma,
+                  .beta = beta,
+                  .out = out,
+                  .cols = cols};
+  parallel_layernorm(&j, rows);
+}
+
+static void gelu_threaded(float *x, int n) {
+  RowwiseJob j = {.gelu = gelu_reference, .out = x};
+  parallel_gelu(&j, n);
+}
+
+#ifdef KERNELS_HAVE_SIMD
+static void softmax_simd_threaded(const float *in, float *out, int rows,
+                                  int cols) {
+  RowwiseJob j = {.softmax = softmax_simd, .in = in, .out = out, .cols = cols};
+  parallel_softmax(&j, rows);
+}
+
+static void layernorm_simd_threaded(const float *in, const float *gamma,
+                                    const float *beta, float *out, int rows,
+                                    int cols) {
+  RowwiseJob j = {.layernorm = layernorm_simd,
+                  .in = in,
+                  .gamma = gamma,
+                  .beta = beta,
+                  .out = out,
+                  .cols = cols};
+  parallel_layernorm(&j, rows);
+}
+
+static void gelu_simd_threaded(float *x, int n) {
+  RowwiseJob j = {.gelu = gelu_simd, .out = x};
+  parallel_gelu(&j, n);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Backend tables
+
+static const KernelTable reference_table = {
+    "reference",         gemm_reference, gemm_nt_reference, softmax_rows,
+    layernorm_reference, gelu_reference};
+
+static const KernelTable blocked_table = {
+    "blocked",          gemm_blocked,  gemm_nt_blocked, softmax_threaded,
+    layernorm_threaded, gelu_threaded};
+
+#ifdef KERNELS_HAVE_SIMD
+static const KernelTable simd_table = {"simd",
+                                       gemm_simd,
+                                       gemm_nt_simd,
+                                       softmax_simd_threaded,
+                                       layernorm_simd_threaded,
+                                       gelu_simd_threaded};
+#endif
+
+#ifdef USE_OPENBLAS
+static const KernelTable blas_table = {
+    "blas",             gemm_blas,     gemm_nt_blas, softmax_threaded,
+    layernorm_threaded, gelu_threaded};
+#endif
+
+static const char *BACKEND_NAMES[KERNEL_NUM_BACKENDS] = {"reference", "blocked",
+                                                         "simd", "blas"};
+
+const char *kernel_backend_name(KernelBackend backend) {
+  return BACKEND_NAMES[backend];
+}
+
+const KernelTable *kernel_backend_table(KernelBackend backend) {
+  switch (backend) {
+  case KERNEL_REFERENCE:
+    return &reference_table;
+  case KERNEL_BLOCKED:
+    return &blocked_table;
+  case KERNEL_SIMD:
+#ifdef KERNELS_HAVE_SIMD
+    return simd_supported() ? &simd_table : NULL;
+#else
+    return NULL;
+#endif
+  case KERNEL_BLAS:
+#ifdef USE_OPENBLAS
+    return &blas_table;
+#else
+    return NULL;
+#endif
+  default:
+    return NULL;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Automatic selection
+
+// GEMM shape classes: rows (1, <= 16, <= 128, more) x N*K (<= 16K, <= 256K,
+// more). Row counts separate decode steps from prefill-sized blocks.
+#define M_CLASSES 4
+#define NK_CLASSES 3
+
+// Written by kernels_calibrate while other threads may be running kernels:
+// every choice is a single word, read and written atomically
+static KernelBackend gemm_choice[M_CLASSES][NK_CLASSES];
+static KernelBackend gemm_nt_choice[M_CLASSES][NK_CLASSES];
+static KernelBackend softmax_choice, layernorm_choice, gelu_choice;
+static pthread_once_t auto_once = PTHREAD_ONCE_INIT;
+
+#define LOAD_CHOICE(c) __atomic_load_n(&(c), __ATOMIC_RELAXED)
+#define STORE_CHOICE(c, b) __atomic_store_n(&(c), (b), __ATOMIC_RELAXED)
+
+static int m_class(int M) { return M <= 1 ? 0 : M <= 16 ? 1 : M <= 128 ? 2 : 3; }
+
+static int nk_class(int N, int K) {
+  long long nk = (long long)N * K;
+  return nk <= (16 << 10) ? 0 : nk <= (256 << 10) ? 1 : 2;
+}
+
+// Before calibration: BLAS for GEMMs when built in, else SIMD, else blocked
+static void init_auto_defaults(void) {
+  KernelBackend gemm = KERNEL_BLOCKED;
+  KernelBackend rowwise = KERNEL_REFERENCE;
+  if (kernel_backend_table(KERNEL_SIMD))
+    gemm = rowwise = KERNEL_SIMD;
+  if (kernel_backend_table(KERNEL_BLAS))
+    gemm = KERNEL_BLAS;
+
+  for (int m = 0; m < M_CLASSES; m++) {
+    for (int nk = 0; nk < NK_CLASSES; nk++) {
+      STORE_CHOICE(gemm_choice[m][nk], gemm);
+      STORE_CHOICE(gemm_nt_choice[m][nk], gemm);
+    }
+  }
+  STORE_CHOICE(softmax_choice, rowwise);
+  STORE_CHOICE(layernorm_choice, rowwise);
+  STORE_CHOICE(gelu_choice, rowwise);
+}
+
+static void gemm_auto(const float *A, int lda, const float *B, int ldb,
+                      float *C, int ldc, int M, int N, int K) {
+  KernelBackend b = LOAD_CHOICE(gemm_choice[m_class(M)][nk_class(N, K)]);
+  kernel_backend_table(b)->gemm(A, lda, B, ldb, C, ldc, M, N, K);
+}
+
+static void gemm_nt_auto(const float *A, int lda, const float *B, int ldb,
+                         float *C, int ldc, int M, int N, int K) {
+  KernelBackend b = LOAD_CHOICE(gemm_nt_choice[m_class(M)][nk_class(N, K)]);
+  kernel_backend_table(b)->gemm_nt(A, lda, B, ldb, C, ldc, M, N, K);
+}
+
+static void softmax_auto(const float *in, float *out, int rows, int cols) {
+  kernel_backend_table(LOAD_CHOICE(softmax_choice))->softmax(in, out, rows, cols);
+}
+
+static void layernorm_auto(const float *in, const float *gamma,
+                           const float *beta, float *out, int rows, int cols) {
+  kernel_backend_table(LOAD_CHOICE(layernorm_choice))
+      ->layernorm(in, gamma, beta, out, rows, cols);
+}
+
+static void gelu_auto(float *x, int n) {
+  kernel_backend_table(LOAD_CHOICE(gelu_choice))->gelu(x, n);
+}
+
+static const KernelTable auto_table = {"auto",         gemm_auto,
+                                       gemm_nt_auto,   softmax_auto,
+                                       layernorm_auto, gelu_auto};
+
+static const KernelTable *active;
+static pthread_once_t env_once = PTHREAD_ONCE_INIT;
+
+// First use without an explicit selection: environment overrides, once
+static void init_from_env(void) {
+  pthread_once(&auto_once, init_auto_defaults);
+  const char *cache = getenv("TRANSFORMER_TILE_CACHE");
+  if (cache)
+    kernels_load_tiles(cache);
+  const char *env = getenv("TRANSFORMER_KERNELS");
+  if (!env || kernels_select_by_name(env) != 0) {
+    if (env)
+      fprintf(stderr, "Unknown or unavailable TRANSFORMER_KERNELS=%s\n", env);
+    kernels_select_auto();
+  }
+}
+
+const KernelTable *kernels(void) {
+  const KernelTable *t = __atomic_load_n(&active, __ATOMIC_ACQUIRE);
+  if (t)
+    return t;
+
+  pthread_once(&env_once, init_from_env);
+  return __atomic_load_n(&active, __ATOMIC_ACQUIRE);
+}
+
+int kernels_select(KernelBackend backend) {
+  const KernelTable *t = kernel_backend_table(backend);
+  if (!t)
+    return -1;
+  __atomic_store_n(&active, t, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int kernels_select_by_name(const char *name) {
+  if (strcmp(name, KERNEL_AUTO_NAME) == 0) {
+    kernels_select_auto();
+    return 0;
+  }
+  for (int b = 0; b < KERNEL_NUM_BACKENDS; b++) {
+    if (strcmp(name, BACKEND_NAMES[b]) == 0)
+      return kernels_select((KernelBackend)b);
+  }
+  return -1;
+}
+
+void kernels_select_auto(void) {
+  pthread_once(&auto_once, init_auto_defaults);
+  __atomic_store_n(&active, &auto_table, __ATOMIC_RELEASE);
+}
+
+// ---------------------------------------------------------------------------
+// Calibration
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+typedef struct {
+  int M, N, K;
+  float *A, *B, *C;
+} CalibShape;
+
+// Best of a few runs after a warm-up
+static double time_gemm(const KernelTable *t, int nt, const CalibShape *s) {
+  double best = 1e30;
+  for (int rep = 0; rep < 3; rep++) {
+    double t0 = now_us();
+    if (nt)
+      t->gemm_nt(s->A, s->K, s->B, s->K, s->C, s->N, s->M, s->N, s->K);
+    else
+      t->gemm(s->A, s->K, s->B, s->N, s->C, s->N, s->M, s->N, s->K);
+    double dt = now_us() - t0;
+    if (rep > 0 && dt < best)
+      best = dt;
+  }
+  return best;
+}
+
+static KernelBackend fastest_gemm(int nt, const CalibShape *s) {
+  KernelBackend best = KERNEL_BLOCKED;
+  double best_us = 1e30;
+  // The reference loops are never competitive; skip them to save time
+  for (int b = KERNEL_BLOCKED; b < KERNEL_NUM_BACKENDS; b++) {
+    const KernelTable *t = kernel_backend_table((KernelBackend)b);
+    if (!t)
+      continue;
+    double us = time_gemm(t, nt, s);
+    if (us < best_us) {
+      best_us = us;
+      best = (KernelBackend)b;
+    }
+  }
+  return best;
+}
+
+// op: 0 softmax, 1 layernorm, 2 gelu
+static KernelBackend fastest_rowwise(int op, float *x, float *y,
+                                     const float *gamma, const float *beta,
+                                     int rows, int cols) {
+  KernelBackend best = KERNEL_REFERENCE;
+  double best_us = 1e30;
+  for (int b = 0; b < KERNEL_NUM_BACKENDS; b++) {
+    const KernelTable *t = kernel_backend_table((KernelBackend)b);
+    if (!t)
+      continue;
+    double us = 1e30;
+    for (int rep = 0; rep < 3; rep++) {
+      double t0 = now_us();
+      if (op == 0)
+        t->softmax(x, y, rows, cols);
+      else if (op == 1)
+        t->layernorm(x, gamma, beta, y, rows, cols);
+      else
+        t->gelu(y, rows * cols);
+      double dt = now_us() - t0;
+      if (rep > 0 && dt < us)
+        us = dt;
+    }
+    if (us < best_us) {
+      best_us = us;
+      best = (KernelBackend)b;
+    }
+  }
+  return best;
+}
+
+int kernels_calibrate(int verbose) {
+  // One representative shape per class
+  static const int M_REP[M_CLASSES] = {1, 8, 64, 192};
+  static const int NK_REP[NK_CLASSES] = {64, 256, 512}; // N = K
+
+  int max_m = M_REP[M_CLASSES - 1], max_nk = NK_REP[NK_CLASSES - 1];
+  int rows = 64, cols = 2048;
+  size_t n_a = (size_t)max_m * max_nk, n_b = (size_t)max_nk * max_nk;
+  size_t n_row = (size_t)rows * cols;
+
+  float *A = (float *)malloc(n_a * sizeof(float));
+  float *B = (float *)malloc(n_b * sizeof(float));
+  float *C = (float *)malloc(n_a * sizeof(float));
+  float *x = (float *)malloc(n_row * sizeof(float));
+  float *y = (float *)malloc(n_row * sizeof(float));
+  float *gamma = (float *)malloc(cols * sizeof(float));
+  float *beta = (float *)malloc(cols * sizeof(float));
+  if (!A || !B || !C || !x || !y || !gamma || !beta) {
+    free(A);
+    free(B);
+    free(C);
+    free(x);
+    free(y);
+    free(gamma);
+    free(beta);
+    return -1;
+  }
+  for (size_t i = 0; i < n_b; i++)
+    B[i] = (float)((i * 7919) % 1000) / 1000.0f - 0.5f;
+  for (size_t i = 0; i < n_a; i++)
+    A[i] = (float)((i * 104729) % 1000) / 1000.0f - 0.5f;
+  for (size_t i = 0; i < n_row; i++)
+    x[i] = y[i] = (float)((i * 7919) % 1000) / 250.0f - 2.0f;
+  for (int j = 0; j < cols; j++) {
+    gamma[j] = 1.0f;
+    beta[j] = 0.0f;
+  }
+
+  pthread_once(&auto_once, init_auto_defaults);
+
+  for (int m = 0; m < M_CLASSES; m++) {
+    for (int nk = 0; nk < NK_CLASSES; nk++) {
+      CalibShape s = {M_REP[m], NK_REP[nk], NK_REP[nk], A, B, C};
+      KernelBackend gemm = fastest_gemm(0, &s);
+      KernelBackend gemm_nt = fastest_gemm(1, &s);
+      STORE_CHOICE(gemm_choice[m][nk], gemm);
+      STORE_CHOICE(gemm_nt_choice[m][nk], gemm_nt);
+      if (verbose)
+        fprintf(stderr, "kernels: M=%d N=K=%d gemm=%s gemm_nt=%s\n", s.M, s.N,
+                BACKEND_NAMES[gemm], BACKEND_NAMES[gemm_nt]);
+    }
+  }
+  KernelBackend softmax = fastest_rowwise(0, x, y, gamma, beta, rows, cols);
+  KernelBackend layernorm =
+      fastest_rowwise(1, x, y, gamma, beta, rows, cols / 4);
+  KernelBackend gelu = fastest_rowwise(2, x, y, gamma, beta, rows, cols);
+  STORE_CHOICE(softmax_choice, softmax);
+  STORE_CHOICE(layernorm_choice, layernorm);
+  STORE_CHOICE(gelu_choice, gelu);
+  if (verbose)
+    fprintf(stderr, "kernels: softmax=%s layernorm=%s gelu=%s\n",
+            BACKEND_NAMES[softmax], BACKEND_NAMES[layernorm],
+            BACKEND_NAMES[gelu]);
+
+  free(A);
+  free(B);
+  free(C);
+  free(x);
+  free(y);
+  free(gamma);
+  free(beta);
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// GEMM tiles and autotuning
+
+// Tuned tiles of one class packed into a single word, so a GEMM running
+// while they are retuned or reloaded never sees half an update: MC, NC and KC
+// in 21 bits each, bit 63 set once tuned, 0 until then
+#define TILE_BITS 21
+#define TILE_MAX ((1 << TILE_BITS) - 1)
+#define TILE_SET (1ULL << 63)
+
+static unsigned long long tuned_tiles[KERNEL_NUM_BACKENDS][M_CLASSES]
+                                     [NK_CLASSES];
+
+// Larger tiles than any real dimension behave alike, so clamping is harmless
+static unsigned long long tile_field(int v) {
+  return v < 0 ? 0 : v > TILE_MAX ? TILE_MAX : (unsigned long long)v;
+}
+
+static unsigned long long pack_tiles(GemmTiles t) {
+  return TILE_SET | tile_field(t.mc) << (2 * TILE_BITS) |
+         tile_field(t.nc) << TILE_BITS | tile_field(t.kc);
+}
+
+static GemmTiles unpack_tiles(unsigned long long w) {
+  GemmTiles t = {(int)(w >> (2 * TILE_BITS) & TILE_MAX),
+                 (int)(w >> TILE_BITS & TILE_MAX), (int)(w & TILE_MAX)};
+  return t;
+}
+
+// Until tuned: 64-wide square tiles for the blocked loops, none for SIMD
+static GemmTiles default_tiles(KernelBackend backend) {
+  GemmTiles t = {0, 0, 0};
+  if (backend == KERNEL_BLOCKED)
+    t.mc = t.nc = t.kc = 64;
+  return t;
+}
+
+static GemmTiles gemm_tiles_for(KernelBackend backend, int M, int N, int K) {
+  int m = m_class(M), nk = nk_class(N, K);
+  unsigned long long w =
+      __atomic_load_n(&tuned_tiles[backend][m][nk], __ATOMIC_RELAXED);
+  return w ? unpack_tiles(w) : default_tiles(backend);
+}
+
+GemmTiles kernels_gemm_tiles(KernelBackend backend, int M, int N, int K) {
+  return gemm_tiles_for(backend, M, N, K);
+}
+
+void kernels_set_gemm_tiles(KernelBackend backend, int M, int N, int K,
+                            GemmTiles tiles) {
+  int m = m_class(M), nk = nk_class(N, K);
+  __atomic_store_n(&tuned_tiles[backend][m][nk], pack_tiles(tiles),
+                   __ATOMIC_RELAXED);
+}
+
+// Candidates per dimension; 0 = untiled
+static const int MC_CANDIDATES[] = {0, 16, 32, 64, 128, 256};
+static const int NC_CANDIDATES[] = {0, 64, 128, 256, 512, 1024};
+static const int KC_CANDIDATES[] = {0, 64, 128, 256, 512};
+
+// Total time of the shapes in one class. Small shapes are repeated so every
+// measurement spans at least ~100us and timer noise cannot pick the tiles.
+static double time_tiles(const KernelTable *t, const GemmShape *shapes,
+                         const int *members, int n_members, float *A, float *B,
+                         float *C) {
+  double total = 0.0;
+  for (int s = 0; s < n_members; s++) {
+    const GemmShape *g = &shapes[members[s]];
+    CalibShape c = {g->M, g->N, g->K, A, B, C};
+    double once = time_gemm(t, 0, &c);
+    int reps = once < 1.0 ? 100 : once < 100.0 ? (int)(100.0 / once) + 1 : 1;
+    double best = 1e30;
+    for (int trial = 0; trial < 3; trial++) {
+      double t0 = now_us();
+      for (int r = 0; r < reps; r++)
+        t->gemm(A, c.K, B, c.N, C, c.N, c.M, c.N, c.K);
+      double dt = (now_us() - t0) / reps;
+      if (dt < best)
+        best = dt;
+    }
+    total += best;
+  }
+  return total;
+}
+
+// Coordinate descent, KC then NC then MC, starting from the current tiles.
+// Candidates at least as large as every member's dimension behave like 0 and
+// are skipped.
+static GemmTiles tune_class(KernelBackend backend, const GemmShape *shapes,
+                            const int *members, int n_members, float *A,
+                            float *B, float *C) {
+  const KernelTable *t = kernel_backend_table(backend);
+  const GemmShape *g0 = &shapes[members[0]];
+  GemmTiles best = gemm_tiles_for(backend, g0->M, g0->N, g0->K);
+  int max_m = 0, max_n = 0, max_k = 0;
+  for (int s = 0; s < n_members; s++) {
+    const GemmShape *g = &shapes[members[s]];
+    max_m = g->M > max_m ? g->M : max_m;
+    max_n = g->N > max_n ? g->N : max_n;
+    max_k = g->K > max_k ? g->K : max_k;
+  }
+
+  for (int dim = 0; dim < 3; dim++) {
+    const int *cand = dim == 0 ? KC_CANDIDATES
+                      : dim == 1 ? NC_CANDIDATES
+                                 : MC_CANDIDATES;
+    int n_cand = dim == 0   ? (int)(sizeof(KC_CANDIDATES) / sizeof(int))
+                 : dim == 1 ? (int)(sizeof(NC_CANDIDATES) / sizeof(int))
+                            : (int)(sizeof(MC_CANDIDATES) / sizeof(int));
+    int limit = dim == 0 ? max_k : dim == 1 ? max_n : max_m;
+
+    double best_us = 1e30;
+    GemmTiles winner = best;
+    for (int c = 0; c < n_cand; c++) {
+      if (cand[c] >= limit)
+        continue;
+      GemmTiles trial = best;
+      if (dim == 0)
+        trial.kc = cand[c];
+      else if (dim == 1)
+        trial.nc = cand[c];
+      else
+        trial.mc = cand[c];
+      kernels_set_gemm_tiles(backend, g0->M, g0->N, g0->K, trial);
+      double us = time_tiles(t, shapes, members, n_members, A, B, C);
+      if (us < best_us) {
+        best_us = us;
+        winner = trial;
+      }
+    }
+    best = winner;
+  }
+  kernels_set_gemm_tiles(backend, g0->M, g0->N, g0->K, best);
+  return best;
+}
+
+int kernels_autotune(const GemmShape *shapes, int n_shapes, int verbose) {
+  size_t max_a = 1, max_b = 1, max_c = 1;
+  for (int s = 0; s < n_shapes; s++) {
+    size_t M = shapes[s].M, N = shapes[s].N, K = shapes[s].K;
+    max_a = M * K > max_a ? M * K : max_a;
+    max_b = K * N > max_b ? K * N : max_b;
+    max_c = M * N > max_c ? M * N : max_c;
+  }
+  float *A = (float *)malloc(max_a * sizeof(float));
+  float *B = (float *)malloc(max_b * sizeof(float));
+  float *C = (float *)malloc(max_c * sizeof(float));
+  int *members = (int *)malloc((n_shapes ? n_shapes : 1) * sizeof(int));
+  if (!A || !B || !C || !members) {
+    free(A);
+    free(B);
+    free(C);
+    free(members);
+    return -1;
+  }
+  for (size_t i = 0; i < max_a; i++)
+    A[i] = (float)((i * 104729) % 1000) / 1000.0f - 0.5f;
+  for (size_t i = 0; i < max_b; i++)
+    B[i] = (float)((i * 7919) % 1000) / 1000.0f - 0.5f;
+
+  static const KernelBackend TUNED[] = {KERNEL_BLOCKED, KERNEL_SIMD};
+  for (int b = 0; b < 2; b++) {
+    if (!kernel_backend_table(TUNED[b]))
+      continue;
+    for (int m = 0; m < M_CLASSES; m++) {
+      for (int nk = 0; nk < NK_CLASSES; nk++) {
+        int n_members = 0;
+        for (int s = 0; s < n_shapes; s++) {
+          if (m_class(shapes[s].M) == m &&
+              nk_class(shapes[s].N, shapes[s].K) == nk)
+            members[n_members++] = s;
+        }
+        if (n_members == 0)
+          continue;
+        GemmTiles t = tune_class(TUNED[b], shapes, members, n_members, A, B, C);
+        if (verbose)
+          fprintf(stderr,
+                  "kernels: %s tiles for M=%d N=%d K=%d (+%d shapes): "
+                  "mc=%d nc=%d kc=%d\n",
+                  BACKEND_NAMES[TUNED[b]], shapes[members[0]].M,
+                  shapes[members[0]].N, shapes[members[0]].K, n_members - 1,
+                  t.mc, t.nc, t.kc);
+      }
+    }
+  }
+
+  free(A);
+  free(B);
+  free(C);
+  free(members);
+  return 0;
+}
+
+// CPU model from /proc/cpuinfo; tiles tuned on one model are not reused on
+// another
+static void cpu_model(char *buf, size_t size) {
+  snprintf(buf, size, "unknown");
+  FILE *f = fopen("/proc/cpuinfo", "r");
+  if (!f)
+    return;
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    char *colon = strchr(line, ':');
+    if (strncmp(line, "model name", 10) == 0 && colon) {
+      char *v = colon + 1;
+      while (*v == ' ')
+        v++;
+      v[strcspn(v, "\n")] = '\0';
+      snprintf(buf, size, "%s", v);
+      break;
+    }
+  }
+  fclose(f);
+}
+
+// Format: "cpu <model>", then "<backend> <m class> <nk class> <mc> <nc> <kc>"
+// per tuned class
+int kernels_save_tiles(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f)
+    return -1;
+  char cpu[200];
+  cpu_model(cpu, sizeof(cpu));
+  fprintf(f, "cpu %s\n", cpu);
+  for (int b = 0; b < KERNEL_NUM_BACKENDS; b++)
+    for (int m = 0; m < M_CLASSES; m++)
+      for (int nk = 0; nk < NK_CLASSES; nk++) {
+        unsigned long long w =
+            __atomic_load_n(&tuned_tiles[b][m][nk], __ATOMIC_RELAXED);
+        if (w) {
+          GemmTiles t = unpack_tiles(w);
+          fprintf(f, "%s %d %d %d %d %d\n", BACKEND_NAMES[b], m, nk, t.mc,
+                  t.nc, t.kc);
+        }
+      }
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+int kernels_load_tiles(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return -1;
+
+  char line[256] = "", cpu[200];
+  cpu_model(cpu, sizeof(cpu));
+  int header = fgets(line, sizeof(line), f) != NULL;
+  line[strcspn(line, "\n")] = '\0';
+  if (!header || strncmp(line, "cpu ", 4) != 0 || strcmp(line + 4, cpu) != 0) {
+    fclose(f);
+    return -1;
+  }
+
+  // Parse everything before applying anything
+  GemmTiles tiles[KERNEL_NUM_BACKENDS][M_CLASSES][NK_CLASSES];
+  unsigned char set[KERNEL_NUM_BACKENDS][M_CLASSES][NK_CLASSES] = {{{0}}};
+  int ok = 1;
+  while (ok && fgets(line, sizeof(line), f)) {
+    char name[32];
+    int m, nk, mc, nc, kc, b;
+    if (sscanf(line, "%31s %d %d %d %d %d", name, &m, &nk, &mc, &nc, &kc) != 6) {
+      ok = 0;
+      break;
+    }
+    for (b = 0; b < KERNEL_NUM_BACKENDS; b++)
+      if (strcmp(name, BACKEND_NAMES[b]) == 0)
+        break;
+    ok = b < KERNEL_NUM_BACKENDS && m >= 0 && m < M_CLASSES && nk >= 0 &&
+         nk < NK_CLASSES && mc >= 0 && nc >= 0 && kc >= 0;
+    if (ok) {
+      tiles[b][m][nk] = (GemmTiles){mc, nc, kc};
+      set[b][m][nk] = 1;
+    }
+  }
+  fclose(f);
+  if (!ok)
+    return -1;
+
+  for (int b = 0; b < KERNEL_NUM_BACKENDS; b++)
+    for (int m = 0; m < M_CLASSES; m++)
+      for (int nk = 0; nk < NK_CLASSES; nk++)
+        if (set[b][m][nk])
+          __atomic_store_n(&tuned_tiles[b][m][nk], pack_tiles(tiles[b][m][nk]),
+                           __ATOMIC_RELAXED);
+  return 0;
+}
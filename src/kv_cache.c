@@ -0,0 +1,182 @@
+#include "../include/kv_cache.h"
+#include "../include/huge_alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int create_cross_kv(CrossKV *ckv, int num_layers, int d_model, int L_src) {
+  ckv->num_layers = num_layers;
+  ckv->d_model = d_model;
+  ckv->L_src = L_src;
+  ckv->K = (float **)calloc(num_layers, sizeof(float *));
+  ckv->V = (float **)calloc(num_layers, sizeof(float *));
+  int ok = ckv->K && ckv->V;
+  for (int l = 0; ok && l < num_layers; l++) {
+    ckv->K[l] = (float *)calloc((size_t)L_src * d_model, sizeof(float));
+    ckv->V[l] = (float *)calloc((size_t)L_src * d_model, sizeof(float));
+    ok = ckv->K[l] && ckv->V[l];
+  }
+  if (!ok) {
+    free_cross_kv(ckv);
+    return -1;
+  }
+  return 0;
+}
+
+void init_cross_kv(CrossKV *ckv, int num_layers, int d_model, int L_src) {
+  if (!ckv) {
+    fprintf(stderr, "Error: NULL pointer passed in init_cross_kv\n");
+    exit(1);
+  }
+  if (create_cross_kv(ckv, num_layers, d_model, L_src) != 0) {
+    fprintf(stderr, "Memory allocation failed for CrossKV\n");
+    exit(1);
+  }
+}
+
+void free_cross_kv(CrossKV *ckv) {
+  if (!ckv)
+    return;
+  for (int l = 0; l < ckv->num_layers; l++) {
+    if (ckv->K)
+      free(ckv->K[l]);
+    if (ckv->V)
+      free(ckv->V[l]);
+  }
+  free(ckv->K);
+  free(ckv->V);
+  ckv->K = ckv->V = NULL;
+}
+
+int create_kv_cache(KVCache *cache, int num_layers, int d_model, int num_slots,
+                    int max_len) {
+  size_t layer_size = (size_t)num_slots * max_len * d_model;
+
+  cache->num_layers = num_layers;
+  cache->d_model = d_model;
+  cache->num_slots = num_slots;
+  cache->max_len = max_len;
+  cache->K = (float **)calloc(num_layers, sizeof(float *));
+  cache->V = (float **)calloc(num_layers, sizeof(float *));
+  cache->len = (int *)calloc(num_slots, sizeof(int));
+  cache->cross = (const CrossKV **)calloc(num_slots, sizeof(CrossKV *));
+  cache->scratch = (float *)malloc(layer_size * sizeof(float));
+  cache->scratch_len = (int *)calloc(num_slots, sizeof(int));
+  cache->scratch_cross =
+      (const CrossKV **)calloc(num_slots, sizeof(CrossKV *));
+
+  int ok = cache->K && cache->V && cache->len && cache->cross &&
+           cache->scratch && cache->scratch_len && cache->scratch_cross;
+  for (int l = 0; ok && l < num_layers; l++) {
+    cache->K[l] = (float *)malloc(layer_size * sizeof(float));
+    cache->V[l] = (float *)malloc(layer_size * sizeof(float));
+    ok = cache->K[l] && cache->V[l];
+  }
+  if (!ok) {
+    free_kv_cache(cache);
+    return -1;
+  }
+  return 0;
+}
+
+void init_kv_cache(KVCache *cache, int num_layers, int d_model, int num_slots,
+                   int max_len) {
+  if (!cache) {
+    fprintf(stderr, "Error: NULL pointer passed in init_kv_cache\n");
+    exit(1);
+  }
+  if (create_kv_cache(cache, num_layers, d_model, num_slots, max_len) != 0) {
+    fprintf(stderr, "Memory allocation failed for KVCache\n");
+    exit(1);
+  }
+}
+
+void free_kv_cache(KVCache *cache) {
+  if (!cache)
+    return;
+  for (int l = 0; l < cache->num_layers; l++) {
+    if (cache->K)
+      free(cache->K[l]);
+    if (cache->V)
+      free(cache->V[l]);
+  }
+  free(cache->K);
+  free(cache->V);
+  free(cache->len);
+  free(cache->cross);
+  free(cache->scratch);
+  free(cache->scratch_len);
+  free(cache->scratch_cross);
+  cache->K = cache->V = NULL;
+  cache->len = cache->scratch_len = NULL;
+  cache->cross = cache->scratch_cross = NULL;
+  cache->scratch = NULL;
+}
+
+void kv_cache_reset_slot(KVCache *cache, int slot, const CrossKV *cross) {
+  cache->len[slot] = 0;
+  cache->cross[slot] = cross;
+}
+
+void kv_cache_release(KVCache *cache) {
+  size_t layer_bytes =
+      (size_t)cache->num_slots * cache->max_len * cache->d_model * sizeof(float);
+  for (int l = 0; l < cache->num_layers; l++) {
+    huge_release(cache->K[l], layer_bytes);
+    huge_release(cache->V[l], layer_bytes);
+  }
+  huge_release(cache->scratch, layer_bytes);
+  for (int s = 0; s < cache->num_slots; s++)
+    kv_cache_reset_slot(cache, s, NULL);
+}
+
+void cross_kv_release(CrossKV *ckv) {
+  size_t bytes = (size_t)ckv->L_src * ckv->d_model * sizeof(float);
+  for (int l = 0; l < ckv->num_layers; l++) {
+    huge_release(ckv->K[l], bytes);
+    huge_release(ckv->V[l], bytes);
+  }
+}
+
+void kv_cache_truncate(KVCache *cache, int slot, int len) {
+  // Positions past len are simply overwritten by the next step
+  if (len < cache->len[slot])
+    cache->len[slot] = len;
+}
+
+// Gather the moved slots of one layer buffer into scratch, then write back.
+// Reading every parent before writing any child keeps overlapping moves safe.
+static void reorder_layer(KVCache *cache, float *buf, const int *parents,
+                          int n) {
+  size_t slot_size = (size_t)cache->max_len * cache->d_model;
+
+  for (int i = 0; i < n; i++) {
+    int p = parents[i];
+    if (p == i)
+      continue;
+    memcpy(cache->scratch + i * slot_size, buf + p * slot_size,
+           (size_t)cache->len[p] * cache->d_model * sizeof(float));
+  }
+  for (int i = 0; i < n; i++) {
+    int p = parents[i];
+    if (p == i)
+      continue;
+    memcpy(buf + i * slot_size, cache->scratch + i * slot_size,
+           (size_t)cache->len[p] * cache->d_model * sizeof(float));
+  }
+}
+
+void kv_cache_reorder(KVCache *cache, const int *parents, int n) {
+  for (int l = 0; l < cache->num_layers; l++) {
+    reorder_layer(cache, cache->K[l], parents, n);
+    reorder_layer(cache, cache->V[l], parents, n);
+  }
+
+  for (int i = 0; i < n; i++) {
+    cache->scratch_len[i] = cache->len[parents[i]];
+    cache->scratch_cross[i] = cache->cross[parents[i]];
+  }
+  memcpy(cache->len, cache->scratch_len, n * sizeof(int));
+  memcpy(cache->cross, cache->scratch_cross, n * sizeof(CrossKV *));
+}
@@ -1,23 +1,14 @@
 #include "../include/layernorm.h"
-#include "../include/math_utils.h"
-#include "../include/utils.h"
-
-#include <math.h>
+#include "../include/kernels.h"
+#include "../include/profiler.h"
 
 void compute_layernorm(const float *input, const LayerNormParams *params,
                        float *output, int L, int d_model) {
 
-  for (int i = 0; i < L; i++) {
-    //--1-- isolate the current token's feature vercor
-    const float *X_i = input + i * d_model;
-    float *Y_i = output + i * d_model;
-    //--2-- compute the mean and variance
-    float mean, var;
-    compute_mean_variance(X_i, d_model, &mean, &var);
-    //--3-- layer normalization formula
-    for (int j = 0; j < d_model; j++) {
-      float x_hat = (X_i[j] - mean) / sqrtf(var);
-      Y_i[j] = params->gamma[j] * x_hat + params->beta[j];
-    }
-  }
+  PROF_BEGIN(OP_LAYERNORM);
+  // y = gamma * (x - mean) / sqrt(var) + beta, row by row
+  kernels()->layernorm(input, params->gamma, params->beta, output, L, d_model);
+  // mean, variance, normalize, scale and shift
+  PROF_END_COST(OP_LAYERNORM, 8.0 * L * d_model,
+                4.0 * (2.0 * L * d_model + 2 * d_model));
 }
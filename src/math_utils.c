@@ -2,6 +2,7 @@
 #include "../include/utils.h"
 
 #include <math.h>
+#include <stddef.h>
 
 void softmax_rows(const float *scores, float *weights, int rows, int cols) {
   for (int i = 0; i < rows; i++) {
@@ -73,3 +74,82 @@ void apply_gelu(float *M, int rows, int cols) {
     M[i] = 0.5f * M[i] *
            (1.0f + tanhf(SQRT_2_OVER_PI * (M[i] + GELU_A * powf(M[i], 3))));
 }
+
+void log_softmax_rows(const float *scores, float *out, int rows, int cols) {
+  for (int i = 0; i < rows; i++) {
+    const float *row_in = scores + ((size_t)i * cols);
+    float *row_out = out + ((size_t)i * cols);
+
+    float max_val = -INFINITY;
+    for (int j = 0; j < cols; j++) {
+      if (row_in[j] > max_val)
+        max_val = row_in[j];
+    }
+
+    float sum = 0.0f;
+    for (int j = 0; j < cols; j++)
+      sum += expf(row_in[j] - max_val);
+
+    float log_z = max_val + logf(sum);
+    for (int j = 0; j < cols; j++)
+      row_out[j] = row_in[j] - log_z;
+  }
+}
+
+static void heap_swap(float *vals, int *ids, int a, int b) {
+  float tv = vals[a];
+  vals[a] = vals[b];
+  vals[b] = tv;
+  int ti = ids[a];
+  ids[a] = ids[b];
+  ids[b] = ti;
+}
+
+static void heap_sift_down(float *vals, int *ids, int count, int i) {
+  for (;;) {
+    int l = 2 * i + 1, r = l + 1, m = i;
+    if (l < count && vals[l] < vals[m])
+      m = l;
+    if (r < count && vals[r] < vals[m])
+      m = r;
+    if (m == i)
+      return;
+    heap_swap(vals, ids, i, m);
+    i = m;
+  }
+}
+
+void topk_push(float *vals, int *ids, int *count, int k, float val, int id) {
+  if (k <= 0)
+    return;
+
+  if (*count < k) {
+    // Append and sift up
+    int i = (*count)++;
+    vals[i] = val;
+    ids[i] = id;
+    while (i > 0) {
+      int parent = (i - 1) / 2;
+      if (vals[parent] <= vals[i])
+        break;
+      heap_swap(vals, ids, i, parent);
+      i = parent;
+    }
+    return;
+  }
+
+  // Full: replace the current minimum only if the new value beats it
+  if (val <= vals[0])
+    return;
+  vals[0] = val;
+  ids[0] = id;
+  heap_sift_down(vals, ids, *count, 0);
+}
+
+void topk_sort(float *vals, int *ids, int count) {
+  // Heapsort on a min-heap leaves the array in descending order
+  for (int end = count - 1; end > 0; end--) {
+    heap_swap(vals, ids, 0, end);
+    heap_sift_down(vals, ids, end, 0);
+  }
+}
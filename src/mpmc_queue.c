@@ -0,0 +1,109 @@
+#include "../include/mpmc_queue.h"
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+void init_mpmc_queue(MpmcQueue *q, size_t capacity) {
+  size_t cap = 2;
+  while (cap < capacity)
+    cap <<= 1;
+
+  q->cells = (MpmcCell *)malloc(cap * sizeof(MpmcCell));
+  if (!q->cells) {
+    fprintf(stderr, "Alloc failed in init_mpmc_queue\n");
+    exit(1);
+  }
+  for (size_t i = 0; i < cap; i++) {
+    q->cells[i].seq = i;
+    q->cells[i].item = NULL;
+  }
+  q->mask = cap - 1;
+  q->head = 0;
+  q->tail = 0;
+}
+
+void free_mpmc_queue(MpmcQueue *q) {
+  free(q->cells);
+  q->cells = NULL;
+}
+
+int mpmc_try_push(MpmcQueue *q, void *item) {
+  size_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+  for (;;) {
+    MpmcCell *cell = &q->cells[pos & q->mask];
+    size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      // Cell is free for this lap: claim the position
+      if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        cell->item = item;
+        __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+        return 0;
+      }
+      // pos was reloaded by the failed CAS
+    } else if (diff < 0) {
+      return -1; // Still holds an item from the previous lap
+    } else {
+      pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+int mpmc_try_pop(MpmcQueue *q, void **item) {
+  size_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+  for (;;) {
+    MpmcCell *cell = &q->cells[pos & q->mask];
+    size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *item = cell->item;
+        // Hand the cell to the push one lap ahead
+        __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+        return 0;
+      }
+    } else if (diff < 0) {
+      return -1; // Not yet written
+    } else {
+      pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/**
+ * @brief Wait a little longer on every call: busy-spin first (the other side
+ * is usually mid-operation), then give up the core, then sleep so idle
+ * workers do not burn a CPU while the other stage is busy.
+ */
+void mpmc_backoff(int *attempt) {
+  int a = (*attempt)++;
+  if (a < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  } else if (a < 128) {
+    sched_yield();
+  } else {
+    struct timespec ts = {0, 50000}; // 50 us
+    nanosleep(&ts, NULL);
+  }
+}
+
+void mpmc_push(MpmcQueue *q, void *item) {
+  int attempt = 0;
+  while (mpmc_try_push(q, item) != 0)
+    mpmc_backoff(&attempt);
+}
+
+void *mpmc_pop(MpmcQueue *q) {
+  void *item;
+  int attempt = 0;
+  while (mpmc_try_pop(q, &item) != 0)
+    mpmc_backoff(&attempt);
+  return item;
+}
@@ -0,0 +1,191 @@
+// sched_setaffinity, CPU_SET and syscall() are GNU extensions
+#define _GNU_SOURCE
+#include "../include/numa_placement.h"
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Memory policy modes and flags of mbind(2) / set_mempolicy(2). Issued as raw
+// syscalls so the build does not need libnuma.
+#define NUMA_MPOL_DEFAULT 0
+#define NUMA_MPOL_BIND 2
+#define NUMA_MPOL_INTERLEAVE 3
+#define NUMA_MPOL_MF_MOVE (1 << 1)
+
+#define NODE_SYSFS "/sys/devices/system/node"
+
+// Parse a sysfs CPU list ("0-3,8,10-11") into cpus
+static int parse_cpulist(const char *s, int *cpus, int max_cpus) {
+  int n = 0;
+  while (*s && *s != '\n') {
+    char *end;
+    long lo = strtol(s, &end, 10), hi = lo;
+    if (end == s)
+      break;
+    if (*end == '-')
+      hi = strtol(end + 1, &end, 10);
+    for (long c = lo; c <= hi && n < max_cpus; c++)
+      cpus[n++] = (int)c;
+    s = *end == ',' ? end + 1 : end;
+  }
+  return n;
+}
+
+int numa_node_count(void) {
+  int count = 0;
+  char path[64];
+  for (int node = 0; node < NUMA_MAX_NODES; node++) {
+    snprintf(path, sizeof(path), NODE_SYSFS "/node%d", node);
+    if (access(path, F_OK) == 0)
+      count = node + 1;
+  }
+  return count > 0 ? count : 1;
+}
+
+int numa_node_cpus(int node, int *cpus, int max_cpus) {
+  char path[64], line[4096] = "";
+  snprintf(path, sizeof(path), NODE_SYSFS "/node%d/cpulist", node);
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    // No NUMA information: node 0 holds every online CPU
+    if (node != 0)
+      return 0;
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = 0;
+    for (long c = 0; c < n && count < max_cpus; c++)
+      cpus[count++] = (int)c;
+    return count;
+  }
+  if (!fgets(line, sizeof(line), f))
+    line[0] = '\0';
+  fclose(f);
+  return parse_cpulist(line, cpus, max_cpus);
+}
+
+int numa_current_node(void) {
+  unsigned int cpu = 0, node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+    return 0;
+  return (int)node;
+}
+
+int pin_thread_to_cpu(int cpu) {
+  if (cpu < 0 || cpu >= CPU_SETSIZE)
+    return -1;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int pin_thread_to_node(int node) {
+  int cpus[CPU_SETSIZE];
+  int n = numa_node_cpus(node, cpus, CPU_SETSIZE);
+  if (n == 0)
+    return -1;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int i = 0; i < n; i++)
+    CPU_SET(cpus[i], &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int numa_cpu_order(int *cpus, int max_cpus) {
+  int n = 0, nodes = numa_node_count();
+  for (int node = 0; node < nodes && n < max_cpus; node++)
+    n += numa_node_cpus(node, cpus + n, max_cpus - n);
+  return n;
+}
+
+// ---------------------------------------------------------------------------
+// Memory policy
+
+typedef struct {
+  int mode;
+  unsigned long mask;
+  unsigned int flags;
+  int failed;
+} PolicyCtx;
+
+// Apply the policy to the whole pages inside [p, p + bytes)
+static int apply_policy(void *p, size_t bytes, const PolicyCtx *c) {
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = ((uintptr_t)p + page - 1) & ~(page - 1);
+  uintptr_t end = ((uintptr_t)p + bytes) & ~(page - 1);
+  if (end <= start)
+    return 0;
+  // maxnode counts one past the mask bits, as in libnuma
+  long rc = syscall(SYS_mbind, (void *)start, (unsigned long)(end - start),
+                    c->mode, &c->mask, (unsigned long)NUMA_MAX_NODES + 1,
+                    c->flags);
+  return rc == 0 ? 0 : -1;
+}
+
+static void policy_tensor(float **tensor, size_t count, void *ctx) {
+  PolicyCtx *c = (PolicyCtx *)ctx;
+  if (apply_policy(*tensor, count * sizeof(float), c) != 0)
+    c->failed = 1;
+}
+
+static unsigned long all_nodes_mask(void) {
+  int nodes = numa_node_count();
+  return nodes >= NUMA_MAX_NODES ? ~0UL : (1UL << nodes) - 1;
+}
+
+int numa_interleave_params(TransformerParams *params) {
+  PolicyCtx c = {NUMA_MPOL_INTERLEAVE, all_nodes_mask(), NUMA_MPOL_MF_MOVE, 0};
+  transformer_params_foreach(params, policy_tensor, &c);
+  return c.failed ? -1 : 0;
+}
+
+int numa_bind_params(TransformerParams *params, int node) {
+  if (node < 0 || node >= NUMA_MAX_NODES)
+    return -1;
+  PolicyCtx c = {NUMA_MPOL_BIND, 1UL << node, NUMA_MPOL_MF_MOVE, 0};
+  transformer_params_foreach(params, policy_tensor, &c);
+  return c.failed ? -1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Per-node replicas
+
+void init_params_replicas(ParamsReplicas *r, const TransformerParams *params) {
+  r->num_nodes = numa_node_count();
+  r->replicas =
+      (TransformerParams *)malloc(r->num_nodes * sizeof(TransformerParams));
+  if (!r->replicas) {
+    fprintf(stderr, "Alloc failed in init_params_replicas\n");
+    exit(1);
+  }
+
+  for (int node = 0; node < r->num_nodes; node++) {
+    // Pages of the copy are first touched under a policy bound to the node;
+    // the bind then moves whatever reused heap pages landed elsewhere.
+    // Placement is best effort: without NUMA support the copies stay local.
+    unsigned long mask = 1UL << node;
+    int bound = syscall(SYS_set_mempolicy, NUMA_MPOL_BIND, &mask,
+                        (unsigned long)NUMA_MAX_NODES + 1) == 0;
+    copy_transformer_params(&r->replicas[node], params);
+    if (bound)
+      syscall(SYS_set_mempolicy, NUMA_MPOL_DEFAULT, NULL, 0UL);
+    numa_bind_params(&r->replicas[node], node);
+  }
+}
+
+void free_params_replicas(ParamsReplicas *r) {
+  for (int node = 0; node < r->num_nodes; node++)
+    free_transformer_params(&r->replicas[node]);
+  free(r->replicas);
+  r->replicas = NULL;
+  r->num_nodes = 0;
+}
+
+const TransformerParams *params_replica_local(const ParamsReplicas *r) {
+  int node = numa_current_node();
+  return &r->replicas[node < r->num_nodes ? node : 0];
+}
@@ -0,0 +1,124 @@
+#include "../include/pipeline.h"
+#include "../include/encoder_cache.h"
+#include "../include/kernels.h"
+#include "../include/thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// A NULL item tells one worker to exit. Workers of a group share their input
+// queue, so each of them receives exactly one after every real request.
+
+// Pin the calling worker to its group's node; weights to read from there
+static const TransformerParams *place_worker(Pipeline *p, int node) {
+  if (p->config.numa_bind)
+    pin_thread_to_node(node);
+  return p->config.replicas ? params_replica_local(p->config.replicas)
+                            : p->params;
+}
+
+static void *encoder_worker(void *arg) {
+  Pipeline *p = (Pipeline *)arg;
+  const TransformerParams *params = place_worker(p, p->config.encoder_node);
+  const TransformerConfig *cfg = &params->config;
+  for (;;) {
+    PipelineRequest *r = (PipelineRequest *)mpmc_pop(&p->submitted);
+    if (!r)
+      break;
+    int ok =
+        create_cross_kv(&r->ckv, cfg->num_layers, cfg->d_model, r->L_src) == 0;
+    ok = ok && compute_encoder_cached(r->sampling.encoder_cache, r->src_tokens,
+                                      r->L_src, params, NULL, &r->ckv) == 0;
+    // Out of memory: the decoder only completes the request, with n_out -1
+    if (!ok)
+      r->n_out = -1;
+    mpmc_push(&p->encoded, r);
+  }
+  return NULL;
+}
+
+static void *decoder_worker(void *arg) {
+  Pipeline *p = (Pipeline *)arg;
+  const TransformerParams *params = place_worker(p, p->config.decoder_node);
+  for (;;) {
+    PipelineRequest *r = (PipelineRequest *)mpmc_pop(&p->encoded);
+    if (!r)
+      break;
+    if (r->n_out == 0)
+      r->n_out = generate_from_cross(&r->ckv, r->src_tokens, r->L_src, params,
+                                     &r->sampling, r->out_tokens);
+    free_cross_kv(&r->ckv);
+    if (p->config.on_done)
+      p->config.on_done(r, p->config.on_done_arg);
+    __atomic_store_n(&r->done, 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+void init_pipeline(Pipeline *p, const TransformerParams *params,
+                   const PipelineConfig *config) {
+  p->params = params;
+  p->config = *config;
+  if (p->config.encoder_threads < 1)
+    p->config.encoder_threads = 1;
+  if (p->config.decoder_threads < 1)
+    p->config.decoder_threads = 1;
+  if (p->config.queue_capacity < 1)
+    p->config.queue_capacity = 1;
+
+  init_mpmc_queue(&p->submitted, p->config.queue_capacity);
+  init_mpmc_queue(&p->encoded, p->config.queue_capacity);
+
+  // Resolve the kernel table before several threads race to do it
+  kernels();
+  if (p->config.replicas)
+    thread_pool_set_node_pools(1);
+
+  int n = p->config.encoder_threads + p->config.decoder_threads;
+  p->threads = (pthread_t *)malloc(n * sizeof(pthread_t));
+  if (!p->threads) {
+    fprintf(stderr, "Alloc failed in init_pipeline\n");
+    exit(1);
+  }
+  for (int i = 0; i < n; i++) {
+    void *(*fn)(void *) =
+        i < p->config.encoder_threads ? encoder_worker : decoder_worker;
+    if (pthread_create(&p->threads[i], NULL, fn, p) != 0) {
+      fprintf(stderr, "pthread_create failed in init_pipeline\n");
+      exit(1);
+    }
+  }
+}
+
+void free_pipeline(Pipeline *p) {
+  int n_enc = p->config.encoder_threads, n_dec = p->config.decoder_threads;
+
+  // Encoders first, so every request reaches the decoder queue before the
+  // decoders are told to stop
+  for (int i = 0; i < n_enc; i++)
+    mpmc_push(&p->submitted, NULL);
+  for (int i = 0; i < n_enc; i++)
+    pthread_join(p->threads[i], NULL);
+  for (int i = 0; i < n_dec; i++)
+    mpmc_push(&p->encoded, NULL);
+  for (int i = 0; i < n_dec; i++)
+    pthread_join(p->threads[n_enc + i], NULL);
+
+  if (p->config.replicas)
+    thread_pool_set_node_pools(0);
+  free(p->threads);
+  free_mpmc_queue(&p->submitted);
+  free_mpmc_queue(&p->encoded);
+}
+
+void pipeline_submit(Pipeline *p, PipelineRequest *req) {
+  req->n_out = 0;
+  req->done = 0;
+  mpmc_push(&p->submitted, req);
+}
+
+void pipeline_wait(PipelineRequest *req) {
+  int attempt = 0;
+  while (!__atomic_load_n(&req->done, __ATOMIC_ACQUIRE))
+    mpmc_backoff(&attempt);
+}
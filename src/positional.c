@@ -0,0 +1,66 @@
+#include "../include/positional.h"
+
+#include <math.h>
+#include <stddef.h>
+
+// Frequencies handled per pass, small enough for the stack
+#define POSITIONAL_CHUNK 64
+
+void sinusoidal_table(const int *positions, int n, int dim, float *out) {
+  double w[POSITIONAL_CHUNK], s[POSITIONAL_CHUNK], c[POSITIONAL_CHUNK];
+  double step_s[POSITIONAL_CHUNK], step_c[POSITIONAL_CHUNK];
+  int pairs = (dim + 1) / 2; // An odd dim ends with a lone sine column
+
+  for (int j0 = 0; j0 < pairs; j0 += POSITIONAL_CHUNK) {
+    int m = pairs - j0 < POSITIONAL_CHUNK ? pairs - j0 : POSITIONAL_CHUNK;
+    for (int j = 0; j < m; j++)
+      w[j] = exp(-log(POSITIONAL_BASE) * 2.0 * (j0 + j) / dim);
+
+    if (!positions) {
+      // Position 0, then rotate by one step of each frequency per row
+      for (int j = 0; j < m; j++) {
+        s[j] = 0.0;
+        c[j] = 1.0;
+        step_s[j] = sin(w[j]);
+        step_c[j] = cos(w[j]);
+      }
+    }
+
+    for (int i = 0; i < n; i++) {
+      if (positions) {
+        for (int j = 0; j < m; j++) {
+          s[j] = sin(positions[i] * w[j]);
+          c[j] = cos(positions[i] * w[j]);
+        }
+      }
+      float *row = out + (size_t)i * dim + 2 * j0;
+      int full = 2 * (j0 + m) <= dim ? m : m - 1;
+      for (int j = 0; j < full; j++) {
+        row[2 * j] = (float)s[j];
+        row[2 * j + 1] = (float)c[j];
+      }
+      if (full < m)
+        row[2 * full] = (float)s[full];
+      if (!positions) {
+        for (int j = 0; j < m; j++) {
+          double next_s = s[j] * step_c[j] + c[j] * step_s[j];
+          c[j] = c[j] * step_c[j] - s[j] * step_s[j];
+          s[j] = next_s;
+        }
+      }
+    }
+  }
+}
+
+void apply_rotary(float *x, int row_stride, const float *table, int n,
+                  int d_k) {
+  for (int i = 0; i < n; i++) {
+    float *row = x + (size_t)i * row_stride;
+    const float *t = table + (size_t)i * d_k;
+    for (int j = 0; j + 1 < d_k; j += 2) {
+      float x0 = row[j], x1 = row[j + 1];
+      row[j] = x0 * t[j + 1] - x1 * t[j];
+      row[j + 1] = x0 * t[j] + x1 * t[j + 1];
+    }
+  }
+}
@@ -0,0 +1,316 @@
+#include "../include/prefix_cache.h"
+#include "../include/encoder_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void init_prefix_cache(PrefixCache *cache, const TransformerConfig *config,
+                       size_t max_bytes) {
+  memset(cache, 0, sizeof(*cache));
+  cache->num_layers = config->num_layers;
+  cache->d_model = config->d_model;
+  cache->max_bytes = max_bytes;
+}
+
+static size_t node_bytes(const PrefixCache *cache) {
+  return sizeof(PrefixNode) +
+         (size_t)(2 * cache->num_layers + 1) * cache->d_model * sizeof(float);
+}
+
+static size_t root_bytes(int L_src) {
+  return sizeof(PrefixNode) + (size_t)L_src * sizeof(int);
+}
+
+static void free_subtree(PrefixNode *node) {
+  PrefixNode *child = node->children;
+  while (child) {
+    PrefixNode *next = child->sibling;
+    free_subtree(child);
+    child = next;
+  }
+  free(node->kv);
+  free(node->hidden);
+  free(node->src);
+  free(node);
+}
+
+void free_prefix_cache(PrefixCache *cache) {
+  if (!cache)
+    return;
+  PrefixNode *root = cache->roots;
+  while (root) {
+    PrefixNode *next = root->sibling;
+    free_subtree(root);
+    root = next;
+  }
+  cache->roots = NULL;
+  cache->head = cache->tail = NULL;
+  cache->bytes = 0;
+  cache->num_nodes = 0;
+}
+
+// Every leaf below a root is listed once the insert creating it returns
+static int lru_listed(const PrefixCache *cache, const PrefixNode *node) {
+  return node->prev || cache->head == node;
+}
+
+static void lru_unlink(PrefixCache *cache, PrefixNode *node) {
+  if (node->prev)
+    node->prev->next = node->next;
+  else
+    cache->head = node->next;
+  if (node->next)
+    node->next->prev = node->prev;
+  else
+    cache->tail = node->prev;
+  node->prev = node->next = NULL;
+}
+
+static void lru_push_front(PrefixCache *cache, PrefixNode *node) {
+  node->prev = NULL;
+  node->next = cache->head;
+  if (cache->head)
+    cache->head->prev = node;
+  cache->head = node;
+  if (!cache->tail)
+    cache->tail = node;
+}
+
+// A parent left childless joins the leaves at its own last_used, which is
+// usually at or next to the tail
+static void lru_insert_sorted(PrefixCache *cache, PrefixNode *node) {
+  PrefixNode *after = cache->tail;
+  while (after && after->last_used > node->last_used)
+    after = after->prev;
+  if (!after) {
+    lru_push_front(cache, node);
+    return;
+  }
+  node->prev = after;
+  node->next = after->next;
+  if (after->next)
+    after->next->prev = node;
+  else
+    cache->tail = node;
+  after->next = node;
+}
+
+static PrefixNode *find_root(PrefixCache *cache, const int *src, int L_src) {
+  unsigned long long key = hash_tokens(src, L_src);
+  for (PrefixNode *r = cache->roots; r; r = r->sibling) {
+    if (r->key == key && r->L_src == L_src &&
+        memcmp(r->src, src, L_src * sizeof(int)) == 0)
+      return r;
+  }
+  return NULL;
+}
+
+static PrefixNode *find_child(PrefixNode *node, int token) {
+  for (PrefixNode *c = node->children; c; c = c->sibling) {
+    if (c->token == token)
+      return c;
+  }
+  return NULL;
+}
+
+// Unlink node from its parent's child list (or from the root list)
+static void unlink_node(PrefixCache *cache, PrefixNode *node) {
+  PrefixNode **link = node->parent ? &node->parent->children : &cache->roots;
+  while (*link != node)
+    link = &(*link)->sibling;
+  *link = node->sibling;
+}
+
+// Drop the least recently used leaf, and its root once the trie is empty
+static int evict_one(PrefixCache *cache) {
+  PrefixNode *victim = cache->tail;
+  if (!victim)
+    return 0;
+
+  PrefixNode *parent = victim->parent;
+  lru_unlink(cache, victim);
+  unlink_node(cache, victim);
+  free_subtree(victim);
+  cache->bytes -= node_bytes(cache);
+  cache->num_nodes--;
+  cache->evictions++;
+
+  if (parent->children) {
+    // Still an inner node
+  } else if (parent->parent) {
+    lru_insert_sorted(cache, parent);
+  } else {
+    unlink_node(cache, parent);
+    cache->bytes -= root_bytes(parent->L_src);
+    free_subtree(parent);
+  }
+  return 1;
+}
+
+int prefix_cache_restore(PrefixCache *cache, const int *src, int L_src,
+                         const int *tokens, int n, KVCache *kv, int slot,
+                         float *hidden) {
+  int d_model = cache->d_model;
+  size_t slot_offset = (size_t)slot * kv->max_len * d_model;
+  unsigned long long tick = ++cache->tick;
+
+  cache->lookups++;
+  if (n > kv->max_len)
+    n = kv->max_len;
+
+  PrefixNode *node = find_root(cache, src, L_src);
+  int m = 0;
+  if (node) {
+    node->last_used = tick;
+    while (m < n) {
+      PrefixNode *child = find_child(node, tokens[m]);
+      if (!child)
+        break;
+      for (int l = 0; l < cache->num_layers; l++) {
+        size_t offset = slot_offset + (size_t)m * d_model;
+        memcpy(kv->K[l] + offset, child->kv + (2 * l) * d_model,
+               d_model * sizeof(float));
+        memcpy(kv->V[l] + offset, child->kv + (2 * l + 1) * d_model,
+               d_model * sizeof(float));
+      }
+      child->last_used = tick;
+      node = child;
+      m++;
+    }
+    if (m > 0 && !node->children) {
+      lru_unlink(cache, node);
+      lru_push_front(cache, node);
+    }
+  }
+
+  kv->len[slot] = m;
+  if (m > 0 && hidden)
+    memcpy(hidden, node->hidden, d_model * sizeof(float));
+  cache->hit_tokens += m;
+  return m;
+}
+
+void prefix_cache_insert(PrefixCache *cache, const int *src, int L_src,
+                         const int *tokens, int start, int n,
+                         const KVCache *kv, int slot, const float *hidden) {
+  int d_model = cache->d_model;
+  size_t slot_offset = (size_t)slot * kv->max_len * d_model;
+  unsigned long long tick = ++cache->tick;
+
+  PrefixNode *node = find_root(cache, src, L_src);
+  if (!node) {
+    if (start > 0)
+      return; // Known part was evicted meanwhile, nothing to attach to
+
+    node = (PrefixNode *)calloc(1, sizeof(PrefixNode));
+    int *src_copy = (int *)malloc(L_src * sizeof(int));
+    if (!node || !src_copy) {
+      free(node);
+      free(src_copy);
+      return;
+    }
+    memcpy(src_copy, src, L_src * sizeof(int));
+    node->token = -1;
+    node->key = hash_tokens(src, L_src);
+    node->src = src_copy;
+    node->L_src = L_src;
+    node->sibling = cache->roots;
+    cache->roots = node;
+    cache->bytes += root_bytes(L_src);
+  }
+  node->last_used = tick;
+
+  for (int i = 0; i < n; i++) {
+    PrefixNode *child = find_child(node, tokens[i]);
+    if (!child) {
+      if (i < start)
+        return; // Known part was evicted meanwhile, nothing to attach to
+
+      child = (PrefixNode *)calloc(1, sizeof(PrefixNode));
+      float *kv_rows =
+          (float *)malloc((size_t)2 * cache->num_layers * d_model * sizeof(float));
+      float *h = (float *)malloc(d_model * sizeof(float));
+      if (!child || !kv_rows || !h) {
+        // Keep what was recorded so far
+        free(child);
+        free(kv_rows);
+        free(h);
+        break;
+      }
+      for (int l = 0; l < cache->num_layers; l++) {
+        size_t offset = slot_offset + (size_t)i * d_model;
+        memcpy(kv_rows + (2 * l) * d_model, kv->K[l] + offset,
+               d_model * sizeof(float));
+        memcpy(kv_rows + (2 * l + 1) * d_model, kv->V[l] + offset,
+               d_model * sizeof(float));
+      }
+      memcpy(h, hidden + (size_t)(i - start) * d_model,
+             d_model * sizeof(float));
+
+      // The parent stops being a leaf
+      if (lru_listed(cache, node))
+        lru_unlink(cache, node);
+
+      child->token = tokens[i];
+      child->kv = kv_rows;
+      child->hidden = h;
+      child->parent = node;
+      child->sibling = node->children;
+      node->children = child;
+      cache->bytes += node_bytes(cache);
+      cache->num_nodes++;
+    }
+    child->last_used = tick;
+    node = child;
+  }
+  if (node->parent && !node->children) {
+    if (lru_listed(cache, node))
+      lru_unlink(cache, node);
+    lru_push_front(cache, node);
+  } else if (!node->parent && !node->children) {
+    // A root nothing could be recorded under
+    unlink_node(cache, node);
+    cache->bytes -= root_bytes(node->L_src);
+    free_subtree(node);
+  }
+
+  while (cache->bytes > cache->max_bytes && evict_one(cache))
+    ;
+}
+
+int decoder_prefill(const TransformerParams *params, PrefixCache *cache,
+                    const int *src, int L_src, KVCache *kv, int slot,
+                    const int *tokens, int n, float *hidden_last) {
+  int d_model = params->config.d_model;
+
+  int m = 0;
+  if (cache)
+    m = prefix_cache_restore(cache, src, L_src, tokens, n, kv, slot, hidden_last);
+  if (m == n)
+    return m;
+
+  // Divergent suffix: one multi-token decoder pass
+  int rest = n - m;
+  int *slots = (int *)malloc(rest * sizeof(int));
+  float *hidden = (float *)malloc((size_t)rest * d_model * sizeof(float));
+  if (!slots || !hidden) {
+    free(slots);
+    free(hidden);
+    return -1;
+  }
+  for (int i = 0; i < rest; i++)
+    slots[i] = slot;
+
+  compute_decoder_step(tokens + m, slots, params, kv, hidden, rest);
+  memcpy(hidden_last, hidden + (size_t)(rest - 1) * d_model,
+         d_model * sizeof(float));
+
+  if (cache) {
+    cache->miss_tokens += rest;
+    prefix_cache_insert(cache, src, L_src, tokens, m, n, kv, slot, hidden);
+  }
+
+  free(slots);
+  free(hidden);
+  return m;
+}
@@ -0,0 +1,198 @@
+#include "../include/profiler.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+static const char *OP_NAMES[OP_COUNT] = {
+    "embedding",   "qkv_projection",      "attn_scores", "attn_softmax",
+    "attn_output", "attn_cached",         "attn_out_projection",
+    "ffn_gemm1",   "ffn_gelu",            "ffn_gemm2",   "layernorm",
+    "output_projection"};
+
+static const char *STACK_NAMES[] = {"model", "encoder", "decoder"};
+
+static ProfEvent *events;
+static int num_events;
+static int num_dropped;
+static int next_tid;
+
+// Layer context is per thread so concurrent forward passes stay separate
+static _Thread_local ProfStack cur_stack = PROF_MODEL;
+static _Thread_local int cur_layer = -1;
+static _Thread_local int cur_tid = -1;
+
+long long prof_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void prof_set_layer(ProfStack stack, int layer) {
+  cur_stack = stack;
+  cur_layer = layer;
+}
+
+const char *prof_op_name(ProfOp op) { return OP_NAMES[op]; }
+
+void prof_record(ProfOp op, long long start_ns, double flops,
+                 double bytes) {
+  long long end_ns = prof_now_ns();
+
+  if (!events) {
+    ProfEvent *buf = (ProfEvent *)malloc(PROF_MAX_EVENTS * sizeof(ProfEvent));
+    if (!buf)
+      return;
+    // Another thread may have won the race; keep the first buffer
+    ProfEvent *expected = NULL;
+    if (!__atomic_compare_exchange_n(&events, &expected, buf, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      free(buf);
+  }
+  if (cur_tid < 0)
+    cur_tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+
+  // Claim a slot, but never move the count past the buffer
+  int idx = __atomic_load_n(&num_events, __ATOMIC_RELAXED);
+  do {
+    if (idx >= PROF_MAX_EVENTS) {
+      __atomic_fetch_add(&num_dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+  } while (!__atomic_compare_exchange_n(&num_events, &idx, idx + 1, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  ProfEvent *e = &events[idx];
+  e->op = (unsigned char)op;
+  e->stack = (unsigned char)cur_stack;
+  e->layer = (short)cur_layer;
+  e->tid = cur_tid;
+  e->start_ns = start_ns;
+  e->dur_ns = end_ns - start_ns;
+  e->flops = flops;
+  e->bytes = bytes;
+}
+
+void prof_reset(void) {
+  __atomic_store_n(&num_events, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&num_dropped, 0, __ATOMIC_RELAXED);
+}
+
+int prof_num_events(void) {
+  return __atomic_load_n(&num_events, __ATOMIC_RELAXED);
+}
+
+int prof_write_chrome_trace(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f)
+    return -1;
+
+  int n = prof_num_events();
+  long long t0 = n > 0 ? events[0].start_ns : 0;
+  for (int i = 1; i < n; i++) {
+    if (events[i].start_ns < t0)
+      t0 = events[i].start_ns;
+  }
+
+  // Timestamps are microseconds relative to the first event
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  for (int i = 0; i < n; i++) {
+    const ProfEvent *e = &events[i];
+    fprintf(f,
+            "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+            "\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"layer\":%d,"
+            "\"flops\":%.0f,\"bytes\":%.0f}}%s\n",
+            OP_NAMES[e->op], STACK_NAMES[e->stack],
+            (e->start_ns - t0) / 1000.0, e->dur_ns / 1000.0, e->tid, e->layer,
+            e->flops, e->bytes, (i + 1 < n) ? "," : "");
+  }
+  fprintf(f, "]}\n");
+
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+typedef struct {
+  long long calls;
+  long long ns;
+  double flops;
+  double bytes;
+} ProfTotals;
+
+static void add_event(ProfTotals *t, const ProfEvent *e) {
+  t->calls++;
+  t->ns += e->dur_ns;
+  t->flops += e->flops;
+  t->bytes += e->bytes;
+}
+
+static void print_header(FILE *out, const char *first) {
+  fprintf(out, "%-22s %8s %10s %10s %7s %9s %9s %8s %8s\n", first, "calls",
+          "total_ms", "mean_us", "share", "GFLOP", "GFLOP/s", "GB/s",
+          "FLOP/B");
+}
+
+static void print_row(FILE *out, const char *name, const ProfTotals *t,
+                      long long all_ns) {
+  // FLOP per ns == GFLOP per s
+  double ns = t->ns > 0 ? (double)t->ns : 1.0;
+  fprintf(out, "%-22s %8lld %10.3f %10.3f %6.1f%% %9.4f %9.3f %8.3f %8.2f\n",
+          name, t->calls, t->ns / 1e6, t->ns / 1e3 / t->calls,
+          all_ns ? 100.0 * t->ns / all_ns : 0.0, t->flops / 1e9,
+          t->flops / ns, t->bytes / ns,
+          t->bytes > 0 ? t->flops / t->bytes : 0.0);
+}
+
+void prof_print_summary(FILE *out) {
+  ProfTotals totals[OP_COUNT] = {{0}};
+  long long all = 0;
+
+  int n = prof_num_events();
+  for (int i = 0; i < n; i++) {
+    add_event(&totals[events[i].op], &events[i]);
+    all += events[i].dur_ns;
+  }
+
+  print_header(out, "op");
+  for (int op = 0; op < OP_COUNT; op++) {
+    if (totals[op].calls)
+      print_row(out, OP_NAMES[op], &totals[op], all);
+  }
+  if (num_dropped)
+    fprintf(out, "(%d events dropped, raise PROF_MAX_EVENTS)\n", num_dropped);
+}
+
+void prof_print_layer_summary(FILE *out) {
+  // Row 0 holds ops outside any layer, then one row per (stack, layer)
+  int max_layer = -1;
+  int n = prof_num_events();
+  for (int i = 0; i < n; i++) {
+    if (events[i].layer > max_layer)
+      max_layer = events[i].layer;
+  }
+  int per_stack = max_layer + 1;
+  int rows = 1 + 3 * per_stack;
+
+  ProfTotals *totals = (ProfTotals *)calloc(rows, sizeof(ProfTotals));
+  if (!totals)
+    return;
+  long long all = 0;
+  for (int i = 0; i < n; i++) {
+    const ProfEvent *e = &events[i];
+    int row = e->layer < 0 ? 0 : 1 + e->stack * per_stack + e->layer;
+    add_event(&totals[row], e);
+    all += e->dur_ns;
+  }
+
+  print_header(out, "layer");
+  for (int r = 0; r < rows; r++) {
+    if (!totals[r].calls)
+      continue;
+    char name[32];
+    if (r == 0)
+      snprintf(name, sizeof(name), "(outside layers)");
+    else
+      snprintf(name, sizeof(name), "%s.%d",
+               STACK_NAMES[(r - 1) / per_stack], (r - 1) % per_stack);
+    print_row(out, name, &totals[r], all);
+  }
+  free(totals);
+}
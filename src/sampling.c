@@ -0,0 +1,204 @@
+#include "../include/sampling.h"
+#include "../include/kernels.h"
+#include "../include/kv_cache.h"
+#include "../include/math_utils.h"
+#include "../include/prefix_cache.h"
+#include "../include/profiler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+float sampling_rand(unsigned long long *state) {
+  unsigned long long x = *state ? *state : 0x9E3779B97F4A7C15ULL;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  // Top 24 bits give an exactly representable float in [0, 1)
+  return (float)((x * 0x2545F4914F6CDD1DULL) >> 40) / 16777216.0f;
+}
+
+/**
+ * @brief logits[j] = hidden · output_projection[:, v0 + j] for one tile.
+ */
+static void project_tile(const float *hidden, const float *W, int d_model,
+                         int vocab_size, int v0, int n, float *tile) {
+  // (1 x d_model) * (d_model x n) over a column block of W
+  kernels()->gemm(hidden, d_model, W + v0, vocab_size, tile, n, 1, n, d_model);
+}
+
+int sample_from_hidden(const float *hidden, const float *output_projection,
+                       int d_model, int vocab_size, const SamplingConfig *cfg,
+                       unsigned long long *rng_state) {
+  int greedy = (cfg->temperature <= 0.0f || cfg->top_k == 1);
+  float inv_temp = greedy ? 1.0f : 1.0f / cfg->temperature;
+
+  int k = SAMPLING_MAX_CANDIDATES;
+  if (greedy)
+    k = 1;
+  else if (cfg->top_k > 0 && cfg->top_k < k)
+    k = cfg->top_k;
+
+  float tile[SAMPLING_TILE];
+  float cand_vals[SAMPLING_MAX_CANDIDATES];
+  int cand_ids[SAMPLING_MAX_CANDIDATES];
+  int count = 0;
+
+  // Running log-sum-exp of the tempered logits over the whole vocabulary
+  float run_max = -INFINITY;
+  float run_sum = 0.0f;
+
+  // Projection and selection are fused, so they are timed as one op
+  PROF_BEGIN(OP_OUTPUT_PROJECTION);
+  for (int v0 = 0; v0 < vocab_size; v0 += SAMPLING_TILE) {
+    int n = (v0 + SAMPLING_TILE > vocab_size) ? vocab_size - v0 : SAMPLING_TILE;
+    project_tile(hidden, output_projection, d_model, vocab_size, v0, n, tile);
+
+    for (int j = 0; j < n; j++) {
+      float z = tile[j] * inv_temp;
+      if (!greedy) {
+        if (z > run_max) {
+          run_sum = run_sum * expf(run_max - z) + 1.0f;
+          run_max = z;
+        } else {
+          run_sum += expf(z - run_max);
+        }
+      }
+      topk_push(cand_vals, cand_ids, &count, k, z, v0 + j);
+    }
+  }
+  PROF_END_COST(OP_OUTPUT_PROJECTION, PROF_GEMM_FLOPS(1, vocab_size, d_model),
+                PROF_GEMM_BYTES(1, vocab_size, d_model));
+
+  if (greedy)
+    return cand_ids[0];
+
+  topk_sort(cand_vals, cand_ids, count);
+
+  // Probabilities of the kept candidates; with top-k they are renormalised
+  // over the k survivors, otherwise they are the full-vocabulary values
+  float mass = 0.0f;
+  for (int i = 0; i < count; i++) {
+    cand_vals[i] = expf(cand_vals[i] - run_max) / run_sum;
+    mass += cand_vals[i];
+  }
+  if (cfg->top_k > 0) {
+    for (int i = 0; i < count; i++)
+      cand_vals[i] /= mass;
+    mass = 1.0f;
+  }
+
+  // Nucleus: smallest prefix reaching top_p
+  int keep = count;
+  if (cfg->top_p < 1.0f) {
+    float cum = 0.0f;
+    for (int i = 0; i < count; i++) {
+      cum += cand_vals[i];
+      if (cum >= cfg->top_p * mass) {
+        keep = i + 1;
+        break;
+      }
+    }
+  }
+
+  float total = 0.0f;
+  for (int i = 0; i < keep; i++)
+    total += cand_vals[i];
+
+  float r = sampling_rand(rng_state) * total;
+  for (int i = 0; i < keep; i++) {
+    r -= cand_vals[i];
+    if (r < 0.0f)
+      return cand_ids[i];
+  }
+  return cand_ids[keep - 1];
+}
+
+// At least one token asked for, and BOS and the forced prefix leave a
+// position for it
+static int can_generate(const TransformerParams *params,
+                        const SamplingConfig *cfg) {
+  return cfg->max_len > 0 &&
+         1 + cfg->prefix_len <= transformer_max_positions(params->config);
+}
+
+int generate_sampled(const int *src_tokens, int L_src,
+                     const TransformerParams *params, const SamplingConfig *cfg,
+                     int *out_tokens) {
+  if (!can_generate(params, cfg))
+    return 0;
+
+  CrossKV ckv;
+  if (create_cross_kv(&ckv, params->config.num_layers, params->config.d_model,
+                      L_src) != 0)
+    return -1;
+  int n = -1;
+  if (compute_encoder_cached(cfg->encoder_cache, src_tokens, L_src, params,
+                             NULL, &ckv) == 0)
+    n = generate_from_cross(&ckv, src_tokens, L_src, params, cfg, out_tokens);
+  free_cross_kv(&ckv);
+  return n;
+}
+
+int generate_from_cross(const CrossKV *ckv, const int *src_tokens, int L_src,
+                        const TransformerParams *params,
+                        const SamplingConfig *cfg, int *out_tokens) {
+  int d_model = params->config.d_model;
+  int num_layers = params->config.num_layers;
+  if (!can_generate(params, cfg))
+    return 0;
+
+  // Decoder prompt: BOS followed by the forced prefix, if any
+  int n_prompt = 1 + cfg->prefix_len;
+  int cache_len = n_prompt - 1 + cfg->max_len;
+  int max_positions = transformer_max_positions(params->config);
+  if (cache_len > max_positions)
+    cache_len = max_positions;
+
+  KVCache cache;
+  if (create_kv_cache(&cache, num_layers, d_model, 1, cache_len) != 0)
+    return -1;
+  kv_cache_reset_slot(&cache, 0, ckv);
+
+  int *prompt = (int *)malloc(n_prompt * sizeof(int));
+  float *hidden = (float *)malloc(d_model * sizeof(float));
+  int ok = prompt && hidden;
+  if (ok) {
+    prompt[0] = cfg->bos_id;
+    if (cfg->prefix_len > 0)
+      memcpy(prompt + 1, cfg->prefix, cfg->prefix_len * sizeof(int));
+
+    // Shared prompt prefixes come from the prefix cache when one is given
+    ok = decoder_prefill(params, cfg->prefix_cache, src_tokens, L_src, &cache,
+                         0, prompt, n_prompt, hidden) >= 0;
+  }
+
+  // Project onto the shortlist's gathered columns when one is given
+  const VocabShortlist *sl = cfg->shortlist;
+  const float *W_out = sl ? sl->W : params->output_projection;
+  int n_cols = sl ? sl->size : params->config.vocab_size;
+
+  unsigned long long rng = cfg->seed;
+  int slot = 0;
+  int n = 0;
+
+  while (ok && n < cfg->max_len) {
+    int token = sample_from_hidden(hidden, W_out, d_model, n_cols, cfg, &rng);
+    if (sl)
+      token = sl->ids[token];
+    if (token == cfg->eos_id)
+      break;
+    out_tokens[n++] = token;
+    if (cfg->on_token && cfg->on_token(token, cfg->on_token_arg))
+      break;
+    if (n == cfg->max_len || cache.len[0] == cache_len)
+      break;
+    compute_decoder_step(&token, &slot, params, &cache, hidden, 1);
+  }
+
+  free(prompt);
+  free(hidden);
+  free_kv_cache(&cache);
+  return ok ? n : -1;
+}
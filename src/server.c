@@ -0,0 +1,582 @@
+#include "../include/server.h"
+#include "../include/kernels.h"
+#include "../include/sampling.h"
+#include "../include/transformer_api.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A connection lives while its reader runs or one of its requests is queued
+// or decoding; the last reference closes the socket.
+typedef struct ServerConn {
+  Server *server;
+  int fd;
+  int refs;
+  int dead; // A write failed: the client is gone
+  pthread_mutex_t write_mutex;
+  struct ServerConn *next; // In server->conns while the reader runs
+} ServerConn;
+
+typedef struct ServerRequest {
+  ServerConn *conn;
+  uint32_t id;
+  int *src;
+  int L_src;
+  SamplingConfig cfg;
+  unsigned long long rng;
+  int n_out;
+  int cache_len;  // Cache positions this request may use
+  int next_token; // Fed at the next step
+} ServerRequest;
+
+// ---------------------------------------------------------------------------
+// Socket I/O
+
+static int read_full(int fd, void *buf, size_t n) {
+  char *p = (char *)buf;
+  while (n > 0) {
+    ssize_t r = recv(fd, p, n, 0);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return -1;
+    p += r;
+    n -= (size_t)r;
+  }
+  return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t n) {
+  const char *p = (const char *)buf;
+  while (n > 0) {
+    // No SIGPIPE from a client that hung up: the write just fails
+    ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      return -1;
+    p += w;
+    n -= (size_t)w;
+  }
+  return 0;
+}
+
+int server_connect(const char *path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int server_send_request(int fd, const ServerRequestHeader *header,
+                        const int *src_tokens) {
+  if (write_full(fd, header, sizeof(*header)) != 0)
+    return -1;
+  return write_full(fd, src_tokens, header->L_src * sizeof(int32_t));
+}
+
+int server_read_response(int fd, ServerResponse *response) {
+  if (read_full(fd, response, sizeof(*response)) != 0)
+    return -1;
+  return response->magic == SERVER_RESPONSE_MAGIC ? 0 : -1;
+}
+
+// ---------------------------------------------------------------------------
+// Connections
+
+static void conn_retain(ServerConn *c) {
+  __atomic_fetch_add(&c->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void conn_release(ServerConn *c) {
+  if (__atomic_sub_fetch(&c->refs, 1, __ATOMIC_ACQ_REL) > 0)
+    return;
+  close(c->fd);
+  pthread_mutex_destroy(&c->write_mutex);
+  free(c);
+}
+
+static void conn_send(ServerConn *c, ServerMessage type, uint32_t id,
+                      int32_t value) {
+  ServerResponse r = {SERVER_RESPONSE_MAGIC, type, id, value};
+  pthread_mutex_lock(&c->write_mutex);
+  if (!c->dead && write_full(c->fd, &r, sizeof(r)) != 0)
+    c->dead = 1;
+  pthread_mutex_unlock(&c->write_mutex);
+}
+
+static int conn_dead(ServerConn *c) {
+  pthread_mutex_lock(&c->write_mutex);
+  int dead = c->dead;
+  pthread_mutex_unlock(&c->write_mutex);
+  return dead;
+}
+
+static void free_request(ServerRequest *r) {
+  conn_release(r->conn);
+  free(r->src);
+  free(r);
+}
+
+// Drop a request body the server refuses, to stay in step with the stream
+static int discard(int fd, size_t n) {
+  char buf[4096];
+  while (n > 0) {
+    size_t chunk = n < sizeof(buf) ? n : sizeof(buf);
+    if (read_full(fd, buf, chunk) != 0)
+      return -1;
+    n -= chunk;
+  }
+  return 0;
+}
+
+static TfStatus check_request(const Server *s, const ServerRequestHeader *h,
+                              const int *src) {
+  int vocab = s->params->config.vocab_size;
+  if (h->max_len == 0 || h->bos_id < 0 || h->bos_id >= vocab ||
+      h->eos_id < -1 || h->eos_id >= vocab)
+    return TF_ERR_INVALID_ARG;
+  for (uint32_t i = 0; i < h->L_src; i++) {
+    if (src[i] < 0 || src[i] >= vocab)
+      return TF_ERR_INVALID_ARG;
+  }
+  return TF_OK;
+}
+
+static ServerRequest *read_request(ServerConn *c, int *closed) {
+  Server *s = c->server;
+  ServerRequestHeader h;
+  *closed = 1;
+  if (read_full(c->fd, &h, sizeof(h)) != 0 || h.magic != SERVER_REQUEST_MAGIC)
+    return NULL;
+
+  if (h.L_src == 0 || h.L_src > (uint32_t)s->params->config.max_seq_len) {
+    *closed = discard(c->fd, (size_t)h.L_src * sizeof(int32_t)) != 0;
+    conn_send(c, SERVER_MSG_ERROR, h.request_id,
+              h.L_src ? TF_ERR_CAPACITY : TF_ERR_INVALID_ARG);
+    return NULL;
+  }
+
+  ServerRequest *r = (ServerRequest *)calloc(1, sizeof(ServerRequest));
+  int *src = (int *)malloc(h.L_src * sizeof(int));
+  if (!r || !src) {
+    free(r);
+    free(src);
+    *closed = discard(c->fd, (size_t)h.L_src * sizeof(int32_t)) != 0;
+    conn_send(c, SERVER_MSG_ERROR, h.request_id, TF_ERR_NO_MEMORY);
+    return NULL;
+  }
+  if (read_full(c->fd, src, h.L_src * sizeof(int32_t)) != 0) {
+    free(r);
+    free(src);
+    return NULL;
+  }
+  *closed = 0;
+
+  TfStatus status = check_request(s, &h, src);
+  if (status != TF_OK) {
+    conn_send(c, SERVER_MSG_ERROR, h.request_id, status);
+    free(r);
+    free(src);
+    return NULL;
+  }
+
+  r->conn = c;
+  r->id = h.request_id;
+  r->src = src;
+  r->L_src = (int)h.L_src;
+  r->cfg.temperature = h.temperature;
+  r->cfg.top_k = (int)h.top_k;
+  r->cfg.top_p = h.top_p;
+  r->cfg.seed = h.seed;
+  r->cfg.max_len = (int)h.max_len;
+  r->cfg.bos_id = h.bos_id;
+  r->cfg.eos_id = h.eos_id;
+  return r;
+}
+
+static void *reader_main(void *arg) {
+  ServerConn *c = (ServerConn *)arg;
+  Server *s = c->server;
+  for (;;) {
+    int closed;
+    ServerRequest *r = read_request(c, &closed);
+    if (closed)
+      break;
+    if (r) {
+      conn_retain(c);
+      mpmc_push(&s->queue, r);
+    }
+  }
+
+  pthread_mutex_lock(&s->mutex);
+  for (ServerConn **p = &s->conns; *p; p = &(*p)->next) {
+    if (*p == c) {
+      *p = c->next;
+      break;
+    }
+  }
+  if (--s->n_readers == 0)
+    pthread_cond_broadcast(&s->readers_done);
+  pthread_mutex_unlock(&s->mutex);
+  conn_release(c);
+  return NULL;
+}
+
+static void *accept_main(void *arg) {
+  Server *s = (Server *)arg;
+  for (;;) {
+    int fd = accept(s->listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (__atomic_load_n(&s->stopping, __ATOMIC_ACQUIRE))
+        break;
+      continue;
+    }
+
+    ServerConn *c = (ServerConn *)calloc(1, sizeof(ServerConn));
+    if (!c) {
+      close(fd);
+      continue;
+    }
+    c->server = s;
+    c->fd = fd;
+    c->refs = 1; // The reader's
+    pthread_mutex_init(&c->write_mutex, NULL);
+
+    pthread_mutex_lock(&s->mutex);
+    pthread_t tid;
+    if (s->stopping || pthread_create(&tid, NULL, reader_main, c) != 0) {
+      pthread_mutex_unlock(&s->mutex);
+      conn_release(c);
+      continue;
+    }
+    pthread_detach(tid);
+    c->next = s->conns;
+    s->conns = c;
+    s->n_readers++;
+    pthread_mutex_unlock(&s->mutex);
+  }
+  return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Scheduler
+
+// Encoder, cross K/V and an empty cache slot for a new request
+static void start_request(Server *s, int slot, ServerRequest *r) {
+  const TransformerParams *params = s->params;
+  s->ws.failed = 0;
+  compute_encoder(r->src, params, s->enc_output, r->L_src);
+  s->ckv[slot].L_src = r->L_src;
+  compute_cross_kv(params, s->enc_output, &s->ckv[slot]);
+  kv_cache_reset_slot(&s->cache, slot, &s->ckv[slot]);
+
+  r->rng = r->cfg.seed;
+  r->next_token = r->cfg.bos_id;
+  r->cache_len = r->cfg.max_len < params->config.max_seq_len
+                     ? r->cfg.max_len
+                     : params->config.max_seq_len;
+  s->active[slot] = r;
+  s->requests++;
+}
+
+static void finish_request(Server *s, int slot, int send_done) {
+  ServerRequest *r = s->active[slot];
+  if (send_done)
+    conn_send(r->conn, SERVER_MSG_DONE, r->id, r->n_out);
+  free_request(r);
+  s->active[slot] = NULL;
+}
+
+// The compute path gave up on this slot's request (see scratch_fail)
+static void fail_request(Server *s, int slot) {
+  ServerRequest *r = s->active[slot];
+  conn_send(r->conn, SERVER_MSG_ERROR, r->id, TF_ERR_NO_MEMORY);
+  free_request(r);
+  s->active[slot] = NULL;
+}
+
+// Sample the row of one slot; same stopping rules as generate_from_cross
+static void emit_token(Server *s, int slot, const float *hidden) {
+  const TransformerConfig *cfg = &s->params->config;
+  ServerRequest *r = s->active[slot];
+  int token = sample_from_hidden(hidden, s->params->output_projection,
+                                 cfg->d_model, cfg->vocab_size, &r->cfg,
+                                 &r->rng);
+  if (token == r->cfg.eos_id) {
+    finish_request(s, slot, 1);
+    return;
+  }
+  conn_send(r->conn, SERVER_MSG_TOKEN, r->id, token);
+  r->n_out++;
+  s->tokens++;
+  if (r->n_out == r->cfg.max_len || s->cache.len[slot] == r->cache_len)
+    finish_request(s, slot, 1);
+  else
+    r->next_token = token;
+}
+
+static void *scheduler_main(void *arg) {
+  Server *s = (Server *)arg;
+  int B = s->config.max_batch;
+  int d_model = s->params->config.d_model;
+  int n_active = 0;
+  Workspace *prev = workspace_bind(&s->ws);
+
+  for (;;) {
+    // Fill free slots; wait for work only when nothing is running
+    int stop = 0;
+    for (int slot = 0; slot < B; slot++) {
+      if (s->active[slot])
+        continue;
+      void *item;
+      if (n_active == 0)
+        item = mpmc_pop(&s->queue);
+      else if (mpmc_try_pop(&s->queue, &item) != 0)
+        break;
+      if (!item) {
+        stop = 1;
+        break;
+      }
+      start_request(s, slot, (ServerRequest *)item);
+      if (s->ws.failed)
+        fail_request(s, slot);
+      else
+        n_active++;
+    }
+    if (stop)
+      break;
+
+    // One row per live request
+    int n = 0;
+    for (int slot = 0; slot < B; slot++) {
+      ServerRequest *r = s->active[slot];
+      if (!r)
+        continue;
+      if (conn_dead(r->conn)) {
+        finish_request(s, slot, 0);
+        n_active--;
+        continue;
+      }
+      s->step_tokens[n] = r->next_token;
+      s->step_slots[n++] = slot;
+    }
+    if (n == 0)
+      continue;
+
+    s->ws.failed = 0;
+    compute_decoder_step(s->step_tokens, s->step_slots, s->params, &s->cache,
+                         s->hidden, n);
+    if (s->ws.failed) {
+      for (int b = 0; b < n; b++)
+        fail_request(s, s->step_slots[b]);
+      n_active -= n;
+      continue;
+    }
+    s->steps++;
+    s->step_rows += n;
+    for (int b = 0; b < n; b++) {
+      emit_token(s, s->step_slots[b], s->hidden + (size_t)b * d_model);
+      if (!s->active[s->step_slots[b]])
+        n_active--;
+    }
+  }
+
+  for (int slot = 0; slot < B; slot++) {
+    if (s->active[slot])
+      finish_request(s, slot, 0);
+  }
+  workspace_bind(prev);
+  return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Lifecycle
+
+// Scheduler state; safe on a server whose setup stopped part way
+static void free_scheduler_state(Server *s) {
+  if (s->ckv) {
+    for (int b = 0; b < s->config.max_batch; b++)
+      free_cross_kv(&s->ckv[b]);
+  }
+  free(s->ckv);
+  free(s->active);
+  free(s->step_tokens);
+  free(s->step_slots);
+  free(s->hidden);
+  free(s->enc_output);
+  free_kv_cache(&s->cache);
+  free_workspace(&s->ws);
+}
+
+/**
+ * @brief Dry run of the scheduler's largest calls (a max_seq_len encoder
+ * pass and a step over every slot) under a measuring workspace, so that the
+ * arena it binds serves any batch without the heap.
+ */
+static int measure_scheduler(Server *s, size_t *bytes, int *blocks) {
+  const TransformerConfig *c = &s->params->config;
+  int B = s->config.max_batch;
+  Workspace probe;
+  if (init_workspace(&probe, 0, 0) != 0)
+    return -1;
+  int *tokens = (int *)calloc(c->max_seq_len, sizeof(int));
+  if (!tokens) {
+    free_workspace(&probe);
+    return -1;
+  }
+
+  Workspace *prev = workspace_bind(&probe);
+  compute_encoder(tokens, s->params, s->enc_output, c->max_seq_len);
+  compute_cross_kv(s->params, s->enc_output, &s->ckv[0]);
+  for (int b = 0; b < B; b++) {
+    kv_cache_reset_slot(&s->cache, b, &s->ckv[0]);
+    s->step_tokens[b] = 0;
+    s->step_slots[b] = b;
+  }
+  compute_decoder_step(s->step_tokens, s->step_slots, s->params, &s->cache,
+                       s->hidden, B);
+  workspace_bind(prev);
+  int failed = probe.failed > 0;
+
+  *bytes = probe.peak;
+  *blocks = probe.peak_blocks;
+  free_workspace(&probe);
+  free(tokens);
+  return failed ? -1 : 0;
+}
+
+int server_start(Server *s, const TransformerParams *params,
+                 const ServerConfig *config, const char *path) {
+  memset(s, 0, sizeof(*s));
+  s->params = params;
+  s->config = *config;
+  if (s->config.max_batch < 1)
+    s->config.max_batch = 1;
+  if (s->config.queue_capacity < 1)
+    s->config.queue_capacity = 1;
+
+  s->addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(s->addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(s->addr.sun_path, path);
+  s->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (s->listen_fd < 0)
+    return -1;
+  unlink(path);
+  struct sockaddr *addr = (struct sockaddr *)&s->addr;
+  if (bind(s->listen_fd, addr, sizeof(s->addr)) != 0 ||
+      listen(s->listen_fd, 64) != 0) {
+    int err = errno;
+    close(s->listen_fd);
+    errno = err;
+    return -1;
+  }
+
+  const TransformerConfig *cfg = &params->config;
+  int B = s->config.max_batch;
+  s->ckv = (CrossKV *)calloc(B, sizeof(CrossKV));
+  s->active = (ServerRequest **)calloc(B, sizeof(ServerRequest *));
+  s->step_tokens = (int *)malloc(B * sizeof(int));
+  s->step_slots = (int *)malloc(B * sizeof(int));
+  s->hidden = (float *)malloc((size_t)B * cfg->d_model * sizeof(float));
+  s->enc_output =
+      (float *)malloc((size_t)cfg->max_seq_len * cfg->d_model * sizeof(float));
+  int ok = s->ckv && s->active && s->step_tokens && s->step_slots &&
+           s->hidden && s->enc_output &&
+           create_kv_cache(&s->cache, cfg->num_layers, cfg->d_model, B,
+                           cfg->max_seq_len) == 0;
+  for (int b = 0; ok && b < B; b++)
+    ok = create_cross_kv(&s->ckv[b], cfg->num_layers, cfg->d_model,
+                         cfg->max_seq_len) == 0;
+
+  // Resolve the kernel table before the scheduler and callers race to do it
+  kernels();
+
+  size_t ws_bytes = 0;
+  int ws_blocks = 0;
+  ok = ok && measure_scheduler(s, &ws_bytes, &ws_blocks) == 0 &&
+       init_workspace(&s->ws, ws_bytes > 0 ? ws_bytes : 1,
+                      ws_blocks > 0 ? ws_blocks : 1) == 0;
+  if (!ok) {
+    free_scheduler_state(s);
+    close(s->listen_fd);
+    unlink(path);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  init_mpmc_queue(&s->queue, s->config.queue_capacity);
+  pthread_mutex_init(&s->mutex, NULL);
+  pthread_cond_init(&s->readers_done, NULL);
+
+  int err = pthread_create(&s->scheduler_thread, NULL, scheduler_main, s);
+  if (err == 0) {
+    err = pthread_create(&s->accept_thread, NULL, accept_main, s);
+    if (err != 0) {
+      mpmc_push(&s->queue, NULL);
+      pthread_join(s->scheduler_thread, NULL);
+    }
+  }
+  if (err != 0) {
+    free_scheduler_state(s);
+    free_mpmc_queue(&s->queue);
+    pthread_mutex_destroy(&s->mutex);
+    pthread_cond_destroy(&s->readers_done);
+    close(s->listen_fd);
+    unlink(path);
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+void server_stop(Server *s) {
+  // No new connections
+  __atomic_store_n(&s->stopping, 1, __ATOMIC_RELEASE);
+  shutdown(s->listen_fd, SHUT_RDWR);
+  pthread_join(s->accept_thread, NULL);
+  close(s->listen_fd);
+  unlink(s->addr.sun_path);
+
+  // Readers see end of stream; writes to their clients fail from now on
+  pthread_mutex_lock(&s->mutex);
+  for (ServerConn *c = s->conns; c; c = c->next)
+    shutdown(c->fd, SHUT_RDWR);
+  while (s->n_readers > 0)
+    pthread_cond_wait(&s->readers_done, &s->mutex);
+  pthread_mutex_unlock(&s->mutex);
+
+  mpmc_push(&s->queue, NULL);
+  pthread_join(s->scheduler_thread, NULL);
+  void *item;
+  while (mpmc_try_pop(&s->queue, &item) == 0) {
+    if (item)
+      free_request((ServerRequest *)item);
+  }
+
+  free_scheduler_state(s);
+  free_mpmc_queue(&s->queue);
+  pthread_mutex_destroy(&s->mutex);
+  pthread_cond_destroy(&s->readers_done);
+}
@@ -0,0 +1,134 @@
+#include "../include/shared_params.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHARED_PARAMS_MAGIC 0x31534D5241504654ULL // "TFPARMS1" little-endian
+#define SHARED_PARAMS_VERSION 2 // 2: TransformerConfig.pos_mode
+
+// Start of the segment; tensors follow at data_offset
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t ready; // Set last by the publisher
+  TransformerConfig config;
+  uint64_t data_offset;
+  uint64_t data_bytes;
+} SharedParamsHeader;
+
+// Header padded to a page so the tensors start page-aligned
+static size_t data_offset(void) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (sizeof(SharedParamsHeader) + page - 1) / page * page;
+}
+
+// Build sp->params on top of a mapping whose header is already checked;
+// unmaps it on failure
+static int view_segment(SharedParams *sp, void *base, size_t bytes) {
+  const SharedParamsHeader *h = (const SharedParamsHeader *)base;
+  if (view_transformer_params(&sp->params, h->config,
+                              (char *)base + h->data_offset) != 0) {
+    munmap(base, bytes);
+    errno = ENOMEM;
+    return -1;
+  }
+  sp->base = base;
+  sp->bytes = bytes;
+  return 0;
+}
+
+int shared_params_publish(SharedParams *sp, const char *name,
+                          const TransformerParams *src) {
+  size_t offset = data_offset();
+  size_t data_bytes = transformer_params_packed_bytes(src->config);
+  size_t bytes = offset + data_bytes;
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    return -1;
+  if (ftruncate(fd, (off_t)bytes) != 0) {
+    int err = errno;
+    close(fd);
+    shm_unlink(name);
+    errno = err;
+    return -1;
+  }
+  void *base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    int err = errno;
+    shm_unlink(name);
+    errno = err;
+    return -1;
+  }
+
+  SharedParamsHeader *h = (SharedParamsHeader *)base;
+  h->magic = SHARED_PARAMS_MAGIC;
+  h->version = SHARED_PARAMS_VERSION;
+  h->config = src->config;
+  h->data_offset = offset;
+  h->data_bytes = data_bytes;
+  pack_transformer_params(src, (char *)base + offset);
+  // Workers that see ready also see every tensor written above
+  __atomic_store_n(&h->ready, 1, __ATOMIC_RELEASE);
+
+  // From here on the publisher reads the weights like any worker
+  mprotect(base, bytes, PROT_READ);
+  if (view_segment(sp, base, bytes) != 0) {
+    shm_unlink(name);
+    errno = ENOMEM;
+    return -1;
+  }
+  return 0;
+}
+
+int shared_params_attach(SharedParams *sp, const char *name) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SharedParamsHeader)) {
+    close(fd);
+    errno = EAGAIN; // Created but not sized yet
+    return -1;
+  }
+  size_t bytes = (size_t)st.st_size;
+  void *base = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return -1;
+
+  const SharedParamsHeader *h = (const SharedParamsHeader *)base;
+  int err = 0;
+  if (!__atomic_load_n(&h->ready, __ATOMIC_ACQUIRE))
+    err = EAGAIN;
+  else if (h->magic != SHARED_PARAMS_MAGIC ||
+           h->version != SHARED_PARAMS_VERSION ||
+           h->data_offset + h->data_bytes > bytes ||
+           transformer_params_packed_bytes(h->config) != h->data_bytes)
+    err = EINVAL;
+  if (err) {
+    munmap(base, bytes);
+    errno = err;
+    return -1;
+  }
+  return view_segment(sp, base, bytes);
+}
+
+void shared_params_detach(SharedParams *sp) {
+  if (!sp->base)
+    return;
+  free_transformer_params_view(&sp->params);
+  munmap(sp->base, sp->bytes);
+  sp->base = NULL;
+  sp->bytes = 0;
+}
+
+int shared_params_unlink(const char *name) {
+  return shm_unlink(name) == 0 ? 0 : -1;
+}
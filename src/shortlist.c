@@ -0,0 +1,87 @@
+#include "../include/shortlist.h"
+#include "../include/profiler.h"
+#include "../include/tensor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Ids outside the vocabulary (eos_id -1, unknown source tokens) are skipped
+static void mark(unsigned char *seen, int vocab_size, const int *ids, int n) {
+  for (int i = 0; i < n; i++) {
+    if (ids[i] >= 0 && ids[i] < vocab_size)
+      seen[ids[i]] = 1;
+  }
+}
+
+int build_shortlist_ids(const int *src_tokens, int L_src, const int *frequent,
+                        int n_frequent, int bos_id, int eos_id,
+                        const int *prefix, int prefix_len, int vocab_size,
+                        int *out_ids) {
+  unsigned char *seen = (unsigned char *)calloc(vocab_size, 1);
+  if (!seen)
+    return -1;
+
+  int special[2] = {bos_id, eos_id};
+  mark(seen, vocab_size, special, 2);
+  mark(seen, vocab_size, prefix, prefix_len);
+  mark(seen, vocab_size, src_tokens, L_src);
+  mark(seen, vocab_size, frequent, n_frequent);
+
+  // Scanning the marker array yields sorted ids, so the gathered columns stay
+  // in the same order as in output_projection
+  int n = 0;
+  for (int v = 0; v < vocab_size; v++) {
+    if (seen[v])
+      out_ids[n++] = v;
+  }
+
+  free(seen);
+  return n;
+}
+
+int init_vocab_shortlist(VocabShortlist *sl, const TransformerParams *params,
+                         const int *ids, int size) {
+  int d_model = params->config.d_model;
+  int vocab_size = params->config.vocab_size;
+
+  for (int j = 0; j < size; j++) {
+    if (ids[j] < 0 || ids[j] >= vocab_size)
+      return -1;
+  }
+
+  sl->d_model = d_model;
+  sl->size = size;
+  sl->ids = (int *)malloc(size * sizeof(int));
+  sl->W = (float *)malloc((size_t)d_model * size * sizeof(float));
+  if (!sl->ids || !sl->W) {
+    free_vocab_shortlist(sl);
+    return -1;
+  }
+
+  memcpy(sl->ids, ids, size * sizeof(int));
+  for (int d = 0; d < d_model; d++) {
+    const float *src_row = params->output_projection + (size_t)d * vocab_size;
+    float *dst_row = sl->W + (size_t)d * size;
+    for (int j = 0; j < size; j++)
+      dst_row[j] = src_row[ids[j]];
+  }
+  return 0;
+}
+
+void free_vocab_shortlist(VocabShortlist *sl) {
+  if (!sl)
+    return;
+  free(sl->ids);
+  free(sl->W);
+  sl->ids = NULL;
+  sl->W = NULL;
+}
+
+void compute_shortlist_logits(const float *hidden, const VocabShortlist *sl,
+                              float *out_logits, int L) {
+  PROF_BEGIN(OP_OUTPUT_PROJECTION);
+  matmul_strided(hidden, sl->d_model, sl->W, sl->size, out_logits, sl->size, L,
+                 sl->size, sl->d_model);
+  PROF_END_COST(OP_OUTPUT_PROJECTION, PROF_GEMM_FLOPS(L, sl->size, sl->d_model),
+                PROF_GEMM_BYTES(L, sl->size, sl->d_model));
+}
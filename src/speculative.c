@@ -0,0 +1,173 @@
+#include "../include/speculative.h"
+#include "../include/kv_cache.h"
+#include "../include/sampling.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Per-model decoding state: one cache slot over its own encoder context
+typedef struct {
+  const TransformerParams *params;
+  CrossKV ckv;
+  KVCache cache;
+  float *hidden; // (num_draft + 1) x d_model
+} SpecModel;
+
+// 0, or -1 when out of memory; free_spec_model is safe either way
+static int init_spec_model(SpecModel *m, const TransformerParams *params,
+                           const int *src_tokens, int L_src, int cache_len,
+                           int max_rows) {
+  int d_model = params->config.d_model;
+  int num_layers = params->config.num_layers;
+
+  memset(m, 0, sizeof(*m));
+  m->params = params;
+  if (create_cross_kv(&m->ckv, num_layers, d_model, L_src) != 0 ||
+      create_kv_cache(&m->cache, num_layers, d_model, 1, cache_len) != 0)
+    return -1;
+  kv_cache_reset_slot(&m->cache, 0, &m->ckv);
+
+  m->hidden = (float *)malloc((size_t)max_rows * d_model * sizeof(float));
+  if (!m->hidden)
+    return -1;
+  return compute_encoder_cached(NULL, src_tokens, L_src, params, NULL,
+                                &m->ckv);
+}
+
+static void free_spec_model(SpecModel *m) {
+  free(m->hidden);
+  free_kv_cache(&m->cache);
+  free_cross_kv(&m->ckv);
+}
+
+static int greedy_token(const SpecModel *m, int row) {
+  static const SamplingConfig greedy = {.temperature = 0.0f};
+  int d_model = m->params->config.d_model;
+  return sample_from_hidden(m->hidden + (size_t)row * d_model,
+                            m->params->output_projection, d_model,
+                            m->params->config.vocab_size, &greedy, NULL);
+}
+
+int speculative_generate(const int *src_tokens, int L_src,
+                         const TransformerParams *target,
+                         const TransformerParams *draft,
+                         const SpeculativeConfig *cfg, int *out_tokens,
+                         SpeculativeStats *stats) {
+  if (target->config.vocab_size != draft->config.vocab_size)
+    return -1;
+
+  int k = cfg->num_draft > 0 ? cfg->num_draft : 0;
+
+  // BOS + generated tokens, plus room for a full round of rejected drafts
+  int cache_len = 1 + cfg->max_len + k;
+  if (cache_len > transformer_max_positions(target->config))
+    cache_len = transformer_max_positions(target->config);
+  if (cache_len > transformer_max_positions(draft->config))
+    cache_len = transformer_max_positions(draft->config);
+
+  SpecModel tm, dm;
+  int ok =
+      init_spec_model(&tm, target, src_tokens, L_src, cache_len, k + 1) == 0;
+  ok &= init_spec_model(&dm, draft, src_tokens, L_src, cache_len, k + 1) == 0;
+
+  // seq = BOS followed by the committed tokens. The last entry of seq is
+  // never in the target cache at the start of a round.
+  int *seq = (int *)malloc((1 + cfg->max_len) * sizeof(int));
+  int *rows = (int *)malloc((k + 1) * sizeof(int));
+  int *slots = (int *)calloc(k + 1, sizeof(int));
+  if (!ok || !seq || !rows || !slots) {
+    free(seq);
+    free(rows);
+    free(slots);
+    free_spec_model(&tm);
+    free_spec_model(&dm);
+    return -1;
+  }
+  seq[0] = cfg->bos_id;
+  int seq_len = 1;
+
+  SpeculativeStats st = {0};
+  int done = 0;
+
+  while (!done && seq_len - 1 < cfg->max_len) {
+    int t_len = tm.cache.len[0]; // == seq_len - 1
+
+    // Drafts this round: bounded by the remaining length and cache room
+    int n_draft = k;
+    if (n_draft > cfg->max_len - (seq_len - 1) - 1)
+      n_draft = cfg->max_len - (seq_len - 1) - 1;
+    if (n_draft > cache_len - t_len - 1)
+      n_draft = cache_len - t_len - 1;
+    if (n_draft < 0)
+      break;
+
+    // --- 1. Draft proposes n_draft tokens greedily ---
+    rows[0] = seq[seq_len - 1];
+    if (n_draft > 0) {
+      int pending = seq_len - dm.cache.len[0];
+      compute_decoder_step(seq + dm.cache.len[0], slots, draft, &dm.cache,
+                           dm.hidden, pending);
+      rows[1] = greedy_token(&dm, pending - 1);
+
+      // Nothing worth proposing after an EOS
+      int proposed = 1;
+      while (proposed < n_draft && rows[proposed] != cfg->eos_id) {
+        compute_decoder_step(&rows[proposed], slots, draft, &dm.cache,
+                             dm.hidden, 1);
+        rows[proposed + 1] = greedy_token(&dm, 0);
+        proposed++;
+      }
+      n_draft = proposed;
+    }
+
+    // --- 2. Target verifies all drafts in one multi-token pass ---
+    compute_decoder_step(rows, slots, target, &tm.cache, tm.hidden,
+                         n_draft + 1);
+
+    // Row i's output is the target's choice after draft i, so draft i + 1
+    // is accepted while it matches
+    int accepted = 0;
+    int next = greedy_token(&tm, 0);
+    while (accepted < n_draft && rows[accepted + 1] == next) {
+      accepted++;
+      if (next == cfg->eos_id)
+        break;
+      next = greedy_token(&tm, accepted);
+    }
+
+    // --- 3. Commit accepted drafts plus the target's own next token ---
+    for (int i = 1; i <= accepted && !done; i++) {
+      if (rows[i] == cfg->eos_id)
+        done = 1;
+      else
+        seq[seq_len++] = rows[i];
+    }
+    if (!done) {
+      if (next == cfg->eos_id)
+        done = 1;
+      else
+        seq[seq_len++] = next;
+    }
+
+    // Roll back past the rejected positions: the target keeps the round's
+    // first row and the accepted drafts, the draft keeps what it fed of those
+    kv_cache_truncate(&tm.cache, 0, t_len + 1 + accepted);
+    kv_cache_truncate(&dm.cache, 0, t_len + 1 + accepted);
+
+    st.rounds++;
+    st.proposed += n_draft;
+    st.accepted += accepted;
+  }
+
+  int n = seq_len - 1;
+  memcpy(out_tokens, seq + 1, n * sizeof(int));
+  if (stats)
+    *stats = st;
+
+  free(seq);
+  free(rows);
+  free(slots);
+  free_spec_model(&tm);
+  free_spec_model(&dm);
+  return n;
+}
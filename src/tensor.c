@@ -1,4 +1,5 @@
 #include "../include/tensor.h"
+#include "../include/kernels.h"
 
 #include <string.h>
 
@@ -15,38 +16,30 @@ void mattri_low(float *A, int M) {
   }
 }
 
-#define BLOCK_SIZE 64 // depends on your CPU cache size
-
 void matmul_blocked(const float *A, const float *B, float *C, int M, int N,
                     int K) {
-
-  memset(C, 0, M * N * sizeof(float));
   // A: M×K,  B: K×N,  C: M×N
-  for (int ii = 0; ii < M; ii += BLOCK_SIZE) {
-    for (int jj = 0; jj < N; jj += BLOCK_SIZE) {
-      for (int kk = 0; kk < K; kk += BLOCK_SIZE) {
-
-        int i_max = (ii + BLOCK_SIZE > M) ? M : ii + BLOCK_SIZE;
-        int j_max = (jj + BLOCK_SIZE > N) ? N : jj + BLOCK_SIZE;
-        int k_max = (kk + BLOCK_SIZE > K) ? K : kk + BLOCK_SIZE;
-
-        for (int i = ii; i < i_max; i++) {
-          for (int k = kk; k < k_max; k++) {
-            float a_ik = A[i * K + k];
-            for (int j = jj; j < j_max; j++) {
-              C[i * N + j] += a_ik * B[k * N + j];
-            }
-          }
-        }
-      }
-    }
-  }
+  kernel_backend_table(KERNEL_BLOCKED)->gemm(A, K, B, N, C, N, M, N, K);
 }
 
+void matmul_strided(const float *A, int lda, const float *B, int ldb, float *C,
+                    int ldc, int M, int N, int K) {
+  // A: M×K (row stride lda), B: K×N (row stride ldb), C: M×N (row stride ldc)
+  kernels()->gemm(A, lda, B, ldb, C, ldc, M, N, K);
+}
+
+// 32 x 32 floats: a source and a destination tile fit in L1 together
+#define TRANSPOSE_BLOCK 32
+
 void transpose_matrix(const float *src, float *dst, int rows, int cols) {
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      dst[j * rows + i] = src[i * cols + j];
+  // Tiled so the strided writes stay within a few cache lines per tile
+  for (int ii = 0; ii < rows; ii += TRANSPOSE_BLOCK) {
+    int i_max = (ii + TRANSPOSE_BLOCK > rows) ? rows : ii + TRANSPOSE_BLOCK;
+    for (int jj = 0; jj < cols; jj += TRANSPOSE_BLOCK) {
+      int j_max = (jj + TRANSPOSE_BLOCK > cols) ? cols : jj + TRANSPOSE_BLOCK;
+      for (int i = ii; i < i_max; i++)
+        for (int j = jj; j < j_max; j++)
+          dst[(size_t)j * rows + i] = src[(size_t)i * cols + j];
     }
   }
 }
@@ -0,0 +1,382 @@
+#include "../include/thread_pool.h"
+#include "../include/numa_placement.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Polls before a waiting thread sleeps on the condition variable (workers) or
+// keeps yielding (the caller); loops arrive back to back during a forward
+// pass. The first quarter busy-waits, the rest yields the core.
+#define THREAD_POOL_SPIN 4096
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+// Remaining iterations [begin, end) of one thread: the owner takes chunks
+// from the front, thieves split off the back. Own cache line each.
+typedef struct {
+  int begin, end;
+  int lock;
+  char pad[64 - 3 * sizeof(int)];
+} WorkRange;
+
+typedef struct {
+  int n_threads; // Participants, the calling thread included (0: not set up)
+  int node;      // Node the workers are pinned to; -1 for the shared pool
+  pthread_t *threads;
+  WorkRange *ranges;
+
+  // Current loop
+  ParallelForFn fn;
+  void *ctx;
+  int grain;
+  int remaining; // Iterations not finished yet
+  unsigned int generation;
+  int open;   // Workers may still join the loop
+  int active; // Workers inside the loop
+  int stop;
+  int busy; // Some thread owns the pool
+
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+} Pool;
+
+// One shared pool, or one per NUMA node (thread_pool_set_node_pools)
+static Pool pools[NUMA_MAX_NODES];
+static int n_pools;
+static int pin; // Workers pinned to CPUs (thread_pool_set_affinity)
+
+// Pool index of this thread; -1 outside a loop
+static _Thread_local int cur_worker = -1;
+
+// Wait for a counter other threads are counting down; yields once spinning
+// has gone on long enough that the holder was probably descheduled
+static void wait_for_zero(int *counter) {
+  for (int spins = 0; __atomic_load_n(counter, __ATOMIC_ACQUIRE) > 0;
+       spins++) {
+    if (spins < THREAD_POOL_SPIN / 4)
+      cpu_relax();
+    else
+      sched_yield();
+  }
+}
+
+static void range_lock(WorkRange *r) {
+  while (__atomic_exchange_n(&r->lock, 1, __ATOMIC_ACQUIRE))
+    cpu_relax();
+}
+
+static void range_unlock(WorkRange *r) {
+  __atomic_store_n(&r->lock, 0, __ATOMIC_RELEASE);
+}
+
+// Next chunk of the thread's own range; 0 when it is empty. Bounds are
+// written atomically because steal() peeks at them without the lock.
+static int take_front(WorkRange *r, int grain, int *begin, int *end) {
+  range_lock(r);
+  int ok = r->begin < r->end;
+  if (ok) {
+    *begin = r->begin;
+    *end = r->begin + grain < r->end ? r->begin + grain : r->end;
+    __atomic_store_n(&r->begin, *end, __ATOMIC_RELAXED);
+  }
+  range_unlock(r);
+  return ok;
+}
+
+// Move the back half of some other thread's range into our own (empty) one
+static int steal(Pool *pool, int self, int grain) {
+  int n = pool->n_threads;
+  for (int i = 1; i < n; i++) {
+    WorkRange *victim = &pool->ranges[(self + i) % n];
+    if (__atomic_load_n(&victim->begin, __ATOMIC_RELAXED) >=
+        __atomic_load_n(&victim->end, __ATOMIC_RELAXED))
+      continue;
+
+    range_lock(victim);
+    int size = victim->end - victim->begin;
+    int b = 0, e = 0;
+    if (size > 0) {
+      // Whole grains to the thief, at least one
+      int half = size > grain ? (size / 2 + grain - 1) / grain * grain : size;
+      if (half > size)
+        half = size;
+      e = victim->end;
+      b = e - half;
+      __atomic_store_n(&victim->end, b, __ATOMIC_RELAXED);
+    }
+    range_unlock(victim);
+
+    if (b < e) {
+      WorkRange *own = &pool->ranges[self];
+      range_lock(own);
+      __atomic_store_n(&own->begin, b, __ATOMIC_RELAXED);
+      __atomic_store_n(&own->end, e, __ATOMIC_RELAXED);
+      range_unlock(own);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void run_loop(Pool *pool, int self) {
+  WorkRange *own = &pool->ranges[self];
+  int grain = pool->grain;
+  for (;;) {
+    int b, e;
+    if (!take_front(own, grain, &b, &e)) {
+      if (!steal(pool, self, grain))
+        break;
+      continue;
+    }
+    pool->fn(pool->ctx, b, e, self);
+    __atomic_sub_fetch(&pool->remaining, e - b, __ATOMIC_RELEASE);
+  }
+}
+
+// Per-CPU pinning places workers node by node; a node pool's workers stay on
+// their node either way
+static void pin_worker(const Pool *pool, int self) {
+  int cpus[THREAD_POOL_MAX_THREADS];
+  int n = pool->node < 0
+              ? numa_cpu_order(cpus, THREAD_POOL_MAX_THREADS)
+              : numa_node_cpus(pool->node, cpus, THREAD_POOL_MAX_THREADS);
+  if (pin && n > 0)
+    pin_thread_to_cpu(cpus[self % n]);
+  else if (pool->node >= 0)
+    pin_thread_to_node(pool->node);
+}
+
+// Workers learn their pool and index from one word
+#define WORKER_ARG(pool_index, self) ((void *)(long)((pool_index) << 16 | (self)))
+
+static void *worker_main(void *arg) {
+  Pool *pool = &pools[(long)arg >> 16];
+  int self = (int)((long)arg & 0xffff);
+  unsigned int seen = 0;
+  if (pin || pool->node >= 0)
+    pin_worker(pool, self);
+
+  for (;;) {
+    // Spin briefly for the next loop, then sleep until one is posted
+    int spins = 0;
+    while (__atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE) == seen &&
+           !__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE)) {
+      if (++spins < THREAD_POOL_SPIN) {
+        if (spins < THREAD_POOL_SPIN / 4)
+          cpu_relax();
+        else
+          sched_yield();
+        continue;
+      }
+      pthread_mutex_lock(&pool->mutex);
+      while (pool->generation == seen && !pool->stop)
+        pthread_cond_wait(&pool->wake, &pool->mutex);
+      pthread_mutex_unlock(&pool->mutex);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->stop) {
+      pthread_mutex_unlock(&pool->mutex);
+      break;
+    }
+    seen = pool->generation;
+    int join = pool->open;
+    // Paired with the lock-free decrement of a worker leaving run_loop
+    if (join)
+      __atomic_add_fetch(&pool->active, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (join) {
+      cur_worker = self;
+      run_loop(pool, self);
+      cur_worker = -1;
+      __atomic_sub_fetch(&pool->active, 1, __ATOMIC_RELEASE);
+    }
+  }
+  return NULL;
+}
+
+static int default_threads(void) {
+  const char *env = getenv("TRANSFORMER_THREADS");
+  long n = env ? strtol(env, NULL, 10) : 0;
+  if (n <= 0)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1)
+    n = 1;
+  return n > THREAD_POOL_MAX_THREADS ? THREAD_POOL_MAX_THREADS : (int)n;
+}
+
+// Runs with fewer threads (down to the caller alone) when memory or
+// threads run out, rather than failing the loops that use it
+static void start_pool(int index, int node, int n) {
+  Pool *pool = &pools[index];
+  pool->node = node;
+  pool->ranges = (WorkRange *)calloc(n, sizeof(WorkRange));
+  pool->threads = (pthread_t *)malloc(n * sizeof(pthread_t));
+  if (!pool->ranges || !pool->threads) {
+    free(pool->ranges);
+    free(pool->threads);
+    pool->ranges = NULL;
+    pool->threads = NULL;
+    n = 1;
+  }
+  pool->stop = 0;
+  pool->open = 0;
+  for (int i = 1; i < n; i++) {
+    if (pthread_create(&pool->threads[i], NULL, worker_main,
+                       WORKER_ARG(index, i)) != 0) {
+      fprintf(stderr, "pthread_create failed in thread pool, using %d\n", i);
+      n = i;
+    }
+  }
+  __atomic_store_n(&pool->n_threads, n, __ATOMIC_RELEASE);
+}
+
+static void stop_pool(Pool *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  __atomic_store_n(&pool->stop, 1, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->mutex);
+  for (int i = 1; i < pool->n_threads; i++)
+    pthread_join(pool->threads[i], NULL);
+  free(pool->threads);
+  free(pool->ranges);
+  pool->threads = NULL;
+  pool->ranges = NULL;
+  pool->n_threads = 0;
+}
+
+// Stop every pool, then start count of them with n threads each: the shared
+// one (count == 1) or one per node
+static void restart_pools(int count, int n) {
+  for (int i = 0; i < n_pools; i++)
+    stop_pool(&pools[i]);
+  n_pools = count;
+  for (int i = 0; i < count; i++)
+    start_pool(i, count > 1 ? i : -1, n);
+}
+
+// Worker indices any pool hands out stay below this. Pools are started at
+// one size and differ only when one of them could not start every thread.
+static int pool_threads(void) {
+  int n = 0;
+  for (int i = 0; i < n_pools; i++) {
+    int t = __atomic_load_n(&pools[i].n_threads, __ATOMIC_ACQUIRE);
+    if (t > n)
+      n = t;
+  }
+  return n;
+}
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static void init_pool(void) {
+  for (int i = 0; i < NUMA_MAX_NODES; i++) {
+    pthread_mutex_init(&pools[i].mutex, NULL);
+    pthread_cond_init(&pools[i].wake, NULL);
+  }
+  const char *env = getenv("TRANSFORMER_PIN_THREADS");
+  pin = env && atoi(env) > 0;
+  restart_pools(1, default_threads());
+}
+
+int thread_pool_size(void) {
+  pthread_once(&pool_once, init_pool);
+  return pool_threads();
+}
+
+void thread_pool_set_threads(int n) {
+  pthread_once(&pool_once, init_pool);
+  if (n <= 0)
+    n = n_pools > 1 ? (default_threads() + n_pools - 1) / n_pools
+                    : default_threads();
+  if (n > THREAD_POOL_MAX_THREADS)
+    n = THREAD_POOL_MAX_THREADS;
+  if (n == pool_threads())
+    return;
+  restart_pools(n_pools, n);
+}
+
+void thread_pool_set_affinity(int on) {
+  pthread_once(&pool_once, init_pool);
+  on = on != 0;
+  if (on == pin)
+    return;
+  // Unpinning needs fresh threads as much as pinning does
+  pin = on;
+  restart_pools(n_pools, pool_threads());
+}
+
+void thread_pool_set_node_pools(int on) {
+  pthread_once(&pool_once, init_pool);
+  int count = on ? numa_node_count() : 1;
+  if (count == n_pools)
+    return;
+  // The same threads in total, split evenly
+  int n = (pool_threads() * n_pools + count - 1) / count;
+  restart_pools(count, n > THREAD_POOL_MAX_THREADS ? THREAD_POOL_MAX_THREADS
+                                                   : n);
+}
+
+void parallel_for(int n, int grain, ParallelForFn fn, void *ctx) {
+  if (n <= 0)
+    return;
+  if (grain < 1)
+    grain = 1;
+
+  pthread_once(&pool_once, init_pool);
+  Pool *pool = &pools[0];
+  if (n_pools > 1) {
+    int node = numa_current_node();
+    pool = &pools[node < n_pools ? node : 0];
+  }
+  int threads = pool->n_threads;
+  if (n <= grain || threads == 1 || cur_worker >= 0 ||
+      __atomic_exchange_n(&pool->busy, 1, __ATOMIC_ACQUIRE)) {
+    fn(ctx, 0, n, 0);
+    return;
+  }
+
+  // Contiguous shares in whole grains; threads past the last grain start
+  // empty and steal
+  int chunks = (n + grain - 1) / grain;
+  for (int t = 0; t < threads; t++) {
+    long long c0 = (long long)chunks * t / threads;
+    long long c1 = (long long)chunks * (t + 1) / threads;
+    int b = (int)(c0 * grain), e = (int)(c1 * grain);
+    pool->ranges[t].begin = b < n ? b : n;
+    pool->ranges[t].end = e < n ? e : n;
+  }
+  pool->fn = fn;
+  pool->ctx = ctx;
+  pool->grain = grain;
+  __atomic_store_n(&pool->remaining, n, __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->open = 1;
+  __atomic_add_fetch(&pool->generation, 1, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->mutex);
+
+  cur_worker = 0;
+  run_loop(pool, 0);
+  cur_worker = -1;
+
+  // Chunks stolen by other threads may still be running
+  wait_for_zero(&pool->remaining);
+
+  // No late joiners, then wait for the ones inside to leave run_loop
+  pthread_mutex_lock(&pool->mutex);
+  pool->open = 0;
+  pthread_mutex_unlock(&pool->mutex);
+  wait_for_zero(&pool->active);
+
+  __atomic_store_n(&pool->busy, 0, __ATOMIC_RELEASE);
+}
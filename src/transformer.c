@@ -1,51 +1,89 @@
 #include "../include/transformer.h"
+#include "../include/checkpoint.h"
+#include "../include/workspace.h"
 #include "../include/tensor.h"
 #include "../include/init.h"
-#ifdef USE_OPENBLAS
-#include <cblas.h>
-#endif
+#include "../include/kernels.h"
+#include "../include/positional.h"
+#include "../include/profiler.h"
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 /**
- * @brief Simple embedding lookup helper.
+ * @brief Embedding lookup plus the positional encoding of the model's mode.
+ * Computed encodings are written first and the token rows added on top, so
+ * no table is read.
+ * @param positions Position of each token, or NULL for 0..L-1
  */
-static void apply_embedding(const int *tokens, int L, int d_model,
-                            const float *emb_table, const float *pos_table,
-                            float *out) {
+static void apply_embedding(const int *tokens, const int *positions, int L,
+                            const TransformerParams *params, float *out) {
+  int d_model = params->config.d_model;
+  const float *emb_table = params->token_embedding;
+  PositionalMode mode = params->config.pos_mode;
+  PROF_BEGIN(OP_EMBEDDING);
+  if (mode == POS_SINUSOIDAL)
+    sinusoidal_table(positions, L, d_model, out);
   for (int i = 0; i < L; i++) {
-    int token_id = tokens[i];
-    // Copy token embedding
-    memcpy(out + (i * d_model), emb_table + (token_id * d_model),
-           d_model * sizeof(float));
-    // Add positional encoding (Residual style)
-    for (int d = 0; d < d_model; d++) {
-      out[i * d_model + d] += pos_table[i * d_model + d];
+    const float *emb = emb_table + (size_t)tokens[i] * d_model;
+    float *row = out + (size_t)i * d_model;
+    if (mode == POS_LEARNED) {
+      // Token embedding + positional encoding (Residual style)
+      int pos = positions ? positions[i] : i;
+      const float *pos_row = params->pos_encoding + (size_t)pos * d_model;
+      for (int d = 0; d < d_model; d++)
+        row[d] = emb[d] + pos_row[d];
+    } else if (mode == POS_SINUSOIDAL) {
+      for (int d = 0; d < d_model; d++)
+        row[d] += emb[d];
+    } else {
+      // Rotary positions are applied inside self-attention
+      memcpy(row, emb, d_model * sizeof(float));
     }
   }
+  // token row + position row -> output row
+  PROF_END_COST(OP_EMBEDDING, (double)L * d_model,
+                4.0 * (mode == POS_LEARNED ? 3 : 2) * L * d_model);
+}
+
+int transformer_max_positions(TransformerConfig config) {
+  return config.pos_mode == POS_LEARNED ? config.max_seq_len : INT_MAX;
+}
+
+// Let a paged checkpoint bring layer i in (and read ahead) before it runs
+static inline void enter_layer(const TransformerParams *params,
+                               PagerStack stack, int i) {
+  if (params->pager)
+    layer_pager_enter(params->pager, stack, i);
 }
 
-void compute_transformer(const int *src_tokens, const int *tgt_tokens,
-                         const TransformerParams *params, float *out_logits,
-                         int L_src, int L_tgt) {
+void compute_encoder(const int *src_tokens, const TransformerParams *params,
+                     float *enc_output, int L_src) {
 
   int d_model = params->config.d_model;
   int d_ff = params->config.d_ff;
   int num_heads = params->config.num_heads;
   int num_layers = params->config.num_layers;
 
-  // --- 1. Encoder Path ---
-  float *enc_buf = (float *)calloc(L_src * d_model, sizeof(float));
-  float *enc_input = (float *)calloc(L_src * d_model, sizeof(float));
+  float *enc_buf = (float *)scratch_calloc(L_src * d_model, sizeof(float));
+  float *enc_input = (float *)scratch_calloc(L_src * d_model, sizeof(float));
+  if (!enc_buf || !enc_input) {
+    scratch_fail("Alloc failed in encoder");
+    scratch_free(enc_buf);
+    scratch_free(enc_input);
+    return;
+  }
 
   // Embedding + Positional Encoding
-  apply_embedding(src_tokens, L_src, d_model, params->token_embedding,
-                  params->pos_encoding, enc_input);
+  apply_embedding(src_tokens, NULL, L_src, params, enc_input);
 
   // Iterative Encoder Layers
   float *current_src = enc_input;
   float *next_src = enc_buf;
   for (int i = 0; i < num_layers; i++) {
+    PROF_LAYER(PROF_ENCODER, i);
+    enter_layer(params, PAGER_ENCODER, i);
     compute_encoder_layer(current_src, &params->encoder_layers[i], next_src,
                           L_src, d_model, d_ff, num_heads);
     // Swap
@@ -53,21 +91,104 @@ void compute_transformer(const int *src_tokens, const int *tgt_tokens,
     current_src = next_src;
     next_src = tmp;
   }
+  PROF_LAYER(PROF_MODEL, -1);
   // Result: current_src now contains the final Encoder context
+  memcpy(enc_output, current_src, L_src * d_model * sizeof(float));
+
+  scratch_free(enc_buf);
+  scratch_free(enc_input);
+}
+
+void compute_logits(const float *hidden, const TransformerParams *params,
+                    float *out_logits, int L) {
+  // (L x d_model) * (d_model x vocab_size) = (L x vocab_size)
+  int d_model = params->config.d_model;
+  int vocab_size = params->config.vocab_size;
+  PROF_BEGIN(OP_OUTPUT_PROJECTION);
+  kernels()->gemm(hidden, d_model, params->output_projection, vocab_size,
+                  out_logits, vocab_size, L, vocab_size, d_model);
+  PROF_END_COST(OP_OUTPUT_PROJECTION,
+                PROF_GEMM_FLOPS(L, vocab_size, d_model),
+                PROF_GEMM_BYTES(L, vocab_size, d_model));
+}
+
+int transformer_gemm_shapes(TransformerConfig config, int L,
+                            GemmShape *shapes) {
+  int d = config.d_model, d_ff = config.d_ff;
+  int d_k = d / config.num_heads;
+  int n = 0;
+
+  // Forward pass: per-head projections and attention, then W_o and the FFN
+  shapes[n++] = (GemmShape){L, 3 * d_k, d};
+  shapes[n++] = (GemmShape){L, d_k, d};
+  shapes[n++] = (GemmShape){L, L, d_k};
+  shapes[n++] = (GemmShape){L, d_k, L};
+  shapes[n++] = (GemmShape){L, d, d};
+  shapes[n++] = (GemmShape){L, d_ff, d};
+  shapes[n++] = (GemmShape){L, d, d_ff};
+
+  // Decode step: fused QKV, per-head cross-attention queries, W_o, the FFN
+  // and the vocabulary projection for a single row
+  shapes[n++] = (GemmShape){1, 3 * d, d};
+  shapes[n++] = (GemmShape){1, d_k, d};
+  shapes[n++] = (GemmShape){1, d, d};
+  shapes[n++] = (GemmShape){1, d_ff, d};
+  shapes[n++] = (GemmShape){1, d, d_ff};
+  shapes[n++] = (GemmShape){1, config.vocab_size, d};
+  return n;
+}
+
+int compute_transformer(const int *src_tokens, const int *tgt_tokens,
+                        const TransformerParams *params, float *out_logits,
+                        int L_src, int L_tgt) {
+  return compute_transformer_positions(src_tokens, tgt_tokens, params, NULL,
+                                       L_tgt, out_logits, L_src, L_tgt);
+}
+
+int compute_transformer_positions(const int *src_tokens,
+                                  const int *tgt_tokens,
+                                  const TransformerParams *params,
+                                  const int *positions, int n_positions,
+                                  float *out_logits, int L_src, int L_tgt) {
+
+  // Rows are packed into an L_tgt-row buffer below
+  if (n_positions < 0 || n_positions > L_tgt)
+    return -1;
+  for (int i = 0; positions && i < n_positions; i++) {
+    if (positions[i] < 0 || positions[i] >= L_tgt)
+      return -1;
+  }
+
+  int d_model = params->config.d_model;
+  int d_ff = params->config.d_ff;
+  int num_heads = params->config.num_heads;
+  int num_layers = params->config.num_layers;
+
+  // --- 1. Encoder Path ---
+  float *enc_output = (float *)scratch_calloc(L_src * d_model, sizeof(float));
+  float *dec_buf = (float *)scratch_calloc(L_tgt * d_model, sizeof(float));
+  float *dec_input = (float *)scratch_calloc(L_tgt * d_model, sizeof(float));
+  if (!enc_output || !dec_buf || !dec_input) {
+    scratch_fail("Alloc failed in transformer forward");
+    scratch_free(enc_output);
+    scratch_free(dec_buf);
+    scratch_free(dec_input);
+    return -1;
+  }
+  compute_encoder(src_tokens, params, enc_output, L_src);
 
   // --- 2. Decoder Path ---
-  float *dec_buf = (float *)calloc(L_tgt * d_model, sizeof(float));
-  float *dec_input = (float *)calloc(L_tgt * d_model, sizeof(float));
 
   // Embedding + Positional Encoding
-  apply_embedding(tgt_tokens, L_tgt, d_model, params->token_embedding,
-                  params->pos_encoding, dec_input);
+  apply_embedding(tgt_tokens, NULL, L_tgt, params, dec_input);
 
   float *current_tgt = dec_input;
   float *next_tgt = dec_buf;
   for (int i = 0; i < num_layers; i++) {
-    // Note: Cross-attention always uses the final current_src from the Encoder
-    compute_decoder_layer(current_tgt, current_src, &params->decoder_layers[i],
+    PROF_LAYER(PROF_DECODER, i);
+    enter_layer(params, PAGER_DECODER, i);
+    // Note: Cross-attention always uses the final encoder output
+    compute_decoder_layer(current_tgt, enc_output, &params->decoder_layers[i],
                           next_tgt, L_tgt, L_src, d_model, d_ff, num_heads);
     // Swap
     float *tmp = current_tgt;
@@ -75,22 +196,96 @@ void compute_transformer(const int *src_tokens, const int *tgt_tokens,
     next_tgt = tmp;
   }
 
+  PROF_LAYER(PROF_MODEL, -1);
+
   // --- 3. Final Output Projection (Logits) ---
-  // (L_tgt x d_model) * (d_model x vocab_size) = (L_tgt x vocab_size)
-  // We use the last current_tgt (decoder output)
-#ifdef USE_OPENBLAS
-  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, L_tgt,
-              params->config.vocab_size, d_model, 1.0f, current_tgt, d_model,
-              params->output_projection, params->config.vocab_size, 0.0f,
-              out_logits, params->config.vocab_size);
-#else
-  matmul_blocked(current_tgt, params->output_projection, out_logits, L_tgt,
-                 params->config.vocab_size, d_model);
-#endif
+  // We use the last current_tgt (decoder output). Requested rows are packed
+  // into the spare buffer so the GEMM only covers n_positions rows.
+  const float *proj_rows = current_tgt;
+  if (positions) {
+    for (int i = 0; i < n_positions; i++) {
+      memcpy(next_tgt + i * d_model, current_tgt + positions[i] * d_model,
+             d_model * sizeof(float));
+    }
+    proj_rows = next_tgt;
+  }
+  compute_logits(proj_rows, params, out_logits, n_positions);
 
   // Cleanup
-  free(enc_buf);
-  free(enc_input);
-  free(dec_buf);
-  free(dec_input);
+  scratch_free(enc_output);
+  scratch_free(dec_buf);
+  scratch_free(dec_input);
+  return 0;
+}
+
+void compute_cross_kv(const TransformerParams *params, const float *enc_output,
+                      CrossKV *ckv) {
+  for (int i = 0; i < params->config.num_layers; i++) {
+    PROF_LAYER(PROF_DECODER, i);
+    enter_layer(params, PAGER_DECODER, i);
+    compute_decoder_cross_kv(enc_output, &params->decoder_layers[i], ckv->K[i],
+                             ckv->V[i], ckv->L_src, params->config.d_model,
+                             params->config.num_heads);
+  }
+  PROF_LAYER(PROF_MODEL, -1);
+}
+
+void compute_decoder_step(const int *tokens, const int *slots,
+                          const TransformerParams *params, KVCache *cache,
+                          float *hidden, int n) {
+
+  int d_model = params->config.d_model;
+  int d_ff = params->config.d_ff;
+  int num_heads = params->config.num_heads;
+  int num_layers = params->config.num_layers;
+
+  // Rows of the same slot occupy consecutive positions after its cached ones
+  int *positions = (int *)scratch_alloc(n * sizeof(int));
+  float *dec_buf = (float *)scratch_alloc((size_t)n * d_model * sizeof(float));
+  int ok = positions && dec_buf;
+  if (!ok)
+    scratch_fail("Alloc failed in decoder step");
+  for (int b = 0; ok && b < n; b++) {
+    positions[b] = cache->len[slots[b]];
+    for (int j = 0; j < b; j++) {
+      if (slots[j] == slots[b])
+        positions[b]++;
+    }
+    if (positions[b] >= cache->max_len) {
+      scratch_fail("Decoder step exceeds KV cache length");
+      ok = 0;
+    }
+  }
+  if (!ok) {
+    scratch_free(positions);
+    scratch_free(dec_buf);
+    return;
+  }
+
+  // Embedding + Positional Encoding
+  apply_embedding(tokens, positions, n, params, hidden);
+
+  float *current_tgt = hidden;
+  float *next_tgt = dec_buf;
+  for (int i = 0; i < num_layers; i++) {
+    PROF_LAYER(PROF_DECODER, i);
+    enter_layer(params, PAGER_DECODER, i);
+    compute_decoder_layer_step(current_tgt, &params->decoder_layers[i], cache,
+                               i, slots, positions, next_tgt, n, d_model, d_ff,
+                               num_heads);
+    float *tmp = current_tgt;
+    current_tgt = next_tgt;
+    next_tgt = tmp;
+  }
+  PROF_LAYER(PROF_MODEL, -1);
+  if (current_tgt != hidden)
+    memcpy(hidden, current_tgt, (size_t)n * d_model * sizeof(float));
+
+  for (int b = 0; b < n; b++) {
+    if (positions[b] + 1 > cache->len[slots[b]])
+      cache->len[slots[b]] = positions[b] + 1;
+  }
+
+  scratch_free(positions);
+  scratch_free(dec_buf);
 }
@@ -0,0 +1,427 @@
+#include "../include/transformer_api.h"
+#include "../include/checkpoint.h"
+#include "../include/huge_alloc.h"
+#include "../include/kv_cache.h"
+#include "../include/sampling.h"
+#include "../include/shared_params.h"
+#include "../include/transformer.h"
+#include "../include/workspace.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum { MODEL_OWNED, MODEL_CHECKPOINT, MODEL_SHARED } ModelKind;
+
+struct TfModel {
+  ModelKind kind;
+  TransformerParams owned;
+  Checkpoint ck; // Holds the pager, so the model is never moved
+  SharedParams sp;
+  const TransformerParams *params;
+};
+
+struct TfSession {
+  const TransformerParams *params;
+  int max_src, max_tgt;
+
+  Workspace ws;
+  KVCache cache; // One slot of max_tgt positions
+  CrossKV ckv;   // Sized for max_src, L_src set by each encode
+  float *enc_output; // max_src x d_model
+  float *hidden;     // d_model
+  int encoded;       // ckv / cache hold a source
+  int cancel;        // Set by tf_session_cancel, from any thread
+};
+
+const char *tf_status_string(TfStatus status) {
+  switch (status) {
+  case TF_OK:
+    return "ok";
+  case TF_ERR_INVALID_ARG:
+    return "invalid argument";
+  case TF_ERR_NO_MEMORY:
+    return "out of memory";
+  case TF_ERR_IO:
+    return "I/O error";
+  case TF_ERR_CAPACITY:
+    return "exceeds session capacity";
+  case TF_ERR_STATE:
+    return "invalid session state";
+  case TF_ERR_CANCELLED:
+    return "cancelled";
+  }
+  return "unknown status";
+}
+
+// ---------------------------------------------------------------------------
+// Models
+
+static int valid_config(const TransformerConfig *c) {
+  return c->num_layers > 0 && c->d_model > 0 && c->d_ff > 0 &&
+         c->num_heads > 0 && c->d_model % c->num_heads == 0 &&
+         c->vocab_size > 0 && c->max_seq_len > 0 &&
+         (c->pos_mode == POS_LEARNED || c->pos_mode == POS_SINUSOIDAL ||
+          c->pos_mode == POS_ROTARY);
+}
+
+TfStatus tf_model_create_random(const TfModelConfig *config, TfModel **model) {
+  if (!config || !model)
+    return TF_ERR_INVALID_ARG;
+  TransformerConfig c = {config->num_layers, config->d_model,
+                         config->d_ff,       config->num_heads,
+                         config->vocab_size, config->max_seq_len,
+                         (PositionalMode)config->positional};
+  if (!valid_config(&c))
+    return TF_ERR_INVALID_ARG;
+
+  TfModel *m = (TfModel *)calloc(1, sizeof(TfModel));
+  if (!m)
+    return TF_ERR_NO_MEMORY;
+  if (create_transformer_params(&m->owned, c) != 0) {
+    free(m);
+    return TF_ERR_NO_MEMORY;
+  }
+  m->kind = MODEL_OWNED;
+  m->params = &m->owned;
+  *model = m;
+  return TF_OK;
+}
+
+TfStatus tf_model_open(const char *path, int resident_layers,
+                       TfModel **model) {
+  if (!path || !model || resident_layers < 0 || resident_layers == 1)
+    return TF_ERR_INVALID_ARG;
+  TfModel *m = (TfModel *)calloc(1, sizeof(TfModel));
+  if (!m)
+    return TF_ERR_NO_MEMORY;
+  if (open_checkpoint(&m->ck, path, resident_layers) != 0) {
+    TfStatus status = errno == ENOMEM ? TF_ERR_NO_MEMORY : TF_ERR_IO;
+    free(m);
+    return status;
+  }
+  m->kind = MODEL_CHECKPOINT;
+  m->params = &m->ck.params;
+  *model = m;
+  return TF_OK;
+}
+
+TfStatus tf_model_attach_shared(const char *name, TfModel **model) {
+  if (!name || !model)
+    return TF_ERR_INVALID_ARG;
+  TfModel *m = (TfModel *)calloc(1, sizeof(TfModel));
+  if (!m)
+    return TF_ERR_NO_MEMORY;
+  if (shared_params_attach(&m->sp, name) != 0) {
+    TfStatus status = errno == ENOMEM ? TF_ERR_NO_MEMORY : TF_ERR_IO;
+    free(m);
+    return status;
+  }
+  m->kind = MODEL_SHARED;
+  m->params = &m->sp.params;
+  *model = m;
+  return TF_OK;
+}
+
+void tf_model_destroy(TfModel *model) {
+  if (!model)
+    return;
+  switch (model->kind) {
+  case MODEL_OWNED:
+    free_transformer_params(&model->owned);
+    break;
+  case MODEL_CHECKPOINT:
+    close_checkpoint(&model->ck);
+    break;
+  case MODEL_SHARED:
+    shared_params_detach(&model->sp);
+    break;
+  }
+  free(model);
+}
+
+TfStatus tf_model_config(const TfModel *model, TfModelConfig *config) {
+  if (!model || !config)
+    return TF_ERR_INVALID_ARG;
+  const TransformerConfig *c = &model->params->config;
+  config->num_layers = c->num_layers;
+  config->d_model = c->d_model;
+  config->d_ff = c->d_ff;
+  config->num_heads = c->num_heads;
+  config->vocab_size = c->vocab_size;
+  config->max_seq_len = c->max_seq_len;
+  config->positional = (TfPositional)c->pos_mode;
+  return TF_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Sessions
+
+// Callers have validated their arguments and bound the session's workspace.
+// A pass that failed (scratch_fail) leaves ws.failed set; see end_call.
+
+static void run_encode(TfSession *s, const int *src, int L_src) {
+  compute_encoder(src, s->params, s->enc_output, L_src);
+  s->ckv.L_src = L_src;
+  compute_cross_kv(s->params, s->enc_output, &s->ckv);
+  kv_cache_reset_slot(&s->cache, 0, &s->ckv);
+  s->encoded = 1;
+}
+
+static void run_step(TfSession *s, int token, float *logits) {
+  int slot = 0;
+  compute_decoder_step(&token, &slot, s->params, &s->cache, s->hidden, 1);
+  if (logits)
+    compute_logits(s->hidden, s->params, logits, 1);
+}
+
+static int valid_tokens(const TfSession *s, const int *tokens, int n) {
+  for (int i = 0; i < n; i++) {
+    if (tokens[i] < 0 || tokens[i] >= s->params->config.vocab_size)
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Run every entry point once at its maximum shapes with a measuring
+ * workspace bound, and return the arena they needed.
+ */
+static int measure_workspace(TfSession *s, size_t *bytes, int *blocks) {
+  const TransformerConfig *c = &s->params->config;
+  int n_tokens = s->max_src > s->max_tgt ? s->max_src : s->max_tgt;
+  int *tokens = (int *)calloc(n_tokens, sizeof(int));
+  float *logits =
+      (float *)malloc((size_t)s->max_tgt * c->vocab_size * sizeof(float));
+  Workspace probe;
+  if (!tokens || !logits || init_workspace(&probe, 0, 0) != 0) {
+    free(tokens);
+    free(logits);
+    return -1;
+  }
+
+  Workspace *prev = workspace_bind(&probe);
+  compute_transformer(tokens, tokens, s->params, logits, s->max_src,
+                      s->max_tgt);
+  run_encode(s, tokens, s->max_src);
+  run_step(s, 0, logits);
+  workspace_bind(prev);
+  s->encoded = 0;
+  int failed = probe.failed > 0;
+
+  *bytes = probe.peak;
+  *blocks = probe.peak_blocks;
+  free_workspace(&probe);
+  free(tokens);
+  free(logits);
+  return failed ? -1 : 0;
+}
+
+TfStatus tf_session_create(const TfModel *model, const TfSessionConfig *config,
+                           TfSession **session) {
+  if (!model || !session)
+    return TF_ERR_INVALID_ARG;
+  const TransformerConfig *c = &model->params->config;
+  int max_src = config && config->max_src_len ? config->max_src_len
+                                              : c->max_seq_len;
+  int max_tgt = config && config->max_tgt_len ? config->max_tgt_len
+                                              : c->max_seq_len;
+  int max_positions = transformer_max_positions(*c);
+  if (max_src <= 0 || max_tgt <= 0 || max_src > max_positions ||
+      max_tgt > max_positions)
+    return TF_ERR_INVALID_ARG;
+
+  TfSession *s = (TfSession *)calloc(1, sizeof(TfSession));
+  if (!s)
+    return TF_ERR_NO_MEMORY;
+  s->params = model->params;
+  s->max_src = max_src;
+  s->max_tgt = max_tgt;
+
+  s->enc_output = (float *)malloc((size_t)max_src * c->d_model * sizeof(float));
+  s->hidden = (float *)malloc(c->d_model * sizeof(float));
+  size_t ws_bytes = 0;
+  int ws_blocks = 0;
+  if (!s->enc_output || !s->hidden ||
+      create_cross_kv(&s->ckv, c->num_layers, c->d_model, max_src) != 0 ||
+      create_kv_cache(&s->cache, c->num_layers, c->d_model, 1, max_tgt) != 0 ||
+      measure_workspace(s, &ws_bytes, &ws_blocks) != 0 ||
+      init_workspace(&s->ws, ws_bytes > 0 ? ws_bytes : 1,
+                     ws_blocks > 0 ? ws_blocks : 1) != 0) {
+    tf_session_destroy(s);
+    return TF_ERR_NO_MEMORY;
+  }
+  *session = s;
+  return TF_OK;
+}
+
+void tf_session_destroy(TfSession *session) {
+  if (!session)
+    return;
+  free_workspace(&session->ws);
+  free_kv_cache(&session->cache);
+  free_cross_kv(&session->ckv);
+  free(session->enc_output);
+  free(session->hidden);
+  free(session);
+}
+
+// Bind the session's workspace for one call
+static Workspace *begin_call(TfSession *session) {
+  session->ws.failed = 0;
+  return workspace_bind(&session->ws);
+}
+
+/**
+ * @brief Unbind and report whether the compute path gave up. The caches may
+ * then be half written, so the session has to be encoded again.
+ */
+static TfStatus end_call(TfSession *session, Workspace *prev) {
+  workspace_bind(prev);
+  if (!session->ws.failed)
+    return TF_OK;
+  session->encoded = 0;
+  return TF_ERR_NO_MEMORY;
+}
+
+TfStatus tf_forward(TfSession *session, const int *src, int L_src,
+                    const int *tgt, int L_tgt, float *logits) {
+  if (!session || !src || !tgt || !logits || L_src <= 0 || L_tgt <= 0)
+    return TF_ERR_INVALID_ARG;
+  if (L_src > session->max_src || L_tgt > session->max_tgt)
+    return TF_ERR_CAPACITY;
+  if (!valid_tokens(session, src, L_src) || !valid_tokens(session, tgt, L_tgt))
+    return TF_ERR_INVALID_ARG;
+
+  Workspace *prev = begin_call(session);
+  compute_transformer(src, tgt, session->params, logits, L_src, L_tgt);
+  return end_call(session, prev);
+}
+
+TfStatus tf_encode(TfSession *session, const int *src, int L_src) {
+  if (!session || !src || L_src <= 0)
+    return TF_ERR_INVALID_ARG;
+  if (L_src > session->max_src)
+    return TF_ERR_CAPACITY;
+  if (!valid_tokens(session, src, L_src))
+    return TF_ERR_INVALID_ARG;
+
+  Workspace *prev = begin_call(session);
+  run_encode(session, src, L_src);
+  return end_call(session, prev);
+}
+
+TfStatus tf_decode_step(TfSession *session, int token, float *logits) {
+  if (!session || !valid_tokens(session, &token, 1))
+    return TF_ERR_INVALID_ARG;
+  if (!session->encoded)
+    return TF_ERR_STATE;
+  if (session->cache.len[0] >= session->max_tgt)
+    return TF_ERR_CAPACITY;
+
+  Workspace *prev = begin_call(session);
+  run_step(session, token, logits);
+  return end_call(session, prev);
+}
+
+TfStatus tf_generate_stream(TfSession *session, const int *src, int L_src,
+                            const TfSamplingParams *sampling,
+                            TfTokenCallback on_token, void *user, int *n_out) {
+  if (!session || !sampling || !on_token || sampling->max_len <= 0 ||
+      !valid_tokens(session, &sampling->bos_id, 1) ||
+      (sampling->eos_id != -1 && !valid_tokens(session, &sampling->eos_id, 1)))
+    return TF_ERR_INVALID_ARG;
+  __atomic_store_n(&session->cancel, 0, __ATOMIC_RELAXED);
+  TfStatus status = tf_encode(session, src, L_src);
+  if (status != TF_OK)
+    return status;
+
+  SamplingConfig cfg = {0};
+  cfg.temperature = sampling->temperature;
+  cfg.top_k = sampling->top_k;
+  cfg.top_p = sampling->top_p;
+  cfg.seed = sampling->seed;
+  cfg.max_len = sampling->max_len;
+  cfg.bos_id = sampling->bos_id;
+  cfg.eos_id = sampling->eos_id;
+
+  const TransformerConfig *c = &session->params->config;
+  unsigned long long rng = cfg.seed;
+  int n = 0;
+
+  // Same loop as generate_from_cross, on the session's buffers
+  Workspace *prev = begin_call(session);
+  run_step(session, cfg.bos_id, NULL);
+  while (!session->ws.failed) {
+    int token = sample_from_hidden(session->hidden,
+                                   session->params->output_projection,
+                                   c->d_model, c->vocab_size, &cfg, &rng);
+    if (token == cfg.eos_id)
+      break;
+    n++;
+    if (on_token(token, user) ||
+        __atomic_load_n(&session->cancel, __ATOMIC_RELAXED)) {
+      status = TF_ERR_CANCELLED;
+      break;
+    }
+    if (n == cfg.max_len || session->cache.len[0] == session->max_tgt)
+      break;
+    run_step(session, token, NULL);
+  }
+  if (end_call(session, prev) != TF_OK)
+    status = TF_ERR_NO_MEMORY;
+
+  if (status == TF_ERR_CANCELLED)
+    tf_session_release(session);
+  if (n_out)
+    *n_out = n;
+  return status;
+}
+
+typedef struct {
+  int *out;
+  int n;
+} CollectCtx;
+
+static int collect_token(int token, void *user) {
+  CollectCtx *ctx = (CollectCtx *)user;
+  ctx->out[ctx->n++] = token;
+  return 0;
+}
+
+TfStatus tf_generate(TfSession *session, const int *src, int L_src,
+                     const TfSamplingParams *sampling, int *out, int *n_out) {
+  if (!out || !n_out)
+    return TF_ERR_INVALID_ARG;
+  CollectCtx ctx = {out, 0};
+  return tf_generate_stream(session, src, L_src, sampling, collect_token, &ctx,
+                            n_out);
+}
+
+void tf_session_cancel(TfSession *session) {
+  if (session)
+    __atomic_store_n(&session->cancel, 1, __ATOMIC_RELAXED);
+}
+
+TfStatus tf_session_release(TfSession *session) {
+  if (!session)
+    return TF_ERR_INVALID_ARG;
+  kv_cache_release(&session->cache);
+  session->ckv.L_src = session->max_src;
+  cross_kv_release(&session->ckv);
+  huge_release(session->enc_output, (size_t)session->max_src *
+                                        session->params->config.d_model *
+                                        sizeof(float));
+  huge_release(session->ws.base, session->ws.capacity);
+  session->encoded = 0;
+  return TF_OK;
+}
+
+TfStatus tf_session_stats(const TfSession *session, TfSessionStats *stats) {
+  if (!session || !stats)
+    return TF_ERR_INVALID_ARG;
+  stats->workspace_bytes = session->ws.capacity;
+  stats->workspace_peak = session->ws.peak;
+  stats->overflows = session->ws.overflows;
+  return TF_OK;
+}
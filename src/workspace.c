@@ -0,0 +1,155 @@
+#include "../include/workspace.h"
+#include "../include/huge_alloc.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static _Thread_local Workspace *bound = NULL;
+
+int init_workspace(Workspace *ws, size_t capacity, int max_blocks) {
+  memset(ws, 0, sizeof(*ws));
+  if (capacity > 0) {
+    ws->base = (char *)huge_alloc(capacity);
+    ws->blocks = (WorkspaceBlock *)malloc(max_blocks * sizeof(WorkspaceBlock));
+    if (!ws->base || !ws->blocks) {
+      free_workspace(ws);
+      return -1;
+    }
+    ws->capacity = capacity;
+    ws->max_blocks = max_blocks;
+  }
+  return 0;
+}
+
+void free_workspace(Workspace *ws) {
+  huge_free(ws->base);
+  free(ws->blocks);
+  ws->base = NULL;
+  ws->blocks = NULL;
+  ws->capacity = 0;
+  ws->max_blocks = 0;
+}
+
+Workspace *workspace_bind(Workspace *ws) {
+  Workspace *prev = bound;
+  bound = ws;
+  return prev;
+}
+
+static size_t align_up(size_t n) {
+  return (n + HUGE_ALLOC_ALIGN - 1) / HUGE_ALLOC_ALIGN * HUGE_ALLOC_ALIGN;
+}
+
+// Measuring workspaces keep only the offsets of their virtual blocks
+static int measuring(const Workspace *ws) { return ws->capacity == 0; }
+
+// Push a block at the top of the (real or virtual) arena
+static void push_block(Workspace *ws, size_t size, void *heap) {
+  WorkspaceBlock *b = &ws->blocks[ws->n_blocks++];
+  b->offset = ws->top;
+  b->freed = 0;
+  b->heap = heap;
+  ws->top += size;
+  if (ws->top > ws->peak)
+    ws->peak = ws->top;
+  if (ws->n_blocks > ws->peak_blocks)
+    ws->peak_blocks = ws->n_blocks;
+}
+
+// Mark the block freed and unwind every freed block on top
+static void pop_block(Workspace *ws, int i) {
+  ws->blocks[i].freed = 1;
+  while (ws->n_blocks > 0 && ws->blocks[ws->n_blocks - 1].freed) {
+    ws->n_blocks--;
+    ws->top = ws->blocks[ws->n_blocks].offset;
+  }
+}
+
+// Room for one more virtual block; -1 when the block list cannot grow
+static int reserve_block(Workspace *ws) {
+  if (ws->n_blocks < ws->max_blocks)
+    return 0;
+  int n = ws->max_blocks ? 2 * ws->max_blocks : 64;
+  WorkspaceBlock *blocks =
+      (WorkspaceBlock *)realloc(ws->blocks, n * sizeof(WorkspaceBlock));
+  if (!blocks)
+    return -1;
+  ws->blocks = blocks;
+  ws->max_blocks = n;
+  return 0;
+}
+
+void *scratch_alloc(size_t bytes) {
+  Workspace *ws = bound;
+  if (!ws)
+    return huge_alloc(bytes);
+
+  size_t size = align_up(bytes ? bytes : 1);
+  if (measuring(ws)) {
+    void *p = huge_alloc(bytes);
+    // A block that cannot be tracked makes the measurement a lower bound
+    if (p && reserve_block(ws) == 0)
+      push_block(ws, size, p);
+    else if (p)
+      ws->overflows++;
+    return p;
+  }
+
+  // Refused rather than served by the heap: the pass fails through
+  // scratch_fail and its owner reports it
+  if (ws->top + size > ws->capacity || ws->n_blocks >= ws->max_blocks) {
+    ws->overflows++;
+    return NULL;
+  }
+  push_block(ws, size, NULL);
+  return ws->base + ws->blocks[ws->n_blocks - 1].offset;
+}
+
+void *scratch_calloc(size_t count, size_t size) {
+  if (size && count > SIZE_MAX / size)
+    return NULL;
+  void *p = scratch_alloc(count * size);
+  if (p)
+    memset(p, 0, count * size);
+  return p;
+}
+
+void scratch_free(void *p) {
+  Workspace *ws = bound;
+  if (!p)
+    return;
+  if (ws && measuring(ws)) {
+    for (int i = ws->n_blocks - 1; i >= 0; i--) {
+      if (ws->blocks[i].heap == p && !ws->blocks[i].freed) {
+        pop_block(ws, i);
+        break;
+      }
+    }
+    huge_free(p);
+    return;
+  }
+  if (!ws || (char *)p < ws->base || (char *)p >= ws->base + ws->capacity) {
+    huge_free(p);
+    return;
+  }
+
+  size_t offset = (size_t)((char *)p - ws->base);
+  for (int i = ws->n_blocks - 1; i >= 0; i--) {
+    if (ws->blocks[i].offset == offset && !ws->blocks[i].freed) {
+      pop_block(ws, i);
+      break;
+    }
+  }
+}
+
+void scratch_fail(const char *what) {
+  Workspace *ws = bound;
+  if (ws) {
+    ws->failed++;
+    return;
+  }
+  fprintf(stderr, "%s\n", what);
+  exit(1);
+}
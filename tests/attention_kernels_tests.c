@@ -0,0 +1,90 @@
+#include "../include/attention_kernels.h"
+#include "../include/kernels.h"
+#include "../include/math_utils.h"
+#include "../include/utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/*.c tests/attention_kernels_tests.c -lm -O2 -o
+// attention_kernels_tests
+
+static void fill(float *x, int n, unsigned int seed) {
+  for (int i = 0; i < n; i++) {
+    seed = seed * 1103515245u + 12345u;
+    x[i] = ((seed >> 8) & 0xFFFF) / 32768.0f - 1.0f;
+  }
+}
+
+// Reference: scores GEMM, scale, mask, softmax, output GEMM
+static void attention_reference(const float *Q, int ldq, const float *K,
+                                const float *V, int ldkv, float *W, float *out,
+                                int ldo, int rows, int n_keys, int causal,
+                                int d_k) {
+  const KernelTable *ref = kernel_backend_table(KERNEL_REFERENCE);
+  ref->gemm_nt(Q, ldq, K, ldkv, W, n_keys, rows, n_keys, d_k);
+  scale_scores(W, rows * n_keys, d_k);
+  if (causal)
+    for (int i = 0; i < rows; i++)
+      for (int j = n_keys - rows + i + 1; j < n_keys; j++)
+        W[i * n_keys + j] = -INFINITY;
+  ref->softmax(W, W, rows, n_keys);
+  ref->gemm(W, n_keys, V, ldkv, out, ldo, rows, d_k, n_keys);
+}
+
+// Strided Q / K / V / out, as the decoder reads heads out of wider rows
+static int check_kernel(int d_k, int rows, int n_keys, int causal) {
+  int ld = d_k + 7;
+  float *Q = malloc((size_t)rows * ld * sizeof(float));
+  float *K = malloc((size_t)n_keys * ld * sizeof(float));
+  float *V = malloc((size_t)n_keys * ld * sizeof(float));
+  float *W = malloc((size_t)rows * n_keys * sizeof(float));
+  float *W_ref = malloc((size_t)rows * n_keys * sizeof(float));
+  float *out = calloc((size_t)rows * ld, sizeof(float));
+  float *out_ref = calloc((size_t)rows * ld, sizeof(float));
+  fill(Q, rows * ld, 1);
+  fill(K, n_keys * ld, 2);
+  fill(V, n_keys * ld, 3);
+
+  attention_kernel(d_k)(Q, ld, K, V, ld, W, n_keys, out, ld, rows, n_keys,
+                        causal, d_k);
+  attention_reference(Q, ld, K, V, ld, W_ref, out_ref, ld, rows, n_keys,
+                      causal, d_k);
+  int ok = compare(W, W_ref, rows * n_keys) &&
+           compare(out, out_ref, rows * ld);
+
+  free(Q);
+  free(K);
+  free(V);
+  free(W);
+  free(W_ref);
+  free(out);
+  free(out_ref);
+  return ok;
+}
+
+static void test_kernels_match_reference() {
+  static const int d_ks[] = {32, 64, 128, 8, 20, 48, 80};
+  int ok = 1;
+  for (int i = 0; i < 7; i++) {
+    int d_k = d_ks[i];
+    ok &= (attention_kernel_specialized(d_k) == (i < 3));
+    ok &= check_kernel(d_k, 1, 1, 0);
+    ok &= check_kernel(d_k, 1, 37, 0);
+    ok &= check_kernel(d_k, 6, 19, 1);
+  }
+
+  printf("Testing specialized and generic attention kernels:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+int main() {
+  printf("===== Running attention kernels tests =====\n");
+  test_kernels_match_reference();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -1,5 +1,6 @@
 #include "../include/attention.h"
 #include "../include/math_utils.h"
+#include "../include/thread_pool.h"
 #include "../include/utils.h"
 
 #include <math.h>
@@ -75,7 +76,7 @@ void test_attention_basic() {
   float out[4];
 
   compute_attention_gemm(X, W_qkv, Q, K, V, scores, weights, out, L, d_model,
-                         d_k);
+                         d_k, NULL);
 
   // print results
   print_mat("out", out, L, d_k);
@@ -259,6 +260,74 @@ void test_compute_cross_attention() {
   free(out);
 }
 
+static void fill_random(float *x, size_t n, float scale) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = ((float)rand() / RAND_MAX - 0.5f) * scale;
+}
+
+static void test_heads_across_threads() {
+  // Odd sizes, more heads than threads; outputs must not depend on the split
+  int L = 37, L_enc = 23, d_model = 64, num_heads = 8;
+  float *X = malloc((size_t)L * d_model * sizeof(float));
+  float *X_kv = malloc((size_t)L_enc * d_model * sizeof(float));
+  AttentionParams params;
+  params.W_qkv = malloc((size_t)d_model * 3 * d_model * sizeof(float));
+  params.W_o = malloc((size_t)d_model * d_model * sizeof(float));
+  fill_random(X, (size_t)L * d_model, 2.0f);
+  fill_random(X_kv, (size_t)L_enc * d_model, 2.0f);
+  fill_random(params.W_qkv, (size_t)d_model * 3 * d_model, 0.5f);
+  fill_random(params.W_o, (size_t)d_model * d_model, 0.5f);
+
+  float *self_ref[2], *self_got[2], *cross_ref, *cross_got;
+  for (int r = 0; r < 2; r++) {
+    self_ref[r] = malloc((size_t)L * d_model * sizeof(float));
+    self_got[r] = malloc((size_t)L * d_model * sizeof(float));
+  }
+  cross_ref = malloc((size_t)L * d_model * sizeof(float));
+  cross_got = malloc((size_t)L * d_model * sizeof(float));
+
+  thread_pool_set_threads(1);
+  for (int r = 0; r < 2; r++) {
+    params.rotary = r;
+    compute_multihead_attention(X, &params, self_ref[r], L, d_model,
+                                num_heads);
+  }
+  compute_cross_attention(X, X_kv, &params, cross_ref, L, L_enc, d_model,
+                          num_heads);
+
+  thread_pool_set_threads(3);
+  for (int r = 0; r < 2; r++) {
+    params.rotary = r;
+    compute_multihead_attention(X, &params, self_got[r], L, d_model,
+                                num_heads);
+  }
+  compute_cross_attention(X, X_kv, &params, cross_got, L, L_enc, d_model,
+                          num_heads);
+  thread_pool_set_threads(0);
+
+  int ok = 1;
+  for (int r = 0; r < 2; r++)
+    ok &= compare(self_ref[r], self_got[r], L * d_model);
+  ok &= compare(cross_ref, cross_got, L * d_model);
+
+  printf("Testing attention heads on 1 vs 3 threads:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  for (int r = 0; r < 2; r++) {
+    free(self_ref[r]);
+    free(self_got[r]);
+  }
+  free(cross_ref);
+  free(cross_got);
+  free(params.W_qkv);
+  free(params.W_o);
+  free(X);
+  free(X_kv);
+}
+
 int main() {
   // return 0 & 1 for the tests
   printf("===== Running utils unit tests =====\n");
@@ -267,6 +336,7 @@ int main() {
   test_attention_basic();
   test_multihead_attention();
   test_compute_cross_attention();
+  test_heads_across_threads();
   printf("===== All tests complete =====\n");
   return 0;
 }
@@ -0,0 +1,177 @@
+#include "../include/beam_search.h"
+#include "../include/kv_cache.h"
+#include "../include/transformer.h"
+#include "../include/utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/*.c tests/beam_search_tests.c -lm -O2 -o beam_search_tests
+
+static TransformerConfig test_config(void) {
+  TransformerConfig config = {.num_layers = 2,
+                              .d_model = 32,
+                              .d_ff = 64,
+                              .num_heads = 4,
+                              .vocab_size = 50,
+                              .max_seq_len = 32};
+  return config;
+}
+
+static int argmax(const float *row, int n) {
+  int best = 0;
+  for (int i = 1; i < n; i++) {
+    if (row[i] > row[best])
+      best = i;
+  }
+  return best;
+}
+
+/**
+ * @brief Feeding the target one token at a time through the KV cache must give
+ * the same logits as the full forward pass, row for row.
+ */
+static void test_incremental_matches_full() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int L_src = 6, L_tgt = 5;
+  int src[6] = {3, 7, 11, 2, 9, 4};
+  int tgt[5] = {1, 5, 8, 13, 21};
+  int V = config.vocab_size;
+
+  float *full = malloc(L_tgt * V * sizeof(float));
+  compute_transformer(src, tgt, &params, full, L_src, L_tgt);
+
+  float *enc = malloc(L_src * config.d_model * sizeof(float));
+  compute_encoder(src, &params, enc, L_src);
+  CrossKV ckv;
+  init_cross_kv(&ckv, config.num_layers, config.d_model, L_src);
+  compute_cross_kv(&params, enc, &ckv);
+
+  // Slot 0 is fed one token per step, slot 1 receives the first three tokens
+  // in a single multi-token call and the rest one by one
+  KVCache cache;
+  init_kv_cache(&cache, config.num_layers, config.d_model, 2, L_tgt);
+  kv_cache_reset_slot(&cache, 0, &ckv);
+  kv_cache_reset_slot(&cache, 1, &ckv);
+
+  float *hidden = malloc(3 * config.d_model * sizeof(float));
+  float *step = malloc(L_tgt * V * sizeof(float));
+  float *chunk = malloc(L_tgt * V * sizeof(float));
+
+  int slot0 = 0;
+  for (int t = 0; t < L_tgt; t++) {
+    compute_decoder_step(&tgt[t], &slot0, &params, &cache, hidden, 1);
+    compute_logits(hidden, &params, step + t * V, 1);
+  }
+
+  int slots1[3] = {1, 1, 1};
+  compute_decoder_step(tgt, slots1, &params, &cache, hidden, 3);
+  compute_logits(hidden, &params, chunk, 3);
+  for (int t = 3; t < L_tgt; t++) {
+    compute_decoder_step(&tgt[t], &slots1[0], &params, &cache, hidden, 1);
+    compute_logits(hidden, &params, chunk + t * V, 1);
+  }
+
+  printf("Testing incremental decoding vs full forward:\n\t");
+  if (compare(full, step, L_tgt * V) && compare(full, chunk, L_tgt * V))
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(full);
+  free(enc);
+  free(hidden);
+  free(step);
+  free(chunk);
+  free_kv_cache(&cache);
+  free_cross_kv(&ckv);
+  free_transformer_params(&params);
+}
+
+/**
+ * @brief With a single beam, beam search is greedy decoding.
+ */
+static void test_beam_width_one_is_greedy() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int src[4] = {5, 6, 7, 8};
+  BeamSearchConfig cfg = {.beam_width = 1,
+                          .max_len = 6,
+                          .length_penalty = 0.0f,
+                          .bos_id = 0,
+                          .eos_id = 1};
+
+  int out[6];
+  float score;
+  int n = beam_search(src, 4, &params, &cfg, out, &score);
+
+  // Reference: rerun the full forward pass on the growing prefix
+  int prefix[7] = {cfg.bos_id};
+  int ref_len = 0;
+  float *logits = malloc(7 * config.vocab_size * sizeof(float));
+  for (int s = 0; s < cfg.max_len; s++) {
+    compute_transformer(src, prefix, &params, logits, 4, s + 1);
+    int next = argmax(logits + s * config.vocab_size, config.vocab_size);
+    if (next == cfg.eos_id)
+      break;
+    prefix[s + 1] = next;
+    ref_len++;
+  }
+
+  int ok = (n == ref_len);
+  for (int i = 0; ok && i < n; i++)
+    ok = (out[i] == prefix[i + 1]);
+
+  printf("Testing beam_search (beam_width=1) vs greedy decoding:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(logits);
+  free_transformer_params(&params);
+}
+
+static void test_beam_search_wide() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int src[5] = {9, 8, 7, 6, 5};
+  BeamSearchConfig cfg = {.beam_width = 4,
+                          .max_len = 10,
+                          .length_penalty = 0.6f,
+                          .bos_id = 0,
+                          .eos_id = 1};
+
+  int out[10];
+  float score = 0.0f;
+  int n = beam_search(src, 5, &params, &cfg, out, &score);
+
+  int ok = (n >= 0 && n <= cfg.max_len && score <= 0.0f);
+  for (int i = 0; ok && i < n; i++)
+    ok = (out[i] >= 0 && out[i] < config.vocab_size && out[i] != cfg.eos_id);
+
+  printf("Testing beam_search (beam_width=4, len=%d, score=%.4f):\n\t", n,
+         score);
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_transformer_params(&params);
+}
+
+int main() {
+  printf("===== Running beam search tests =====\n");
+  test_incremental_matches_full();
+  test_beam_width_one_is_greedy();
+  test_beam_search_wide();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -0,0 +1,197 @@
+#include "../include/checkpoint.h"
+#include "../include/sampling.h"
+#include "../include/transformer.h"
+#include "../include/utils.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// gcc -Iinclude src/*.c tests/checkpoint_tests.c -lm -O2 -pthread -o checkpoint_tests
+
+static const TransformerConfig config = {.num_layers = 4,
+                                         .d_model = 64,
+                                         .d_ff = 256,
+                                         .num_heads = 4,
+                                         .vocab_size = 300,
+                                         .max_seq_len = 64};
+
+#define L_SRC 20
+#define L_TGT 17
+
+static void forward(const TransformerParams *params, float *logits) {
+  int src[L_SRC], tgt[L_TGT];
+  for (int i = 0; i < L_SRC; i++)
+    src[i] = (i * 7 + 3) % config.vocab_size;
+  for (int i = 0; i < L_TGT; i++)
+    tgt[i] = (i * 11 + 5) % config.vocab_size;
+  compute_transformer(src, tgt, params, logits, L_SRC, L_TGT);
+}
+
+static int generate(const TransformerParams *params, int *out) {
+  int src[6] = {2, 4, 6, 8, 10, 12};
+  SamplingConfig cfg = {.temperature = 0.0f,
+                        .top_p = 1.0f,
+                        .max_len = 12,
+                        .bos_id = 0,
+                        .eos_id = 1};
+  return generate_sampled(src, 6, params, &cfg, out);
+}
+
+static void test_checkpoint_round_trip() {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/transformer_ckpt_%d.bin", (int)getpid());
+
+  TransformerParams params;
+  init_transformer_params(&params, config);
+  size_t n_logits = (size_t)L_TGT * config.vocab_size;
+  float *expected = malloc(n_logits * sizeof(float));
+  float *got = malloc(n_logits * sizeof(float));
+  int ref[12], out[12];
+  forward(&params, expected);
+  int n_ref = generate(&params, ref);
+
+  int ok = save_checkpoint(&params, path) == 0;
+  free_transformer_params(&params);
+
+  // Fully mapped, then streamed with only two layers resident
+  for (int resident = 0; resident <= 2; resident += 2) {
+    Checkpoint ck;
+    if (open_checkpoint(&ck, path, resident) != 0) {
+      ok = 0;
+      continue;
+    }
+    ok &= (ck.params.pager != NULL) == (resident > 0);
+    forward(&ck.params, got);
+    ok &= compare(expected, got, (int)n_logits);
+    int n = generate(&ck.params, out);
+    ok &= (n == n_ref);
+    for (int i = 0; ok && i < n; i++)
+      ok &= (out[i] == ref[i]);
+    // 8 layers through a 2-layer window: layers were read ahead and dropped
+    if (resident > 0)
+      ok &= ck.pager.prefetches > 0 && ck.pager.releases > 0;
+    close_checkpoint(&ck);
+  }
+
+  printf("Testing checkpoint save / mapped and streamed forward:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  remove(path);
+  free(expected);
+  free(got);
+}
+
+static void test_checkpoint_rejects_bad_files() {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/transformer_bad_%d.bin", (int)getpid());
+  Checkpoint ck;
+  int ok = open_checkpoint(&ck, path, 0) == -1; // Missing
+
+  FILE *f = fopen(path, "wb");
+  for (int i = 0; i < 1000; i++)
+    fputc(i & 0xff, f);
+  fclose(f);
+  ok &= open_checkpoint(&ck, path, 2) == -1; // Not a checkpoint
+  remove(path);
+
+  printf("Testing checkpoint rejects missing and foreign files:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+// Header layout of version 1 files, written before pos_mode existed
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t reserved;
+  int config[6];
+  uint64_t data_offset;
+  uint64_t data_bytes;
+} HeaderV1;
+
+static void test_checkpoint_positional_modes() {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/transformer_pos_%d.bin", (int)getpid());
+  size_t n_logits = (size_t)L_TGT * config.vocab_size;
+  float *expected = malloc(n_logits * sizeof(float));
+  float *got = malloc(n_logits * sizeof(float));
+  int ok = 1;
+
+  // A rotary model keeps its mode and has no position table to store
+  TransformerConfig rotary = config;
+  rotary.pos_mode = POS_ROTARY;
+  TransformerParams params;
+  init_transformer_params(&params, rotary);
+  forward(&params, expected);
+  ok &= save_checkpoint(&params, path) == 0;
+  free_transformer_params(&params);
+  Checkpoint ck;
+  if (ok && open_checkpoint(&ck, path, 0) == 0) {
+    ok &= ck.params.config.pos_mode == POS_ROTARY && !ck.params.pos_encoding;
+    forward(&ck.params, got);
+    ok &= compare(expected, got, (int)n_logits);
+    close_checkpoint(&ck);
+  } else
+    ok = 0;
+
+  // Version 1 files load as learned-table models
+  init_transformer_params(&params, config);
+  forward(&params, expected);
+  ok &= save_checkpoint(&params, path) == 0;
+  free_transformer_params(&params);
+  FILE *f = fopen(path, "r+b");
+  uint64_t head[2];
+  uint32_t version;
+  TransformerConfig c;
+  uint64_t offsets[2];
+  ok &= f && fread(head, sizeof(head), 1, f) == 1 &&
+        fread(&c, sizeof(c), 1, f) == 1;
+  // data_offset / data_bytes follow the config at 8-byte alignment
+  ok &= f && fseek(f, (16 + sizeof(c) + 7) / 8 * 8, SEEK_SET) == 0 &&
+        fread(offsets, sizeof(offsets), 1, f) == 1;
+  memcpy(&version, (char *)head + 8, sizeof(version));
+  HeaderV1 v1 = {.magic = head[0],
+                 .version = 1,
+                 .config = {c.num_layers, c.d_model, c.d_ff, c.num_heads,
+                            c.vocab_size, c.max_seq_len},
+                 .data_offset = offsets[0],
+                 .data_bytes = offsets[1]};
+  ok &= version == 2 && fseek(f, 0, SEEK_SET) == 0 &&
+        fwrite(&v1, sizeof(v1), 1, f) == 1;
+  if (f)
+    fclose(f);
+  if (ok && open_checkpoint(&ck, path, 0) == 0) {
+    ok &= ck.params.config.pos_mode == POS_LEARNED && ck.params.pos_encoding;
+    forward(&ck.params, got);
+    ok &= compare(expected, got, (int)n_logits);
+    close_checkpoint(&ck);
+  } else
+    ok = 0;
+
+  printf("Testing checkpoint positional modes and version 1 files:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  remove(path);
+  free(expected);
+  free(got);
+}
+
+int main() {
+  printf("===== Running checkpoint tests =====\n");
+  test_checkpoint_round_trip();
+  test_checkpoint_rejects_bad_files();
+  test_checkpoint_positional_modes();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
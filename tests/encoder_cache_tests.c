@@ -0,0 +1,187 @@
+#include "../include/beam_search.h"
+#include "../include/encoder_cache.h"
+#include "../include/transformer.h"
+#include "../include/utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/*.c tests/encoder_cache_tests.c -lm -O2 -o
+// encoder_cache_tests
+
+static TransformerConfig test_config(void) {
+  TransformerConfig config = {.num_layers = 2,
+                              .d_model = 32,
+                              .d_ff = 64,
+                              .num_heads = 4,
+                              .vocab_size = 50,
+                              .max_seq_len = 32};
+  return config;
+}
+
+static void test_hit_matches_encoder() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  EncoderCache cache;
+  init_encoder_cache(&cache, &config, 1 << 20, 1);
+
+  int L = 6, d = config.d_model;
+  int src[6] = {4, 8, 15, 16, 23, 42};
+  float *ref = malloc(L * d * sizeof(float));
+  float *out = malloc(L * d * sizeof(float));
+  compute_encoder(src, &params, ref, L);
+
+  CrossKV ref_ckv, ckv;
+  init_cross_kv(&ref_ckv, config.num_layers, d, L);
+  init_cross_kv(&ckv, config.num_layers, d, L);
+  compute_cross_kv(&params, ref, &ref_ckv);
+
+  compute_encoder_cached(&cache, src, L, &params, out, NULL); // miss
+  compute_encoder_cached(&cache, src, L, &params, out, &ckv); // hit
+
+  int ok = compare(ref, out, L * d);
+  for (int l = 0; l < config.num_layers; l++) {
+    ok &= compare(ref_ckv.K[l], ckv.K[l], L * d);
+    ok &= compare(ref_ckv.V[l], ckv.V[l], L * d);
+  }
+  ok &= (cache.hits == 1 && cache.misses == 1 && cache.count == 1);
+
+  printf("Testing encoder cache hit (hits=%llu, misses=%llu):\n\t", cache.hits,
+         cache.misses);
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(ref);
+  free(out);
+  free_cross_kv(&ref_ckv);
+  free_cross_kv(&ckv);
+  free_encoder_cache(&cache);
+  free_transformer_params(&params);
+}
+
+static void test_lru_eviction() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int L = 4, d = config.d_model;
+  // Room for two entries without cross K/V
+  size_t entry = sizeof(EncoderCacheEntry) + L * sizeof(int) +
+                 (size_t)L * d * sizeof(float);
+  EncoderCache cache;
+  init_encoder_cache(&cache, &config, 2 * entry, 0);
+
+  int a[4] = {1, 2, 3, 4}, b[4] = {5, 6, 7, 8}, c[4] = {9, 10, 11, 12};
+  float *out = malloc(L * d * sizeof(float));
+
+  compute_encoder_cached(&cache, a, L, &params, out, NULL); // miss
+  compute_encoder_cached(&cache, b, L, &params, out, NULL); // miss
+  compute_encoder_cached(&cache, a, L, &params, out, NULL); // hit, a is MRU
+  compute_encoder_cached(&cache, c, L, &params, out, NULL); // miss, evicts b
+  compute_encoder_cached(&cache, a, L, &params, out, NULL); // hit
+  compute_encoder_cached(&cache, b, L, &params, out, NULL); // miss
+
+  int ok = (cache.hits == 2 && cache.misses == 4 && cache.evictions == 2 &&
+            cache.count == 2 && cache.bytes <= cache.max_bytes);
+
+  printf("Testing encoder cache LRU eviction (evictions=%llu):\n\t",
+         cache.evictions);
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(out);
+  free_encoder_cache(&cache);
+  free_transformer_params(&params);
+}
+
+static void test_models_keyed_apart() {
+  // Two models of one layout sharing a cache, as a draft and its target
+  TransformerConfig config = test_config();
+  TransformerParams first, second;
+  init_transformer_params(&first, config);
+  init_transformer_params(&second, config);
+
+  EncoderCache cache;
+  init_encoder_cache(&cache, &config, 1 << 20, 0);
+
+  int L = 5, d = config.d_model;
+  int src[5] = {2, 7, 1, 8, 2};
+  float *ref1 = malloc(L * d * sizeof(float));
+  float *ref2 = malloc(L * d * sizeof(float));
+  float *out = malloc(L * d * sizeof(float));
+  compute_encoder(src, &first, ref1, L);
+  compute_encoder(src, &second, ref2, L);
+
+  compute_encoder_cached(&cache, src, L, &first, out, NULL); // miss
+  compute_encoder_cached(&cache, src, L, &second, out, NULL); // miss
+  int ok = compare(ref2, out, L * d);
+  compute_encoder_cached(&cache, src, L, &first, out, NULL); // hit
+  ok &= compare(ref1, out, L * d);
+  compute_encoder_cached(&cache, src, L, &second, out, NULL); // hit
+  ok &= compare(ref2, out, L * d);
+  ok &= cache.hits == 2 && cache.misses == 2 && cache.count == 2;
+
+  printf("Testing encoder cache entries of two models stay apart:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(ref1);
+  free(ref2);
+  free(out);
+  free_encoder_cache(&cache);
+  free_transformer_params(&first);
+  free_transformer_params(&second);
+}
+
+static void test_beam_search_reuses_encoder() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  EncoderCache cache;
+  init_encoder_cache(&cache, &config, 1 << 20, 1);
+
+  int src[5] = {3, 1, 4, 1, 5};
+  BeamSearchConfig cfg = {.beam_width = 3,
+                          .max_len = 8,
+                          .length_penalty = 0.6f,
+                          .bos_id = 0,
+                          .eos_id = 1};
+  int ref[8], out[8];
+  int n_ref = beam_search(src, 5, &params, &cfg, ref, NULL);
+
+  cfg.encoder_cache = &cache;
+  beam_search(src, 5, &params, &cfg, out, NULL);
+  int n = beam_search(src, 5, &params, &cfg, out, NULL);
+
+  int ok = (n == n_ref && cache.hits == 1 && cache.misses == 1);
+  for (int i = 0; ok && i < n; i++)
+    ok = (out[i] == ref[i]);
+
+  printf("Testing beam_search with a shared encoder cache:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_encoder_cache(&cache);
+  free_transformer_params(&params);
+}
+
+int main() {
+  printf("===== Running encoder cache tests =====\n");
+  test_hit_matches_encoder();
+  test_models_keyed_apart();
+  test_lru_eviction();
+  test_beam_search_reuses_encoder();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
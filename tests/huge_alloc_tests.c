@@ -0,0 +1,115 @@
+#include "../include/huge_alloc.h"
+#include "../include/transformer.h"
+#include "../include/utils.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/*.c tests/huge_alloc_tests.c -lm -O2 -pthread -o huge_alloc_tests
+
+// Allocate, check alignment and zeroing, write every element, free
+static int check_block(size_t count) {
+  float *p = (float *)huge_calloc(count, sizeof(float));
+  if (!p || (uintptr_t)p % HUGE_ALLOC_ALIGN != 0)
+    return 0;
+  int ok = 1;
+  for (size_t i = 0; i < count; i++) {
+    ok &= (p[i] == 0.0f);
+    p[i] = (float)i;
+  }
+  ok &= (p[count - 1] == (float)(count - 1));
+  huge_free(p);
+  return ok;
+}
+
+static void test_alignment_and_zeroing() {
+  HugePageMode saved = huge_pages_mode();
+  int ok = 1;
+  static const HugePageMode modes[] = {HUGE_PAGES_OFF, HUGE_PAGES_THP,
+                                       HUGE_PAGES_HUGETLB};
+  for (int m = 0; m < 3; m++) {
+    huge_pages_set_mode(modes[m]);
+    ok &= check_block(1);
+    ok &= check_block(1000);
+    ok &= check_block(HUGE_PAGE_SIZE / sizeof(float));     // One huge page
+    ok &= check_block(3 * HUGE_PAGE_SIZE / sizeof(float) + 7); // Ragged tail
+  }
+
+  // Large THP blocks start on a huge-page boundary and are tracked
+  huge_pages_set_mode(HUGE_PAGES_THP);
+  HugeAllocStats before, during, after;
+  huge_alloc_stats(&before);
+  char *big = (char *)huge_alloc(4 * HUGE_PAGE_SIZE);
+  huge_alloc_stats(&during);
+  ok &= big && ((uintptr_t)big % HUGE_PAGE_SIZE == 0);
+  ok &= (during.thp_bytes + during.hugetlb_bytes ==
+         before.thp_bytes + before.hugetlb_bytes + 4 * HUGE_PAGE_SIZE);
+  huge_free(big);
+  huge_alloc_stats(&after);
+  ok &= (after.thp_bytes == before.thp_bytes &&
+         after.hugetlb_bytes == before.hugetlb_bytes);
+
+  // Plain heap pointers and NULL are accepted
+  huge_free(malloc(100));
+  huge_free(NULL);
+  huge_pages_set_mode(saved);
+
+  printf("Testing huge_alloc alignment, zeroing and fallback:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+static void test_transformer_page_modes_agree() {
+  // Wide enough that the embedding and FFN weights span huge pages
+  TransformerConfig config = {.num_layers = 1,
+                              .d_model = 256,
+                              .d_ff = 2048,
+                              .num_heads = 4,
+                              .vocab_size = 2048,
+                              .max_seq_len = 64};
+  int L_src = 12, L_tgt = 9;
+  int src[12], tgt[9];
+  for (int i = 0; i < L_src; i++)
+    src[i] = (i * 7 + 3) % config.vocab_size;
+  for (int i = 0; i < L_tgt; i++)
+    tgt[i] = (i * 11 + 5) % config.vocab_size;
+
+  size_t n_logits = (size_t)L_tgt * config.vocab_size;
+  float *expected = malloc(n_logits * sizeof(float));
+  float *got = malloc(n_logits * sizeof(float));
+
+  HugePageMode saved = huge_pages_mode();
+  TransformerParams params;
+  huge_pages_set_mode(HUGE_PAGES_OFF);
+  srand(7);
+  init_transformer_params(&params, config);
+  compute_transformer(src, tgt, &params, expected, L_src, L_tgt);
+  free_transformer_params(&params);
+
+  huge_pages_set_mode(HUGE_PAGES_THP);
+  srand(7);
+  init_transformer_params(&params, config);
+  compute_transformer(src, tgt, &params, got, L_src, L_tgt);
+  free_transformer_params(&params);
+  huge_pages_set_mode(saved);
+
+  printf("Testing compute_transformer with heap vs huge-page weights:\n\t");
+  if (compare(expected, got, (int)n_logits))
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(expected);
+  free(got);
+}
+
+int main() {
+  printf("===== Running huge page allocation tests =====\n");
+  test_alignment_and_zeroing();
+  test_transformer_page_modes_agree();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
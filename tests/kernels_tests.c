@@ -0,0 +1,221 @@
+#include "../include/kernels.h"
+#include "../include/thread_pool.h"
+#include "../include/utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// gcc -Iinclude src/*.c tests/kernels_tests.c -lm -O2 -o kernels_tests
+
+static void fill(float *x, int n, unsigned int seed) {
+  for (int i = 0; i < n; i++) {
+    seed = seed * 1103515245u + 12345u;
+    x[i] = ((seed >> 8) & 0xFFFF) / 32768.0f - 1.0f;
+  }
+}
+
+// Odd sizes exercise every vector tail; lda/ldb/ldc exceed the row widths
+static int check_gemm(const KernelTable *t, int M, int N, int K) {
+  const KernelTable *ref = kernel_backend_table(KERNEL_REFERENCE);
+  int lda = K + 3, ldb = N + 5, ldc = N + 2, ldb_nt = K + 1;
+  float *A = malloc((size_t)M * lda * sizeof(float));
+  float *B = malloc((size_t)K * ldb * sizeof(float));
+  float *B_nt = malloc((size_t)N * ldb_nt * sizeof(float));
+  float *C = malloc((size_t)M * ldc * sizeof(float));
+  float *C_ref = malloc((size_t)M * ldc * sizeof(float));
+  fill(A, M * lda, 1);
+  fill(B, K * ldb, 2);
+  fill(B_nt, N * ldb_nt, 3);
+
+  int ok = 1;
+  for (int nt = 0; nt < 2; nt++) {
+    // Padding columns must be left alone
+    memset(C, 0x7f, (size_t)M * ldc * sizeof(float));
+    memset(C_ref, 0x7f, (size_t)M * ldc * sizeof(float));
+    if (nt) {
+      t->gemm_nt(A, lda, B_nt, ldb_nt, C, ldc, M, N, K);
+      ref->gemm_nt(A, lda, B_nt, ldb_nt, C_ref, ldc, M, N, K);
+    } else {
+      t->gemm(A, lda, B, ldb, C, ldc, M, N, K);
+      ref->gemm(A, lda, B, ldb, C_ref, ldc, M, N, K);
+    }
+    ok &= (memcmp(C + N, C_ref + N, (ldc - N) * sizeof(float)) == 0);
+    for (int i = 0; i < M; i++)
+      ok &= compare(C + (size_t)i * ldc, C_ref + (size_t)i * ldc, N);
+  }
+
+  free(A);
+  free(B);
+  free(B_nt);
+  free(C);
+  free(C_ref);
+  return ok;
+}
+
+static int check_rowwise(const KernelTable *t, int rows, int cols) {
+  const KernelTable *ref = kernel_backend_table(KERNEL_REFERENCE);
+  int n = rows * cols;
+  float *x = malloc(n * sizeof(float));
+  float *y = malloc(n * sizeof(float));
+  float *y_ref = malloc(n * sizeof(float));
+  float *gamma = malloc(cols * sizeof(float));
+  float *beta = malloc(cols * sizeof(float));
+  fill(gamma, cols, 4);
+  fill(beta, cols, 5);
+
+  // Softmax with masked (-inf) scores and a wide range of values
+  fill(x, n, 6);
+  for (int i = 0; i < n; i++)
+    x[i] *= 20.0f;
+  for (int j = 10; j < cols; j++)
+    x[j] = -INFINITY;
+  t->softmax(x, y, rows, cols);
+  ref->softmax(x, y_ref, rows, cols);
+  int ok = compare(y, y_ref, n);
+  for (int j = 10; j < cols; j++)
+    ok &= (y[j] == 0.0f);
+
+  // Layer norm, including a constant row (zero variance)
+  fill(x, n, 7);
+  for (int j = 0; j < cols; j++)
+    x[cols + j] = 0.25f;
+  t->layernorm(x, gamma, beta, y, rows, cols);
+  ref->layernorm(x, gamma, beta, y_ref, rows, cols);
+  ok &= compare(y, y_ref, n);
+
+  // GELU in place, large magnitudes included
+  fill(x, n, 8);
+  for (int i = 0; i < n; i++)
+    x[i] *= 12.0f;
+  memcpy(y, x, n * sizeof(float));
+  memcpy(y_ref, x, n * sizeof(float));
+  t->gelu(y, n);
+  ref->gelu(y_ref, n);
+  ok &= compare(y, y_ref, n);
+
+  free(x);
+  free(y);
+  free(y_ref);
+  free(gamma);
+  free(beta);
+  return ok;
+}
+
+static void test_backends_match_reference() {
+  for (int b = 0; b < KERNEL_NUM_BACKENDS; b++) {
+    const KernelTable *t = kernel_backend_table((KernelBackend)b);
+    if (!t) {
+      printf("Skipping kernel backend %s (unavailable)\n",
+             kernel_backend_name((KernelBackend)b));
+      continue;
+    }
+    // The last shape is deeper than one packed NT panel
+    int ok = check_gemm(t, 1, 75, 33) && check_gemm(t, 9, 37, 19) &&
+             check_gemm(t, 70, 130, 67) && check_gemm(t, 12, 20, 300) &&
+             check_rowwise(t, 3, 43);
+
+    printf("Testing kernel backend %s against reference:\n\t", t->name);
+    if (ok)
+      printf("PASSED\n");
+    else
+      printf("FAILED\n");
+  }
+}
+
+static void test_selection_and_calibration() {
+  int ok = (kernels_select_by_name("reference") == 0);
+  ok &= (strcmp(kernels()->name, "reference") == 0);
+  ok &= (kernels_select_by_name("no-such-backend") == -1);
+  ok &= (strcmp(kernels()->name, "reference") == 0);
+
+  kernels_calibrate(0);
+  kernels_select_auto();
+  ok &= (strcmp(kernels()->name, KERNEL_AUTO_NAME) == 0);
+  ok &= check_gemm(kernels(), 1, 75, 33) && check_gemm(kernels(), 70, 130, 67);
+  ok &= check_rowwise(kernels(), 3, 43);
+
+  printf("Testing kernel selection and calibrated auto dispatch:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+static void test_gemm_tiles_and_cache() {
+  // Odd tiles: partial blocks everywhere and several KC slices per product
+  static const KernelBackend tiled[] = {KERNEL_BLOCKED, KERNEL_SIMD};
+  GemmTiles odd = {5, 24, 7};
+  int ok = 1;
+  for (int b = 0; b < 2; b++) {
+    const KernelTable *t = kernel_backend_table(tiled[b]);
+    if (!t)
+      continue;
+    kernels_set_gemm_tiles(tiled[b], 1, 75, 33, odd);
+    kernels_set_gemm_tiles(tiled[b], 70, 130, 67, odd);
+    ok &= check_gemm(t, 1, 75, 33) && check_gemm(t, 70, 130, 67);
+  }
+
+  GemmShape shapes[] = {{1, 96, 64}, {24, 64, 32}, {40, 40, 40}};
+  kernels_autotune(shapes, 3, 0);
+  GemmTiles tuned = kernels_gemm_tiles(KERNEL_BLOCKED, 24, 64, 32);
+
+  const char *path = "/tmp/kernels_tests_tiles.cache";
+  ok &= (kernels_save_tiles(path) == 0);
+  kernels_set_gemm_tiles(KERNEL_BLOCKED, 24, 64, 32, odd);
+  ok &= (kernels_load_tiles(path) == 0);
+  GemmTiles loaded = kernels_gemm_tiles(KERNEL_BLOCKED, 24, 64, 32);
+  ok &= (loaded.mc == tuned.mc && loaded.nc == tuned.nc &&
+         loaded.kc == tuned.kc);
+  ok &= check_gemm(kernel_backend_table(KERNEL_BLOCKED), 24, 64, 32);
+
+  // Tiles tuned on another CPU model are ignored
+  FILE *f = fopen(path, "w");
+  if (f) {
+    fprintf(f, "cpu some other cpu\nblocked 1 0 8 8 8\n");
+    fclose(f);
+  }
+  ok &= (kernels_load_tiles(path) == -1);
+  loaded = kernels_gemm_tiles(KERNEL_BLOCKED, 24, 64, 32);
+  ok &= (loaded.mc == tuned.mc);
+  remove(path);
+  ok &= (kernels_load_tiles(path) == -1);
+
+  printf("Testing GEMM tiles, autotuning and the tile cache:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+static void test_threaded_backends() {
+  // Big enough to be split: by rows, by columns (decode) and both; row-wise
+  // ops over many chunks
+  thread_pool_set_threads(4);
+  int ok = 1;
+  for (int b = 0; b < KERNEL_NUM_BACKENDS; b++) {
+    const KernelTable *t = kernel_backend_table((KernelBackend)b);
+    if (!t)
+      continue;
+    ok &= check_gemm(t, 150, 70, 90) && check_gemm(t, 1, 2050, 300) &&
+          check_gemm(t, 37, 515, 129) && check_rowwise(t, 257, 301);
+  }
+  thread_pool_set_threads(0);
+
+  printf("Testing kernel backends on 4 pool threads:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+int main() {
+  printf("===== Running kernels tests =====\n");
+  test_backends_match_reference();
+  test_selection_and_calibration();
+  test_gemm_tiles_and_cache();
+  test_threaded_backends();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include "../include/mpmc_queue.h"
+#include "../include/pipeline.h"
+#include "../include/sampling.h"
+#include "../include/transformer.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/*.c tests/pipeline_tests.c -lm -O2 -pthread -o pipeline_tests
+
+static void test_queue_bounds_and_order() {
+  MpmcQueue q;
+  init_mpmc_queue(&q, 3); // Rounded up to 4
+  int ok = 1;
+  for (intptr_t i = 1; i <= 4; i++)
+    ok &= (mpmc_try_push(&q, (void *)i) == 0);
+  ok &= (mpmc_try_push(&q, (void *)5) == -1);
+
+  // Several laps around the ring
+  for (intptr_t i = 1; i <= 20; i++) {
+    void *item = NULL;
+    ok &= (mpmc_try_pop(&q, &item) == 0 && (intptr_t)item == i);
+    ok &= (mpmc_try_push(&q, (void *)(i + 4)) == 0);
+  }
+  for (intptr_t i = 21; i <= 24; i++)
+    ok &= ((intptr_t)mpmc_pop(&q) == i);
+  void *item;
+  ok &= (mpmc_try_pop(&q, &item) == -1);
+  free_mpmc_queue(&q);
+
+  printf("Testing MPMC queue capacity and FIFO order:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+#define QUEUE_ITEMS 20000
+
+typedef struct {
+  MpmcQueue *q;
+  long long sum;
+  int count;
+} QueueWorker;
+
+static void *producer(void *arg) {
+  QueueWorker *w = (QueueWorker *)arg;
+  for (intptr_t i = 1; i <= QUEUE_ITEMS; i++)
+    mpmc_push(w->q, (void *)i);
+  return NULL;
+}
+
+static void *consumer(void *arg) {
+  QueueWorker *w = (QueueWorker *)arg;
+  for (;;) {
+    intptr_t v = (intptr_t)mpmc_pop(w->q);
+    if (v == 0)
+      break;
+    w->sum += v;
+    w->count++;
+  }
+  return NULL;
+}
+
+static void test_queue_concurrent() {
+  // Small ring, so producers and consumers keep hitting full / empty
+  MpmcQueue q;
+  init_mpmc_queue(&q, 8);
+  QueueWorker w[4] = {{&q, 0, 0}, {&q, 0, 0}, {&q, 0, 0}, {&q, 0, 0}};
+  pthread_t t[4];
+  for (int i = 0; i < 4; i++)
+    pthread_create(&t[i], NULL, i < 2 ? producer : consumer, &w[i]);
+  pthread_join(t[0], NULL);
+  pthread_join(t[1], NULL);
+  mpmc_push(&q, NULL);
+  mpmc_push(&q, NULL);
+  pthread_join(t[2], NULL);
+  pthread_join(t[3], NULL);
+  free_mpmc_queue(&q);
+
+  long long expected = 2LL * QUEUE_ITEMS * (QUEUE_ITEMS + 1) / 2;
+  int ok = (w[2].count + w[3].count == 2 * QUEUE_ITEMS) &&
+           (w[2].sum + w[3].sum == expected);
+
+  printf("Testing MPMC queue with 2 producers and 2 consumers:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+static void count_done(PipelineRequest *req, void *arg) {
+  (void)req;
+  __atomic_fetch_add((int *)arg, 1, __ATOMIC_RELAXED);
+}
+
+static void test_pipeline_matches_serial() {
+  TransformerConfig config = {.num_layers = 2,
+                              .d_model = 32,
+                              .d_ff = 64,
+                              .num_heads = 4,
+                              .vocab_size = 60,
+                              .max_seq_len = 32};
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  enum { N = 12, MAX_LEN = 10 };
+  int src[N][8];
+  PipelineRequest req[N] = {0};
+  int out[N][MAX_LEN], ref[N][MAX_LEN], n_ref[N];
+  for (int r = 0; r < N; r++) {
+    int L = 3 + r % 6;
+    for (int i = 0; i < L; i++)
+      src[r][i] = 2 + (r * 7 + i * 3) % 58;
+    req[r].src_tokens = src[r];
+    req[r].L_src = L;
+    req[r].sampling = (SamplingConfig){.temperature = r % 2 ? 0.8f : 0.0f,
+                                       .top_p = 1.0f,
+                                       .seed = 100 + r,
+                                       .max_len = MAX_LEN,
+                                       .bos_id = 0,
+                                       .eos_id = 1};
+    req[r].out_tokens = out[r];
+    n_ref[r] = generate_sampled(src[r], L, &params, &req[r].sampling, ref[r]);
+  }
+
+  // Queues smaller than the request count: submit has to wait for room
+  int n_done = 0;
+  PipelineConfig pc = {.encoder_threads = 2,
+                       .decoder_threads = 2,
+                       .queue_capacity = 2,
+                       .on_done = count_done,
+                       .on_done_arg = &n_done};
+  Pipeline p;
+  init_pipeline(&p, &params, &pc);
+  for (int r = 0; r < N; r++)
+    pipeline_submit(&p, &req[r]);
+  pipeline_wait(&req[N - 1]);
+  free_pipeline(&p);
+
+  int ok = (n_done == N);
+  for (int r = 0; r < N; r++) {
+    ok &= (req[r].done && req[r].n_out == n_ref[r]);
+    for (int i = 0; ok && i < n_ref[r]; i++)
+      ok &= (out[r][i] == ref[r][i]);
+  }
+
+  printf("Testing pipelined generation vs generate_sampled:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_transformer_params(&params);
+}
+
+int main() {
+  printf("===== Running pipeline tests =====\n");
+  test_queue_bounds_and_order();
+  test_queue_concurrent();
+  test_pipeline_matches_serial();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include "../include/positional.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/positional.c tests/positional_tests.c -o positional_tests
+// -lm -O2
+
+static void test_sinusoidal_table() {
+  // Odd width spanning two frequency chunks, over a long sequence
+  int n = 5000, dim = 131;
+  int positions[3] = {0, 77, 4999};
+  float *table = (float *)malloc((size_t)n * dim * sizeof(float));
+  float picked[3 * 131];
+  sinusoidal_table(NULL, n, dim, table);
+  sinusoidal_table(positions, 3, dim, picked);
+
+  int ok = 1;
+  for (int i = 0; i < n; i++) {
+    for (int d = 0; d < dim; d++) {
+      double w = pow(POSITIONAL_BASE, -(double)(d - d % 2) / dim);
+      double ref = d % 2 ? cos(i * w) : sin(i * w);
+      if (fabs(table[(size_t)i * dim + d] - ref) > 1e-5)
+        ok = 0;
+    }
+  }
+  for (int k = 0; k < 3; k++)
+    for (int d = 0; d < dim; d++)
+      ok &= fabsf(picked[k * dim + d] -
+                  table[(size_t)positions[k] * dim + d]) < 1e-5f;
+
+  printf("Testing sinusoidal_table:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+  free(table);
+}
+
+static float dot(const float *a, const float *b, int n) {
+  float s = 0.0f;
+  for (int i = 0; i < n; i++)
+    s += a[i] * b[i];
+  return s;
+}
+
+static void test_apply_rotary() {
+  // q at position m and k at position n score like q at m + s, k at n + s
+  enum { D_K = 16 };
+  float q[D_K], k[D_K];
+  for (int i = 0; i < D_K; i++) {
+    q[i] = (float)rand() / RAND_MAX - 0.5f;
+    k[i] = (float)rand() / RAND_MAX - 0.5f;
+  }
+  int pos[4] = {3, 10, 503, 510};
+  float table[4 * D_K], rot[4][D_K];
+  sinusoidal_table(pos, 4, D_K, table);
+  for (int r = 0; r < 4; r++) {
+    for (int i = 0; i < D_K; i++)
+      rot[r][i] = r % 2 ? k[i] : q[i];
+    apply_rotary(rot[r], D_K, table + r * D_K, 1, D_K);
+  }
+
+  int ok = fabsf(dot(rot[0], rot[1], D_K) - dot(rot[2], rot[3], D_K)) < 1e-4f;
+  // Rotations keep the norm
+  ok &= fabsf(dot(rot[2], rot[2], D_K) - dot(q, q, D_K)) < 1e-4f;
+  // Position 0 is the identity
+  int zero = 0;
+  float id_table[D_K], x[D_K];
+  sinusoidal_table(&zero, 1, D_K, id_table);
+  for (int i = 0; i < D_K; i++)
+    x[i] = q[i];
+  apply_rotary(x, D_K, id_table, 1, D_K);
+  for (int i = 0; i < D_K; i++)
+    ok &= x[i] == q[i];
+
+  printf("Testing apply_rotary:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+int main() {
+  printf("===== Running positional encoding tests =====\n");
+  test_sinusoidal_table();
+  test_apply_rotary();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
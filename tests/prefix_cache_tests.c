@@ -0,0 +1,219 @@
+#include "../include/encoder_cache.h"
+#include "../include/prefix_cache.h"
+#include "../include/sampling.h"
+#include "../include/transformer.h"
+#include "../include/utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/*.c tests/prefix_cache_tests.c -lm -O2 -o
+// prefix_cache_tests
+
+static TransformerConfig test_config(void) {
+  TransformerConfig config = {.num_layers = 2,
+                              .d_model = 32,
+                              .d_ff = 64,
+                              .num_heads = 4,
+                              .vocab_size = 50,
+                              .max_seq_len = 32};
+  return config;
+}
+
+static void test_prefill_reuses_prefix() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int L_src = 5, d = config.d_model;
+  int src[5] = {7, 7, 8, 9, 3};
+  float *enc = malloc(L_src * d * sizeof(float));
+  compute_encoder(src, &params, enc, L_src);
+  CrossKV ckv;
+  init_cross_kv(&ckv, config.num_layers, d, L_src);
+  compute_cross_kv(&params, enc, &ckv);
+
+  PrefixCache pc;
+  init_prefix_cache(&pc, &config, 1 << 20);
+
+  // Slot 0: reference without cache. Slots 1-3 go through the prefix cache.
+  KVCache kv;
+  init_kv_cache(&kv, config.num_layers, d, 4, 16);
+  for (int s = 0; s < 4; s++)
+    kv_cache_reset_slot(&kv, s, &ckv);
+
+  int prompt_a[6] = {0, 20, 21, 22, 23, 24};
+  int prompt_b[5] = {0, 20, 21, 30, 31};
+  float ref[32], h1[32], h2[32], h3[32];
+
+  decoder_prefill(&params, NULL, src, L_src, &kv, 0, prompt_b, 5, ref);
+  int m1 =
+      decoder_prefill(&params, &pc, src, L_src, &kv, 1, prompt_a, 6, h1);
+  int m2 =
+      decoder_prefill(&params, &pc, src, L_src, &kv, 2, prompt_a, 6, h2);
+  int m3 =
+      decoder_prefill(&params, &pc, src, L_src, &kv, 3, prompt_b, 5, h3);
+
+  int ok = (m1 == 0 && m2 == 6 && m3 == 3);
+  ok &= compare(h1, h2, d);
+  ok &= compare(ref, h3, d);
+  // Restored K/V of slot 2 must equal the computed K/V of slot 1
+  size_t slot_size = (size_t)kv.max_len * d;
+  for (int l = 0; l < config.num_layers; l++) {
+    ok &= compare(kv.K[l] + slot_size, kv.K[l] + 2 * slot_size, 6 * d);
+    ok &= compare(kv.V[l] + slot_size, kv.V[l] + 2 * slot_size, 6 * d);
+  }
+  ok &= (pc.hit_tokens == 9 && pc.miss_tokens == 8 && pc.num_nodes == 8);
+
+  printf("Testing decoder_prefill with a prefix cache (hits=%llu, "
+         "misses=%llu, nodes=%d):\n\t",
+         pc.hit_tokens, pc.miss_tokens, pc.num_nodes);
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(enc);
+  free_kv_cache(&kv);
+  free_cross_kv(&ckv);
+  free_prefix_cache(&pc);
+  free_transformer_params(&params);
+}
+
+static void test_memory_cap() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int src[3] = {1, 2, 3}, d = config.d_model;
+  CrossKV ckv;
+  init_cross_kv(&ckv, config.num_layers, d, 3);
+  compute_encoder_cached(NULL, src, 3, &params, NULL, &ckv);
+
+  size_t node = sizeof(PrefixNode) +
+                (size_t)(2 * config.num_layers + 1) * d * sizeof(float);
+  PrefixCache pc;
+  init_prefix_cache(&pc, &config,
+                    sizeof(PrefixNode) + sizeof(src) + 4 * node);
+
+  KVCache kv;
+  init_kv_cache(&kv, config.num_layers, d, 1, 16);
+  float h[32];
+  int prompt[8] = {0, 5, 6, 7, 8, 9, 10, 11};
+  for (int i = 0; i < 3; i++) {
+    prompt[1] = 5 + i; // three distinct branches
+    kv_cache_reset_slot(&kv, 0, &ckv);
+    decoder_prefill(&params, &pc, src, 3, &kv, 0, prompt, 8, h);
+  }
+
+  printf("Testing prefix cache memory cap (bytes=%zu, cap=%zu):\n\t",
+         pc.bytes, pc.max_bytes);
+  if (pc.bytes <= pc.max_bytes && pc.evictions > 0)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_kv_cache(&kv);
+  free_cross_kv(&ckv);
+  free_prefix_cache(&pc);
+  free_transformer_params(&params);
+}
+
+static void test_eviction_order_and_source_match() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int src[3] = {1, 2, 3}, other[3] = {1, 2, 4}, d = config.d_model;
+  CrossKV ckv;
+  init_cross_kv(&ckv, config.num_layers, d, 3);
+  compute_encoder_cached(NULL, src, 3, &params, NULL, &ckv);
+
+  // Room for the root and three positions
+  size_t node = sizeof(PrefixNode) +
+                (size_t)(2 * config.num_layers + 1) * d * sizeof(float);
+  PrefixCache pc;
+  init_prefix_cache(&pc, &config, sizeof(PrefixNode) + sizeof(src) + 3 * node);
+
+  KVCache kv;
+  init_kv_cache(&kv, config.num_layers, d, 1, 16);
+  float h[32];
+  int a[2] = {0, 5}, b[2] = {0, 6}, c[2] = {0, 7};
+  kv_cache_reset_slot(&kv, 0, &ckv);
+  decoder_prefill(&params, &pc, src, 3, &kv, 0, a, 2, h);
+  kv_cache_reset_slot(&kv, 0, &ckv);
+  decoder_prefill(&params, &pc, src, 3, &kv, 0, b, 2, h);
+  // Touch a, so b is the least recently used leaf when c needs room
+  kv_cache_reset_slot(&kv, 0, &ckv);
+  int ok = decoder_prefill(&params, &pc, src, 3, &kv, 0, a, 2, h) == 2;
+  kv_cache_reset_slot(&kv, 0, &ckv);
+  decoder_prefill(&params, &pc, src, 3, &kv, 0, c, 2, h);
+  ok &= pc.evictions == 1 && pc.num_nodes == 3;
+  kv_cache_reset_slot(&kv, 0, &ckv);
+  ok &= decoder_prefill(&params, &pc, src, 3, &kv, 0, a, 2, h) == 2;
+  kv_cache_reset_slot(&kv, 0, &ckv);
+  ok &= prefix_cache_restore(&pc, src, 3, b, 2, &kv, 0, NULL) == 1;
+
+  // A different source whose hash collides must not share the trie
+  pc.roots->key = hash_tokens(other, 3);
+  ok &= prefix_cache_restore(&pc, other, 3, a, 2, &kv, 0, NULL) == 0;
+
+  printf("Testing prefix cache LRU eviction and source matching:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_kv_cache(&kv);
+  free_cross_kv(&ckv);
+  free_prefix_cache(&pc);
+  free_transformer_params(&params);
+}
+
+static void test_generation_with_prefix_cache() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  PrefixCache pc;
+  init_prefix_cache(&pc, &config, 1 << 20);
+
+  int src[4] = {10, 11, 12, 13};
+  int lang_tag[2] = {2, 3};
+  SamplingConfig cfg = {.temperature = 0.0f,
+                        .top_p = 1.0f,
+                        .max_len = 6,
+                        .bos_id = 0,
+                        .eos_id = 1,
+                        .prefix = lang_tag,
+                        .prefix_len = 2};
+  int ref[6], out[6];
+  int n_ref = generate_sampled(src, 4, &params, &cfg, ref);
+
+  cfg.prefix_cache = &pc;
+  generate_sampled(src, 4, &params, &cfg, out);
+  int n = generate_sampled(src, 4, &params, &cfg, out);
+
+  int ok = (n == n_ref && pc.hit_tokens == 3);
+  for (int i = 0; ok && i < n; i++)
+    ok = (out[i] == ref[i]);
+
+  printf("Testing generation with a forced prefix and prefix cache:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_prefix_cache(&pc);
+  free_transformer_params(&params);
+}
+
+int main() {
+  printf("===== Running prefix cache tests =====\n");
+  test_prefill_reuses_prefix();
+  test_memory_cap();
+  test_eviction_order_and_source_match();
+  test_generation_with_prefix_cache();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
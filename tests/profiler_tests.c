@@ -0,0 +1,107 @@
+#include "../include/profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// gcc -Iinclude src/*.c tests/profiler_tests.c -lm -O2 -o profiler_tests
+
+static void test_record_and_trace() {
+  prof_reset();
+
+  prof_set_layer(PROF_ENCODER, 0);
+  prof_record(OP_QKV_PROJECTION, prof_now_ns(), 0.0, 0.0);
+  prof_set_layer(PROF_DECODER, 1);
+  prof_record(OP_FFN_GELU, prof_now_ns(), 1000.0, 500.0);
+  prof_record(OP_FFN_GELU, prof_now_ns(), 1000.0, 500.0);
+  prof_set_layer(PROF_MODEL, -1);
+
+  int ok = (prof_num_events() == 3);
+
+  const char *path = "/tmp/profiler_tests_trace.json";
+  ok &= (prof_write_chrome_trace(path) == 0);
+
+  // One complete ("X") event per recorded call
+  char buf[4096] = {0};
+  FILE *f = fopen(path, "r");
+  if (f) {
+    fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+  }
+  remove(path);
+
+  int n_complete = 0;
+  for (const char *p = buf; (p = strstr(p, "\"ph\":\"X\"")); p++)
+    n_complete++;
+  ok &= (n_complete == 3);
+  ok &= (strstr(buf, "\"name\":\"ffn_gelu\",\"cat\":\"decoder\"") != NULL);
+  ok &= (strstr(buf, "\"layer\":1,\"flops\":1000,\"bytes\":500") != NULL);
+
+  printf("Testing profiler events and Chrome trace export:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  prof_reset();
+}
+
+static void test_layer_summary() {
+  prof_reset();
+
+  prof_set_layer(PROF_DECODER, 2);
+  prof_record(OP_FFN_GEMM1, prof_now_ns(), 2e6, 1e6);
+  prof_set_layer(PROF_MODEL, -1);
+  prof_record(OP_OUTPUT_PROJECTION, prof_now_ns(), 4e6, 1e6);
+
+  char buf[4096] = {0};
+  FILE *f = tmpfile();
+  int ok = (f != NULL);
+  if (f) {
+    prof_print_layer_summary(f);
+    prof_print_summary(f);
+    rewind(f);
+    fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+  }
+
+  // FLOP/B column: 2.00 for the layer, 4.00 for the output projection
+  ok &= (strstr(buf, "decoder.2") != NULL);
+  ok &= (strstr(buf, "(outside layers)") != NULL);
+  ok &= (strstr(buf, " 2.00\n") != NULL && strstr(buf, " 4.00\n") != NULL);
+
+  printf("Testing profiler FLOP/byte summaries:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  prof_reset();
+}
+
+static void test_events_saturate() {
+  prof_reset();
+  for (int i = 0; i < PROF_MAX_EVENTS + 100; i++)
+    prof_record(OP_LAYERNORM, 0, 0.0, 0.0);
+  int ok = (prof_num_events() == PROF_MAX_EVENTS);
+  prof_reset();
+  prof_record(OP_LAYERNORM, 0, 0.0, 0.0);
+  ok &= (prof_num_events() == 1);
+
+  printf("Testing profiler event count saturates at the buffer size:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  prof_reset();
+}
+
+int main() {
+  printf("===== Running profiler tests =====\n");
+  test_record_and_trace();
+  test_layer_summary();
+  test_events_saturate();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -0,0 +1,290 @@
+#include "../include/beam_search.h"
+#include "../include/sampling.h"
+#include "../include/transformer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/*.c tests/sampling_tests.c -lm -O2 -o sampling_tests
+
+static int argmax(const float *row, int n) {
+  int best = 0;
+  for (int i = 1; i < n; i++) {
+    if (row[i] > row[best])
+      best = i;
+  }
+  return best;
+}
+
+static void random_problem(float **hidden, float **W, int d_model, int vocab) {
+  *hidden = malloc(d_model * sizeof(float));
+  *W = malloc((size_t)d_model * vocab * sizeof(float));
+  for (int i = 0; i < d_model; i++)
+    (*hidden)[i] = (float)rand() / RAND_MAX - 0.5f;
+  for (int i = 0; i < d_model * vocab; i++)
+    (*W)[i] = ((float)rand() / RAND_MAX - 0.5f) * 4.0f;
+}
+
+static void test_greedy_matches_argmax() {
+  int d_model = 16, vocab = 1000; // several tiles plus a ragged tail
+  float *hidden, *W;
+  random_problem(&hidden, &W, d_model, vocab);
+
+  float *logits = calloc(vocab, sizeof(float));
+  for (int d = 0; d < d_model; d++)
+    for (int v = 0; v < vocab; v++)
+      logits[v] += hidden[d] * W[d * vocab + v];
+
+  SamplingConfig cfg = {.temperature = 0.0f, .top_k = 0, .top_p = 1.0f};
+  unsigned long long rng = 1;
+  int token = sample_from_hidden(hidden, W, d_model, vocab, &cfg, &rng);
+
+  printf("Testing greedy sample_from_hidden vs argmax:\n\t");
+  if (token == argmax(logits, vocab))
+    printf("PASSED\n");
+  else
+    printf("FAILED (%d vs %d)\n", token, argmax(logits, vocab));
+
+  free(hidden);
+  free(W);
+  free(logits);
+}
+
+static void test_top_k_stays_in_top_k() {
+  int d_model = 16, vocab = 700;
+  float *hidden, *W;
+  random_problem(&hidden, &W, d_model, vocab);
+
+  float *logits = calloc(vocab, sizeof(float));
+  for (int d = 0; d < d_model; d++)
+    for (int v = 0; v < vocab; v++)
+      logits[v] += hidden[d] * W[d * vocab + v];
+
+  // k-th largest logit as the admission threshold
+  int k = 5;
+  float *sorted = malloc(vocab * sizeof(float));
+  for (int v = 0; v < vocab; v++)
+    sorted[v] = logits[v];
+  for (int i = 0; i < k; i++) {
+    int m = i;
+    for (int j = i + 1; j < vocab; j++)
+      if (sorted[j] > sorted[m])
+        m = j;
+    float t = sorted[i];
+    sorted[i] = sorted[m];
+    sorted[m] = t;
+  }
+  float threshold = sorted[k - 1];
+
+  SamplingConfig cfg = {.temperature = 2.0f, .top_k = k, .top_p = 1.0f};
+  unsigned long long rng = 42;
+  int ok = 1, distinct = 0;
+  int seen[700] = {0};
+  for (int i = 0; i < 500; i++) {
+    int t = sample_from_hidden(hidden, W, d_model, vocab, &cfg, &rng);
+    if (logits[t] < threshold)
+      ok = 0;
+    if (!seen[t]++)
+      distinct++;
+  }
+
+  printf("Testing top-k sampling (k=%d, %d distinct tokens drawn):\n\t", k,
+         distinct);
+  if (ok && distinct > 1)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(hidden);
+  free(W);
+  free(logits);
+  free(sorted);
+}
+
+static void test_tiny_top_p_is_greedy() {
+  int d_model = 16, vocab = 300;
+  float *hidden, *W;
+  random_problem(&hidden, &W, d_model, vocab);
+
+  SamplingConfig greedy = {.temperature = 0.0f, .top_p = 1.0f};
+  SamplingConfig nucleus = {.temperature = 1.0f, .top_p = 1e-6f};
+  unsigned long long rng = 7;
+  int ref = sample_from_hidden(hidden, W, d_model, vocab, &greedy, &rng);
+  int ok = 1;
+  for (int i = 0; i < 50; i++)
+    ok &= (sample_from_hidden(hidden, W, d_model, vocab, &nucleus, &rng) == ref);
+
+  printf("Testing top-p with a tiny nucleus:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(hidden);
+  free(W);
+}
+
+static void test_greedy_generation_matches_beam() {
+  TransformerConfig config = {.num_layers = 2,
+                              .d_model = 32,
+                              .d_ff = 64,
+                              .num_heads = 4,
+                              .vocab_size = 60,
+                              .max_seq_len = 32};
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int src[5] = {2, 4, 6, 8, 10};
+  SamplingConfig cfg = {.temperature = 0.0f,
+                        .top_p = 1.0f,
+                        .max_len = 8,
+                        .bos_id = 0,
+                        .eos_id = 1};
+  BeamSearchConfig beam = {.beam_width = 1,
+                           .max_len = 8,
+                           .length_penalty = 0.0f,
+                           .bos_id = 0,
+                           .eos_id = 1};
+
+  int out[8], ref[8];
+  int n = generate_sampled(src, 5, &params, &cfg, out);
+  int n_ref = beam_search(src, 5, &params, &beam, ref, NULL);
+
+  int ok = (n == n_ref);
+  for (int i = 0; ok && i < n; i++)
+    ok = (out[i] == ref[i]);
+
+  printf("Testing greedy generate_sampled vs beam_search (width=1):\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_transformer_params(&params);
+}
+
+static void test_prefix_filling_positions() {
+  TransformerConfig config = {.num_layers = 1,
+                              .d_model = 16,
+                              .d_ff = 32,
+                              .num_heads = 2,
+                              .vocab_size = 40,
+                              .max_seq_len = 8};
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int src[3] = {5, 6, 7};
+  int prefix[8] = {2, 3, 4, 5, 6, 7, 8, 9};
+  SamplingConfig cfg = {.temperature = 0.0f,
+                        .top_p = 1.0f,
+                        .max_len = 4,
+                        .bos_id = 0,
+                        .eos_id = -1,
+                        .prefix = prefix,
+                        .prefix_len = 8};
+  BeamSearchConfig beam = {.beam_width = 2,
+                           .max_len = 4,
+                           .bos_id = 0,
+                           .eos_id = 1,
+                           .prefix = prefix,
+                           .prefix_len = 8};
+  int out[4];
+  float score = 1.0f;
+
+  // BOS + 8 prefix tokens need 9 of the 8 learned positions
+  int ok = generate_sampled(src, 3, &params, &cfg, out) == 0;
+  ok &= beam_search(src, 3, &params, &beam, out, &score) == 0 && score == 1.0f;
+
+  // One prefix token fewer leaves room for exactly one generated token
+  cfg.prefix_len = beam.prefix_len = 7;
+  ok &= generate_sampled(src, 3, &params, &cfg, out) == 1;
+  ok &= beam_search(src, 3, &params, &beam, out, &score) <= 1;
+
+  // No token asked for: nothing is decoded or written
+  cfg.prefix_len = beam.prefix_len = 0;
+  cfg.max_len = beam.max_len = 0;
+  out[0] = -1;
+  score = 1.0f;
+  ok &= generate_sampled(src, 3, &params, &cfg, out) == 0 && out[0] == -1;
+  ok &= beam_search(src, 3, &params, &beam, out, &score) == 0 &&
+        score == 1.0f && out[0] == -1;
+
+  printf("Testing a prefix that fills the model's positions, and max_len 0:"
+         "\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_transformer_params(&params);
+}
+
+typedef struct {
+  int tokens[32];
+  int n;
+  int stop_after; // Cancel once this many arrived, 0 never
+} StreamCtx;
+
+static int stream_token(int token, void *arg) {
+  StreamCtx *ctx = (StreamCtx *)arg;
+  ctx->tokens[ctx->n++] = token;
+  return ctx->n == ctx->stop_after;
+}
+
+static void test_generation_streams_and_cancels() {
+  TransformerConfig config = {.num_layers = 2,
+                              .d_model = 32,
+                              .d_ff = 64,
+                              .num_heads = 4,
+                              .vocab_size = 60,
+                              .max_seq_len = 32};
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int src[5] = {2, 4, 6, 8, 10};
+  SamplingConfig cfg = {.temperature = 0.9f,
+                        .top_p = 0.95f,
+                        .seed = 3,
+                        .max_len = 20,
+                        .bos_id = 0,
+                        .eos_id = -1};
+  int ref[20], out[20];
+  int n_ref = generate_sampled(src, 5, &params, &cfg, ref);
+
+  // Every token reaches the callback, in order
+  StreamCtx all = {.stop_after = 0};
+  cfg.on_token = stream_token;
+  cfg.on_token_arg = &all;
+  int n = generate_sampled(src, 5, &params, &cfg, out);
+  int ok = (n == n_ref && all.n == n_ref);
+  for (int i = 0; ok && i < n; i++)
+    ok = (out[i] == ref[i] && all.tokens[i] == ref[i]);
+
+  // Cancelling keeps the prefix produced so far
+  StreamCtx cut = {.stop_after = 4};
+  cfg.on_token_arg = &cut;
+  n = generate_sampled(src, 5, &params, &cfg, out);
+  ok &= (n == 4 && cut.n == 4);
+  for (int i = 0; ok && i < n; i++)
+    ok = (out[i] == ref[i]);
+
+  printf("Testing streamed and cancelled generation:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_transformer_params(&params);
+}
+
+int main() {
+  printf("===== Running sampling tests =====\n");
+  test_greedy_matches_argmax();
+  test_top_k_stays_in_top_k();
+  test_tiny_top_p_is_greedy();
+  test_greedy_generation_matches_beam();
+  test_prefix_filling_positions();
+  test_generation_streams_and_cancels();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -0,0 +1,202 @@
+#include "../include/sampling.h"
+#include "../include/server.h"
+#include "../include/transformer.h"
+#include "../include/transformer_api.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// gcc -Iinclude src/*.c tests/server_tests.c -lm -O2 -pthread -o server_tests
+
+static const TransformerConfig config = {.num_layers = 2,
+                                         .d_model = 64,
+                                         .d_ff = 256,
+                                         .num_heads = 4,
+                                         .vocab_size = 300,
+                                         .max_seq_len = 64};
+
+#define N_CLIENTS 3
+#define PER_CLIENT 2
+
+static ServerRequestHeader make_header(uint32_t id, int L_src) {
+  ServerRequestHeader h = {.magic = SERVER_REQUEST_MAGIC,
+                           .request_id = id,
+                           .L_src = (uint32_t)L_src,
+                           .max_len = 10 + id,
+                           .bos_id = 0,
+                           .eos_id = 1,
+                           .temperature = id % 2 ? 0.8f : 0.0f,
+                           .top_k = 20,
+                           .top_p = 0.9f,
+                           .seed = 1000 + id};
+  return h;
+}
+
+// Read frames until requests first .. first + n - 1 are all done
+static int read_responses(int fd, uint32_t first, int n, int out[][64],
+                          int *n_out, int *error) {
+  for (int k = 0; k < n; k++)
+    n_out[k] = error[k] = 0;
+  for (int pending = n; pending > 0;) {
+    ServerResponse r;
+    if (server_read_response(fd, &r) != 0 || r.request_id < first ||
+        r.request_id >= first + n)
+      return -1;
+    int k = r.request_id - first;
+    if (r.type == SERVER_MSG_TOKEN) {
+      out[k][n_out[k]++] = r.value;
+      continue;
+    }
+    if (r.type == SERVER_MSG_ERROR)
+      error[k] = r.value;
+    else if (r.value != n_out[k])
+      return -1;
+    pending--;
+  }
+  return 0;
+}
+
+// One request on its own
+static int read_until_done(int fd, uint32_t id, int *out, int *n_out,
+                           int *error) {
+  int buf[1][64];
+  if (read_responses(fd, id, 1, buf, n_out, error) != 0)
+    return -1;
+  for (int i = 0; i < *n_out; i++)
+    out[i] = buf[0][i];
+  return 0;
+}
+
+static void test_server_streams_generate_sampled() {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/transformer_server_%d.sock",
+           (int)getpid());
+  TransformerParams params;
+  init_transformer_params(&params, config);
+  Server server;
+  ServerConfig sc = {.max_batch = 4, .queue_capacity = 8};
+  int started = server_start(&server, &params, &sc, path) == 0;
+  int ok = started;
+
+  // Every client pipelines its requests before reading any response
+  int fds[N_CLIENTS], src[N_CLIENTS * PER_CLIENT][12];
+  for (int c = 0; ok && c < N_CLIENTS; c++) {
+    fds[c] = server_connect(path);
+    ok &= fds[c] >= 0;
+    for (int k = 0; ok && k < PER_CLIENT; k++) {
+      int id = c * PER_CLIENT + k;
+      for (int i = 0; i < 12; i++)
+        src[id][i] = (i * 7 + id * 13 + 3) % config.vocab_size;
+      ServerRequestHeader h = make_header(id, 6 + id);
+      ok &= server_send_request(fds[c], &h, src[id]) == 0;
+    }
+  }
+
+  // Tokens of a client's requests interleave on its connection
+  for (int c = 0; ok && c < N_CLIENTS; c++) {
+    int out[PER_CLIENT][64], n_out[PER_CLIENT], error[PER_CLIENT];
+    ok &= read_responses(fds[c], c * PER_CLIENT, PER_CLIENT, out, n_out,
+                         error) == 0;
+    for (int k = 0; ok && k < PER_CLIENT; k++) {
+      int id = c * PER_CLIENT + k;
+      ServerRequestHeader h = make_header(id, 6 + id);
+      SamplingConfig cfg = {.temperature = h.temperature,
+                            .top_k = (int)h.top_k,
+                            .top_p = h.top_p,
+                            .seed = h.seed,
+                            .max_len = (int)h.max_len,
+                            .bos_id = h.bos_id,
+                            .eos_id = h.eos_id};
+      int ref[64];
+      int n_ref = generate_sampled(src[id], 6 + id, &params, &cfg, ref);
+      ok &= error[k] == 0 && n_out[k] == n_ref;
+      for (int i = 0; ok && i < n_ref; i++)
+        ok &= out[k][i] == ref[i];
+    }
+    close(fds[c]);
+  }
+
+  if (started) {
+    server_stop(&server);
+    ok &= server.requests == N_CLIENTS * PER_CLIENT && server.steps > 0;
+    // The scheduler's scratch all came from its arena
+    ok &= server.ws.peak > 0 && server.ws.overflows == 0 &&
+          server.ws.failed == 0;
+  }
+
+  printf("Testing server streams the tokens of generate_sampled:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_transformer_params(&params);
+}
+
+static void test_server_errors_and_disconnects() {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/transformer_server_%d.sock",
+           (int)getpid());
+  TransformerParams params;
+  init_transformer_params(&params, config);
+  Server server;
+  ServerConfig sc = {.max_batch = 2, .queue_capacity = 4};
+  int started = server_start(&server, &params, &sc, path) == 0;
+  int ok = started;
+
+  int fd = ok ? server_connect(path) : -1;
+  int src[80] = {0}, out[64], n_out, error;
+  ok &= fd >= 0;
+
+  // Refused requests leave the connection usable
+  src[2] = config.vocab_size; // Out of the vocabulary
+  ServerRequestHeader h = make_header(1, 4);
+  ok &= server_send_request(fd, &h, src) == 0;
+  ok &= read_until_done(fd, 1, out, &n_out, &error) == 0 &&
+        error == TF_ERR_INVALID_ARG;
+  src[2] = 5;
+  h = make_header(2, 80); // Longer than max_seq_len
+  ok &= server_send_request(fd, &h, src) == 0;
+  ok &= read_until_done(fd, 2, out, &n_out, &error) == 0 &&
+        error == TF_ERR_CAPACITY;
+
+  // A client leaving mid-generation does not disturb the others
+  int gone = server_connect(path);
+  h = make_header(3, 8);
+  h.max_len = 60;
+  h.eos_id = -1;
+  ok &= gone >= 0 && server_send_request(gone, &h, src) == 0;
+  close(gone);
+
+  h = make_header(4, 8);
+  h.eos_id = -1; // Runs to max_len
+  ok &= server_send_request(fd, &h, src) == 0;
+  ok &= read_until_done(fd, 4, out, &n_out, &error) == 0 && error == 0 &&
+        n_out == (int)h.max_len;
+
+  // Stopping with a request still queued or running
+  h = make_header(5, 8);
+  h.max_len = 60;
+  ok &= server_send_request(fd, &h, src) == 0;
+  if (started)
+    server_stop(&server);
+  ok &= access(path, F_OK) != 0; // Socket file removed
+  close(fd);
+
+  printf("Testing server error frames, disconnects and stop:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_transformer_params(&params);
+}
+
+int main() {
+  printf("===== Running server tests =====\n");
+  test_server_streams_generate_sampled();
+  test_server_errors_and_disconnects();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -0,0 +1,132 @@
+#include "../include/shared_params.h"
+#include "../include/transformer.h"
+#include "../include/utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// gcc -Iinclude src/*.c tests/shared_params_tests.c -lm -O2 -pthread -o shared_params_tests
+
+static const TransformerConfig config = {.num_layers = 2,
+                                         .d_model = 64,
+                                         .d_ff = 256,
+                                         .num_heads = 4,
+                                         .vocab_size = 300,
+                                         .max_seq_len = 64};
+
+#define L_SRC 20
+#define L_TGT 17
+
+static void forward(const TransformerParams *params, float *logits) {
+  int src[L_SRC], tgt[L_TGT];
+  for (int i = 0; i < L_SRC; i++)
+    src[i] = (i * 7 + 3) % config.vocab_size;
+  for (int i = 0; i < L_TGT; i++)
+    tgt[i] = (i * 11 + 5) % config.vocab_size;
+  compute_transformer(src, tgt, params, logits, L_SRC, L_TGT);
+}
+
+static void test_pack_and_view() {
+  TransformerParams params, view;
+  init_transformer_params(&params, config);
+  size_t bytes = transformer_params_packed_bytes(config);
+  void *packed = NULL;
+  int ok = posix_memalign(&packed, TRANSFORMER_PACK_ALIGN, bytes) == 0;
+  pack_transformer_params(&params, packed);
+  view_transformer_params(&view, config, packed);
+
+  size_t n_logits = (size_t)L_TGT * config.vocab_size;
+  float *expected = malloc(n_logits * sizeof(float));
+  float *got = malloc(n_logits * sizeof(float));
+  forward(&params, expected);
+  forward(&view, got);
+  ok &= compare(expected, got, (int)n_logits);
+  ok &= ((char *)view.output_projection - (char *)packed) %
+            TRANSFORMER_PACK_ALIGN ==
+        0;
+
+  printf("Testing packed parameter layout:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_transformer_params_view(&view);
+  free(packed);
+  free(expected);
+  free(got);
+  free_transformer_params(&params);
+}
+
+static void test_publish_and_attach() {
+  char name[64];
+  snprintf(name, sizeof(name), "/transformer_tests_%d", (int)getpid());
+  shared_params_unlink(name);
+
+  TransformerParams params;
+  init_transformer_params(&params, config);
+  size_t n_logits = (size_t)L_TGT * config.vocab_size;
+  float *expected = malloc(n_logits * sizeof(float));
+  float *got = malloc(n_logits * sizeof(float));
+  forward(&params, expected);
+
+  SharedParams missing;
+  int ok = shared_params_attach(&missing, name) == -1;
+
+  SharedParams pub;
+  ok &= shared_params_publish(&pub, name, &params) == 0;
+  // The name is taken now
+  SharedParams again;
+  ok &= shared_params_publish(&again, name, &params) == -1;
+  // The publisher's own copy is no longer needed
+  free_transformer_params(&params);
+
+  forward(&pub.params, got);
+  ok &= compare(expected, got, (int)n_logits);
+
+  // Worker processes attach and must see identical weights
+  for (int w = 0; w < 2; w++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      SharedParams sp;
+      if (shared_params_attach(&sp, name) != 0)
+        _exit(2);
+      forward(&sp.params, got);
+      int same = compare(expected, got, (int)n_logits);
+      shared_params_detach(&sp);
+      _exit(same ? 0 : 1);
+    }
+    int status = -1;
+    ok &= pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+          WEXITSTATUS(status) == 0;
+  }
+
+  // Unlinking keeps existing mappings alive
+  ok &= shared_params_unlink(name) == 0;
+  forward(&pub.params, got);
+  ok &= compare(expected, got, (int)n_logits);
+  ok &= shared_params_attach(&missing, name) == -1;
+  shared_params_detach(&pub);
+
+  printf("Testing shared memory publish / attach across processes:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(expected);
+  free(got);
+}
+
+int main() {
+  // Forked workers would inherit the pool's state but not its threads
+  setenv("TRANSFORMER_THREADS", "1", 1);
+  printf("===== Running shared params tests =====\n");
+  test_pack_and_view();
+  test_publish_and_attach();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include "../include/beam_search.h"
+#include "../include/shortlist.h"
+#include "../include/transformer.h"
+#include "../include/utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/*.c tests/shortlist_tests.c -lm -O2 -o shortlist_tests
+
+static TransformerConfig test_config(void) {
+  TransformerConfig config = {.num_layers = 2,
+                              .d_model = 32,
+                              .d_ff = 64,
+                              .num_heads = 4,
+                              .vocab_size = 80,
+                              .max_seq_len = 32};
+  return config;
+}
+
+static void test_build_shortlist_ids() {
+  int src[5] = {9, 3, 9, 40, 3};
+  int frequent[4] = {1, 2, 3, 0};
+  int ids[13];
+  int ref[6] = {0, 1, 2, 3, 9, 40};
+
+  int n = build_shortlist_ids(src, 5, frequent, 4, 0, 1, NULL, 0, 80, ids);
+
+  int ok = (n == 6);
+  for (int i = 0; ok && i < n; i++)
+    ok = (ids[i] == ref[i]);
+
+  // Out-of-vocabulary source ids are dropped; BOS, EOS and the prefix are
+  // kept even when neither list has them
+  int bad_src[3] = {-4, 12, 80};
+  int prefix[2] = {70, 12};
+  int ref2[4] = {5, 12, 70, 79};
+  n = build_shortlist_ids(bad_src, 3, NULL, 0, 79, 5, prefix, 2, 80, ids);
+  ok &= (n == 4);
+  for (int i = 0; ok && i < n; i++)
+    ok = (ids[i] == ref2[i]);
+
+  printf("Testing build_shortlist_ids:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+static void test_shortlist_logits_match_full() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int L = 3, V = config.vocab_size, d_model = config.d_model;
+  float *hidden = malloc(L * d_model * sizeof(float));
+  for (int i = 0; i < L * d_model; i++)
+    hidden[i] = (float)rand() / RAND_MAX - 0.5f;
+
+  int ids[5] = {0, 7, 8, 41, 79};
+  VocabShortlist sl;
+  init_vocab_shortlist(&sl, &params, ids, 5);
+
+  float *full = malloc(L * V * sizeof(float));
+  float *short_logits = malloc(L * 5 * sizeof(float));
+  float *gathered = malloc(L * 5 * sizeof(float));
+  compute_logits(hidden, &params, full, L);
+  compute_shortlist_logits(hidden, &sl, short_logits, L);
+  for (int i = 0; i < L; i++)
+    for (int j = 0; j < 5; j++)
+      gathered[i * 5 + j] = full[i * V + ids[j]];
+
+  printf("Testing compute_shortlist_logits vs gathered full logits:\n\t");
+  if (compare(short_logits, gathered, L * 5))
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(hidden);
+  free(full);
+  free(short_logits);
+  free(gathered);
+  free_vocab_shortlist(&sl);
+  free_transformer_params(&params);
+}
+
+static void test_beam_search_with_shortlist() {
+  TransformerConfig config = test_config();
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int src[4] = {11, 12, 13, 14};
+  int frequent[3] = {0, 1, 5};
+  int ids[9];
+  int n_ids = build_shortlist_ids(src, 4, frequent, 3, 0, 1, NULL, 0,
+                                  config.vocab_size, ids);
+
+  VocabShortlist sl;
+  init_vocab_shortlist(&sl, &params, ids, n_ids);
+
+  BeamSearchConfig cfg = {.beam_width = 3,
+                          .max_len = 8,
+                          .length_penalty = 0.6f,
+                          .bos_id = 0,
+                          .eos_id = 1,
+                          .shortlist = &sl};
+  int out[8];
+  int n = beam_search(src, 4, &params, &cfg, out, NULL);
+
+  // Every emitted token must come from the shortlist
+  int ok = 1;
+  for (int i = 0; i < n; i++) {
+    int found = 0;
+    for (int j = 0; j < n_ids; j++)
+      found |= (out[i] == ids[j]);
+    ok &= found;
+  }
+
+  printf("Testing beam_search restricted to a shortlist (%d tokens):\n\t", n);
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_vocab_shortlist(&sl);
+  free_transformer_params(&params);
+}
+
+int main() {
+  printf("===== Running shortlist tests =====\n");
+  test_build_shortlist_ids();
+  test_shortlist_logits_match_full();
+  test_beam_search_with_shortlist();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include "../include/sampling.h"
+#include "../include/speculative.h"
+#include "../include/transformer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/*.c tests/speculative_tests.c -lm -O2 -o speculative_tests
+
+static int run_case(const TransformerParams *target,
+                    const TransformerParams *draft, int num_draft,
+                    SpeculativeStats *stats) {
+  int src[6] = {4, 9, 2, 7, 5, 3};
+  int max_len = 12;
+
+  SamplingConfig greedy = {.temperature = 0.0f,
+                           .top_p = 1.0f,
+                           .max_len = max_len,
+                           .bos_id = 0,
+                           .eos_id = 1};
+  int ref[12];
+  int n_ref = generate_sampled(src, 6, target, &greedy, ref);
+
+  SpeculativeConfig cfg = {
+      .num_draft = num_draft, .max_len = max_len, .bos_id = 0, .eos_id = 1};
+  int out[12];
+  int n = speculative_generate(src, 6, target, draft, &cfg, out, stats);
+
+  int ok = (n == n_ref);
+  for (int i = 0; ok && i < n; i++)
+    ok = (out[i] == ref[i]);
+  return ok;
+}
+
+static void test_self_draft_accepts_everything() {
+  TransformerConfig config = {.num_layers = 2,
+                              .d_model = 32,
+                              .d_ff = 64,
+                              .num_heads = 4,
+                              .vocab_size = 40,
+                              .max_seq_len = 32};
+  TransformerParams target;
+  init_transformer_params(&target, config);
+
+  SpeculativeStats stats;
+  int ok = run_case(&target, &target, 4, &stats);
+  ok &= (stats.accepted == stats.proposed);
+
+  printf("Testing speculative decoding with the target as its own draft "
+         "(%d/%d accepted, %d rounds):\n\t",
+         stats.accepted, stats.proposed, stats.rounds);
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_transformer_params(&target);
+}
+
+static void test_small_draft_matches_greedy() {
+  TransformerConfig config = {.num_layers = 2,
+                              .d_model = 32,
+                              .d_ff = 64,
+                              .num_heads = 4,
+                              .vocab_size = 40,
+                              .max_seq_len = 32};
+  TransformerConfig draft_config = {.num_layers = 1,
+                                    .d_model = 16,
+                                    .d_ff = 32,
+                                    .num_heads = 2,
+                                    .vocab_size = 40,
+                                    .max_seq_len = 32};
+  TransformerParams target, draft;
+  init_transformer_params(&target, config);
+  init_transformer_params(&draft, draft_config);
+
+  int ok = 1;
+  SpeculativeStats stats;
+  for (int k = 1; k <= 5; k += 2)
+    ok &= run_case(&target, &draft, k, &stats);
+
+  // A draft over another vocabulary is rejected
+  TransformerParams other;
+  draft_config.vocab_size = 41;
+  init_transformer_params(&other, draft_config);
+  int src[3] = {4, 9, 2};
+  int out[4];
+  SpeculativeConfig cfg = {
+      .num_draft = 2, .max_len = 4, .bos_id = 0, .eos_id = 1};
+  ok &= (speculative_generate(src, 3, &target, &other, &cfg, out, NULL) == -1);
+
+  printf("Testing speculative decoding with a small draft vs greedy:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_transformer_params(&target);
+  free_transformer_params(&draft);
+  free_transformer_params(&other);
+}
+
+int main() {
+  printf("===== Running speculative decoding tests =====\n");
+  test_self_draft_accepts_everything();
+  test_small_draft_matches_greedy();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -63,9 +63,23 @@ static void test_transpose_matrix(void) {
   float A_T_ref[6] = {1, 4, 2, 5, 3, 6};
 
   transpose_matrix(A, A_T, rows, cols);
+  int ok = compare(A_T_ref, A_T, cols * rows);
+
+  // Several tiles in both directions, partial ones at the edges
+  int R = 45, C = 70;
+  float *B = malloc(R * C * sizeof(float));
+  float *B_T = malloc(R * C * sizeof(float));
+  for (int i = 0; i < R * C; i++)
+    B[i] = (float)i;
+  transpose_matrix(B, B_T, R, C);
+  for (int i = 0; i < R; i++)
+    for (int j = 0; j < C; j++)
+      ok &= (B_T[j * R + i] == B[i * C + j]);
+  free(B);
+  free(B_T);
 
   printf("Testing transpose_matrix_test:\n\t");
-  if (compare(A_T_ref, A_T, cols * rows))
+  if (ok)
     printf("PASSED\n");
   else
     printf("FAILED\n");
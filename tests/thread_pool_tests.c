@@ -0,0 +1,119 @@
+#include "../include/thread_pool.h"
+#include "../include/transformer.h"
+#include "../include/utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// gcc -Iinclude src/*.c tests/thread_pool_tests.c -lm -O2 -pthread -o thread_pool_tests
+
+typedef struct {
+  int *hits;      // Times each index ran
+  int *worker_ok; // Per index: the worker id was in range
+  int n_threads;
+  int nested; // Run an inner parallel_for from every chunk
+} CoverCtx;
+
+static void inner(void *ctx, int begin, int end, int worker) {
+  int *count = (int *)ctx;
+  (void)worker;
+  *count += end - begin;
+}
+
+static void cover(void *ctx, int begin, int end, int worker) {
+  CoverCtx *c = (CoverCtx *)ctx;
+  for (int i = begin; i < end; i++) {
+    // Triangular work: later iterations cost more, like causal rows
+    volatile float x = 0.0f;
+    for (int k = 0; k < i * 10; k++)
+      x += 1.0f;
+    __atomic_fetch_add(&c->hits[i], 1, __ATOMIC_RELAXED);
+    c->worker_ok[i] = (worker >= 0 && worker < c->n_threads);
+    if (c->nested) {
+      int count = 0;
+      parallel_for(50, 1, inner, &count);
+      if (count != 50)
+        c->worker_ok[i] = 0;
+    }
+  }
+}
+
+static int check_cover(int n, int grain, int nested) {
+  CoverCtx c = {calloc(n + 1, sizeof(int)), calloc(n + 1, sizeof(int)),
+                thread_pool_size(), nested};
+  parallel_for(n, grain, cover, &c);
+  int ok = 1;
+  for (int i = 0; i < n; i++)
+    ok &= (c.hits[i] == 1 && c.worker_ok[i]);
+  free(c.hits);
+  free(c.worker_ok);
+  return ok;
+}
+
+static void test_parallel_for_covers_range() {
+  thread_pool_set_threads(4);
+  int ok = (thread_pool_size() == 4);
+  ok &= check_cover(1000, 1, 0);
+  ok &= check_cover(997, 7, 0);
+  ok &= check_cover(3, 1, 0);     // Fewer iterations than threads
+  ok &= check_cover(5, 16, 0);    // One grain: inline
+  ok &= check_cover(200, 2, 1);   // Nested loops run inline
+  for (int rep = 0; rep < 200; rep++) // Back-to-back loops
+    ok &= check_cover(64, 1, 0);
+
+  thread_pool_set_threads(1);
+  ok &= (thread_pool_size() == 1) && check_cover(100, 1, 0);
+  thread_pool_set_threads(4);
+
+  printf("Testing parallel_for coverage, stealing and nesting:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+static void test_transformer_thread_counts_agree() {
+  TransformerConfig config = {.num_layers = 2,
+                              .d_model = 64,
+                              .d_ff = 256,
+                              .num_heads = 4,
+                              .vocab_size = 300,
+                              .max_seq_len = 64};
+  TransformerParams params;
+  init_transformer_params(&params, config);
+
+  int L_src = 40, L_tgt = 33;
+  int src[40], tgt[33];
+  for (int i = 0; i < L_src; i++)
+    src[i] = (i * 7 + 3) % config.vocab_size;
+  for (int i = 0; i < L_tgt; i++)
+    tgt[i] = (i * 11 + 5) % config.vocab_size;
+
+  size_t n_logits = (size_t)L_tgt * config.vocab_size;
+  float *serial = malloc(n_logits * sizeof(float));
+  float *threaded = malloc(n_logits * sizeof(float));
+
+  thread_pool_set_threads(1);
+  compute_transformer(src, tgt, &params, serial, L_src, L_tgt);
+  thread_pool_set_threads(4);
+  compute_transformer(src, tgt, &params, threaded, L_src, L_tgt);
+
+  printf("Testing compute_transformer on 1 vs 4 pool threads:\n\t");
+  if (compare(serial, threaded, (int)n_logits))
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free(serial);
+  free(threaded);
+  free_transformer_params(&params);
+}
+
+int main() {
+  printf("===== Running thread pool tests =====\n");
+  test_parallel_for_covers_range();
+  test_transformer_thread_counts_agree();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -0,0 +1,238 @@
+#include "../include/sampling.h"
+#include "../include/transformer.h"
+#include "../include/transformer_api.h"
+#include "../include/utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/*.c tests/transformer_api_tests.c -lm -O2 -pthread -o transformer_api_tests
+
+static const TfModelConfig api_config = {.num_layers = 2,
+                                         .d_model = 64,
+                                         .d_ff = 256,
+                                         .num_heads = 4,
+                                         .vocab_size = 300,
+                                         .max_seq_len = 64};
+
+#define L_SRC 20
+#define L_TGT 17
+
+// Same random weights through the context API and the legacy one
+static void create_models(TfModel **model, TransformerParams *params) {
+  TransformerConfig config = {api_config.num_layers, api_config.d_model,
+                              api_config.d_ff,       api_config.num_heads,
+                              api_config.vocab_size, api_config.max_seq_len};
+  srand(7);
+  init_transformer_params(params, config);
+  srand(7);
+  *model = NULL;
+  tf_model_create_random(&api_config, model);
+}
+
+static void test_api_matches_legacy() {
+  TfModel *model;
+  TransformerParams params;
+  create_models(&model, &params);
+
+  int src[L_SRC], tgt[L_TGT];
+  for (int i = 0; i < L_SRC; i++)
+    src[i] = (i * 7 + 3) % api_config.vocab_size;
+  for (int i = 0; i < L_TGT; i++)
+    tgt[i] = (i * 11 + 5) % api_config.vocab_size;
+
+  int vocab = api_config.vocab_size;
+  float *expected = malloc((size_t)L_TGT * vocab * sizeof(float));
+  float *got = malloc((size_t)L_TGT * vocab * sizeof(float));
+  compute_transformer(src, tgt, &params, expected, L_SRC, L_TGT);
+
+  TfSession *s = NULL;
+  TfSessionConfig sc = {.max_src_len = 32, .max_tgt_len = 32};
+  int ok = model && tf_session_create(model, &sc, &s) == TF_OK;
+
+  // Full forward, then the same rows one decode step at a time
+  ok = ok && tf_forward(s, src, L_SRC, tgt, L_TGT, got) == TF_OK;
+  ok = ok && compare(expected, got, L_TGT * vocab);
+  ok = ok && tf_encode(s, src, L_SRC) == TF_OK;
+  for (int i = 0; ok && i < L_TGT; i++)
+    ok = tf_decode_step(s, tgt[i], got + (size_t)i * vocab) == TF_OK;
+  ok = ok && compare(expected, got, L_TGT * vocab);
+
+  // Sampled generation, twice on the same session
+  SamplingConfig cfg = {.temperature = 0.8f,
+                        .top_k = 20,
+                        .top_p = 0.9f,
+                        .seed = 99,
+                        .max_len = 24,
+                        .bos_id = 0,
+                        .eos_id = 1};
+  TfSamplingParams sp = {cfg.temperature, cfg.top_k, cfg.top_p, cfg.seed,
+                         cfg.max_len,     cfg.bos_id, cfg.eos_id};
+  int ref[24], out[24], n_out = -1;
+  int n_ref = generate_sampled(src, 6, &params, &cfg, ref);
+  for (int rep = 0; ok && rep < 2; rep++) {
+    ok = tf_generate(s, src, 6, &sp, out, &n_out) == TF_OK && n_out == n_ref;
+    for (int i = 0; ok && i < n_out; i++)
+      ok = (out[i] == ref[i]);
+  }
+
+  // Every call after setup stayed inside the workspace
+  TfSessionStats stats;
+  ok = ok && tf_session_stats(s, &stats) == TF_OK;
+  ok = ok && stats.overflows == 0 && stats.workspace_peak > 0 &&
+       stats.workspace_peak <= stats.workspace_bytes;
+
+  printf("Testing context API against compute_transformer / "
+         "generate_sampled:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  tf_session_destroy(s);
+  tf_model_destroy(model);
+  free_transformer_params(&params);
+  free(expected);
+  free(got);
+}
+
+static void test_api_status_codes() {
+  TfModel *model = NULL;
+  TfModelConfig bad = api_config;
+  bad.num_heads = 5; // Does not divide d_model
+  int ok = tf_model_create_random(&bad, &model) == TF_ERR_INVALID_ARG;
+  ok &= tf_model_open("/nonexistent/model.bin", 0, &model) == TF_ERR_IO;
+  ok &= tf_model_create_random(&api_config, &model) == TF_OK;
+
+  TfSession *s = NULL;
+  TfSessionConfig too_long = {.max_src_len = 65};
+  TfSessionConfig sc = {.max_src_len = 8, .max_tgt_len = 4};
+  ok &= tf_session_create(model, &too_long, &s) == TF_ERR_INVALID_ARG;
+  ok &= tf_session_create(model, &sc, &s) == TF_OK;
+
+  int src[9] = {2, 3, 4, 5, 6, 7, 8, 9, 10};
+  int bad_src[2] = {2, 300};
+  float logits[300];
+  ok &= tf_decode_step(s, 2, logits) == TF_ERR_STATE;
+  ok &= tf_encode(s, src, 9) == TF_ERR_CAPACITY;
+  ok &= tf_encode(s, bad_src, 2) == TF_ERR_INVALID_ARG;
+  ok &= tf_encode(s, src, 0) == TF_ERR_INVALID_ARG;
+  ok &= tf_encode(NULL, src, 4) == TF_ERR_INVALID_ARG;
+  ok &= tf_encode(s, src, 8) == TF_OK;
+  ok &= tf_decode_step(s, -1, logits) == TF_ERR_INVALID_ARG;
+  for (int i = 0; i < 4; i++)
+    ok &= tf_decode_step(s, 2 + i, NULL) == TF_OK;
+  ok &= tf_decode_step(s, 2, logits) == TF_ERR_CAPACITY;
+  ok &= tf_forward(s, src, 8, src, 5, logits) == TF_ERR_CAPACITY;
+
+  // Generation stops at the session's target length
+  TfSamplingParams sp = {.temperature = 0.0f, .top_p = 1.0f, .max_len = 50,
+                         .bos_id = 0, .eos_id = 299};
+  int out[50], n_out = 0;
+  ok &= tf_generate(s, src, 8, &sp, out, &n_out) == TF_OK && n_out <= 4;
+
+  ok &= tf_status_string(TF_ERR_CAPACITY) != NULL;
+
+  // Computed positions are not capped by max_seq_len
+  TfModel *sinusoidal = NULL;
+  TfModelConfig computed = api_config;
+  TfSession *long_session = NULL;
+  TfModelConfig got;
+  computed.positional = TF_POS_SINUSOIDAL;
+  ok &= tf_model_create_random(&computed, &sinusoidal) == TF_OK;
+  ok &= tf_model_config(sinusoidal, &got) == TF_OK &&
+        got.positional == TF_POS_SINUSOIDAL;
+  ok &= tf_session_create(sinusoidal, &too_long, &long_session) == TF_OK;
+  tf_session_destroy(long_session);
+  tf_model_destroy(sinusoidal);
+
+  printf("Testing context API status codes:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  tf_session_destroy(s);
+  tf_model_destroy(model);
+}
+
+typedef struct {
+  TfSession *session;
+  int tokens[64];
+  int n;
+  int stop_after;   // Return nonzero once this many arrived, 0 never
+  int cancel_after; // Call tf_session_cancel instead
+} StreamCtx;
+
+static int stream_token(int token, void *user) {
+  StreamCtx *ctx = (StreamCtx *)user;
+  ctx->tokens[ctx->n++] = token;
+  if (ctx->n == ctx->cancel_after)
+    tf_session_cancel(ctx->session);
+  return ctx->n == ctx->stop_after;
+}
+
+static void test_api_streaming_and_cancel() {
+  TfModel *model = NULL;
+  TfSession *s = NULL;
+  TfSessionConfig sc = {.max_src_len = 16, .max_tgt_len = 32};
+  int ok = tf_model_create_random(&api_config, &model) == TF_OK &&
+           tf_session_create(model, &sc, &s) == TF_OK;
+
+  int src[6] = {3, 5, 7, 9, 11, 13};
+  TfSamplingParams sp = {.temperature = 0.7f, .top_k = 40, .top_p = 0.95f,
+                         .seed = 5, .max_len = 24, .bos_id = 0, .eos_id = -1};
+  int ref[24], n_ref = 0, n_out = -1;
+  ok = ok && tf_generate(s, src, 6, &sp, ref, &n_ref) == TF_OK && n_ref == 24;
+
+  // Streamed tokens are the generated ones
+  StreamCtx all = {.session = s};
+  ok = ok && tf_generate_stream(s, src, 6, &sp, stream_token, &all,
+                                &n_out) == TF_OK;
+  ok = ok && n_out == n_ref && all.n == n_ref;
+  for (int i = 0; ok && i < n_ref; i++)
+    ok = all.tokens[i] == ref[i];
+
+  // Cancel from the callback, then through tf_session_cancel: the session
+  // is released and forgets its source, and serves the next request as new
+  StreamCtx stop = {.session = s, .stop_after = 3};
+  StreamCtx cancel = {.session = s, .cancel_after = 5};
+  ok = ok && tf_generate_stream(s, src, 6, &sp, stream_token, &stop,
+                                &n_out) == TF_ERR_CANCELLED && n_out == 3;
+  ok = ok && tf_decode_step(s, 2, NULL) == TF_ERR_STATE;
+  ok = ok && tf_generate_stream(s, src, 6, &sp, stream_token, &cancel,
+                                &n_out) == TF_ERR_CANCELLED && n_out == 5;
+  for (int i = 0; ok && i < 5; i++)
+    ok = stop.tokens[i % 3] == ref[i % 3] && cancel.tokens[i] == ref[i];
+
+  int again[24], n_again = 0;
+  ok = ok && tf_generate(s, src, 6, &sp, again, &n_again) == TF_OK &&
+       n_again == n_ref;
+  for (int i = 0; ok && i < n_ref; i++)
+    ok = again[i] == ref[i];
+
+  // A cancel that arrives between generations is dropped
+  tf_session_cancel(s);
+  ok = ok && tf_generate(s, src, 6, &sp, again, &n_again) == TF_OK;
+
+  TfSessionStats stats;
+  ok = ok && tf_session_stats(s, &stats) == TF_OK && stats.overflows == 0;
+
+  printf("Testing context API token streaming and cancellation:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  tf_session_destroy(s);
+  tf_model_destroy(model);
+}
+
+int main() {
+  printf("===== Running transformer API tests =====\n");
+  test_api_matches_legacy();
+  test_api_status_codes();
+  test_api_streaming_and_cancel();
+  printf("===== All tests complete =====\n");
+  return 0;
+}
@@ -1,4 +1,5 @@
 #include "../include/transformer.h"
+#include "../include/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -61,8 +62,118 @@ void test_transformer_forward() {
     printf("Transformer forward pass test passed!\n");
 }
 
+void test_transformer_positions() {
+    printf("Testing Transformer forward pass on selected positions...\n");
+
+    TransformerConfig config = {
+        .num_layers = 2,
+        .d_model = 32,
+        .d_ff = 128,
+        .num_heads = 4,
+        .vocab_size = 100,
+        .max_seq_len = 50
+    };
+
+    TransformerParams params;
+    init_transformer_params(&params, config);
+
+    int L_src = 10;
+    int L_tgt = 8;
+    int src_tokens[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    int tgt_tokens[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    int positions[3] = {7, 0, 3};
+    int V = config.vocab_size;
+
+    float *full = (float *)malloc(L_tgt * V * sizeof(float));
+    float *selected = (float *)malloc(3 * V * sizeof(float));
+
+    assert(compute_transformer(src_tokens, tgt_tokens, &params, full, L_src,
+                               L_tgt) == 0);
+    assert(compute_transformer_positions(src_tokens, tgt_tokens, &params,
+                                         positions, 3, selected, L_src,
+                                         L_tgt) == 0);
+
+    for (int i = 0; i < 3; i++)
+        assert(compare(full + positions[i] * V, selected + i * V, V));
+
+    // Out-of-range rows are rejected before anything is written
+    int bad[2][3] = {{7, 0, 8}, {7, -1, 3}};
+    selected[0] = 123.0f;
+    for (int k = 0; k < 2; k++)
+        assert(compute_transformer_positions(src_tokens, tgt_tokens, &params,
+                                             bad[k], 3, selected, L_src,
+                                             L_tgt) == -1);
+    assert(compute_transformer_positions(src_tokens, tgt_tokens, &params,
+                                         NULL, L_tgt + 1, selected, L_src,
+                                         L_tgt) == -1);
+    assert(selected[0] == 123.0f);
+
+    free(full);
+    free(selected);
+    free_transformer_params(&params);
+    printf("Transformer selected positions test passed!\n");
+}
+
+void test_transformer_positional_modes() {
+    printf("Testing computed positional encodings past max_seq_len...\n");
+
+    int L_src = 12;
+    int L_tgt = 10;
+    int src_tokens[12] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+    int tgt_tokens[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+    for (int mode = POS_SINUSOIDAL; mode <= POS_ROTARY; mode++) {
+        TransformerConfig config = {
+            .num_layers = 2,
+            .d_model = 32,
+            .d_ff = 128,
+            .num_heads = 4,
+            .vocab_size = 100,
+            .max_seq_len = 8, // Shorter than both sequences
+            .pos_mode = (PositionalMode)mode
+        };
+        int V = config.vocab_size;
+
+        TransformerParams params;
+        init_transformer_params(&params, config);
+        assert(params.pos_encoding == NULL);
+        assert(transformer_max_positions(config) > L_src);
+
+        float *full = (float *)malloc(L_tgt * V * sizeof(float));
+        float *stepped = (float *)malloc(L_tgt * V * sizeof(float));
+        float *enc_output = (float *)malloc(L_src * config.d_model * sizeof(float));
+        float hidden[32];
+        compute_transformer(src_tokens, tgt_tokens, &params, full, L_src, L_tgt);
+
+        // Same logits one cached decoder step at a time
+        CrossKV ckv;
+        KVCache cache;
+        init_cross_kv(&ckv, config.num_layers, config.d_model, L_src);
+        init_kv_cache(&cache, config.num_layers, config.d_model, 1, L_tgt);
+        compute_encoder(src_tokens, &params, enc_output, L_src);
+        compute_cross_kv(&params, enc_output, &ckv);
+        kv_cache_reset_slot(&cache, 0, &ckv);
+        int slot = 0;
+        for (int t = 0; t < L_tgt; t++) {
+            compute_decoder_step(&tgt_tokens[t], &slot, &params, &cache, hidden, 1);
+            compute_logits(hidden, &params, stepped + t * V, 1);
+        }
+        assert(compare(full, stepped, L_tgt * V));
+
+        free_kv_cache(&cache);
+        free_cross_kv(&ckv);
+        free(full);
+        free(stepped);
+        free(enc_output);
+        free_transformer_params(&params);
+    }
+    printf("Computed positional encodings test passed!\n");
+}
+
 int main() {
     test_transformer_init();
     test_transformer_forward();
+    test_transformer_positions();
+    test_transformer_positional_modes();
     return 0;
 }
@@ -0,0 +1,139 @@
+#include "../include/feedforward.h"
+#include "../include/transformer.h"
+#include "../include/utils.h"
+#include "../include/workspace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// gcc -Iinclude src/*.c tests/workspace_tests.c -lm -O2 -pthread -o workspace_tests
+
+static const TransformerConfig config = {.num_layers = 2,
+                                         .d_model = 128,
+                                         .d_ff = 256,
+                                         .num_heads = 4,
+                                         .vocab_size = 200,
+                                         .max_seq_len = 64};
+
+static void test_workspace_unwinds() {
+  // Out-of-order frees: b is only handed back once c is
+  Workspace ws;
+  int ok = init_workspace(&ws, 1 << 20, 8) == 0;
+  Workspace *prev = workspace_bind(&ws);
+  void *a = scratch_alloc(100);
+  void *b = scratch_alloc(100);
+  void *c = scratch_alloc(100);
+  scratch_free(b);
+  ok &= ws.n_blocks == 3;
+  scratch_free(c);
+  ok &= ws.n_blocks == 1;
+  void *d = scratch_alloc(100);
+  ok &= d == b && ws.peak_blocks == 3;
+  scratch_free(d);
+  scratch_free(a);
+  ok &= ws.n_blocks == 0 && ws.top == 0 && ws.overflows == 0;
+  workspace_bind(prev);
+  free_workspace(&ws);
+
+  printf("Testing workspace stack unwinding:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+static void test_overflow_refused() {
+  // Neither a request past the capacity nor one past the block list is
+  // handed to the heap
+  Workspace ws;
+  int ok = init_workspace(&ws, 1 << 12, 2) == 0;
+  Workspace *prev = workspace_bind(&ws);
+  void *a = scratch_alloc(1 << 11);
+  ok &= a && scratch_alloc(1 << 12) == NULL && ws.overflows == 1;
+  void *b = scratch_alloc(64);
+  ok &= b && scratch_alloc(64) == NULL && ws.overflows == 2;
+  scratch_free(b);
+  scratch_free(a);
+  ok &= ws.n_blocks == 0 && ws.top == 0;
+  workspace_bind(prev);
+  free_workspace(&ws);
+
+  printf("Testing arena overflows are refused:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+static void test_measured_peak_matches_arena() {
+  TransformerParams params;
+  init_transformer_params(&params, config);
+  int L = 64;
+  int *tokens = (int *)calloc(L, sizeof(int));
+  float *expected = (float *)malloc((size_t)L * config.vocab_size * sizeof(float));
+  float *got = (float *)malloc((size_t)L * config.vocab_size * sizeof(float));
+  for (int i = 0; i < L; i++)
+    tokens[i] = (i * 7 + 1) % config.vocab_size;
+
+  // Dry run with a measuring workspace
+  Workspace probe;
+  int ok = init_workspace(&probe, 0, 0) == 0;
+  Workspace *prev = workspace_bind(&probe);
+  compute_transformer(tokens, tokens, &params, expected, L, L);
+  workspace_bind(prev);
+  ok &= probe.n_blocks == 0 && probe.top == 0 && probe.overflows == 0;
+
+  // An arena of exactly that size serves the same pass without the heap and
+  // reaches the same high-water marks
+  Workspace ws;
+  ok &= init_workspace(&ws, probe.peak, probe.peak_blocks) == 0;
+  prev = workspace_bind(&ws);
+  compute_transformer(tokens, tokens, &params, got, L, L);
+  workspace_bind(prev);
+  ok &= ws.overflows == 0 && ws.peak == probe.peak &&
+        ws.peak_blocks == probe.peak_blocks;
+  ok &= compare(expected, got, L * config.vocab_size);
+
+  printf("Testing measured workspace peak equals the arena's:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+
+  free_workspace(&probe);
+  free_workspace(&ws);
+  free(tokens);
+  free(expected);
+  free(got);
+  free_transformer_params(&params);
+}
+
+static void test_failures_reported_when_bound() {
+  // A feed-forward pass whose hidden layer (256 TiB) exceeds the address
+  // space, so no heap can serve it
+  FeedForwardParams ffn = {0};
+  float input[4] = {0}, output[4] = {1, 2, 3, 4};
+  Workspace ws;
+  int ok = init_workspace(&ws, 1 << 16, 8) == 0;
+  Workspace *prev = workspace_bind(&ws);
+  compute_feedforward_network(input, &ffn, output, 1 << 20, 4, 1 << 26);
+  workspace_bind(prev);
+  ok &= ws.failed == 1 && ws.n_blocks == 0 && output[3] == 4.0f;
+  free_workspace(&ws);
+
+  printf("Testing scratch failures are counted, not fatal, when bound:\n\t");
+  if (ok)
+    printf("PASSED\n");
+  else
+    printf("FAILED\n");
+}
+
+int main() {
+  printf("===== Running workspace tests =====\n");
+  test_workspace_unwinds();
+  test_overflow_refused();
+  test_measured_peak_matches_arena();
+  test_failures_reported_when_bound();
+  printf("===== All tests complete =====\n");
+  return 0;
+}